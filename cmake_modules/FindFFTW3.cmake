@@ -4,6 +4,7 @@
 #  FFTW3_FOUND - system has FFTW3
 #  FFTW3_INCLUDE_DIR - the FFTW3 include directory
 #  FFTW3_LIBRARIES - Link these to use FFTW3
+#  FFTW3_THREADS_LIBRARIES - Link these to use the multithreaded FFTW3 planner, if available
 #  FFTW3_VERSION_STRING - Human readable version number of fftw3
 #  FFTW3_VERSION_MAJOR  - Major version number of fftw3
 #  FFTW3_VERSION_MINOR  - Minor version number of fftw3
@@ -30,6 +31,13 @@ else (FFTW3_LIBRARIES)
     /usr/local/lib
   )
 
+  find_library(FFTW3_THREADS_LIBRARIES NAMES fftw3_threads
+    PATHS
+    ${_obLinkDir}
+    ${GNUWIN32_DIR}/lib
+    /usr/local/lib
+  )
+
   if(FFTW3_LIBRARIES)
     set(FFTW3_FOUND TRUE)
   else (FFTW3_LIBRARIES)
@@ -47,6 +55,6 @@ else (FFTW3_LIBRARIES)
     endif (FFTW3_FIND_REQUIRED)
   endif (FFTW3_FOUND)
 
-  mark_as_advanced(FFTW3_LIBRARIES)
+  mark_as_advanced(FFTW3_LIBRARIES FFTW3_THREADS_LIBRARIES)
   
 endif (FFTW3_LIBRARIES)
@@ -0,0 +1,23 @@
+# - Find TurboJPEG
+# Find the libjpeg-turbo TurboJPEG includes and library
+# This module defines
+#  TURBOJPEG_INCLUDE_DIR, where to find turbojpeg.h
+#  TURBOJPEG_LIBRARIES, the libraries needed to use TurboJPEG.
+#  TURBOJPEG_FOUND, If false, do not try to use TurboJPEG.
+# also defined, but not for general use are
+#  TURBOJPEG_LIBRARY, where to find the TurboJPEG library.
+
+FIND_PATH(TURBOJPEG_INCLUDE_DIR turbojpeg.h)
+
+FIND_LIBRARY(TURBOJPEG_LIBRARY NAMES turbojpeg)
+
+# handle the QUIETLY and REQUIRED arguments and set TURBOJPEG_FOUND to TRUE if
+# all listed variables are TRUE
+INCLUDE(FindPackageHandleStandardArgs)
+FIND_PACKAGE_HANDLE_STANDARD_ARGS(TURBOJPEG DEFAULT_MSG TURBOJPEG_LIBRARY TURBOJPEG_INCLUDE_DIR)
+
+IF(TURBOJPEG_FOUND)
+  SET(TURBOJPEG_LIBRARIES ${TURBOJPEG_LIBRARY})
+ENDIF(TURBOJPEG_FOUND)
+
+MARK_AS_ADVANCED(TURBOJPEG_LIBRARY TURBOJPEG_INCLUDE_DIR)
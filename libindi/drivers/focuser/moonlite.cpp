@@ -21,6 +21,7 @@
 #include "moonlite.h"
 
 #include "indicom.h"
+#include "connectionplugins/connectionserial.h"
 
 #include <cmath>
 #include <cstring>
@@ -120,6 +121,28 @@ bool MoonLite::initProperties()
     setDefaultPollingPeriod(500);
     addDebugControl();
 
+    setPublishLimits(&FocusAbsPosNP, 0, { 5 });
+    setPublishLimits(&TemperatureNP, 0, { 0.5 });
+
+    // Auto search only handshakes ports that answer a position query, skipping the slow retries of Ack()
+    serialConnection->registerProbe([](int fd)
+    {
+        char resp[5] = {0};
+        int nbytes = 0;
+
+        // Arduino based controllers reset when the port is opened, keep asking while they boot
+        for (int i = 0; i < 3; i++)
+        {
+            tcflush(fd, TCIOFLUSH);
+            if (tty_write(fd, ":GP#", 4, &nbytes) != TTY_OK)
+                return false;
+            if (tty_read(fd, resp, 5, 1, &nbytes) == TTY_OK && resp[4] == '#')
+                return true;
+        }
+
+        return false;
+    });
+
     return true;
 }
 
@@ -566,25 +589,12 @@ void MoonLite::TimerHit()
         return;
     }
 
-    bool rc = readPosition();
-    if (rc)
-    {
-        if (fabs(lastPos - FocusAbsPosN[0].value) > 5)
-        {
-            IDSetNumber(&FocusAbsPosNP, nullptr);
-            lastPos = FocusAbsPosN[0].value;
-        }
-    }
+    // Sent once this returns, if they moved more than their deadbands
+    if (readPosition())
+        publishNumber(&FocusAbsPosNP);
 
-    rc = readTemperature();
-    if (rc)
-    {
-        if (fabs(lastTemperature - TemperatureN[0].value) >= 0.5)
-        {
-            IDSetNumber(&TemperatureNP, nullptr);
-            lastTemperature = TemperatureN[0].value;
-        }
-    }
+    if (readTemperature())
+        publishNumber(&TemperatureNP);
 
     if (FocusAbsPosNP.s == IPS_BUSY || FocusRelPosNP.s == IPS_BUSY)
     {
@@ -592,9 +602,8 @@ void MoonLite::TimerHit()
         {
             FocusAbsPosNP.s = IPS_OK;
             FocusRelPosNP.s = IPS_OK;
-            IDSetNumber(&FocusAbsPosNP, nullptr);
-            IDSetNumber(&FocusRelPosNP, nullptr);
-            lastPos = FocusAbsPosN[0].value;
+            publishNumber(&FocusAbsPosNP);
+            publishNumber(&FocusRelPosNP);
             LOG_INFO("Focuser reached requested position.");
         }
     }
@@ -620,7 +629,8 @@ bool MoonLite::sendCommand(const char * cmd, char * res)
 {
     int nbytes_written = 0, nbytes_read = 0, rc = -1;
 
-    tcflush(PortFD, TCIOFLUSH);
+    // Drop stale input only, a command without reply may still be on its way out
+    tcflush(PortFD, TCIFLUSH);
 
     LOGF_DEBUG("CMD <%s>", cmd);
 
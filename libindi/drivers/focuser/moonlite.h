@@ -115,7 +115,7 @@ class MoonLite : public INDI::Focuser
         bool setTemperatureCompensation(bool enable);
         void timedMoveCallback();
 
-        double targetPos { 0 }, lastPos { 0 }, lastTemperature { 0 };
+        double targetPos { 0 };
 
         // Read Only Temperature Reporting
         INumber TemperatureN[1];
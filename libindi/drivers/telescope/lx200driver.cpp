@@ -163,7 +163,7 @@ int check_lx200_connection(int in_fd)
     int i       = 0;
     char ack[1] = { 0x06 };
     char MountAlign[64];
-    int nbytes_read = 0;
+    int nbytes_write = 0, nbytes_read = 0;
 
     DEBUGDEVICE(lx200Name, INDI::Logger::DBG_DEBUG, "Testing telescope connection using ACK...");
 
@@ -172,7 +172,7 @@ int check_lx200_connection(int in_fd)
 
     for (i = 0; i < 2; i++)
     {
-        if (write(in_fd, ack, 1) < 0)
+        if (tty_write(in_fd, ack, 1, &nbytes_write) != TTY_OK)
             return -1;
         tty_read(in_fd, MountAlign, 1, LX200_TIMEOUT, &nbytes_read);
         if (nbytes_read == 1)
@@ -201,9 +201,7 @@ char ACK(int fd)
 
     DEBUGFDEVICE(lx200Name, DBG_SCOPE, "CMD <%#02X>", ack[0]);
 
-    nbytes_write = write(fd, ack, 1);
-
-    if (nbytes_write < 0)
+    if (tty_write(fd, ack, 1, &nbytes_write) != TTY_OK)
         return -1;
 
     error_type = tty_read(fd, MountAlign, 1, LX200_TIMEOUT, &nbytes_read);
@@ -250,6 +248,81 @@ int getCommandSexa(int fd, double *value, const char *cmd)
     return 0;
 }
 
+/* read the reply to c, return its error */
+static int readLX200Reply(int fd, LX200Command *c)
+{
+    int nbytes_read = 0;
+
+    c->error = tty_nread_section(fd, c->reply, LX200_REPLY_LEN, c->stop_char, c->timeout, &nbytes_read);
+    if (c->error == TTY_OK)
+    {
+        c->reply[nbytes_read - 1] = '\0';
+        DEBUGFDEVICE(lx200Name, DBG_SCOPE, "RES <%s>", c->reply);
+    }
+
+    return c->error;
+}
+
+int sendLX200Commands(int fd, LX200Command *cmds, int n, bool pipelined)
+{
+    char batch[LX200_REPLY_LEN * 4];
+    int nbytes_write = 0;
+    int len = 0, i;
+
+    for (i = 0; i < n; i++)
+    {
+        cmds[i].reply[0] = '\0';
+        cmds[i].error    = TTY_OK;
+    }
+
+    tcflush(fd, TCIFLUSH);
+
+    if (!pipelined)
+    {
+        for (i = 0; i < n; i++)
+        {
+            DEBUGFDEVICE(lx200Name, DBG_SCOPE, "CMD <%s>", cmds[i].cmd);
+
+            if ((cmds[i].error = tty_write_string(fd, cmds[i].cmd, &nbytes_write)) != TTY_OK ||
+                readLX200Reply(fd, &cmds[i]) != TTY_OK)
+            {
+                tcflush(fd, TCIFLUSH);
+                return cmds[i].error;
+            }
+        }
+
+        return 0;
+    }
+
+    /* all commands in a single write, replies then arrive back to back */
+    for (i = 0; i < n; i++)
+    {
+        int l = strlen(cmds[i].cmd);
+
+        if (len + l >= (int)sizeof(batch))
+            return (cmds[i].error = TTY_OVERFLOW);
+        memcpy(batch + len, cmds[i].cmd, l);
+        len += l;
+    }
+    batch[len] = '\0';
+
+    DEBUGFDEVICE(lx200Name, DBG_SCOPE, "CMD <%s>", batch);
+
+    if ((cmds[0].error = tty_write(fd, batch, len, &nbytes_write)) != TTY_OK)
+        return cmds[0].error;
+
+    for (i = 0; i < n; i++)
+    {
+        if (readLX200Reply(fd, &cmds[i]) != TTY_OK)
+        {
+            tcflush(fd, TCIFLUSH);
+            return cmds[i].error;
+        }
+    }
+
+    return 0;
+}
+
 int getCommandInt(int fd, int *value, const char *cmd)
 {
     char read_buffer[RB_MAX_LEN]={0};
@@ -198,6 +198,30 @@ int getCommandSexa(int fd, double *value, const char *cmd);
 int getCommandString(int fd, char *data, const char *cmd);
 /* Get Int */
 int getCommandInt(int fd, int *value, const char *cmd);
+
+/**************************************************************************
+ Command batches: several commands answered in one round trip
+ **************************************************************************/
+
+#define LX200_REPLY_LEN 64
+
+/* One command of a batch and its reply */
+typedef struct
+{
+    const char *cmd;              /* command to send, e.g. ":GR#" */
+    char stop_char;               /* reply terminator */
+    int timeout;                  /* seconds to wait for the reply */
+    char reply[LX200_REPLY_LEN];  /* reply, without terminator */
+    int error;                    /* TTY_OK or a TTY_ERROR code */
+} LX200Command;
+
+/* Send n commands and collect their replies in cmds[i].reply. If pipelined, all
+ * commands are written at once and replies matched to them in order, else each
+ * command waits for the reply of the previous one, for controllers that do not
+ * buffer commands. Return 0 if all replies were read, else the error of the
+ * first command that failed; later commands are then left unread.
+ */
+int sendLX200Commands(int fd, LX200Command *cmds, int n, bool pipelined);
 /* Get tracking frequency */
 int getTrackFreq(int fd, double *value);
 /* Get site Latitude */
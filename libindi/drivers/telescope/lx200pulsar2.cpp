@@ -51,7 +51,8 @@ static bool resynchronize_needed =
 int ACK(const int fd)
 {
     DEBUGFDEVICE(lx200Name, DBG_SCOPE, "CMD <%02X>", Acknowledge);
-    if (write(fd, &Acknowledge, sizeof(Acknowledge)) < 0)
+    int nbytes_write = 0;
+    if (tty_write(fd, &Acknowledge, sizeof(Acknowledge), &nbytes_write) != TTY_OK)
     {
         DEBUGFDEVICE(lx200Name, DBG_SCOPE, "Error sending ACK: %s", strerror(errno));
         return -1;
@@ -305,7 +305,19 @@ bool LX200Telescope::ReadScopeStatus()
         }
     }
 
-    if (getLX200RA(PortFD, &currentRA) < 0 || getLX200DEC(PortFD, &currentDEC) < 0)
+    // RA and DEC in one round trip
+    LX200Command radec[2] = { { ":GR#", '#', 5 }, { ":GD#", '#', 5 } };
+    int rc = sendLX200Commands(PortFD, radec, 2, pipelineCommands);
+
+    // Only the first command was answered, the controller drops commands it receives while busy
+    if (rc != 0 && pipelineCommands && radec[0].error == TTY_OK)
+    {
+        LOG_INFO("Mount does not buffer commands, polling one command at a time.");
+        pipelineCommands = false;
+        rc = sendLX200Commands(PortFD, radec, 2, false);
+    }
+
+    if (rc != 0 || f_scansexa(radec[0].reply, &currentRA) || f_scansexa(radec[1].reply, &currentDEC))
     {
         EqNP.s = IPS_ALERT;
         IDSetNumber(&EqNP, "Error reading RA/DEC.");
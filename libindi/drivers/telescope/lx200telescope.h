@@ -159,6 +159,8 @@ public:
     int trackingMode;
 
     bool sendTimeOnStartup=true, sendLocationOnStartup=true;
+    // Write polling commands back to back, cleared for controllers found not to buffer them
+    bool pipelineCommands { true };
     uint8_t DBG_SCOPE;
 
     double JD;
@@ -114,6 +114,13 @@ void *peekiFQ(FQ *q, int i)
     return (q->nq > 0 ? q->q[q->head - q->nq + i] : NULL);
 }
 
+/* replace the ith element from head of the given FQ with e */
+void setiFQ(FQ *q, int i, void *e)
+{
+    if (i >= 0 && i < q->nq)
+        q->q[q->head - q->nq + i] = e;
+}
+
 /* return the number of elements in the given FQ */
 int nFQ(FQ *q)
 {
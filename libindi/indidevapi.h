@@ -211,6 +211,12 @@ __attribute__((format(printf, 2, 3)))
 #endif
 ;
 
+/** \brief Register a function called with each number vector sent by IDSetNumber() or
+    IUUpdateMinMax(), to keep track of what clients were told last. Only one function is kept.
+    \param hook function called after the update was sent or queued, NULL for none.
+*/
+extern void IDSetNumberHook(void (*hook)(const INumberVectorProperty *n));
+
 /** \brief Tell client to update an existing switch vector property.
     \param s pointer to the vector switch property.
     \param msg message in printf style to send to the client. May be NULL.
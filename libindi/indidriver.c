@@ -29,14 +29,22 @@
 #include "locale_compat.h"
 
 #include <errno.h>
+#include <fcntl.h>
 #include <pthread.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#ifdef __linux__
+#include <linux/memfd.h>
+#include <sys/syscall.h>
+#endif
 
 pthread_mutex_t stdout_mutex = PTHREAD_MUTEX_INITIALIZER;
 
@@ -53,6 +61,424 @@ enum
     INDI_UNKNOWN
 };
 
+/* Property messages are rendered into a reusable per-thread buffer, then sent
+ * to the server with a single write(2). Numbers are formatted without switching
+ * the process locale.
+ */
+typedef struct
+{
+    char *buf;   /* rendered message */
+    size_t len;  /* bytes used */
+    size_t size; /* bytes allocated */
+} MsgBuf;
+
+static pthread_key_t mbkey;
+static pthread_once_t mbonce = PTHREAD_ONCE_INIT;
+
+static void mbFree(void *arg)
+{
+    MsgBuf *mb = (MsgBuf *)arg;
+
+    free(mb->buf);
+    free(mb);
+}
+
+static void mbMakeKey(void)
+{
+    pthread_key_create(&mbkey, mbFree);
+}
+
+/* return the empty message buffer of the calling thread */
+static MsgBuf *mbGet(void)
+{
+    MsgBuf *mb;
+
+    pthread_once(&mbonce, mbMakeKey);
+    mb = (MsgBuf *)pthread_getspecific(mbkey);
+    if (!mb)
+    {
+        mb = (MsgBuf *)calloc(1, sizeof(MsgBuf));
+        pthread_setspecific(mbkey, mb);
+    }
+    mb->len = 0;
+    return mb;
+}
+
+/* insure mb can hold n more bytes plus a terminating 0 */
+static void mbReserve(MsgBuf *mb, size_t n)
+{
+    if (mb->len + n + 1 > mb->size)
+    {
+        size_t size = mb->size ? mb->size : 1024;
+
+        while (mb->len + n + 1 > size)
+            size *= 2;
+        mb->buf  = (char *)realloc(mb->buf, size);
+        mb->size = size;
+    }
+}
+
+static void mbCatN(MsgBuf *mb, const char *s, size_t n)
+{
+    mbReserve(mb, n);
+    memcpy(mb->buf + mb->len, s, n);
+    mb->len += n;
+    mb->buf[mb->len] = '\0';
+}
+
+static void mbCat(MsgBuf *mb, const char *s)
+{
+    mbCatN(mb, s, strlen(s));
+}
+
+/* append s with xml-sensitive characters replaced by their entities */
+static void mbCatEscaped(MsgBuf *mb, const char *s)
+{
+    const char *ep;
+
+    for (; (ep = strpbrk(s, "&<>'\"")) != NULL; s = ep + 1)
+    {
+        mbCatN(mb, s, ep - s);
+        switch (*ep)
+        {
+            case '&':
+                mbCat(mb, "&amp;");
+                break;
+            case '<':
+                mbCat(mb, "&lt;");
+                break;
+            case '>':
+                mbCat(mb, "&gt;");
+                break;
+            case '\'':
+                mbCat(mb, "&apos;");
+                break;
+            case '"':
+                mbCat(mb, "&quot;");
+                break;
+        }
+    }
+    mbCat(mb, s);
+}
+
+/* append the shortest form of v that reads back exactly, whatever the locale */
+static void mbNumber(MsgBuf *mb, double v)
+{
+    mbReserve(mb, 32);
+    mb->len += fs_double(mb->buf + mb->len, v);
+}
+
+/* append "  name='value'\n" */
+static void mbAttr(MsgBuf *mb, const char *name, const char *value)
+{
+    mbCat(mb, "  ");
+    mbCat(mb, name);
+    mbCat(mb, "='");
+    mbCat(mb, value);
+    mbCat(mb, "'\n");
+}
+
+/* append "  name='v'\n" for a number */
+static void mbNumberAttr(MsgBuf *mb, const char *name, double v)
+{
+    mbCat(mb, "  ");
+    mbCat(mb, name);
+    mbCat(mb, "='");
+    mbNumber(mb, v);
+    mbCat(mb, "'\n");
+}
+
+/* append the current UT as a timestamp attribute */
+static void mbTimestamp(MsgBuf *mb)
+{
+    char ts[32];
+    struct tm tm;
+    time_t t;
+
+    time(&t);
+    gmtime_r(&t, &tm);
+    strftime(ts, sizeof(ts), "%Y-%m-%dT%H:%M:%S", &tm);
+    mbAttr(mb, "timestamp", ts);
+}
+
+/* append the optional message attribute of a property message */
+static void mbMessage(MsgBuf *mb, const char *fmt, va_list ap)
+{
+    char message[MAXINDIMESSAGE];
+
+    vsnprintf(message, MAXINDIMESSAGE, fmt, ap);
+    mbCat(mb, "  message='");
+    mbCatEscaped(mb, message);
+    mbCat(mb, "'\n");
+}
+
+/* Output is shared by all driver threads. A message is written directly by its
+ * caller while the pipe is idle. While a BLOB is being written, small messages
+ * collect in outq instead and BLOBs wait in blobq, both drained by a writer
+ * thread which sends everything in outq before starting the next BLOB. Small
+ * messages thus wait at most for the BLOB already on its way, never for those
+ * queued behind it. A message which may not overtake the queued BLOBs goes
+ * into blobq too, and so does everything sent after it until the writer
+ * takes it. All queue state is guarded by stdout_mutex.
+ */
+typedef struct OutBLOB
+{
+    struct OutBLOB *next;
+    MsgBuf mb;   /* whole setBLOBVector or an ordered small message */
+    int *fds;    /* shared memory to pass before the text */
+    int nfds;    /* n fds */
+    int ordered; /* small message kept in order, counted in nordered */
+    size_t cost; /* bytes accounted in blobqbytes */
+} OutBLOB;
+
+#define MAXOUTQ  (1 << 20)  /* small message bytes queued before callers wait */
+#define MAXBLOBQ (64 << 20) /* BLOB bytes queued before IDSetBLOB waits */
+#define DRAINTO  10         /* secs to wait at exit for output to be written */
+#define MAXSHAREDBLOBS 16   /* BLOBs attached per vector, as many as indiserver takes (MAXBLOBFDS) */
+
+static MsgBuf outq;                  /* small messages waiting for the writer */
+static OutBLOB *blobq, *blobqtail;   /* BLOBs waiting for the writer, oldest first */
+static size_t blobqbytes;            /* sum of cost in blobq */
+static int nordered;                 /* ordered messages in blobq, later ones queue behind them */
+static int writing;                  /* writer thread is writing without the lock */
+static pthread_cond_t outcond = PTHREAD_COND_INITIALIZER;
+static pthread_once_t outonce = PTHREAD_ONCE_INIT;
+
+/* write len bytes of buf to the server, return 0 or -1 on error */
+static int outWrite(const char *buf, size_t len)
+{
+    size_t written = 0;
+
+    /* anything still buffered by stdio goes first */
+    fflush(stdout);
+
+    while (written < len)
+    {
+        ssize_t nw = write(fileno(stdout), buf + written, len - written);
+
+        if (nw < 0 && errno == EINTR)
+            continue;
+        if (nw <= 0)
+            return -1;
+        written += nw;
+    }
+
+    return 0;
+}
+
+/* pass a shared memory descriptor to indiserver with one byte of whitespace,
+ * in order with the text already written.
+ * return 0 if sent, else -1.
+ */
+static int outSendFd(int fd)
+{
+    union
+    {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } ctl;
+    struct cmsghdr *cmsg;
+    struct msghdr msg;
+    struct iovec iov;
+    char nl = '\n';
+    ssize_t ns;
+
+    iov.iov_base = &nl;
+    iov.iov_len  = 1;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = ctl.buf;
+    msg.msg_controllen = sizeof(ctl.buf);
+    cmsg               = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level   = SOL_SOCKET;
+    cmsg->cmsg_type    = SCM_RIGHTS;
+    cmsg->cmsg_len     = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+    do
+        ns = sendmsg(fileno(stdout), &msg, 0);
+    while (ns < 0 && errno == EINTR);
+
+    return (ns == 1 ? 0 : -1);
+}
+
+/* writer thread: drain outq, then one BLOB, until both are empty, forever */
+static void *outWriter(void *arg)
+{
+    MsgBuf spare = { NULL, 0, 0 };
+
+    (void)arg;
+
+    pthread_mutex_lock(&stdout_mutex);
+    for (;;)
+    {
+        OutBLOB *bp = NULL;
+        MsgBuf tmp;
+        int i;
+
+        while (outq.len == 0 && !blobq)
+            pthread_cond_wait(&outcond, &stdout_mutex);
+
+        /* swap buffers so callers may keep queueing while we write */
+        if (outq.len > 0)
+        {
+            tmp   = spare;
+            spare = outq;
+            outq  = tmp;
+            outq.len = 0;
+        }
+        else
+        {
+            bp    = blobq;
+            blobq = bp->next;
+            if (!blobq)
+                blobqtail = NULL;
+            if (bp->ordered)
+                nordered--;
+        }
+        writing = 1;
+        pthread_mutex_unlock(&stdout_mutex);
+
+        if (bp)
+        {
+            for (i = 0; i < bp->nfds; i++)
+            {
+                outSendFd(bp->fds[i]);
+                close(bp->fds[i]);
+            }
+            outWrite(bp->mb.buf, bp->mb.len);
+        }
+        else
+            outWrite(spare.buf, spare.len);
+
+        pthread_mutex_lock(&stdout_mutex);
+        writing = 0;
+        if (bp)
+        {
+            blobqbytes -= bp->cost;
+            free(bp->mb.buf);
+            free(bp->fds);
+            free(bp);
+        }
+        pthread_cond_broadcast(&outcond);
+    }
+
+    return NULL;
+}
+
+/* at exit, wait until everything queued has been written, but not forever
+ * in case the server stopped reading.
+ */
+static void outDrain(void)
+{
+    struct timespec deadline;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += DRAINTO;
+
+    pthread_mutex_lock(&stdout_mutex);
+    while (outq.len > 0 || blobq || writing)
+    {
+        if (pthread_cond_timedwait(&outcond, &stdout_mutex, &deadline) == ETIMEDOUT)
+        {
+            fprintf(stderr, "%s: output not drained after %d secs, dropped\n", me, DRAINTO);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&stdout_mutex);
+}
+
+static void outStart(void)
+{
+    pthread_attr_t attr;
+    pthread_t writer;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&writer, &attr, outWriter, NULL) != 0)
+    {
+        fprintf(stderr, "%s: can not start output thread: %s\n", me, strerror(errno));
+        exit(1);
+    }
+    pthread_attr_destroy(&attr);
+    atexit(outDrain);
+}
+
+/* append bp to blobq, taking ownership. Must be called with stdout_mutex held. */
+static void outQueueBLOB(OutBLOB *bp)
+{
+    pthread_once(&outonce, outStart);
+
+    /* let the writer catch up with a producer faster than the pipe */
+    while (blobq && blobqbytes + bp->cost > MAXBLOBQ)
+        pthread_cond_wait(&outcond, &stdout_mutex);
+
+    bp->next = NULL;
+    if (blobqtail)
+        blobqtail->next = bp;
+    else
+        blobq = bp;
+    blobqtail = bp;
+    blobqbytes += bp->cost;
+    pthread_cond_broadcast(&outcond);
+}
+
+/* queue a copy of mb behind the BLOBs in blobq. Must be called with
+ * stdout_mutex held.
+ */
+static void mbQueueOrdered(MsgBuf *mb)
+{
+    OutBLOB *bp;
+
+    bp = (OutBLOB *)calloc(1, sizeof(OutBLOB));
+    mbCatN(&bp->mb, mb->buf, mb->len);
+    bp->ordered = 1;
+    bp->cost    = mb->len;
+    nordered++;
+    outQueueBLOB(bp);
+}
+
+/* send mb to the server in one piece, or queue it behind the BLOB being
+ * written, or behind an ordered message still waiting in blobq.
+ * Must be called with stdout_mutex held.
+ */
+static void mbSend(MsgBuf *mb)
+{
+    if (nordered > 0)
+    {
+        mbQueueOrdered(mb);
+        return;
+    }
+
+    for (;;)
+    {
+        if (!writing && outq.len == 0)
+        {
+            outWrite(mb->buf, mb->len);
+            return;
+        }
+        if (outq.len < MAXOUTQ)
+            break;
+        pthread_cond_wait(&outcond, &stdout_mutex);
+    }
+
+    pthread_once(&outonce, outStart);
+    mbCatN(&outq, mb->buf, mb->len);
+    pthread_cond_broadcast(&outcond);
+}
+
+/* as mbSend but mb may not overtake BLOBs already queued, for messages that
+ * would invalidate them. Must be called with stdout_mutex held.
+ */
+static void mbSendOrdered(MsgBuf *mb)
+{
+    if (blobq)
+        mbQueueOrdered(mb);
+    else
+        mbSend(mb);
+}
+
 /* Return index of property property if already cached, -1 otherwise */
 int isPropDefined(const char *property_name, const char *device_name)
 {
@@ -111,26 +537,31 @@ char *escapeXML(const char *s, unsigned int MAX_BUF_SIZE)
  */
 void IDDelete(const char *dev, const char *name, const char *fmt, ...)
 {
-    pthread_mutex_lock(&stdout_mutex);
+    MsgBuf *mb = mbGet();
 
-    xmlv1();
-    printf("<delProperty\n  device='%s'\n", dev);
+    mbCat(mb, "<?xml version='1.0'?>\n");
+    mbCat(mb, "<delProperty\n  device='");
+    mbCat(mb, dev);
+    mbCat(mb, "'\n");
     if (name)
-        printf(" name='%s'\n", name);
-    printf("  timestamp='%s'\n", timestamp());
+    {
+        mbCat(mb, " name='");
+        mbCat(mb, name);
+        mbCat(mb, "'\n");
+    }
+    mbTimestamp(mb);
     if (fmt)
     {
         va_list ap;
         va_start(ap, fmt);
-        char message[MAXINDIMESSAGE];
-        printf("  message='");
-        vsnprintf(message, MAXINDIMESSAGE, fmt, ap);
-        printf("%s'\n", entityXML(message));
+        mbMessage(mb, fmt, ap);
         va_end(ap);
     }
-    printf("/>\n");
-    fflush(stdout);
+    mbCat(mb, "/>\n");
 
+    /* BLOBs still queued for the property must reach the client before it goes */
+    pthread_mutex_lock(&stdout_mutex);
+    mbSendOrdered(mb);
     pthread_mutex_unlock(&stdout_mutex);
 }
 
@@ -139,13 +570,22 @@ void IDDelete(const char *dev, const char *name, const char *fmt, ...)
  */
 void IDSnoopDevice(const char *snooped_device, const char *snooped_property)
 {
-    pthread_mutex_lock(&stdout_mutex);
-    xmlv1();
+    MsgBuf *mb = mbGet();
+
+    mbCat(mb, "<?xml version='1.0'?>\n");
+    mbCat(mb, "<getProperties version='");
+    mbNumber(mb, INDIV);
+    mbCat(mb, "' device='");
+    mbCat(mb, snooped_device);
     if (snooped_property && snooped_property[0])
-        printf("<getProperties version='%g' device='%s' name='%s'/>\n", INDIV, snooped_device, snooped_property);
-    else
-        printf("<getProperties version='%g' device='%s'/>\n", INDIV, snooped_device);
-    fflush(stdout);
+    {
+        mbCat(mb, "' name='");
+        mbCat(mb, snooped_property);
+    }
+    mbCat(mb, "'/>\n");
+
+    pthread_mutex_lock(&stdout_mutex);
+    mbSend(mb);
     pthread_mutex_unlock(&stdout_mutex);
 }
 
@@ -154,6 +594,7 @@ void IDSnoopDevice(const char *snooped_device, const char *snooped_property)
  */
 void IDSnoopBLOBs(const char *snooped_device, const char *snooped_property, BLOBHandling bh)
 {
+    MsgBuf *mb;
     const char *how;
 
     switch (bh)
@@ -171,13 +612,21 @@ void IDSnoopBLOBs(const char *snooped_device, const char *snooped_property, BLOB
             return;
     }
 
-    pthread_mutex_lock(&stdout_mutex);
-    xmlv1();
+    mb = mbGet();
+    mbCat(mb, "<?xml version='1.0'?>\n");
+    mbCat(mb, "<enableBLOB device='");
+    mbCat(mb, snooped_device);
     if (snooped_property && snooped_property[0])
-        printf("<enableBLOB device='%s' name='%s'>%s</enableBLOB>\n", snooped_device, snooped_property, how);
-    else
-        printf("<enableBLOB device='%s'>%s</enableBLOB>\n", snooped_device, how);
-    fflush(stdout);
+    {
+        mbCat(mb, "' name='");
+        mbCat(mb, snooped_property);
+    }
+    mbCat(mb, "'>");
+    mbCat(mb, how);
+    mbCat(mb, "</enableBLOB>\n");
+
+    pthread_mutex_lock(&stdout_mutex);
+    mbSend(mb);
     pthread_mutex_unlock(&stdout_mutex);
 }
 
@@ -1437,28 +1886,28 @@ int IUGetConfigText(const char *dev, const char *property, const char *member, c
 /* send client a message for a specific device or at large if !dev */
 void IDMessage(const char *dev, const char *fmt, ...)
 {
-    pthread_mutex_lock(&stdout_mutex);
+    MsgBuf *mb = mbGet();
 
-    xmlv1();
-    printf("<message\n");
+    mbCat(mb, "<?xml version='1.0'?>\n");
+    mbCat(mb, "<message\n");
     if (dev)
-        printf(" device='%s'\n", dev);
-    printf("  timestamp='%s'\n", timestamp());
+    {
+        mbCat(mb, " device='");
+        mbCat(mb, dev);
+        mbCat(mb, "'\n");
+    }
+    mbTimestamp(mb);
     if (fmt)
     {
         va_list ap;
         va_start(ap, fmt);
-        char message[MAXINDIMESSAGE];
-        printf("  message='");
-        vsnprintf(message, MAXINDIMESSAGE, fmt, ap);
-        char *escapedMessage = escapeXML(message, MAXINDIMESSAGE);
-        printf("%s'\n", escapedMessage);
-        free(escapedMessage);
+        mbMessage(mb, fmt, ap);
         va_end(ap);
     }
-    printf("/>\n");
-    fflush(stdout);
+    mbCat(mb, "/>\n");
 
+    pthread_mutex_lock(&stdout_mutex);
+    mbSend(mb);
     pthread_mutex_unlock(&stdout_mutex);
 }
 
@@ -1624,47 +2073,49 @@ void IUSaveConfigBLOB(FILE *fp, const IBLOBVectorProperty *bvp)
 /* tell client to create a text vector property */
 void IDDefText(const ITextVectorProperty *tvp, const char *fmt, ...)
 {
+    MsgBuf *mb = mbGet();
     int i;
     ROSC *SC;
 
-    pthread_mutex_lock(&stdout_mutex);
-
-    xmlv1();
-    locale_char_t *orig = indi_locale_C_numeric_push();
-    printf("<defTextVector\n");
-    printf("  device='%s'\n", tvp->device);
-    printf("  name='%s'\n", tvp->name);
-    printf("  label='%s'\n", tvp->label);
-    printf("  group='%s'\n", tvp->group);
-    printf("  state='%s'\n", pstateStr(tvp->s));
-    printf("  perm='%s'\n", permStr(tvp->p));
-    printf("  timeout='%g'\n", tvp->timeout);
-    printf("  timestamp='%s'\n", timestamp());
+    mbCat(mb, "<?xml version='1.0'?>\n");
+    mbCat(mb, "<defTextVector\n");
+    mbAttr(mb, "device", tvp->device);
+    mbAttr(mb, "name", tvp->name);
+    mbAttr(mb, "label", tvp->label);
+    mbAttr(mb, "group", tvp->group);
+    mbAttr(mb, "state", pstateStr(tvp->s));
+    mbAttr(mb, "perm", permStr(tvp->p));
+    mbNumberAttr(mb, "timeout", tvp->timeout);
+    mbTimestamp(mb);
     if (fmt)
     {
         va_list ap;
         va_start(ap, fmt);
-        char message[MAXINDIMESSAGE];
-        printf("  message='");
-        vsnprintf(message, MAXINDIMESSAGE, fmt, ap);
-        char *escapedMessage = escapeXML(message, MAXINDIMESSAGE);
-        printf("%s'\n", escapedMessage);
-        free(escapedMessage);
+        mbMessage(mb, fmt, ap);
         va_end(ap);
     }
-    printf(">\n");
+    mbCat(mb, ">\n");
 
     for (i = 0; i < tvp->ntp; i++)
     {
         IText *tp = &tvp->tp[i];
-        printf("  <defText\n");
-        printf("    name='%s'\n", tp->name);
-        printf("    label='%s'>\n", tp->label);
-        printf("      %s\n", tp->text ? tp->text : "");
-        printf("  </defText>\n");
+        mbCat(mb, "  <defText\n");
+        mbCat(mb, "  ");
+        mbAttr(mb, "name", tp->name);
+        mbCat(mb, "    label='");
+        mbCat(mb, tp->label);
+        mbCat(mb, "'>\n");
+        mbCat(mb, "      ");
+        mbCat(mb, tp->text ? tp->text : "");
+        mbCat(mb, "\n");
+        mbCat(mb, "  </defText>\n");
     }
 
-    printf("</defTextVector>\n");
+    mbCat(mb, "</defTextVector>\n");
+
+    pthread_mutex_lock(&stdout_mutex);
+
+    mbSend(mb);
 
     if (isPropDefined(tvp->name, tvp->device) < 0)
     {
@@ -1680,63 +2131,65 @@ void IDDefText(const ITextVectorProperty *tvp, const char *fmt, ...)
         SC->type = INDI_TEXT;
     }
 
-    indi_locale_C_numeric_pop(orig);
-    fflush(stdout);
-
     pthread_mutex_unlock(&stdout_mutex);
 }
 
 /* tell client to create a new numeric vector property */
 void IDDefNumber(const INumberVectorProperty *n, const char *fmt, ...)
 {
+    MsgBuf *mb = mbGet();
     int i;
     ROSC *SC;
 
-    pthread_mutex_lock(&stdout_mutex);
-
-    xmlv1();
-    locale_char_t *orig = indi_locale_C_numeric_push();
-    printf("<defNumberVector\n");
-    printf("  device='%s'\n", n->device);
-    printf("  name='%s'\n", n->name);
-    printf("  label='%s'\n", n->label);
-    printf("  group='%s'\n", n->group);
-    printf("  state='%s'\n", pstateStr(n->s));
-    printf("  perm='%s'\n", permStr(n->p));
-    printf("  timeout='%g'\n", n->timeout);
-    printf("  timestamp='%s'\n", timestamp());
-
+    mbCat(mb, "<?xml version='1.0'?>\n");
+    mbCat(mb, "<defNumberVector\n");
+    mbAttr(mb, "device", n->device);
+    mbAttr(mb, "name", n->name);
+    mbAttr(mb, "label", n->label);
+    mbAttr(mb, "group", n->group);
+    mbAttr(mb, "state", pstateStr(n->s));
+    mbAttr(mb, "perm", permStr(n->p));
+    mbNumberAttr(mb, "timeout", n->timeout);
+    mbTimestamp(mb);
     if (fmt)
     {
         va_list ap;
         va_start(ap, fmt);
-        char message[MAXINDIMESSAGE];
-        printf("  message='");
-        vsnprintf(message, MAXINDIMESSAGE, fmt, ap);
-        char *escapedMessage = escapeXML(message, MAXINDIMESSAGE);
-        printf("%s'\n", escapedMessage);
-        free(escapedMessage);
+        mbMessage(mb, fmt, ap);
         va_end(ap);
     }
-    printf(">\n");
+    mbCat(mb, ">\n");
 
     for (i = 0; i < n->nnp; i++)
     {
         INumber *np = &n->np[i];
 
-        printf("  <defNumber\n");
-        printf("    name='%s'\n", np->name);
-        printf("    label='%s'\n", np->label);
-        printf("    format='%s'\n", np->format);
-        printf("    min='%.20g'\n", np->min);
-        printf("    max='%.20g'\n", np->max);
-        printf("    step='%.20g'>\n", np->step);
-        printf("      %.20g\n", np->value);
+        mbCat(mb, "  <defNumber\n");
+        mbCat(mb, "  ");
+        mbAttr(mb, "name", np->name);
+        mbCat(mb, "  ");
+        mbAttr(mb, "label", np->label);
+        mbCat(mb, "  ");
+        mbAttr(mb, "format", np->format);
+        mbCat(mb, "  ");
+        mbNumberAttr(mb, "min", np->min);
+        mbCat(mb, "  ");
+        mbNumberAttr(mb, "max", np->max);
+        mbCat(mb, "    step='");
+        mbNumber(mb, np->step);
+        mbCat(mb, "'>\n");
+        mbCat(mb, "      ");
+        mbNumber(mb, np->value);
+        mbCat(mb, "\n");
+
+        mbCat(mb, "  </defNumber>\n");
+    }
+
+    mbCat(mb, "</defNumberVector>\n");
 
-        printf("  </defNumber>\n");
-    }
+    pthread_mutex_lock(&stdout_mutex);
 
-    printf("</defNumberVector>\n");
+    mbSend(mb);
 
     if (isPropDefined(n->name, n->device) < 0)
     {
@@ -1752,9 +2205,6 @@ void IDDefNumber(const INumberVectorProperty *n, const char *fmt, ...)
         SC->type = INDI_NUMBER;
     }
 
-    indi_locale_C_numeric_pop(orig);
-    fflush(stdout);
-
     pthread_mutex_unlock(&stdout_mutex);
 }
 
@@ -1762,48 +2212,50 @@ void IDDefNumber(const INumberVectorProperty *n, const char *fmt, ...)
 void IDDefSwitch(const ISwitchVectorProperty *s, const char *fmt, ...)
 
 {
+    MsgBuf *mb = mbGet();
     int i;
     ROSC *SC;
 
-    pthread_mutex_lock(&stdout_mutex);
-
-    xmlv1();
-    locale_char_t *orig = indi_locale_C_numeric_push();
-    printf("<defSwitchVector\n");
-    printf("  device='%s'\n", s->device);
-    printf("  name='%s'\n", s->name);
-    printf("  label='%s'\n", s->label);
-    printf("  group='%s'\n", s->group);
-    printf("  state='%s'\n", pstateStr(s->s));
-    printf("  perm='%s'\n", permStr(s->p));
-    printf("  rule='%s'\n", ruleStr(s->r));
-    printf("  timeout='%g'\n", s->timeout);
-    printf("  timestamp='%s'\n", timestamp());
+    mbCat(mb, "<?xml version='1.0'?>\n");
+    mbCat(mb, "<defSwitchVector\n");
+    mbAttr(mb, "device", s->device);
+    mbAttr(mb, "name", s->name);
+    mbAttr(mb, "label", s->label);
+    mbAttr(mb, "group", s->group);
+    mbAttr(mb, "state", pstateStr(s->s));
+    mbAttr(mb, "perm", permStr(s->p));
+    mbAttr(mb, "rule", ruleStr(s->r));
+    mbNumberAttr(mb, "timeout", s->timeout);
+    mbTimestamp(mb);
     if (fmt)
     {
         va_list ap;
         va_start(ap, fmt);
-        char message[MAXINDIMESSAGE];
-        printf("  message='");
-        vsnprintf(message, MAXINDIMESSAGE, fmt, ap);
-        char *escapedMessage = escapeXML(message, MAXINDIMESSAGE);
-        printf("%s'\n", escapedMessage);
-        free(escapedMessage);
+        mbMessage(mb, fmt, ap);
         va_end(ap);
     }
-    printf(">\n");
+    mbCat(mb, ">\n");
 
     for (i = 0; i < s->nsp; i++)
     {
         ISwitch *sp = &s->sp[i];
-        printf("  <defSwitch\n");
-        printf("    name='%s'\n", sp->name);
-        printf("    label='%s'>\n", sp->label);
-        printf("      %s\n", sstateStr(sp->s));
-        printf("  </defSwitch>\n");
+        mbCat(mb, "  <defSwitch\n");
+        mbCat(mb, "  ");
+        mbAttr(mb, "name", sp->name);
+        mbCat(mb, "    label='");
+        mbCat(mb, sp->label);
+        mbCat(mb, "'>\n");
+        mbCat(mb, "      ");
+        mbCat(mb, sstateStr(sp->s));
+        mbCat(mb, "\n");
+        mbCat(mb, "  </defSwitch>\n");
     }
 
-    printf("</defSwitchVector>\n");
+    mbCat(mb, "</defSwitchVector>\n");
+
+    pthread_mutex_lock(&stdout_mutex);
+
+    mbSend(mb);
 
     if (isPropDefined(s->name, s->device) < 0)
     {
@@ -1819,100 +2271,96 @@ void IDDefSwitch(const ISwitchVectorProperty *s, const char *fmt, ...)
         SC->type = INDI_SWITCH;
     }
 
-    indi_locale_C_numeric_pop(orig);
-    fflush(stdout);
-
     pthread_mutex_unlock(&stdout_mutex);
 }
 
 /* tell client to create a new lights vector property */
 void IDDefLight(const ILightVectorProperty *lvp, const char *fmt, ...)
 {
+    MsgBuf *mb = mbGet();
     int i;
 
-    pthread_mutex_lock(&stdout_mutex);
-
-    xmlv1();
-    printf("<defLightVector\n");
-    printf("  device='%s'\n", lvp->device);
-    printf("  name='%s'\n", lvp->name);
-    printf("  label='%s'\n", lvp->label);
-    printf("  group='%s'\n", lvp->group);
-    printf("  state='%s'\n", pstateStr(lvp->s));
-    printf("  timestamp='%s'\n", timestamp());
+    mbCat(mb, "<?xml version='1.0'?>\n");
+    mbCat(mb, "<defLightVector\n");
+    mbAttr(mb, "device", lvp->device);
+    mbAttr(mb, "name", lvp->name);
+    mbAttr(mb, "label", lvp->label);
+    mbAttr(mb, "group", lvp->group);
+    mbAttr(mb, "state", pstateStr(lvp->s));
+    mbTimestamp(mb);
     if (fmt)
     {
         va_list ap;
         va_start(ap, fmt);
-        char message[MAXINDIMESSAGE];
-        printf("  message='");
-        vsnprintf(message, MAXINDIMESSAGE, fmt, ap);
-        char *escapedMessage = escapeXML(message, MAXINDIMESSAGE);
-        printf("%s'\n", escapedMessage);
-        free(escapedMessage);
+        mbMessage(mb, fmt, ap);
         va_end(ap);
     }
-    printf(">\n");
+    mbCat(mb, ">\n");
 
     for (i = 0; i < lvp->nlp; i++)
     {
         ILight *lp = &lvp->lp[i];
-        printf("  <defLight\n");
-        printf("    name='%s'\n", lp->name);
-        printf("    label='%s'>\n", lp->label);
-        printf("      %s\n", pstateStr(lp->s));
-        printf("  </defLight>\n");
+        mbCat(mb, "  <defLight\n");
+        mbCat(mb, "  ");
+        mbAttr(mb, "name", lp->name);
+        mbCat(mb, "    label='");
+        mbCat(mb, lp->label);
+        mbCat(mb, "'>\n");
+        mbCat(mb, "      ");
+        mbCat(mb, pstateStr(lp->s));
+        mbCat(mb, "\n");
+        mbCat(mb, "  </defLight>\n");
     }
 
-    printf("</defLightVector>\n");
-    fflush(stdout);
+    mbCat(mb, "</defLightVector>\n");
 
+    pthread_mutex_lock(&stdout_mutex);
+    mbSend(mb);
     pthread_mutex_unlock(&stdout_mutex);
 }
 
 /* tell client to create a new BLOB vector property */
 void IDDefBLOB(const IBLOBVectorProperty *b, const char *fmt, ...)
 {
+    MsgBuf *mb = mbGet();
     int i;
     ROSC *SC;
 
-    pthread_mutex_lock(&stdout_mutex);
-
-    xmlv1();
-    locale_char_t *orig = indi_locale_C_numeric_push();
-    printf("<defBLOBVector\n");
-    printf("  device='%s'\n", b->device);
-    printf("  name='%s'\n", b->name);
-    printf("  label='%s'\n", b->label);
-    printf("  group='%s'\n", b->group);
-    printf("  state='%s'\n", pstateStr(b->s));
-    printf("  perm='%s'\n", permStr(b->p));
-    printf("  timeout='%g'\n", b->timeout);
-    printf("  timestamp='%s'\n", timestamp());
+    mbCat(mb, "<?xml version='1.0'?>\n");
+    mbCat(mb, "<defBLOBVector\n");
+    mbAttr(mb, "device", b->device);
+    mbAttr(mb, "name", b->name);
+    mbAttr(mb, "label", b->label);
+    mbAttr(mb, "group", b->group);
+    mbAttr(mb, "state", pstateStr(b->s));
+    mbAttr(mb, "perm", permStr(b->p));
+    mbNumberAttr(mb, "timeout", b->timeout);
+    mbTimestamp(mb);
     if (fmt)
     {
         va_list ap;
         va_start(ap, fmt);
-        char message[MAXINDIMESSAGE];
-        printf("  message='");
-        vsnprintf(message, MAXINDIMESSAGE, fmt, ap);
-        char *escapedMessage = escapeXML(message, MAXINDIMESSAGE);
-        printf("%s'\n", escapedMessage);
-        free(escapedMessage);
+        mbMessage(mb, fmt, ap);
         va_end(ap);
     }
-    printf(">\n");
+    mbCat(mb, ">\n");
 
     for (i = 0; i < b->nbp; i++)
     {
         IBLOB *bp = &b->bp[i];
-        printf("  <defBLOB\n");
-        printf("    name='%s'\n", bp->name);
-        printf("    label='%s'\n", bp->label);
-        printf("  />\n");
+        mbCat(mb, "  <defBLOB\n");
+        mbCat(mb, "  ");
+        mbAttr(mb, "name", bp->name);
+        mbCat(mb, "  ");
+        mbAttr(mb, "label", bp->label);
+        mbCat(mb, "  />\n");
     }
 
-    printf("</defBLOBVector>\n");
+    mbCat(mb, "</defBLOBVector>\n");
+
+    pthread_mutex_lock(&stdout_mutex);
+
+    mbSend(mb);
 
     if (isPropDefined(b->name, b->device) < 0)
     {
@@ -1928,286 +2376,385 @@ void IDDefBLOB(const IBLOBVectorProperty *b, const char *fmt, ...)
         SC->type = INDI_BLOB;
     }
 
-    indi_locale_C_numeric_pop(orig);
-    fflush(stdout);
-
     pthread_mutex_unlock(&stdout_mutex);
 }
 
 /* tell client to update an existing text vector property */
 void IDSetText(const ITextVectorProperty *tvp, const char *fmt, ...)
 {
+    MsgBuf *mb = mbGet();
     int i;
 
-    pthread_mutex_lock(&stdout_mutex);
-
-    xmlv1();
-    locale_char_t *orig = indi_locale_C_numeric_push();
-    printf("<setTextVector\n");
-    printf("  device='%s'\n", tvp->device);
-    printf("  name='%s'\n", tvp->name);
-    printf("  state='%s'\n", pstateStr(tvp->s));
-    printf("  timeout='%g'\n", tvp->timeout);
-    printf("  timestamp='%s'\n", timestamp());
+    mbCat(mb, "<?xml version='1.0'?>\n");
+    mbCat(mb, "<setTextVector\n");
+    mbAttr(mb, "device", tvp->device);
+    mbAttr(mb, "name", tvp->name);
+    mbAttr(mb, "state", pstateStr(tvp->s));
+    mbNumberAttr(mb, "timeout", tvp->timeout);
+    mbTimestamp(mb);
     if (fmt)
     {
         va_list ap;
         va_start(ap, fmt);
-        char message[MAXINDIMESSAGE];
-        printf("  message='");
-        vsnprintf(message, MAXINDIMESSAGE, fmt, ap);
-        printf("%s'\n", entityXML(message));
+        mbMessage(mb, fmt, ap);
         va_end(ap);
     }
-    printf(">\n");
+    mbCat(mb, ">\n");
 
     for (i = 0; i < tvp->ntp; i++)
     {
         IText *tp = &tvp->tp[i];
-        printf("  <oneText name='%s'>\n", tp->name);
-        printf("      %s\n", tp->text ? entityXML(tp->text) : "");
-        printf("  </oneText>\n");
+        mbCat(mb, "  <oneText name='");
+        mbCat(mb, tp->name);
+        mbCat(mb, "'>\n");
+        mbCat(mb, "      ");
+        if (tp->text)
+            mbCatEscaped(mb, tp->text);
+        mbCat(mb, "\n");
+        mbCat(mb, "  </oneText>\n");
     }
 
-    printf("</setTextVector>\n");
-    indi_locale_C_numeric_pop(orig);
-    fflush(stdout);
+    mbCat(mb, "</setTextVector>\n");
 
+    pthread_mutex_lock(&stdout_mutex);
+    mbSend(mb);
     pthread_mutex_unlock(&stdout_mutex);
 }
 
 /* tell client to update an existing numeric vector property */
+static void (*setNumberHook)(const INumberVectorProperty *nvp);
+
+void IDSetNumberHook(void (*hook)(const INumberVectorProperty *nvp))
+{
+    setNumberHook = hook;
+}
+
 void IDSetNumber(const INumberVectorProperty *nvp, const char *fmt, ...)
 {
+    MsgBuf *mb = mbGet();
     int i;
 
-    pthread_mutex_lock(&stdout_mutex);
-
-    xmlv1();
-    locale_char_t *orig = indi_locale_C_numeric_push();
-    printf("<setNumberVector\n");
-    printf("  device='%s'\n", nvp->device);
-    printf("  name='%s'\n", nvp->name);
-    printf("  state='%s'\n", pstateStr(nvp->s));
-    printf("  timeout='%g'\n", nvp->timeout);
-    printf("  timestamp='%s'\n", timestamp());
+    mbCat(mb, "<?xml version='1.0'?>\n");
+    mbCat(mb, "<setNumberVector\n");
+    mbAttr(mb, "device", nvp->device);
+    mbAttr(mb, "name", nvp->name);
+    mbAttr(mb, "state", pstateStr(nvp->s));
+    mbNumberAttr(mb, "timeout", nvp->timeout);
+    mbTimestamp(mb);
     if (fmt)
     {
         va_list ap;
         va_start(ap, fmt);
-        char message[MAXINDIMESSAGE];
-        printf("  message='");
-        vsnprintf(message, MAXINDIMESSAGE, fmt, ap);
-        printf("%s'\n", entityXML(message));
+        mbMessage(mb, fmt, ap);
         va_end(ap);
     }
-    printf(">\n");
+    mbCat(mb, ">\n");
 
     for (i = 0; i < nvp->nnp; i++)
     {
         INumber *np = &nvp->np[i];
-        printf("  <oneNumber name='%s'>\n", np->name);
-        printf("      %.20g\n", np->value);
-        printf("  </oneNumber>\n");
+        mbCat(mb, "  <oneNumber name='");
+        mbCat(mb, np->name);
+        mbCat(mb, "'>\n");
+        mbCat(mb, "      ");
+        mbNumber(mb, np->value);
+        mbCat(mb, "\n");
+        mbCat(mb, "  </oneNumber>\n");
     }
 
-    printf("</setNumberVector>\n");
-    indi_locale_C_numeric_pop(orig);
-    fflush(stdout);
+    mbCat(mb, "</setNumberVector>\n");
 
+    pthread_mutex_lock(&stdout_mutex);
+    mbSend(mb);
     pthread_mutex_unlock(&stdout_mutex);
+
+    if (setNumberHook)
+        setNumberHook(nvp);
 }
 
 /* tell client to update an existing switch vector property */
 void IDSetSwitch(const ISwitchVectorProperty *svp, const char *fmt, ...)
 {
+    MsgBuf *mb = mbGet();
     int i;
 
-    pthread_mutex_lock(&stdout_mutex);
-
-    xmlv1();
-    locale_char_t *orig = indi_locale_C_numeric_push();
-    printf("<setSwitchVector\n");
-    printf("  device='%s'\n", svp->device);
-    printf("  name='%s'\n", svp->name);
-    printf("  state='%s'\n", pstateStr(svp->s));
-    printf("  timeout='%g'\n", svp->timeout);
-    printf("  timestamp='%s'\n", timestamp());
+    mbCat(mb, "<?xml version='1.0'?>\n");
+    mbCat(mb, "<setSwitchVector\n");
+    mbAttr(mb, "device", svp->device);
+    mbAttr(mb, "name", svp->name);
+    mbAttr(mb, "state", pstateStr(svp->s));
+    mbNumberAttr(mb, "timeout", svp->timeout);
+    mbTimestamp(mb);
     if (fmt)
     {
         va_list ap;
         va_start(ap, fmt);
-        char message[MAXINDIMESSAGE];
-        printf("  message='");
-        vsnprintf(message, MAXINDIMESSAGE, fmt, ap);
-        printf("%s'\n", entityXML(message));
+        mbMessage(mb, fmt, ap);
         va_end(ap);
     }
-    printf(">\n");
+    mbCat(mb, ">\n");
 
     for (i = 0; i < svp->nsp; i++)
     {
         ISwitch *sp = &svp->sp[i];
-        printf("  <oneSwitch name='%s'>\n", sp->name);
-        printf("      %s\n", sstateStr(sp->s));
-        printf("  </oneSwitch>\n");
+        mbCat(mb, "  <oneSwitch name='");
+        mbCat(mb, sp->name);
+        mbCat(mb, "'>\n");
+        mbCat(mb, "      ");
+        mbCat(mb, sstateStr(sp->s));
+        mbCat(mb, "\n");
+        mbCat(mb, "  </oneSwitch>\n");
     }
 
-    printf("</setSwitchVector>\n");
-    indi_locale_C_numeric_pop(orig);
-    fflush(stdout);
+    mbCat(mb, "</setSwitchVector>\n");
 
+    pthread_mutex_lock(&stdout_mutex);
+    mbSend(mb);
     pthread_mutex_unlock(&stdout_mutex);
 }
 
 /* tell client to update an existing lights vector property */
 void IDSetLight(const ILightVectorProperty *lvp, const char *fmt, ...)
 {
+    MsgBuf *mb = mbGet();
     int i;
 
-    pthread_mutex_lock(&stdout_mutex);
-
-    xmlv1();
-    printf("<setLightVector\n");
-    printf("  device='%s'\n", lvp->device);
-    printf("  name='%s'\n", lvp->name);
-    printf("  state='%s'\n", pstateStr(lvp->s));
-    printf("  timestamp='%s'\n", timestamp());
+    mbCat(mb, "<?xml version='1.0'?>\n");
+    mbCat(mb, "<setLightVector\n");
+    mbAttr(mb, "device", lvp->device);
+    mbAttr(mb, "name", lvp->name);
+    mbAttr(mb, "state", pstateStr(lvp->s));
+    mbTimestamp(mb);
     if (fmt)
     {
         va_list ap;
         va_start(ap, fmt);
-        char message[MAXINDIMESSAGE];
-        printf("  message='");
-        vsnprintf(message, MAXINDIMESSAGE, fmt, ap);
-        printf("%s'\n", entityXML(message));
+        mbMessage(mb, fmt, ap);
         va_end(ap);
     }
-    printf(">\n");
+    mbCat(mb, ">\n");
 
     for (i = 0; i < lvp->nlp; i++)
     {
         ILight *lp = &lvp->lp[i];
-        printf("  <oneLight name='%s'>\n", lp->name);
-        printf("      %s\n", pstateStr(lp->s));
-        printf("  </oneLight>\n");
+        mbCat(mb, "  <oneLight name='");
+        mbCat(mb, lp->name);
+        mbCat(mb, "'>\n");
+        mbCat(mb, "      ");
+        mbCat(mb, pstateStr(lp->s));
+        mbCat(mb, "\n");
+        mbCat(mb, "  </oneLight>\n");
     }
 
-    printf("</setLightVector>\n");
-    fflush(stdout);
+    mbCat(mb, "</setLightVector>\n");
 
+    pthread_mutex_lock(&stdout_mutex);
+    mbSend(mb);
     pthread_mutex_unlock(&stdout_mutex);
 }
 
-/* tell client to update an existing BLOB vector property */
+/* return 1 if BLOBs may be passed to indiserver as shared memory: the server
+ * announced it in our environment and stdout is the socket pair it gave us.
+ */
+static int sharedBLOBs(void)
+{
+    static int shared = -1;
+
+    if (shared < 0)
+    {
+        const char *env = getenv("INDISHAREDBLOB");
+        struct stat st;
+
+        shared = env && !strcmp(env, "1") && fstat(fileno(stdout), &st) == 0 && S_ISSOCK(st.st_mode);
+    }
+
+    return shared;
+}
+
+/* copy the contents of bp to a new shared memory segment for indiserver.
+ * return its descriptor, or -1 if the BLOB must be sent as base64.
+ */
+static int makeSharedBLOB(const IBLOB *bp)
+{
+    void *shm;
+    int fd = -1;
+
+#if defined(__linux__) && defined(SYS_memfd_create)
+    fd = syscall(SYS_memfd_create, "indiblob", MFD_CLOEXEC);
+#else
+    {
+        static int seq;
+        char shmname[64];
+
+        snprintf(shmname, sizeof(shmname), "/indiblob-%d-%d", (int)getpid(), seq++);
+        fd = shm_open(shmname, O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd >= 0)
+            shm_unlink(shmname);
+    }
+#endif
+    if (fd < 0)
+        return -1;
+
+    if (ftruncate(fd, bp->bloblen) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    shm = mmap(NULL, bp->bloblen, PROT_WRITE, MAP_SHARED, fd, 0);
+    if (shm == MAP_FAILED)
+    {
+        close(fd);
+        return -1;
+    }
+    memcpy(shm, bp->blob, bp->bloblen);
+    munmap(shm, bp->bloblen);
+
+    return fd;
+}
+
+/* tell client to update an existing BLOB vector property. The message is
+ * rendered here and written by the output thread, so the caller and other
+ * threads sending property updates do not wait for the pipe.
+ */
 void IDSetBLOB(const IBLOBVectorProperty *bvp, const char *fmt, ...)
 {
+    OutBLOB *ob = (OutBLOB *)calloc(1, sizeof(OutBLOB));
+    MsgBuf *mb  = &ob->mb;
+    char sz[32];
     int i;
 
-    pthread_mutex_lock(&stdout_mutex);
+    if (sharedBLOBs())
+        ob->fds = (int *)malloc(MAXSHAREDBLOBS * sizeof(int));
 
-    xmlv1();
-    locale_char_t *orig = indi_locale_C_numeric_push();
-    printf("<setBLOBVector\n");
-    printf("  device='%s'\n", bvp->device);
-    printf("  name='%s'\n", bvp->name);
-    printf("  state='%s'\n", pstateStr(bvp->s));
-    printf("  timeout='%g'\n", bvp->timeout);
-    printf("  timestamp='%s'\n", timestamp());
+    mbCat(mb, "<?xml version='1.0'?>\n");
+    mbCat(mb, "<setBLOBVector\n");
+    mbAttr(mb, "device", bvp->device);
+    mbAttr(mb, "name", bvp->name);
+    mbAttr(mb, "state", pstateStr(bvp->s));
+    mbNumberAttr(mb, "timeout", bvp->timeout);
+    mbTimestamp(mb);
     if (fmt)
     {
         va_list ap;
         va_start(ap, fmt);
-        printf("  message='");
-        vprintf(fmt, ap);
-        printf("'\n");
+        mbMessage(mb, fmt, ap);
         va_end(ap);
     }
-    printf(">\n");
+    mbCat(mb, ">\n");
 
     for (i = 0; i < bvp->nbp; i++)
     {
         IBLOB *bp = &bvp->bp[i];
-        unsigned char *encblob;
-        int l;
-
-        printf("  <oneBLOB\n");
-        printf("    name='%s'\n", bp->name);
-        printf("    size='%d'\n", bp->size);
-
+        int fd    = -1;
+
+        mbCat(mb, "  <oneBLOB\n");
+        mbCat(mb, "  ");
+        mbAttr(mb, "name", bp->name);
+        snprintf(sz, sizeof(sz), "%d", bp->size);
+        mbCat(mb, "  ");
+        mbAttr(mb, "size", sz);
+
+        // Contents passed as shared memory, indiserver fills in the encoding. Any more are sent inline.
+        if (ob->fds && ob->nfds < MAXSHAREDBLOBS && bp->size > 0 && bp->bloblen > 0 &&
+            (fd = makeSharedBLOB(bp)) >= 0)
+        {
+            ob->fds[ob->nfds++] = fd;
+            ob->cost += bp->bloblen;
+            mbCat(mb, "    attached='true'\n");
+            mbCat(mb, "    format='");
+            mbCat(mb, bp->format);
+            mbCat(mb, "'>\n");
+        }
         // If size is zero, we are only sending a state-change
-        if (bp->size == 0)
+        else if (bp->size == 0)
         {
-            printf("    enclen='0'\n");
-            printf("    format='%s'>\n", bp->format);
+            mbCat(mb, "    enclen='0'\n");
+            mbCat(mb, "    format='");
+            mbCat(mb, bp->format);
+            mbCat(mb, "'>\n");
         }
         else
         {
-            encblob = malloc(4 * bp->bloblen / 3 + 4);
-            l       = to64frombits(encblob, bp->blob, bp->bloblen);
-            printf("    enclen='%d'\n", l);
-            printf("    format='%s'>\n", bp->format);
-            size_t written = 0;
-
-            while ((int)written < l)
+            unsigned char *encblob = malloc(4 * bp->bloblen / 3 + 4);
+            int l                  = to64frombits(encblob, bp->blob, bp->bloblen);
+            int written;
+
+            snprintf(sz, sizeof(sz), "%d", l);
+            mbCat(mb, "  ");
+            mbAttr(mb, "enclen", sz);
+            mbCat(mb, "    format='");
+            mbCat(mb, bp->format);
+            mbCat(mb, "'>\n");
+
+            /* 72 columns per line */
+            mbReserve(mb, l + l / 72 + 1);
+            for (written = 0; written < l; written += 72)
             {
-                size_t towrite = ((l - written) > 72) ? 72 : l - written;
-                size_t wr      = fwrite(encblob + written, 1, towrite, stdout);
+                int n = (l - written > 72) ? 72 : l - written;
 
-                if (wr > 0)
-                    written += wr;
-                if ((written % 72) == 0)
-                    fputc('\n', stdout);
+                memcpy(mb->buf + mb->len, encblob + written, n);
+                mb->len += n;
+                mb->buf[mb->len++] = '\n';
             }
-
-            if ((written % 72) != 0)
-                fputc('\n', stdout);
+            mb->buf[mb->len] = '\0';
 
             free(encblob);
         }
 
-        printf("  </oneBLOB>\n");
+        mbCat(mb, "  </oneBLOB>\n");
     }
 
-    printf("</setBLOBVector>\n");
-    indi_locale_C_numeric_pop(orig);
-    fflush(stdout);
+    mbCat(mb, "</setBLOBVector>\n");
+    ob->cost += mb->len;
 
+    pthread_mutex_lock(&stdout_mutex);
+    outQueueBLOB(ob);
     pthread_mutex_unlock(&stdout_mutex);
 }
 
 /* tell client to update min/max elements of an existing number vector property */
 void IUUpdateMinMax(const INumberVectorProperty *nvp)
 {
+    MsgBuf *mb = mbGet();
     int i;
 
-    pthread_mutex_lock(&stdout_mutex);
-    xmlv1();
-    locale_char_t *orig = indi_locale_C_numeric_push();
-    printf("<setNumberVector\n");
-    printf("  device='%s'\n", nvp->device);
-    printf("  name='%s'\n", nvp->name);
-    printf("  state='%s'\n", pstateStr(nvp->s));
-    printf("  timeout='%g'\n", nvp->timeout);
-    printf("  timestamp='%s'\n", timestamp());
-    printf(">\n");
+    mbCat(mb, "<?xml version='1.0'?>\n");
+    mbCat(mb, "<setNumberVector\n");
+    mbAttr(mb, "device", nvp->device);
+    mbAttr(mb, "name", nvp->name);
+    mbAttr(mb, "state", pstateStr(nvp->s));
+    mbNumberAttr(mb, "timeout", nvp->timeout);
+    mbTimestamp(mb);
+    mbCat(mb, ">\n");
 
     for (i = 0; i < nvp->nnp; i++)
     {
         INumber *np = &nvp->np[i];
-        printf("  <oneNumber name='%s'\n", np->name);
-        printf("    min='%g'\n", np->min);
-        printf("    max='%g'\n", np->max);
-        printf("    step='%g'\n", np->step);
-        printf(">\n");
-        printf("      %g\n", np->value);
-        printf("  </oneNumber>\n");
-    }
+        mbCat(mb, "  <oneNumber name='");
+        mbCat(mb, np->name);
+        mbCat(mb, "'\n");
+        mbCat(mb, "  ");
+        mbNumberAttr(mb, "min", np->min);
+        mbCat(mb, "  ");
+        mbNumberAttr(mb, "max", np->max);
+        mbCat(mb, "  ");
+        mbNumberAttr(mb, "step", np->step);
+        mbCat(mb, ">\n");
+        mbCat(mb, "      ");
+        mbNumber(mb, np->value);
+        mbCat(mb, "\n");
+        mbCat(mb, "  </oneNumber>\n");
+    }
+
+    mbCat(mb, "</setNumberVector>\n");
 
-    printf("</setNumberVector>\n");
-    indi_locale_C_numeric_pop(orig);
-    fflush(stdout);
+    pthread_mutex_lock(&stdout_mutex);
+    mbSend(mb);
     pthread_mutex_unlock(&stdout_mutex);
+
+    if (setNumberHook)
+        setNumberHook(nvp);
 }
 
 int IUFindIndex(const char *needle, char **hay, unsigned int n)
@@ -32,6 +32,39 @@
  * 2017-01-29 JM: Added option to drop stream blobs if client blob queue is
  * higher than maxstreamsiz bytes
  *
+ * Local drivers write to a Unix socket pair rather than a pipe. Drivers that
+ * see INDISHAREDBLOB in their environment may pass BLOB contents as shared
+ * memory descriptors (SCM_RIGHTS) instead of base64 text; the server encodes
+ * them once for clients and snooping drivers.
+ *
+ * Clients that send binary='true' with enableBLOB receive BLOB contents raw:
+ * each oneBLOB carries binlen instead of enclen and its start tag is followed
+ * by exactly binlen bytes of content. Other clients keep receiving base64.
+ *
+ * Clients that send coalesce='true' with getProperties, or all clients when
+ * run with -c, only keep the latest value of each property waiting in their
+ * queue: a non-BLOB set*Vector replaces an unsent one for the same device and
+ * property in place. new, def, del and message traffic is never coalesced, so
+ * slow clients stay current instead of falling maxqsiz behind.
+ *
+ * With -M port, traffic counters, queue depths, drops and shutdowns of every
+ * connection, plus parse and serialize latency histograms per message type,
+ * are served read-only in Prometheus text format over HTTP on the loopback
+ * interface. Counters are plain increments, the report is only formatted
+ * when scraped.
+ *
+ * With -u path, the server also listens on a Unix domain socket at path.
+ * Clients on the same host connect there to skip the loopback TCP stack;
+ * they are otherwise served exactly like TCP clients.
+ *
+ * With -t n, the server is threaded for large BLOBs and many clients: each
+ * driver gets a reader thread that receives and parses its messages, n
+ * threads serialize BLOB messages, and each client gets a writer thread that
+ * blocks in write(2) on its own. The main thread still routes every message,
+ * so queues keep their order and each connection sees messages in the order
+ * they were routed. Msgs are refcounted atomically, queues are guarded by one
+ * lock held only to push, pop or replace.
+ *
  * Implementation notes:
  *
  * We fork each driver and open a server socket listening for INDI clients.
@@ -48,6 +81,7 @@
 
 #include "config.h"
 
+#include "base64.h"
 #include "fq.h"
 #include "indiapi.h"
 #include "indidevapi.h"
@@ -56,21 +90,26 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <libgen.h>
+#include <limits.h>
 #include <netdb.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <sys/mman.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <sys/stat.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 
 #define INDIPORT      7624    /* default TCP/IP port to listen */
 #define REMOTEDVR     (-1234) /* invalid PID to flag remote drivers */
@@ -81,6 +120,11 @@
 #define DEFMAXQSIZ    128   /* default max q behind, MB */
 #define DEFMAXSSIZ    5     /* default max stream behind, MB */
 #define DEFMAXRESTART 10    /* default max restarts */
+#define MAXBLOBFDS    16    /* max shared BLOBs a driver attaches to one vector */
+#define NLATBINS      18    /* latency histogram bins, 1us doubling, last is +Inf */
+#define MAXINBOX      256   /* max parsed driver messages dispatched per wakeup */
+#define MAXMETRICSCL  4     /* max metrics requests served at once */
+#define METRICSTO     5     /* secs a metrics request may take */
 
 #ifdef OSX_EMBEDED_MODE
 #define LOGNAME  "/Users/%s/Library/Logs/indiserver.log"
@@ -94,8 +138,59 @@ typedef struct
     unsigned long cl;  /* content length */
     char *cp;          /* content: buf or malloced */
     char buf[SHORTMSGSIZ];    /* local buf for most messages */
+    int ready;         /* 1 once content is set and it may be sent */
+    int latest;        /* 1 if a non-BLOB set*Vector, replaceable by a newer value */
+    int barrier;       /* 1 if a def or del, newer values may not pass it */
+    char dev[MAXINDIDEVICE]; /* device, for latest and barrier */
+    char name[MAXINDINAME];  /* property, for latest */
+    char *elems;       /* element names of a latest value, each followed by '\n', malloced */
 } Msg;
 
+/* BLOB contents received from a driver as shared memory */
+typedef struct
+{
+    XMLEle *ep;          /* oneBLOB element it belongs to */
+    unsigned char *blob; /* mapped contents, or NULL if unavailable */
+    size_t len;          /* bytes in blob */
+} RawBLOB;
+
+/* traffic counters of one client or driver connection */
+typedef struct
+{
+    unsigned long long bytesin;  /* bytes read */
+    unsigned long long bytesout; /* bytes written */
+    unsigned long msgsin;        /* complete messages read */
+    unsigned long msgsout;       /* complete messages written */
+    unsigned long drops;         /* stream BLOBs dropped for being behind */
+    unsigned long coalesced;     /* queued values replaced by newer ones */
+    double parsing;              /* parse time of the message in progress, secs */
+} Traffic;
+
+/* kinds of message timed separately */
+typedef enum
+{
+    MK_DEF,
+    MK_SET,
+    MK_SETBLOB,
+    MK_NEW,
+    MK_DEL,
+    MK_MESSAGE,
+    MK_GETPROPS,
+    MK_ENABLEBLOB,
+    MK_OTHER,
+    NMSGKINDS
+} MsgKind;
+static const char *msgkinds[NMSGKINDS] = { "def",     "set",           "setBLOB",    "new",  "del",
+                                           "message", "getProperties", "enableBLOB", "other" };
+
+/* latency histogram, bin i counts durations up to 2^i us */
+typedef struct
+{
+    unsigned long n;               /* durations recorded */
+    double sum;                    /* total, secs */
+    unsigned long bins[NLATBINS];  /* non-cumulative counts */
+} Latency;
+
 /* device + property name */
 typedef struct
 {
@@ -126,14 +221,35 @@ typedef struct
     int nprops;         /* n entries in props[] */
     int allprops;       /* saw getProperties w/o device */
     BLOBHandling blob;  /* when to send setBLOBs */
+    int binblobs;       /* 1 to send BLOB contents raw instead of base64 */
+    int coalesce;       /* 1 to replace queued set*Vector with newer values */
     int s;              /* socket for this client */
     LilXML *lp;         /* XML parsing context */
     FQ *msgq;           /* Msg queue */
     unsigned int nsent; /* bytes of current Msg sent so far */
+    char peer[64];      /* address:port of the client */
+    Traffic stats;      /* traffic counters */
+    pthread_t writer;   /* writer thread, with -t */
+    int busy;           /* 1 while the writer sends the head of msgq */
+    int quit;           /* 1 to ask the writer to stop */
+    int failed;         /* errno, or -1, once the writer could not send */
 } ClInfo;
 static ClInfo *clinfo; /*  malloced pool of clients */
 static int nclinfo;    /* n total (not active) */
 
+/* input side of a driver connection, read by its own thread with -t */
+typedef struct
+{
+    int dvi;                     /* index of the driver in dvrinfo[] */
+    int rfd;                     /* read fd */
+    int remote;                  /* 1 if a chained server socket */
+    char name[MAXINDINAME];      /* driver name, for messages */
+    LilXML *lp;                  /* XML parsing context */
+    int blobfds[MAXBLOBFDS + 1]; /* shared BLOB descriptors received, in order */
+    int nblobfds;                /* n entries in blobfds[] */
+    pthread_t reader;            /* reader thread, with -t */
+} DvrInput;
+
 /* info for each connected driver */
 typedef struct
 {
@@ -155,9 +271,10 @@ typedef struct
     int wfd;            /* write pipe fd */
     int efd;            /* stderr from driver, if local */
     int restarts;       /* times process has been restarted */
-    LilXML *lp;         /* XML parsing context */
+    DvrInput *in;       /* input side, malloced */
     FQ *msgq;           /* Msg queue */
     unsigned int nsent; /* bytes of current Msg sent so far */
+    Traffic stats;      /* traffic counters, kept across restarts */
 } DvrInfo;
 static DvrInfo *dvrinfo; /* malloced array of drivers */
 static int ndvrinfo;     /* n total */
@@ -166,10 +283,66 @@ static char *me;                                       /* our name */
 static int port = INDIPORT;                            /* public INDI port */
 static int verbose;                                    /* chattiness */
 static int lsocket;                                    /* listen socket */
+static char *upath;                                    /* Unix domain socket path, if any */
+static int usocket = -1;                               /* Unix domain listen socket */
 static char *ldir;                                     /* where to log driver messages */
 static int maxqsiz       = (DEFMAXQSIZ * 1024 * 1024); /* kill if these bytes behind */
 static int maxstreamsiz  = (DEFMAXSSIZ * 1024 * 1024); /* drop blobs if these bytes behind while streaming*/
 static int maxrestarts   = DEFMAXRESTART;
+static int coalesce;                                   /* default for new clients */
+static int mport;                                      /* metrics port, 0 if none */
+static int msocket = -1;                               /* metrics listen socket */
+
+/* a metrics request being read or answered */
+typedef struct
+{
+    int s;            /* socket, -1 if unused */
+    char req[1024];   /* request read so far */
+    int nreq;         /* bytes in req[] */
+    char *report;     /* response once the request is read, malloced */
+    size_t len;       /* bytes in report */
+    size_t nsent;     /* bytes of report sent */
+    double t0;        /* monoSecs() when accepted */
+} MetricsCl;
+static MetricsCl metricscl[MAXMETRICSCL];
+static unsigned long nclshutdowns;                     /* clients shut down, any reason */
+static unsigned long nclbehind;                        /* clients shut down for maxqsiz */
+static Latency parselat[NMSGKINDS];                    /* parse time by message kind */
+static Latency serlat[NMSGKINDS];                      /* serialize time by message kind */
+
+/* a message parsed by a driver reader thread */
+typedef struct
+{
+    int dvi;          /* index of the driver in dvrinfo[] */
+    XMLEle *root;     /* message, or NULL once the reader stopped */
+    RawBLOB *raws;    /* shared BLOB contents of root */
+    int nraws;        /* as returned by mapSharedBLOBs() */
+    unsigned long nr; /* bytes read since the previous message */
+    double parsing;   /* parse time, secs */
+} Parsed;
+
+/* a BLOB message for the serializer threads */
+typedef struct
+{
+    Msg *mp;       /* base64 Msg to set, or NULL */
+    Msg *mpbin;    /* binary Msg to set, or NULL */
+    XMLEle *root;  /* setBLOBVector, owned by the job */
+    RawBLOB *raws; /* shared BLOB contents of root, owned by the job */
+    int nraws;     /* n entries in raws[] */
+} SerJob;
+
+static int nthreads;                                          /* serializer threads, 0 if not threaded */
+static pthread_mutex_t qlock   = PTHREAD_MUTEX_INITIALIZER;   /* guards client queues and Msg ready */
+static pthread_cond_t qcond    = PTHREAD_COND_INITIALIZER;    /* a client queue or Msg changed */
+static pthread_mutex_t inlock  = PTHREAD_MUTEX_INITIALIZER;   /* guards inbox */
+static pthread_mutex_t joblock = PTHREAD_MUTEX_INITIALIZER;   /* guards jobs */
+static pthread_cond_t jobcond  = PTHREAD_COND_INITIALIZER;    /* a job was queued */
+static pthread_mutex_t statlock = PTHREAD_MUTEX_INITIALIZER;  /* guards latency histograms */
+static FQ *inbox;                                             /* Parsed from reader threads */
+static FQ *jobs;                                              /* SerJob for serializer threads */
+static pthread_t mainthread;                                  /* thread running indiRun() */
+static int inboxmore;                                         /* 1 if readInbox() left messages */
+static int wakefd[2] = { -1, -1 };                            /* pipe to wake the main thread */
 static int terminateddrv = 0;
 
 static void logStartup(int ac, char *av[]);
@@ -177,12 +350,23 @@ static void usage(void);
 //static void noZombies(void);
 static void reapZombies(void);
 static void noSIGPIPE(void);
+static void unlinkOnExit(void);
 static void indiFIFO(void);
 static void indiRun(void);
 static void indiListen(void);
+static void indiUnixListen(void);
+static void indiMetricsListen(void);
+static void newMetricsClient(void);
+static void readMetricsClient(MetricsCl *mp);
+static void sendMetricsClient(MetricsCl *mp);
+static void closeMetricsClient(MetricsCl *mp);
+static void prMetrics(FILE *fp);
+static double monoSecs(void);
+static MsgKind msgKind(const char *tag);
+static void addLatency(Latency *lp, double secs);
 static void newFIFO(void);
-static void newClient(void);
-static int newClSocket(void);
+static void newClient(int lfd);
+static int newClSocket(int lfd);
 static void shutdownClient(ClInfo *cp);
 static int readFromClient(ClInfo *cp);
 static void startDvr(DvrInfo *dp);
@@ -193,23 +377,51 @@ static void shutdownDvr(DvrInfo *dp, int restart);
 static int isDeviceInDriver(const char *dev, DvrInfo *dp);
 static void q2RDrivers(const char *dev, Msg *mp, XMLEle *root);
 static void q2SDrivers(DvrInfo *me, int isblob, const char *dev, const char *name, Msg *mp, XMLEle *root);
-static int q2Clients(ClInfo *notme, int isblob, const char *dev, const char *name, Msg *mp, XMLEle *root);
+static int q2Clients(ClInfo *notme, int isblob, const char *dev, const char *name, Msg *mp, Msg *mpbin,
+                     XMLEle *root);
 static int q2Servers(DvrInfo *me, Msg *mp, XMLEle *root);
 static void addSDevice(DvrInfo *dp, const char *dev, const char *name);
 static Property *findSDevice(DvrInfo *dp, const char *dev, const char *name);
 static void addClDevice(ClInfo *cp, const char *dev, const char *name, int isblob);
 static int findClDevice(ClInfo *cp, const char *dev, const char *name);
 static int readFromDriver(DvrInfo *dp);
+static int dispatchDriverMsg(DvrInfo *dp, XMLEle *root, RawBLOB *raws, int nraws);
+static void startDvrInput(DvrInfo *dp);
+static ssize_t recvFromDriver(DvrInput *in, char *buf, size_t size);
+static int mapSharedBLOBs(DvrInput *in, XMLEle *root, RawBLOB **raws);
+static void encodeSharedBLOBs(RawBLOB *raws, int nraws);
+static void unmapSharedBLOBs(RawBLOB *raws, int nraws);
+static void closeBLOBFds(DvrInput *in);
 static int stderrFromDriver(DvrInfo *dp);
 static int msgQSize(FQ *q);
 static void setMsgXMLEle(Msg *mp, XMLEle *root);
+static void setMsgBinXMLEle(Msg *mp, XMLEle *root, RawBLOB *raws, int nraws);
 static void setMsgStr(Msg *mp, char *str);
 static void freeMsg(Msg *mp);
 static Msg *newMsg(void);
+static void refMsg(Msg *mp);
+static void unrefMsg(Msg *mp);
+static void readyMsg(Msg *mp, char *cp, unsigned long cl);
+static int isReadyMsg(Msg *mp);
+static void lockQ(void);
+static void unlockQ(void);
+static void startThreads(void);
+static void wakeMain(void);
+static void *driverReader(void *arg);
+static int readInbox(void);
+static void *serializer(void *arg);
+static void queueSerJob(Msg *mp, Msg *mpbin, XMLEle *root, RawBLOB *raws, int nraws);
+static void startClientWriter(int cli);
+static void *clientWriter(void *arg);
+static int reapClientWriters(void);
 static int sendClientMsg(ClInfo *cp);
 static int sendDriverMsg(DvrInfo *cp);
 static void crackBLOB(const char *enableBLOB, BLOBHandling *bp);
 static void crackBLOBHandling(const char *dev, const char *name, const char *enableBLOB, ClInfo *cp);
+static void crackBinaryBLOBs(XMLEle *root, ClInfo *cp);
+static void crackCoalesce(XMLEle *root, ClInfo *cp);
+static void setMsgKey(Msg *mp, const char *dev, const char *name, XMLEle *root);
+static int coalesceMsg(ClInfo *cp, Msg *mp);
 static void traceMsg(XMLEle *root);
 static char *indi_tstamp(char *s);
 static void logDMsg(XMLEle *root, const char *dev);
@@ -299,6 +511,38 @@ int main(int ac, char *av[])
                         maxrestarts = 0;
                     ac--;
                     break;
+                case 'c':
+                    coalesce = 1;
+                    break;
+                case 't':
+                    if (ac < 2)
+                    {
+                        fprintf(stderr, "-t requires number of serializer threads\n");
+                        usage();
+                    }
+                    nthreads = atoi(*++av);
+                    if (nthreads < 0)
+                        nthreads = 0;
+                    ac--;
+                    break;
+                case 'u':
+                    if (ac < 2)
+                    {
+                        fprintf(stderr, "-u requires unix socket path\n");
+                        usage();
+                    }
+                    upath = *++av;
+                    ac--;
+                    break;
+                case 'M':
+                    if (ac < 2)
+                    {
+                        fprintf(stderr, "-M requires metrics port value\n");
+                        usage();
+                    }
+                    mport = atoi(*++av);
+                    ac--;
+                    break;
                 case 'v':
                     verbose++;
                     break;
@@ -321,6 +565,10 @@ int main(int ac, char *av[])
     clinfo  = (ClInfo *)malloc(1);
     nclinfo = 0;
 
+    /* threads must be ready before drivers start sending */
+    if (nthreads > 0)
+        startThreads();
+
     /* create driver info array all at once since size never changes */
     ndvrinfo = ac;
     dvrinfo  = (DvrInfo *)calloc(ndvrinfo, sizeof(DvrInfo));
@@ -334,6 +582,10 @@ int main(int ac, char *av[])
 
     /* announce we are online */
     indiListen();
+    if (upath)
+        indiUnixListen();
+    if (mport > 0)
+        indiMetricsListen();
 
     /* Load up FIFO, if available */
     indiFIFO();
@@ -371,8 +623,12 @@ static void usage(void)
             " -d m     : drop streaming blobs if client gets more than this many MB behind, default %d. 0 to disable\n",
             DEFMAXSSIZ);
     fprintf(stderr, " -p p     : alternate IP port, default %d\n", INDIPORT);
+    fprintf(stderr, " -u path  : also listen on a Unix domain socket at path\n");
     fprintf(stderr, " -r r     : maximum driver restarts on error, default %d\n", DEFMAXRESTART);
     fprintf(stderr, " -f path  : Path to fifo for dynamic startup and shutdown of drivers.\n");
+    fprintf(stderr, " -c       : keep only the latest queued value of each property for all clients\n");
+    fprintf(stderr, " -M p     : serve Prometheus metrics on loopback port p\n");
+    fprintf(stderr, " -t n     : threaded, with a reader per driver, a writer per client and n BLOB serializers\n");
     fprintf(stderr, " -v       : show key events, no traffic\n");
     fprintf(stderr, " -vv      : -v + key message content\n");
     fprintf(stderr, " -vvv     : -vv + complete xml\n");
@@ -430,6 +686,26 @@ static void noSIGPIPE()
     (void)sigaction(SIGPIPE, &sa, NULL);
 }
 
+/* remove the unix socket node, then die of signum as we would have */
+static void unlinkRaised(int signum)
+{
+    unlink(upath);
+    signal(signum, SIG_DFL);
+    raise(signum);
+}
+
+/* remove the unix socket node when we are told to quit */
+static void unlinkOnExit()
+{
+    struct sigaction sa;
+    sa.sa_handler = unlinkRaised;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = 0;
+    (void)sigaction(SIGTERM, &sa, NULL);
+    (void)sigaction(SIGINT, &sa, NULL);
+    (void)sigaction(SIGHUP, &sa, NULL);
+}
+
 static DvrInfo *allocDvr()
 {
     DvrInfo *dp = NULL;
@@ -488,10 +764,10 @@ static void startLocalDvr(DvrInfo *dp)
     fflush(stderr);
 #endif
 
-    /* build three pipes: r, w and error*/
-    if (pipe(rp) < 0)
+    /* build three channels: r, w and error. r is a socket pair so the driver can pass descriptors */
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, rp) < 0)
     {
-        fprintf(stderr, "%s: read pipe: %s\n", indi_tstamp(NULL), strerror(errno));
+        fprintf(stderr, "%s: read socket pair: %s\n", indi_tstamp(NULL), strerror(errno));
         Bye();
     }
     if (pipe(wp) < 0)
@@ -524,6 +800,9 @@ static void startLocalDvr(DvrInfo *dp)
         for (fd = 3; fd < 100; fd++)
             (void)close(fd);
 
+        /* driver may pass BLOBs as shared memory on stdout */
+        setenv("INDISHAREDBLOB", "1", 1);
+
         if (*dp->envDev)
             setenv("INDIDEV", dp->envDev, 1);
         /* Only reset environment variable in case of FIFO */
@@ -588,7 +867,6 @@ static void startLocalDvr(DvrInfo *dp)
     dp->rfd     = rp[0];
     dp->wfd     = wp[1];
     dp->efd     = ep[0];
-    dp->lp      = newLilXML();
     dp->msgq    = newFQ(1);
     dp->sprops  = (Property *)malloc(1); /* seed for realloc */
     dp->nsprops = 0;
@@ -604,7 +882,9 @@ static void startLocalDvr(DvrInfo *dp)
     pushFQ(dp->msgq, mp);
     snprintf(buf, sizeof(buf), "<getProperties version='%g'/>\n", INDIV);
     setMsgStr(mp, buf);
-    mp->count++;
+    refMsg(mp);
+
+    startDvrInput(dp);
 
     if (verbose > 0)
         fprintf(stderr, "%s: Driver %s: pid=%d rfd=%d wfd=%d efd=%d\n", indi_tstamp(NULL), dp->name, dp->pid, dp->rfd,
@@ -639,7 +919,6 @@ static void startRemoteDvr(DvrInfo *dp)
     dp->port    = indi_port;
     dp->rfd     = sockfd;
     dp->wfd     = sockfd;
-    dp->lp      = newLilXML();
     dp->msgq    = newFQ(1);
     dp->sprops  = (Property *)malloc(1); /* seed for realloc */
     dp->nsprops = 0;
@@ -662,7 +941,9 @@ static void startRemoteDvr(DvrInfo *dp)
     pushFQ(dp->msgq, mp);
     sprintf(buf, "<getProperties device='%s' version='%g'/>\n", dp->dev[0], INDIV);
     setMsgStr(mp, buf);
-    mp->count++;
+    refMsg(mp);
+
+    startDvrInput(dp);
 
     if (verbose > 0)
         fprintf(stderr, "%s: Driver %s: socket=%d\n", indi_tstamp(NULL), dp->name, sockfd);
@@ -756,6 +1037,99 @@ static void indiListen()
         fprintf(stderr, "%s: listening to port %d on fd %d\n", indi_tstamp(NULL), port, sfd);
 }
 
+/* create the Unix domain endpoint usocket at upath for local clients.
+ * a node left by a server that is no longer running is replaced.
+ * exit if trouble.
+ */
+static void indiUnixListen()
+{
+    struct sockaddr_un serv_socket;
+    struct stat st;
+    int sfd;
+
+    if (strlen(upath) >= sizeof(serv_socket.sun_path))
+    {
+        fprintf(stderr, "%s: unix socket path too long: %s\n", indi_tstamp(NULL), upath);
+        Bye();
+    }
+
+    memset(&serv_socket, 0, sizeof(serv_socket));
+    serv_socket.sun_family = AF_UNIX;
+    strncpy(serv_socket.sun_path, upath, sizeof(serv_socket.sun_path) - 1);
+
+    if ((sfd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+    {
+        fprintf(stderr, "%s: unix socket: %s\n", indi_tstamp(NULL), strerror(errno));
+        Bye();
+    }
+
+    /* don't steal the path from a live server */
+    if (connect(sfd, (struct sockaddr *)&serv_socket, sizeof(serv_socket)) == 0)
+    {
+        fprintf(stderr, "%s: %s: another server is listening there\n", indi_tstamp(NULL), upath);
+        Bye();
+    }
+
+    /* only replace a stale socket, never some other file */
+    if (lstat(upath, &st) == 0)
+    {
+        if (!S_ISSOCK(st.st_mode))
+        {
+            fprintf(stderr, "%s: %s: exists and is not a socket\n", indi_tstamp(NULL), upath);
+            Bye();
+        }
+        if (unlink(upath) < 0)
+        {
+            fprintf(stderr, "%s: unlink(%s): %s\n", indi_tstamp(NULL), upath, strerror(errno));
+            Bye();
+        }
+    }
+
+    if (bind(sfd, (struct sockaddr *)&serv_socket, sizeof(serv_socket)) < 0 || listen(sfd, 5) < 0)
+    {
+        fprintf(stderr, "%s: %s: %s\n", indi_tstamp(NULL), upath, strerror(errno));
+        close(sfd);
+        Bye();
+    }
+
+    /* ok */
+    usocket = sfd;
+    unlinkOnExit();
+    if (verbose > 0)
+        fprintf(stderr, "%s: listening to %s on fd %d\n", indi_tstamp(NULL), upath, sfd);
+}
+
+/* create the loopback socket on which metrics are served */
+static void indiMetricsListen()
+{
+    struct sockaddr_in serv_socket;
+    int reuse = 1, i;
+
+    if ((msocket = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+    {
+        fprintf(stderr, "%s: metrics socket: %s\n", indi_tstamp(NULL), strerror(errno));
+        Bye();
+    }
+
+    /* metrics are for local monitoring only */
+    memset(&serv_socket, 0, sizeof(serv_socket));
+    serv_socket.sin_family      = AF_INET;
+    serv_socket.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    serv_socket.sin_port        = htons((unsigned short)mport);
+    if (setsockopt(msocket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) < 0 ||
+        bind(msocket, (struct sockaddr *)&serv_socket, sizeof(serv_socket)) < 0 || listen(msocket, 5) < 0)
+    {
+        fprintf(stderr, "%s: metrics port %d: %s\n", indi_tstamp(NULL), mport, strerror(errno));
+        Bye();
+    }
+
+    for (i = 0; i < MAXMETRICSCL; i++)
+        metricscl[i].s = -1;
+
+    if (verbose > 0)
+        fprintf(stderr, "%s: metrics on port %d on fd %d\n", indi_tstamp(NULL), mport, msocket);
+}
+
 /* Attempt to open up FIFO */
 static void indiFIFO(void)
 {
@@ -778,6 +1152,7 @@ static void indiFIFO(void)
 /* service traffic from clients and drivers */
 static void indiRun(void)
 {
+    struct timeval tv = { 1, 0 }, *ptv = NULL; /* wake to expire stalled metrics requests */
     fd_set rs, ws;
     int maxfd = 0;
     int i, s;
@@ -792,41 +1167,88 @@ static void indiRun(void)
         maxfd = fifo.fd;
     }
 
+    /* threads wake us when they have work for us */
+    if (wakefd[0] >= 0)
+    {
+        FD_SET(wakefd[0], &rs);
+        if (wakefd[0] > maxfd)
+            maxfd = wakefd[0];
+    }
+
     /* always listen for new clients */
     FD_SET(lsocket, &rs);
     if (lsocket > maxfd)
         maxfd = lsocket;
+    if (usocket >= 0)
+    {
+        FD_SET(usocket, &rs);
+        if (usocket > maxfd)
+            maxfd = usocket;
+    }
+
+    /* and for metrics requests, if wanted. requests in progress are read and
+     * answered as the scraper allows, never waiting for one.
+     */
+    if (msocket >= 0)
+    {
+        FD_SET(msocket, &rs);
+        if (msocket > maxfd)
+            maxfd = msocket;
+
+        for (i = 0; i < MAXMETRICSCL; i++)
+        {
+            MetricsCl *mp = &metricscl[i];
+            if (mp->s < 0)
+                continue;
+            if (monoSecs() - mp->t0 > METRICSTO)
+            {
+                closeMetricsClient(mp);
+                continue;
+            }
+            FD_SET(mp->s, mp->report ? &ws : &rs);
+            if (mp->s > maxfd)
+                maxfd = mp->s;
+            ptv = &tv;
+        }
+    }
 
-    /* add all client readers and client writers with work to send */
+    /* add all client readers and client writers with work to send.
+     * writer threads send when threaded.
+     */
     for (i = 0; i < nclinfo; i++)
     {
         ClInfo *cp = &clinfo[i];
         if (cp->active)
         {
             FD_SET(cp->s, &rs);
-            if (nFQ(cp->msgq) > 0)
+            if (!nthreads && nFQ(cp->msgq) > 0)
                 FD_SET(cp->s, &ws);
             if (cp->s > maxfd)
                 maxfd = cp->s;
         }
     }
 
-    /* add all driver readers and driver writers with work to send */
+    /* add all driver readers and driver writers with work to send.
+     * reader threads read when threaded.
+     */
     for (i = 0; i < ndvrinfo; i++)
     {
         DvrInfo *dp = &dvrinfo[i];
         if (dp->active)
         {
-            FD_SET(dp->rfd, &rs);
-            if (dp->rfd > maxfd)
-                maxfd = dp->rfd;
+            if (!nthreads)
+            {
+                FD_SET(dp->rfd, &rs);
+                if (dp->rfd > maxfd)
+                    maxfd = dp->rfd;
+            }
             if (dp->pid != REMOTEDVR)
             {
                 FD_SET(dp->efd, &rs);
                 if (dp->efd > maxfd)
                     maxfd = dp->efd;
             }
-            if (nFQ(dp->msgq) > 0)
+            if (nFQ(dp->msgq) > 0 && isReadyMsg((Msg *)peekFQ(dp->msgq)))
             {
                 FD_SET(dp->wfd, &ws);
                 if (dp->wfd > maxfd)
@@ -835,8 +1257,13 @@ static void indiRun(void)
         }
     }
 
-    /* wait for action */
-    s = select(maxfd + 1, &rs, &ws, NULL, NULL);
+    /* wait for action, just a look if the inbox has more */
+    if (inboxmore)
+    {
+        tv.tv_sec = tv.tv_usec = 0;
+        ptv       = &tv;
+    }
+    s = select(maxfd + 1, &rs, &ws, NULL, ptv);
     if (s < 0)
     {
         if(errno==EINTR)
@@ -845,6 +1272,22 @@ static void indiRun(void)
         Bye();
     }
 
+    /* messages from driver readers or clients writers gone? then on to the
+     * other fds, so a busy driver does not keep clients waiting.
+     */
+    if (s > 0 && wakefd[0] >= 0 && FD_ISSET(wakefd[0], &rs))
+    {
+        char wakes[64];
+        while (read(wakefd[0], wakes, sizeof(wakes)) == sizeof(wakes))
+            ;
+        s--;
+        if (reapClientWriters() < 0)
+            return; /* fds effected */
+        inboxmore = 1;
+    }
+    if (inboxmore && readInbox() < 0)
+        return; /* fds effected */
+
     /* new command from FIFO? */
     if (s > 0 && fifo.fd >= 0 && FD_ISSET(fifo.fd, &rs))
     {
@@ -855,9 +1298,39 @@ static void indiRun(void)
     /* new client? */
     if (s > 0 && FD_ISSET(lsocket, &rs))
     {
-        newClient();
+        newClient(lsocket);
+        s--;
+    }
+
+    /* new local client? */
+    if (s > 0 && usocket >= 0 && FD_ISSET(usocket, &rs))
+    {
+        newClient(usocket);
+        s--;
+    }
+
+    /* metrics request? */
+    if (s > 0 && msocket >= 0 && FD_ISSET(msocket, &rs))
+    {
+        newMetricsClient();
         s--;
     }
+    for (i = 0; s > 0 && msocket >= 0 && i < MAXMETRICSCL; i++)
+    {
+        MetricsCl *mp = &metricscl[i];
+        if (mp->s < 0)
+            continue;
+        if (FD_ISSET(mp->s, &rs))
+        {
+            readMetricsClient(mp);
+            s--;
+        }
+        else if (FD_ISSET(mp->s, &ws))
+        {
+            sendMetricsClient(mp);
+            s--;
+        }
+    }
 
     /* message to/from client? */
     for (i = 0; s > 0 && i < nclinfo; i++)
@@ -871,7 +1344,7 @@ static void indiRun(void)
                     return; /* fds effected */
                 s--;
             }
-            if (s > 0 && FD_ISSET(cp->s, &ws))
+            if (s > 0 && !nthreads && FD_ISSET(cp->s, &ws))
             {
                 if (sendClientMsg(cp) < 0)
                     return; /* fds effected */
@@ -892,13 +1365,13 @@ static void indiRun(void)
                     return; /* fds effected */
                 s--;
             }
-            if (s > 0 && FD_ISSET(dp->rfd, &rs))
+            if (s > 0 && !nthreads && FD_ISSET(dp->rfd, &rs))
             {
                 if (readFromDriver(dp) < 0)
                     return; /* fds effected */
                 s--;
             }
-            if (s > 0 && FD_ISSET(dp->wfd, &ws) && nFQ(dp->msgq) > 0)
+            if (s > 0 && FD_ISSET(dp->wfd, &ws) && nFQ(dp->msgq) > 0 && isReadyMsg((Msg *)peekFQ(dp->msgq)))
             {
                 if (sendDriverMsg(dp) < 0)
                     return; /* fds effected */
@@ -1078,7 +1551,7 @@ static void newFIFO(void)
                         prXMLEle(stderr, root, 0);
                         Msg *mp = newMsg();
 
-                        q2Clients(NULL, 0, dp->dev[i], NULL, mp, root);
+                        q2Clients(NULL, 0, dp->dev[i], NULL, mp, NULL, root);
                         if (mp->count > 0)
                             setMsgXMLEle(mp, root);
                         else
@@ -1094,16 +1567,16 @@ static void newFIFO(void)
     }
 }
 
-/* prepare for new client arriving on lsocket.
+/* prepare for new client arriving on listen socket lfd.
  * exit if trouble.
  */
-static void newClient()
+static void newClient(int lfd)
 {
     ClInfo *cp = NULL;
     int s, cli;
 
     /* assign new socket */
-    s = newClSocket();
+    s = newClSocket(lfd);
 
     /* try to reuse a clinfo slot, else add one */
     for (cli = 0; cli < nclinfo; cli++)
@@ -1111,7 +1584,8 @@ static void newClient()
             break;
     if (cli == nclinfo)
     {
-        /* grow clinfo */
+        /* grow clinfo, writers look up their entry under the lock */
+        lockQ();
         clinfo = (ClInfo *)realloc(clinfo, (nclinfo + 1) * sizeof(ClInfo));
         if (!clinfo)
         {
@@ -1119,6 +1593,7 @@ static void newClient()
             Bye();
         }
         cp = &clinfo[nclinfo++];
+        unlockQ();
     }
 
     if (cp == NULL)
@@ -1132,15 +1607,32 @@ static void newClient()
     cp->msgq   = newFQ(1);
     cp->props  = malloc(1);
     cp->nsent  = 0;
+    cp->coalesce = coalesce;
 
-    if (verbose > 0)
+    if (lfd == usocket)
+    {
+#ifdef SO_PEERCRED
+        struct ucred cred;
+        socklen_t len = sizeof(cred);
+        if (getsockopt(s, SOL_SOCKET, SO_PEERCRED, &cred, &len) == 0)
+            snprintf(cp->peer, sizeof(cp->peer), "unix pid %d", (int)cred.pid);
+        else
+#endif
+            snprintf(cp->peer, sizeof(cp->peer), "unix");
+    }
+    else
     {
         struct sockaddr_in addr;
         socklen_t len = sizeof(addr);
         getpeername(s, (struct sockaddr *)&addr, &len);
-        fprintf(stderr, "%s: Client %d: new arrival from %s:%d - welcome!\n", indi_tstamp(NULL), cp->s,
-                inet_ntoa(addr.sin_addr), ntohs(addr.sin_port));
+        snprintf(cp->peer, sizeof(cp->peer), "%s:%d", inet_ntoa(addr.sin_addr), ntohs(addr.sin_port));
     }
+
+    if (nthreads)
+        startClientWriter(cli);
+
+    if (verbose > 0)
+        fprintf(stderr, "%s: Client %d: new arrival from %s - welcome!\n", indi_tstamp(NULL), cp->s, cp->peer);
 #ifdef OSX_EMBEDED_MODE
     int active = 0;
     for (int i = 0; i < nclinfo; i++)
@@ -1160,6 +1652,7 @@ static int readFromClient(ClInfo *cp)
     char buf[MAXRBUF];
     int shutany = 0;
     ssize_t i, nr;
+    double t0;
 
     /* read client */
     nr = read(cp->s, buf, sizeof(buf));
@@ -1172,8 +1665,10 @@ static int readFromClient(ClInfo *cp)
         shutdownClient(cp);
         return (-1);
     }
+    cp->stats.bytesin += nr;
 
     /* process XML, sending when find closure */
+    t0 = monoSecs();
     for (i = 0; i < nr; i++)
     {
         char err[1024];
@@ -1186,6 +1681,10 @@ static int readFromClient(ClInfo *cp)
             int isblob       = !strcmp(tagXMLEle(root), "setBLOBVector");
             Msg *mp;
 
+            cp->stats.msgsin++;
+            addLatency(&parselat[msgKind(roottag)], cp->stats.parsing + monoSecs() - t0);
+            cp->stats.parsing = 0;
+
             if (verbose > 2)
             {
                 fprintf(stderr, "%s: Client %d: read ", indi_tstamp(NULL), cp->s);
@@ -1206,9 +1705,16 @@ static int readFromClient(ClInfo *cp)
             else if (!strcmp(roottag, "getProperties") && !cp->nprops)
                 cp->allprops = 1;
 
+            /* snag coalesce request -- drivers need not see it */
+            if (!strcmp(roottag, "getProperties"))
+                crackCoalesce(root, cp);
+
             /* snag enableBLOB -- send to remote drivers too */
             if (!strcmp(roottag, "enableBLOB"))
+            {
                 crackBLOBHandling(dev, name, pcdataXMLEle(root), cp);
+                crackBinaryBLOBs(root, cp);
+            }
 
             /* build a new message -- set content iff anyone cares */
             mp = newMsg();
@@ -1226,7 +1732,7 @@ static int readFromClient(ClInfo *cp)
             /* echo new* commands back to other clients */
             if (!strncmp(roottag, "new", 3))
             {
-                if (q2Clients(cp, isblob, dev, name, mp, root) < 0)
+                if (q2Clients(cp, isblob, dev, name, mp, NULL, root) < 0)
                     shutany++;
             }
 
@@ -1236,6 +1742,7 @@ static int readFromClient(ClInfo *cp)
             else
                 freeMsg(mp);
             delXMLEle(root);
+            t0 = monoSecs();
         }
         else if (err[0])
         {
@@ -1246,6 +1753,7 @@ static int readFromClient(ClInfo *cp)
             return (-1);
         }
     }
+    cp->stats.parsing += monoSecs() - t0;
 
     return (shutany ? -1 : 0);
 }
@@ -1261,11 +1769,11 @@ static int readFromDriver(DvrInfo *dp)
     ssize_t nr;
     char err[1024];
     XMLEle **nodes;
-    XMLEle *root;
-    int inode = 0;
+    int inode, nnodes;
+    double t0;
 
     /* read driver */
-    nr = read(dp->rfd, buf, sizeof(buf));
+    nr = recvFromDriver(dp->in, buf, sizeof(buf));
     if (nr <= 0)
     {
         if (nr < 0)
@@ -1277,8 +1785,12 @@ static int readFromDriver(DvrInfo *dp)
         return (-1);
     }
 
+    dp->stats.bytesin += nr;
+
     /* process XML chunk */
-    nodes = parseXMLChunk(dp->lp, buf, nr, err);
+    t0    = monoSecs();
+    nodes = parseXMLChunk(dp->in->lp, buf, nr, err);
+    dp->stats.parsing += monoSecs() - t0;
 
     if (!nodes)
     {
@@ -1293,119 +1805,369 @@ static int readFromDriver(DvrInfo *dp)
         return -1;
     }
 
-    root = nodes[inode];
-    while (root)
+    /* share the parse time among the messages completed */
+    for (nnodes = 0; nodes[nnodes]; nnodes++)
+        ;
+    for (inode = 0; inode < nnodes; inode++)
+        addLatency(&parselat[msgKind(tagXMLEle(nodes[inode]))], dp->stats.parsing / nnodes);
+    if (nnodes > 0)
+        dp->stats.parsing = 0;
+    dp->stats.msgsin += nnodes;
+
+    for (inode = 0; inode < nnodes; inode++)
     {
-        char *roottag    = tagXMLEle(root);
-        const char *dev  = findXMLAttValu(root, "device");
-        const char *name = findXMLAttValu(root, "name");
-        int isblob       = !strcmp(tagXMLEle(root), "setBLOBVector");
-        Msg *mp;
+        XMLEle *root  = nodes[inode];
+        RawBLOB *raws = NULL;
+        int nraws     = 0;
 
-        if (verbose > 2)
-        {
-            fprintf(stderr, "%s: Driver %s: read ", indi_tstamp(0), dp->name);
-            traceMsg(root);
-        }
-        else if (verbose > 1)
-        {
-            fprintf(stderr, "%s: Driver %s: read <%s device='%s' name='%s'>\n", indi_tstamp(NULL), dp->name,
-                    tagXMLEle(root), findXMLAttValu(root, "device"), findXMLAttValu(root, "name"));
-        }
+        if (!strcmp(tagXMLEle(root), "setBLOBVector"))
+            nraws = mapSharedBLOBs(dp->in, root, &raws);
+        if (dispatchDriverMsg(dp, root, raws, nraws) < 0)
+            shutany++;
+    }
 
-        /* that's all if driver is just registering a snoop */
-        /* JM 2016-05-18: Send getProperties to upstream chained servers as well.*/
-        if (!strcmp(roottag, "getProperties"))
-        {
-            addSDevice(dp, dev, name);
-            mp = newMsg();
-            /* send to interested chained servers upstream */
-            if (q2Servers(dp, mp, root) < 0)
-                shutany++;
-            /* Send to snooped drivers if they exist so that they can echo back the snooped propertly immediately */
-            q2RDrivers(dev, mp, root);
+    free(nodes);
 
-            if (mp->count > 0)
-                setMsgXMLEle(mp, root);
-            else
-                freeMsg(mp);
-            delXMLEle(root);
-            inode++;
-            root = nodes[inode];
-            continue;
-        }
+    return (shutany ? -1 : 0);
+}
 
-        /* that's all if driver desires to snoop BLOBs from other drivers */
-        if (!strcmp(roottag, "enableBLOB"))
-        {
-            Property *sp = findSDevice(dp, dev, name);
-            if (sp)
-                crackBLOB(pcdataXMLEle(root), &sp->blob);
-            delXMLEle(root);
-            inode++;
-            root = nodes[inode];
-            continue;
-        }
+/* send message root from driver dp to each interested client and driver.
+ * raws and nraws are from mapSharedBLOBs(). root and raws are consumed.
+ * return 0 if ok else -1 if had to shut down anything.
+ */
+static int dispatchDriverMsg(DvrInfo *dp, XMLEle *root, RawBLOB *raws, int nraws)
+{
+    char *roottag    = tagXMLEle(root);
+    const char *dev  = findXMLAttValu(root, "device");
+    const char *name = findXMLAttValu(root, "name");
+    int isblob       = !strcmp(tagXMLEle(root), "setBLOBVector");
+    int shutany      = 0;
+    Msg *mp, *mpbin;
 
-        /* Found a new device? Let's add it to driver info */
-        if (dev[0] && isDeviceInDriver(dev, dp) == 0)
-        {
-            dp->dev           = (char **)realloc(dp->dev, (dp->ndev + 1) * sizeof(char *));
-            dp->dev[dp->ndev] = (char *)malloc(MAXINDIDEVICE * sizeof(char));
+    if (verbose > 2)
+    {
+        fprintf(stderr, "%s: Driver %s: read ", indi_tstamp(0), dp->name);
+        traceMsg(root);
+    }
+    else if (verbose > 1)
+    {
+        fprintf(stderr, "%s: Driver %s: read <%s device='%s' name='%s'>\n", indi_tstamp(NULL), dp->name,
+                tagXMLEle(root), findXMLAttValu(root, "device"), findXMLAttValu(root, "name"));
+    }
+
+    /* that's all if driver is just registering a snoop */
+    /* JM 2016-05-18: Send getProperties to upstream chained servers as well.*/
+    if (!strcmp(roottag, "getProperties"))
+    {
+        addSDevice(dp, dev, name);
+        mp = newMsg();
+        /* send to interested chained servers upstream */
+        if (q2Servers(dp, mp, root) < 0)
+            shutany++;
+        /* Send to snooped drivers if they exist so that they can echo back the snooped propertly immediately */
+        q2RDrivers(dev, mp, root);
 
-            strncpy(dp->dev[dp->ndev], dev, MAXINDIDEVICE - 1);
-            dp->dev[dp->ndev][MAXINDIDEVICE - 1] = '\0';
+        if (mp->count > 0)
+            setMsgXMLEle(mp, root);
+        else
+            freeMsg(mp);
+        delXMLEle(root);
+        return (shutany ? -1 : 0);
+    }
+
+    /* that's all if driver desires to snoop BLOBs from other drivers */
+    if (!strcmp(roottag, "enableBLOB"))
+    {
+        Property *sp = findSDevice(dp, dev, name);
+        if (sp)
+            crackBLOB(pcdataXMLEle(root), &sp->blob);
+        delXMLEle(root);
+        return (0);
+    }
+
+    /* Found a new device? Let's add it to driver info */
+    if (dev[0] && isDeviceInDriver(dev, dp) == 0)
+    {
+        dp->dev           = (char **)realloc(dp->dev, (dp->ndev + 1) * sizeof(char *));
+        dp->dev[dp->ndev] = (char *)malloc(MAXINDIDEVICE * sizeof(char));
+
+        strncpy(dp->dev[dp->ndev], dev, MAXINDIDEVICE - 1);
+        dp->dev[dp->ndev][MAXINDIDEVICE - 1] = '\0';
 
 #ifdef OSX_EMBEDED_MODE
-            if (!dp->ndev)
-                fprintf(stderr, "STARTED \"%s\"\n", dp->name);
-            fflush(stderr);
+        if (!dp->ndev)
+            fprintf(stderr, "STARTED \"%s\"\n", dp->name);
+        fflush(stderr);
 #endif
 
-            dp->ndev++;
-        }
+        dp->ndev++;
+    }
 
-        /* log messages if any and wanted */
-        if (ldir)
-            logDMsg(root, dev);
+    /* log messages if any and wanted */
+    if (ldir)
+        logDMsg(root, dev);
 
-        /* build a new message -- set content iff anyone cares */
-        mp = newMsg();
+    /* BLOBs passed as shared memory are only encoded if somebody needs base64 */
+    if (nraws < 0)
+    {
+        fprintf(stderr, "%s: Driver %s: missing shared BLOB for %s.%s\n", indi_tstamp(NULL), dp->name, dev, name);
+        nraws = -nraws;
+    }
 
-        /* send to interested clients */
-        if (q2Clients(NULL, isblob, dev, name, mp, root) < 0)
-            shutany++;
+    /* build new messages, base64 and binary -- set content iff anyone cares */
+    mp    = newMsg();
+    mpbin = isblob ? newMsg() : NULL;
 
-        /* send to snooping drivers */
-        q2SDrivers(dp, isblob, dev, name, mp, root);
+    /* send to interested clients */
+    if (q2Clients(NULL, isblob, dev, name, mp, mpbin, root) < 0)
+        shutany++;
 
-        /* set message content if anyone cares else forget it */
-        if (mp->count > 0)
-            setMsgXMLEle(mp, root);
-        else
-            freeMsg(mp);
-        delXMLEle(root);
-        inode++;
-        root = nodes[inode];
+    /* send to snooping drivers */
+    q2SDrivers(dp, isblob, dev, name, mp, root);
+
+    /* forget messages nobody cares about */
+    if (mpbin && mpbin->count == 0)
+    {
+        freeMsg(mpbin);
+        mpbin = NULL;
+    }
+    if (mp->count == 0)
+    {
+        freeMsg(mp);
+        mp = NULL;
     }
 
-    free(nodes);
+    /* large BLOBs are serialized off the main thread when threaded */
+    if (nthreads && isblob && (mp || mpbin))
+    {
+        queueSerJob(mp, mpbin, root, raws, nraws);
+        return (shutany ? -1 : 0);
+    }
+
+    /* set message content.
+     * binary first, it reads the BLOB contents as received.
+     */
+    if (mpbin)
+        setMsgBinXMLEle(mpbin, root, raws, nraws);
+    if (mp)
+    {
+        encodeSharedBLOBs(raws, nraws);
+        setMsgXMLEle(mp, root);
+    }
+    unmapSharedBLOBs(raws, nraws);
+    delXMLEle(root);
 
     return (shutany ? -1 : 0);
 }
 
-/* read more from the given driver stderr, add prefix and send to our stderr.
- * return 0 if ok else -1 if had to restart.
+/* allocate the input side of driver dp once its rfd is open, and start
+ * its reader thread when threaded.
  */
-static int stderrFromDriver(DvrInfo *dp)
+static void startDvrInput(DvrInfo *dp)
 {
-    static char exbuf[MAXRBUF];
-    static int nexbuf;
-    ssize_t i, nr;
+    DvrInput *in = (DvrInput *)calloc(1, sizeof(DvrInput));
 
-    /* read more */
-    nr = read(dp->efd, exbuf + nexbuf, sizeof(exbuf) - nexbuf);
-    if (nr <= 0)
+    in->dvi    = dp - dvrinfo;
+    in->rfd    = dp->rfd;
+    in->remote = (dp->pid == REMOTEDVR);
+    in->lp     = newLilXML();
+    snprintf(in->name, sizeof(in->name), "%s", dp->name);
+    dp->in = in;
+
+    if (nthreads && pthread_create(&in->reader, NULL, driverReader, in) != 0)
+    {
+        fprintf(stderr, "%s: Driver %s: no reader thread: %s\n", indi_tstamp(NULL), dp->name, strerror(errno));
+        Bye();
+    }
+}
+
+/* read from the given driver into buf, queuing any BLOB descriptors passed along.
+ * return as read(2).
+ */
+static ssize_t recvFromDriver(DvrInput *in, char *buf, size_t size)
+{
+    union
+    {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(MAXBLOBFDS * sizeof(int))];
+    } ctl;
+    struct cmsghdr *cmsg;
+    struct msghdr msg;
+    struct iovec iov;
+    char ts[64]; /* may run in a reader thread */
+    int flags = 0, overflow = 0;
+    ssize_t nr;
+
+    if (in->remote)
+        return read(in->rfd, buf, size);
+
+    iov.iov_base = buf;
+    iov.iov_len  = size;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = ctl.buf;
+    msg.msg_controllen = sizeof(ctl.buf);
+#ifdef MSG_CMSG_CLOEXEC
+    flags = MSG_CMSG_CLOEXEC;
+#endif
+
+    nr = recvmsg(in->rfd, &msg, flags);
+    if (nr <= 0)
+        return nr;
+
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+        int i, n, fd;
+
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+            continue;
+
+        n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (i = 0; i < n; i++)
+        {
+            memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+            /* one vector, and the first of the next read along with its end */
+            if (in->nblobfds < MAXBLOBFDS + 1)
+                in->blobfds[in->nblobfds++] = fd;
+            else
+            {
+                if (!overflow)
+                    fprintf(stderr, "%s: Driver %s: too many shared BLOBs pending\n", indi_tstamp(ts), in->name);
+                overflow = 1;
+                close(fd);
+            }
+        }
+    }
+
+    if (msg.msg_flags & MSG_CTRUNC)
+    {
+        fprintf(stderr, "%s: Driver %s: shared BLOB descriptors truncated\n", indi_tstamp(ts), in->name);
+        overflow = 1;
+    }
+
+    /* later attached BLOBs would be paired with the wrong descriptors, fail the driver instead */
+    if (overflow)
+    {
+        closeBLOBFds(in);
+        errno = EPROTO;
+        return (-1);
+    }
+
+    return nr;
+}
+
+/* map the contents of each oneBLOB of root the driver attached as shared memory,
+ * consuming the descriptors in the order they were received. *raws is set to a
+ * malloced array the caller releases with unmapSharedBLOBs().
+ * return the number of entries in *raws, negated if any could not be mapped.
+ */
+static int mapSharedBLOBs(DvrInput *in, XMLEle *root, RawBLOB **raws)
+{
+    XMLEle *ep;
+    int nraws = 0, missing = 0;
+
+    *raws = NULL;
+
+    for (ep = nextXMLEle(root, 1); ep; ep = nextXMLEle(root, 0))
+    {
+        RawBLOB *rp;
+        struct stat st;
+        int fd = -1;
+
+        if (strcmp(tagXMLEle(ep), "oneBLOB") || strcmp(findXMLAttValu(ep, "attached"), "true"))
+            continue;
+
+        rmXMLAtt(ep, "attached");
+
+        *raws    = (RawBLOB *)realloc(*raws, (nraws + 1) * sizeof(RawBLOB));
+        rp       = &(*raws)[nraws++];
+        rp->ep   = ep;
+        rp->blob = NULL;
+        rp->len  = 0;
+
+        if (in->nblobfds > 0)
+        {
+            fd = in->blobfds[0];
+            memmove(in->blobfds, in->blobfds + 1, --in->nblobfds * sizeof(int));
+        }
+
+        if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size > 0 && st.st_size < INT_MAX / 4 * 3)
+        {
+            void *blob = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            if (blob != MAP_FAILED)
+            {
+                rp->blob = (unsigned char *)blob;
+                rp->len  = st.st_size;
+            }
+        }
+
+        if (fd >= 0)
+            close(fd);
+
+        /* an empty BLOB is sent instead so clients still see the state change */
+        if (!rp->blob)
+            missing = 1;
+    }
+
+    return (missing ? -nraws : nraws);
+}
+
+/* set the pcdata of each shared BLOB element to its base64 encoding */
+static void encodeSharedBLOBs(RawBLOB *raws, int nraws)
+{
+    int i;
+
+    for (i = 0; i < nraws; i++)
+    {
+        char enclen[32];
+        char *enc = NULL;
+        int l     = 0;
+
+        if (raws[i].blob && (enc = malloc(4 * raws[i].len / 3 + 4)) != NULL)
+        {
+            l      = to64frombits((unsigned char *)enc, raws[i].blob, raws[i].len);
+            enc[l] = '\0';
+        }
+
+        editXMLEle(raws[i].ep, enc ? enc : "");
+        free(enc);
+
+        snprintf(enclen, sizeof(enclen), "%d", l);
+        addXMLAtt(raws[i].ep, "enclen", enclen);
+    }
+}
+
+/* release the mappings made by mapSharedBLOBs() */
+static void unmapSharedBLOBs(RawBLOB *raws, int nraws)
+{
+    int i;
+
+    for (i = 0; i < nraws; i++)
+        if (raws[i].blob)
+            munmap(raws[i].blob, raws[i].len);
+    free(raws);
+}
+
+/* close any shared BLOB descriptors still pending from in */
+static void closeBLOBFds(DvrInput *in)
+{
+    while (in->nblobfds > 0)
+        close(in->blobfds[--in->nblobfds]);
+}
+
+/* read more from the given driver stderr, add prefix and send to our stderr.
+ * return 0 if ok else -1 if had to restart.
+ */
+static int stderrFromDriver(DvrInfo *dp)
+{
+    static char exbuf[MAXRBUF];
+    static int nexbuf;
+    ssize_t i, nr;
+
+    /* read more */
+    nr = read(dp->efd, exbuf + nexbuf, sizeof(exbuf) - nexbuf);
+    if (nr <= 0)
     {
         if (nr < 0)
             fprintf(stderr, "%s: Driver %s: stderr %s\n", indi_tstamp(NULL), dp->name, strerror(errno));
@@ -1437,8 +2199,16 @@ static void shutdownClient(ClInfo *cp)
 {
     Msg *mp;
 
-    /* close connection */
+    /* close connection, this also unblocks any writer */
     shutdown(cp->s, SHUT_RDWR);
+    if (nthreads)
+    {
+        lockQ();
+        cp->quit = 1;
+        pthread_cond_broadcast(&qcond);
+        unlockQ();
+        pthread_join(cp->writer, NULL);
+    }
     close(cp->s);
 
     /* free memory */
@@ -1447,13 +2217,14 @@ static void shutdownClient(ClInfo *cp)
 
     /* decrement and possibly free any unsent messages for this client */
     while ((mp = (Msg *)popFQ(cp->msgq)) != NULL)
-        if (--mp->count == 0)
-            freeMsg(mp);
+        unrefMsg(mp);
     delFQ(cp->msgq);
 
     /* ok now to recycle */
     cp->active = 0;
 
+    nclshutdowns++;
+
     if (verbose > 0)
         fprintf(stderr, "%s: Client %d: shut down complete - bye!\n", indi_tstamp(NULL), cp->s);
 #ifdef OSX_EMBEDED_MODE
@@ -1471,17 +2242,44 @@ static void shutdownDvr(DvrInfo *dp, int restart)
 {
     Msg *mp;
 
-    /* make sure it's dead, reclaim resources */
+    /* make sure it's dead, reclaim resources.
+     * any reader sees EOF and stops before its fds are closed.
+     */
+    shutdown(dp->rfd, SHUT_RDWR);
+    if (dp->pid != REMOTEDVR)
+        kill(dp->pid, SIGKILL); /* we've insured there are no zombies */
+    if (nthreads)
+    {
+        Parsed *pp;
+        int i, n;
+
+        pthread_join(dp->in->reader, NULL);
+
+        /* forget whatever it left for us */
+        pthread_mutex_lock(&inlock);
+        for (i = 0, n = nFQ(inbox); i < n; i++)
+        {
+            pp = (Parsed *)popFQ(inbox);
+            if (pp->dvi != dp->in->dvi)
+                pushFQ(inbox, pp);
+            else
+            {
+                if (pp->root)
+                    delXMLEle(pp->root);
+                unmapSharedBLOBs(pp->raws, pp->nraws < 0 ? -pp->nraws : pp->nraws);
+                free(pp);
+            }
+        }
+        pthread_mutex_unlock(&inlock);
+    }
     if (dp->pid == REMOTEDVR)
     {
         /* socket connection */
-        shutdown(dp->wfd, SHUT_RDWR);
         close(dp->wfd); /* same as rfd */
     }
     else
     {
         /* local pipe connection */
-        kill(dp->pid, SIGKILL); /* we've insured there are no zombies */
         close(dp->wfd);
         close(dp->rfd);
         close(dp->efd);
@@ -1495,7 +2293,10 @@ static void shutdownDvr(DvrInfo *dp, int restart)
     /* free memory */
     free(dp->sprops);
     free(dp->dev);
-    delLilXML(dp->lp);
+    delLilXML(dp->in->lp);
+    closeBLOBFds(dp->in);
+    free(dp->in);
+    dp->in = NULL;
 
     /* ok now to recycle */
     dp->active = 0;
@@ -1503,8 +2304,7 @@ static void shutdownDvr(DvrInfo *dp, int restart)
 
     /* decrement and possibly free any unsent messages for this client */
     while ((mp = (Msg *)popFQ(dp->msgq)) != NULL)
-        if (--mp->count == 0)
-            freeMsg(mp);
+        unrefMsg(mp);
     delFQ(dp->msgq);
 
     if (restart)
@@ -1570,7 +2370,7 @@ static void q2RDrivers(const char *dev, Msg *mp, XMLEle *root)
         }
 
         /* ok: queue message to this driver */
-        mp->count++;
+        refMsg(mp);
         pushFQ(dp->msgq, mp);
         if (verbose > 1)
         {
@@ -1608,7 +2408,7 @@ static void q2SDrivers(DvrInfo *me, int isblob, const char *dev, const char *nam
         }
 
         /* ok: queue message to this device */
-        mp->count++;
+        refMsg(mp);
         pushFQ(dp->msgq, mp);
         if (verbose > 1)
         {
@@ -1666,14 +2466,19 @@ static Property *findSDevice(DvrInfo *dp, const char *dev, const char *name)
 }
 
 /* put Msg mp on queue of each client interested in dev/name, except notme.
- * if BLOB always honor current mode.
+ * if BLOB always honor current mode. clients that negotiated binary BLOBs get
+ * mpbin instead, if given.
  * return -1 if had to shut down any clients, else 0.
  */
-static int q2Clients(ClInfo *notme, int isblob, const char *dev, const char *name, Msg *mp, XMLEle *root)
+static int q2Clients(ClInfo *notme, int isblob, const char *dev, const char *name, Msg *mp, Msg *mpbin,
+                     XMLEle *root)
 {
     int shutany = 0;
     ClInfo *cp;
-    int ql, i = 0;
+    int ql, coalesced, i = 0;
+
+    /* note what the message is about, for coalescing */
+    setMsgKey(mp, dev, name, root);
 
     /* queue message to each interested client */
     for (cp = clinfo; cp < &clinfo[nclinfo]; cp++)
@@ -1711,8 +2516,21 @@ static int q2Clients(ClInfo *notme, int isblob, const char *dev, const char *nam
                 continue;
         }
 
+        /* replace an older value still waiting, the q does not grow */
+        lockQ();
+        coalesced = cp->coalesce && coalesceMsg(cp, mp);
+        ql        = coalesced ? 0 : msgQSize(cp->msgq);
+        unlockQ();
+        if (coalesced)
+        {
+            cp->stats.coalesced++;
+            if (verbose > 1)
+                fprintf(stderr, "%s: Client %d: coalescing <%s device='%s' name='%s'>\n", indi_tstamp(NULL), cp->s,
+                        tagXMLEle(root), dev, name);
+            continue;
+        }
+
         /* shut down this client if its q is already too large */
-        ql = msgQSize(cp->msgq);
         if (isblob && maxstreamsiz > 0 && ql > maxstreamsiz)
         {
             // Drop frames for streaming blobs
@@ -1734,6 +2552,7 @@ static int q2Clients(ClInfo *notme, int isblob, const char *dev, const char *nam
             }
             if (streamFound)
             {
+                cp->stats.drops++;
                 if (verbose > 1)
                     fprintf(stderr, "%s: Client %d: %d bytes behind. Dropping stream BLOB...\n", indi_tstamp(NULL),
                             cp->s, ql);
@@ -1744,14 +2563,25 @@ static int q2Clients(ClInfo *notme, int isblob, const char *dev, const char *nam
         {
             if (verbose)
                 fprintf(stderr, "%s: Client %d: %d bytes behind, shutting down\n", indi_tstamp(NULL), cp->s, ql);
+            nclbehind++;
             shutdownClient(cp);
             shutany++;
             continue;
         }
 
         /* ok: queue message to this client */
-        mp->count++;
-        pushFQ(cp->msgq, mp);
+        lockQ();
+        if (isblob && mpbin && cp->binblobs)
+        {
+            refMsg(mpbin);
+            pushFQ(cp->msgq, mpbin);
+        }
+        else
+        {
+            refMsg(mp);
+            pushFQ(cp->msgq, mp);
+        }
+        unlockQ();
         if (verbose > 1)
             fprintf(stderr, "%s: Client %d: queuing <%s device='%s' name='%s'>\n", indi_tstamp(NULL), cp->s,
                     tagXMLEle(root), findXMLAttValu(root, "device"), findXMLAttValu(root, "name"));
@@ -1760,6 +2590,75 @@ static int q2Clients(ClInfo *notme, int isblob, const char *dev, const char *nam
     return (shutany ? -1 : 0);
 }
 
+/* record the device and property mp is about and whether it may be coalesced.
+ * a value carrying a message is never coalesced so the message is not lost.
+ */
+static void setMsgKey(Msg *mp, const char *dev, const char *name, XMLEle *root)
+{
+    const char *tag = tagXMLEle(root);
+    XMLEle *ep;
+    size_t l = 0;
+
+    mp->latest  = !strncmp(tag, "set", 3) && strcmp(tag, "setBLOBVector") && !findXMLAtt(root, "message");
+    mp->barrier = !strncmp(tag, "def", 3) || !strncmp(tag, "del", 3);
+    strncpy(mp->dev, dev ? dev : "", MAXINDIDEVICE - 1);
+    strncpy(mp->name, name ? name : "", MAXINDINAME - 1);
+
+    free(mp->elems);
+    mp->elems = NULL;
+    if (!mp->latest)
+        return;
+
+    /* only a value with the same elements may replace another one */
+    for (ep = nextXMLEle(root, 1); ep; ep = nextXMLEle(root, 0))
+    {
+        const char *en = findXMLAttValu(ep, "name");
+        size_t el      = strlen(en);
+
+        mp->elems = (char *)realloc(mp->elems, l + el + 2);
+        memcpy(mp->elems + l, en, el);
+        l += el;
+        mp->elems[l++] = '\n';
+        mp->elems[l]   = '\0';
+    }
+    if (!mp->elems)
+        mp->latest = 0;
+}
+
+/* if mp is a latest value and client cp still has an unsent value of the same
+ * property and elements queued, put mp in its place. search stops at a def or
+ * del for the same device, and at any other message for the same property, so
+ * a value never moves ahead of its definition or of an earlier partial update.
+ * return 1 if mp was queued this way, else 0.
+ */
+static int coalesceMsg(ClInfo *cp, Msg *mp)
+{
+    int first = (cp->nsent > 0 || cp->busy) ? 1 : 0; /* current Msg is partly sent */
+    int i;
+
+    if (!mp->latest)
+        return (0);
+
+    for (i = nFQ(cp->msgq) - 1; i >= first; i--)
+    {
+        Msg *qmp = (Msg *)peekiFQ(cp->msgq, i);
+
+        if (qmp->barrier && !strcmp(qmp->dev, mp->dev))
+            return (0);
+        if (!strcmp(qmp->name, mp->name) && !strcmp(qmp->dev, mp->dev))
+        {
+            if (!qmp->latest || strcmp(qmp->elems, mp->elems))
+                return (0);
+            setiFQ(cp->msgq, i, mp);
+            refMsg(mp);
+            unrefMsg(qmp);
+            return (1);
+        }
+    }
+
+    return (0);
+}
+
 /* put Msg mp on queue of each chained server client, except notme.
   * return -1 if had to shut down any clients, else 0.
  */
@@ -1799,19 +2698,24 @@ static int q2Servers(DvrInfo *me, Msg *mp, XMLEle *root)
             continue;
 
         /* shut down this client if its q is already too large */
+        lockQ();
         ql = msgQSize(cp->msgq);
+        unlockQ();
         if (ql > maxqsiz)
         {
             if (verbose)
                 fprintf(stderr, "%s: Client %d: %d bytes behind, shutting down\n", indi_tstamp(NULL), cp->s, ql);
+            nclbehind++;
             shutdownClient(cp);
             shutany++;
             continue;
         }
 
         /* ok: queue message to this client */
-        mp->count++;
+        lockQ();
+        refMsg(mp);
         pushFQ(cp->msgq, mp);
+        unlockQ();
         if (verbose > 1)
             fprintf(stderr, "%s: Client %d: queuing <%s device='%s' name='%s'>\n", indi_tstamp(NULL), cp->s,
                     tagXMLEle(root), findXMLAttValu(root, "device"), findXMLAttValu(root, "name"));
@@ -1840,13 +2744,103 @@ static int msgQSize(FQ *q)
  */
 static void setMsgXMLEle(Msg *mp, XMLEle *root)
 {
+    double t0 = monoSecs();
+    unsigned long cl;
+    char *cp;
+
     /* want cl to only count content, but need room for final \0 */
-    mp->cl = sprlXMLEle(root, 0);
-    if (mp->cl < sizeof(mp->buf))
-        mp->cp = mp->buf;
+    cl = sprlXMLEle(root, 0);
+    if (cl < sizeof(mp->buf))
+        cp = mp->buf;
     else
-        mp->cp = malloc(mp->cl + 1);
-    sprXMLEle(mp->cp, root, 0);
+        cp = malloc(cl + 1);
+    sprXMLEle(cp, root, 0);
+
+    addLatency(&serlat[msgKind(tagXMLEle(root))], monoSecs() - t0);
+    readyMsg(mp, cp, cl);
+}
+
+/* print the attributes of ep to s, except skip.
+ * return number of bytes written.
+ */
+static int sprXMLAtts(char *s, XMLEle *ep, const char *skip)
+{
+    XMLAtt *ap;
+    int sl = 0;
+
+    for (ap = nextXMLAtt(ep, 1); ap; ap = nextXMLAtt(ep, 0))
+        if (!skip || strcmp(nameXMLAtt(ap), skip))
+            sl += sprintf(s + sl, " %s=\"%s\"", nameXMLAtt(ap), entityXML(valuXMLAtt(ap)));
+
+    return (sl);
+}
+
+/* print setBLOBVector root as content in Msg mp for binary clients: each
+ * oneBLOB start tag carries binlen and is followed by that many raw bytes.
+ * contents come from raws if shared, else are decoded from base64 pcdata.
+ */
+static void setMsgBinXMLEle(Msg *mp, XMLEle *root, RawBLOB *raws, int nraws)
+{
+    double t0 = monoSecs();
+    unsigned long l, cl;
+    XMLEle *ep;
+    char *s;
+    int i;
+
+    /* base64 pcdata is always longer than its contents, shared contents are not in root yet */
+    l = sprlXMLEle(root, 0) + 1;
+    for (i = 0; i < nraws; i++)
+        l += raws[i].len;
+    l += 32 * nXMLEle(root);
+
+    s = (l < sizeof(mp->buf)) ? mp->buf : malloc(l);
+
+    cl = sprintf(s, "<%s", tagXMLEle(root));
+    cl += sprXMLAtts(s + cl, root, NULL);
+    cl += sprintf(s + cl, ">\n");
+
+    for (ep = nextXMLEle(root, 1); ep; ep = nextXMLEle(root, 0))
+    {
+        const unsigned char *blob = NULL;
+        char *decoded             = NULL;
+        unsigned long len         = 0;
+
+        if (strcmp(tagXMLEle(ep), "oneBLOB"))
+        {
+            cl += sprXMLEle(s + cl, ep, 1);
+            continue;
+        }
+
+        for (i = 0; i < nraws; i++)
+            if (raws[i].ep == ep)
+                break;
+
+        if (i < nraws)
+        {
+            blob = raws[i].blob;
+            len  = blob ? raws[i].len : 0;
+        }
+        else if (pcdatalenXMLEle(ep) > 0 && (decoded = malloc(3 * pcdatalenXMLEle(ep) / 4 + 4)) != NULL)
+        {
+            len  = from64tobits_fast(decoded, pcdataXMLEle(ep), pcdatalenXMLEle(ep));
+            blob = (unsigned char *)decoded;
+        }
+
+        cl += sprintf(s + cl, "  <oneBLOB");
+        cl += sprXMLAtts(s + cl, ep, "enclen");
+        cl += sprintf(s + cl, " binlen=\"%lu\">", len);
+        if (len > 0)
+            memcpy(s + cl, blob, len);
+        cl += len;
+        cl += sprintf(s + cl, "</oneBLOB>\n");
+
+        free(decoded);
+    }
+
+    cl += sprintf(s + cl, "</%s>\n", tagXMLEle(root));
+
+    addLatency(&serlat[MK_SETBLOB], monoSecs() - t0);
+    readyMsg(mp, s, cl);
 }
 
 /* save str as content in Msg mp.
@@ -1854,12 +2848,11 @@ static void setMsgXMLEle(Msg *mp, XMLEle *root)
 static void setMsgStr(Msg *mp, char *str)
 {
     /* want cl to only count content, but need room for final \0 */
-    mp->cl = strlen(str);
-    if (mp->cl < sizeof(mp->buf))
-        mp->cp = mp->buf;
-    else
-        mp->cp = malloc(mp->cl + 1);
-    strcpy(mp->cp, str);
+    unsigned long cl = strlen(str);
+    char *cp         = (cl < sizeof(mp->buf)) ? mp->buf : malloc(cl + 1);
+
+    strcpy(cp, str);
+    readyMsg(mp, cp, cl);
 }
 
 /* return pointer to one new nulled Msg
@@ -1874,9 +2867,69 @@ static void freeMsg(Msg *mp)
 {
     if (mp->cp && mp->cp != mp->buf)
         free(mp->cp);
+    free(mp->elems);
     free(mp);
 }
 
+/* add a consumer to Msg mp */
+static void refMsg(Msg *mp)
+{
+    __atomic_add_fetch(&mp->count, 1, __ATOMIC_RELAXED);
+}
+
+/* remove a consumer from Msg mp, free it if it was the last one */
+static void unrefMsg(Msg *mp)
+{
+    if (__atomic_sub_fetch(&mp->count, 1, __ATOMIC_ACQ_REL) == 0)
+        freeMsg(mp);
+}
+
+/* set cl bytes at cp as the content of Msg mp and mark it ready to be sent,
+ * waking any writer waiting for it. until then the main thread may read cl as
+ * an estimate of the size.
+ */
+static void readyMsg(Msg *mp, char *cp, unsigned long cl)
+{
+    if (!nthreads)
+    {
+        mp->cp    = cp;
+        mp->cl    = cl;
+        mp->ready = 1;
+        return;
+    }
+
+    pthread_mutex_lock(&qlock);
+    mp->cp    = cp;
+    mp->cl    = cl;
+    mp->ready = 1;
+    pthread_cond_broadcast(&qcond);
+    pthread_mutex_unlock(&qlock);
+
+    /* driver queues are sent from the main thread, which looks at them anyway */
+    if (!pthread_equal(pthread_self(), mainthread))
+        wakeMain();
+}
+
+/* return whether Msg mp may be sent */
+static int isReadyMsg(Msg *mp)
+{
+    return (__atomic_load_n(&mp->ready, __ATOMIC_ACQUIRE));
+}
+
+/* guard client queues against writer threads, if any */
+static void lockQ(void)
+{
+    if (nthreads)
+        pthread_mutex_lock(&qlock);
+}
+
+/* release lockQ() */
+static void unlockQ(void)
+{
+    if (nthreads)
+        pthread_mutex_unlock(&qlock);
+}
+
 /* write the next chunk of the current message in the queue to the given
  * client. pop message from queue when complete and free the message if we are
  * the last one to use it. shut down this client if trouble.
@@ -1923,10 +2976,11 @@ static int sendClientMsg(ClInfo *cp)
      * to use it and pop from our queue.
      */
     cp->nsent += nw;
+    cp->stats.bytesout += nw;
     if (cp->nsent == mp->cl)
     {
-        if (--mp->count == 0)
-            freeMsg(mp);
+        cp->stats.msgsout++;
+        unrefMsg(mp);
         popFQ(cp->msgq);
         cp->nsent = 0;
     }
@@ -1980,10 +3034,11 @@ static int sendDriverMsg(DvrInfo *dp)
      * to use it and pop from our queue.
      */
     dp->nsent += nw;
+    dp->stats.bytesout += nw;
     if (dp->nsent == mp->cl)
     {
-        if (--mp->count == 0)
-            freeMsg(mp);
+        dp->stats.msgsout++;
+        unrefMsg(mp);
         popFQ(dp->msgq);
         dp->nsent = 0;
     }
@@ -1991,6 +3046,346 @@ static int sendDriverMsg(DvrInfo *dp)
     return (0);
 }
 
+/* start what is shared by the reader, serializer and writer threads, and the
+ * serializer threads themselves.
+ */
+static void startThreads(void)
+{
+    int i;
+
+    if (pipe(wakefd) < 0)
+    {
+        fprintf(stderr, "%s: pipe: %s\n", indi_tstamp(NULL), strerror(errno));
+        Bye();
+    }
+    fcntl(wakefd[0], F_SETFL, O_NONBLOCK);
+    fcntl(wakefd[1], F_SETFL, O_NONBLOCK);
+    mainthread = pthread_self();
+
+    inbox = newFQ(16);
+    jobs  = newFQ(16);
+
+    for (i = 0; i < nthreads; i++)
+    {
+        pthread_t thread;
+
+        if (pthread_create(&thread, NULL, serializer, NULL) != 0)
+        {
+            fprintf(stderr, "%s: no serializer thread: %s\n", indi_tstamp(NULL), strerror(errno));
+            Bye();
+        }
+        pthread_detach(thread);
+    }
+
+    if (verbose > 0)
+        fprintf(stderr, "%s: threaded with %d serializers\n", indi_tstamp(NULL), nthreads);
+}
+
+/* let the main thread know there is something for it to do */
+static void wakeMain(void)
+{
+    char c = 0;
+
+    /* a full pipe already will */
+    if (write(wakefd[1], &c, 1) < 0 && errno != EAGAIN)
+        fprintf(stderr, "wake: %s\n", strerror(errno));
+}
+
+/* reader thread of one driver: receive, parse and map shared BLOBs, then hand
+ * each message to the main thread in order. stop at EOF or error, the main
+ * thread then shuts the driver down.
+ */
+static void *driverReader(void *arg)
+{
+    DvrInput *in = (DvrInput *)arg;
+    unsigned long nr_pending = 0;
+    double parsing = 0;
+    char buf[MAXRBUF];
+    char ts[64];
+
+    while (1)
+    {
+        char err[1024];
+        XMLEle **nodes;
+        Parsed *pp;
+        ssize_t nr;
+        double t0;
+        int i, n;
+
+        nr = recvFromDriver(in, buf, sizeof(buf));
+        if (nr <= 0)
+        {
+            if (nr < 0)
+                fprintf(stderr, "%s: Driver %s: stdin %s\n", indi_tstamp(ts), in->name, strerror(errno));
+            else
+                fprintf(stderr, "%s: Driver %s: stdin EOF\n", indi_tstamp(ts), in->name);
+            break;
+        }
+        nr_pending += nr;
+
+        t0    = monoSecs();
+        nodes = parseXMLChunk(in->lp, buf, nr, err);
+        parsing += monoSecs() - t0;
+        if (!nodes)
+        {
+            if (!err[0])
+                continue;
+            fprintf(stderr, "%s: Driver %s: XML error: %s\n", indi_tstamp(ts), in->name, err);
+            fprintf(stderr, "%s: Driver %s: XML read: %.*s\n", ts, in->name, (int)nr, buf);
+            break;
+        }
+
+        for (n = 0; nodes[n]; n++)
+            ;
+        pthread_mutex_lock(&inlock);
+        for (i = 0; i < n; i++)
+        {
+            pp          = (Parsed *)calloc(1, sizeof(Parsed));
+            pp->dvi     = in->dvi;
+            pp->root    = nodes[i];
+            pp->nr      = i == 0 ? nr_pending : 0;
+            pp->parsing = parsing / n;
+            if (!strcmp(tagXMLEle(pp->root), "setBLOBVector"))
+                pp->nraws = mapSharedBLOBs(in, pp->root, &pp->raws);
+            pushFQ(inbox, pp);
+        }
+        pthread_mutex_unlock(&inlock);
+        free(nodes);
+
+        if (n > 0)
+        {
+            nr_pending = 0;
+            parsing    = 0;
+            wakeMain();
+        }
+    }
+
+    /* tell main we are done */
+    pthread_mutex_lock(&inlock);
+    {
+        Parsed *pp = (Parsed *)calloc(1, sizeof(Parsed));
+        pp->dvi    = in->dvi;
+        pp->nr     = nr_pending;
+        pushFQ(inbox, pp);
+    }
+    pthread_mutex_unlock(&inlock);
+    wakeMain();
+
+    return (NULL);
+}
+
+/* dispatch up to MAXINBOX messages the driver readers have parsed, in order.
+ * the rest wait for the next pass so clients and drivers keep being served
+ * while a fast driver floods us.
+ * a message with no root means its driver reader stopped.
+ */
+static int readInbox(void)
+{
+    DvrInfo *dp;
+    Parsed *pp;
+    int shutany = 0;
+    int n;
+
+    for (n = 0; n < MAXINBOX; n++)
+    {
+        pthread_mutex_lock(&inlock);
+        pp = (Parsed *)popFQ(inbox);
+        pthread_mutex_unlock(&inlock);
+        if (!pp)
+            break;
+
+        dp = &dvrinfo[pp->dvi];
+        dp->stats.bytesin += pp->nr;
+        if (!pp->root)
+        {
+            shutdownDvr(dp, 1);
+            shutany++;
+        }
+        else
+        {
+            dp->stats.msgsin++;
+            addLatency(&parselat[msgKind(tagXMLEle(pp->root))], pp->parsing);
+            if (dispatchDriverMsg(dp, pp->root, pp->raws, pp->nraws) < 0)
+                shutany++;
+        }
+        free(pp);
+    }
+
+    /* come back for the rest after a look around */
+    pthread_mutex_lock(&inlock);
+    inboxmore = nFQ(inbox) > 0;
+    pthread_mutex_unlock(&inlock);
+
+    return (shutany ? -1 : 0);
+}
+
+/* serializer thread: set the content of BLOB messages queued by the main
+ * thread, then let their writers go.
+ */
+static void *serializer(void *arg)
+{
+    (void)arg;
+
+    while (1)
+    {
+        SerJob *jp;
+
+        pthread_mutex_lock(&joblock);
+        while ((jp = (SerJob *)popFQ(jobs)) == NULL)
+            pthread_cond_wait(&jobcond, &joblock);
+        pthread_mutex_unlock(&joblock);
+
+        /* binary first, it reads the BLOB contents as received */
+        if (jp->mpbin)
+        {
+            setMsgBinXMLEle(jp->mpbin, jp->root, jp->raws, jp->nraws);
+            unrefMsg(jp->mpbin);
+        }
+        if (jp->mp)
+        {
+            encodeSharedBLOBs(jp->raws, jp->nraws);
+            setMsgXMLEle(jp->mp, jp->root);
+            unrefMsg(jp->mp);
+        }
+        unmapSharedBLOBs(jp->raws, jp->nraws);
+        delXMLEle(jp->root);
+        free(jp);
+    }
+
+    return (NULL);
+}
+
+/* have a serializer thread set the content of mp and mpbin from root.
+ * the job holds a reference so the Msgs outlive any client shut down meanwhile.
+ */
+static void queueSerJob(Msg *mp, Msg *mpbin, XMLEle *root, RawBLOB *raws, int nraws)
+{
+    SerJob *jp = (SerJob *)malloc(sizeof(SerJob));
+    unsigned long l = sprlXMLEle(root, 0);
+    int i;
+
+    /* estimate sizes so client queues can be measured meanwhile */
+    if (mp)
+        mp->cl = l;
+    if (mpbin)
+        mpbin->cl = l;
+    for (i = 0; i < nraws; i++)
+    {
+        if (mp)
+            mp->cl += 4 * raws[i].len / 3;
+        if (mpbin)
+            mpbin->cl += raws[i].len;
+    }
+
+    jp->mp    = mp;
+    jp->mpbin = mpbin;
+    jp->root  = root;
+    jp->raws  = raws;
+    jp->nraws = nraws;
+    if (mp)
+        refMsg(mp);
+    if (mpbin)
+        refMsg(mpbin);
+
+    pthread_mutex_lock(&joblock);
+    pushFQ(jobs, jp);
+    pthread_cond_signal(&jobcond);
+    pthread_mutex_unlock(&joblock);
+}
+
+/* start the writer thread of client clinfo[cli] */
+static void startClientWriter(int cli)
+{
+    if (pthread_create(&clinfo[cli].writer, NULL, clientWriter, (void *)(intptr_t)cli) != 0)
+    {
+        fprintf(stderr, "%s: Client %d: no writer thread: %s\n", indi_tstamp(NULL), clinfo[cli].s, strerror(errno));
+        Bye();
+    }
+}
+
+/* writer thread of one client: send each message of its queue in order once
+ * its content is ready, blocking in write(2) as long as the client needs.
+ * clinfo may move when it grows, so our entry is only looked up under qlock.
+ * on error note it and let the main thread shut the client down.
+ */
+static void *clientWriter(void *arg)
+{
+    int cli = (int)(intptr_t)arg;
+
+    pthread_mutex_lock(&qlock);
+    while (!clinfo[cli].quit)
+    {
+        ClInfo *cp = &clinfo[cli];
+        unsigned long nsent = 0;
+        Msg *mp;
+        int s;
+
+        mp = (Msg *)peekFQ(cp->msgq);
+        if (!mp || !mp->ready)
+        {
+            pthread_cond_wait(&qcond, &qlock);
+            continue;
+        }
+        cp->busy = 1;
+        s        = cp->s;
+        pthread_mutex_unlock(&qlock);
+
+        while (nsent < mp->cl)
+        {
+            ssize_t nw = write(s, mp->cp + nsent, mp->cl - nsent);
+            if (nw <= 0)
+                break;
+            nsent += nw;
+        }
+
+        pthread_mutex_lock(&qlock);
+        cp       = &clinfo[cli];
+        cp->busy = 0;
+        cp->stats.bytesout += nsent;
+        if (nsent < mp->cl)
+        {
+            cp->failed = errno ? errno : -1;
+            wakeMain();
+            break;
+        }
+        cp->stats.msgsout++;
+        popFQ(cp->msgq);
+        unrefMsg(mp);
+    }
+    pthread_mutex_unlock(&qlock);
+
+    return (NULL);
+}
+
+/* shut down each client whose writer could not send */
+static int reapClientWriters(void)
+{
+    int shutany = 0;
+    int i;
+
+    for (i = 0; i < nclinfo; i++)
+    {
+        ClInfo *cp = &clinfo[i];
+        int failed;
+
+        if (!cp->active)
+            continue;
+
+        lockQ();
+        failed = cp->failed;
+        unlockQ();
+        if (failed && !cp->quit)
+        {
+            fprintf(stderr, "%s: Client %d: write: %s\n", indi_tstamp(NULL), cp->s,
+                    failed > 0 ? strerror(failed) : "returned 0");
+            shutdownClient(cp);
+            shutany++;
+        }
+    }
+
+    return (shutany ? -1 : 0);
+}
+
 /* return 0 if cp may be interested in dev/name else -1
  */
 static int findClDevice(ClInfo *cp, const char *dev, const char *name)
@@ -2046,18 +3441,18 @@ static void addClDevice(ClInfo *cp, const char *dev, const char *name, int isblo
     pp->blob = B_NEVER;
 }
 
-/* block to accept a new client arriving on lsocket.
+/* block to accept a new client arriving on listen socket lfd.
  * return private nonblocking socket or exit.
  */
-static int newClSocket()
+static int newClSocket(int lfd)
 {
-    struct sockaddr_in cli_socket;
+    struct sockaddr_storage cli_socket;
     socklen_t cli_len;
     int cli_fd;
 
     /* get a private connection to new client */
     cli_len = sizeof(cli_socket);
-    cli_fd  = accept(lsocket, (struct sockaddr *)&cli_socket, &cli_len);
+    cli_fd  = accept(lfd, (struct sockaddr *)&cli_socket, &cli_len);
     if (cli_fd < 0)
     {
         fprintf(stderr, "accept: %s\n", strerror(errno));
@@ -2108,6 +3503,38 @@ static void crackBLOBHandling(const char *dev, const char *name, const char *ena
     }
 }
 
+/* note whether client cp asked for binary BLOBs in root. the attribute is
+ * removed since remote drivers must keep sending base64 to us.
+ */
+static void crackBinaryBLOBs(XMLEle *root, ClInfo *cp)
+{
+    XMLAtt *ap = findXMLAtt(root, "binary");
+
+    if (!ap)
+        return;
+
+    cp->binblobs = !strcmp(valuXMLAtt(ap), "true");
+    if (verbose > 0)
+        fprintf(stderr, "%s: Client %d: binary BLOBs %s\n", indi_tstamp(NULL), cp->s, cp->binblobs ? "on" : "off");
+    rmXMLAtt(root, "binary");
+}
+
+/* note whether client cp asked for coalescing in getProperties root.
+ * the attribute is removed before root is passed on to drivers.
+ */
+static void crackCoalesce(XMLEle *root, ClInfo *cp)
+{
+    XMLAtt *ap = findXMLAtt(root, "coalesce");
+
+    if (!ap)
+        return;
+
+    cp->coalesce = !strcmp(valuXMLAtt(ap), "true");
+    if (verbose > 0)
+        fprintf(stderr, "%s: Client %d: coalescing %s\n", indi_tstamp(NULL), cp->s, cp->coalesce ? "on" : "off");
+    rmXMLAtt(root, "coalesce");
+}
+
 /* print key attributes and values of the given xml to stderr.
  */
 static void traceMsg(XMLEle *root)
@@ -2149,14 +3576,14 @@ static void traceMsg(XMLEle *root)
 static char *indi_tstamp(char *s)
 {
     static char sbuf[64];
-    struct tm *tp;
+    struct tm tm;
     time_t t;
 
     time(&t);
-    tp = gmtime(&t);
+    gmtime_r(&t, &tm); /* reader threads stamp too */
     if (!s)
         s = sbuf;
-    strftime(s, sizeof(sbuf), "%Y-%m-%dT%H:%M:%S", tp);
+    strftime(s, sizeof(sbuf), "%Y-%m-%dT%H:%M:%S", &tm);
     return (s);
 }
 
@@ -2191,9 +3618,292 @@ static void logDMsg(XMLEle *root, const char *dev)
     fclose(fp);
 }
 
+/* return a monotonic time in seconds, for measuring durations */
+static double monoSecs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec + ts.tv_nsec * 1e-9);
+}
+
+/* return the kind of message with the given root tag */
+static MsgKind msgKind(const char *tag)
+{
+    if (!strncmp(tag, "def", 3))
+        return (MK_DEF);
+    if (!strcmp(tag, "setBLOBVector"))
+        return (MK_SETBLOB);
+    if (!strncmp(tag, "set", 3))
+        return (MK_SET);
+    if (!strncmp(tag, "new", 3))
+        return (MK_NEW);
+    if (!strncmp(tag, "del", 3))
+        return (MK_DEL);
+    if (!strcmp(tag, "message"))
+        return (MK_MESSAGE);
+    if (!strcmp(tag, "getProperties"))
+        return (MK_GETPROPS);
+    if (!strcmp(tag, "enableBLOB"))
+        return (MK_ENABLEBLOB);
+    return (MK_OTHER);
+}
+
+/* record a duration of secs in lp */
+static void addLatency(Latency *lp, double secs)
+{
+    double us = secs * 1e6;
+    int i;
+
+    for (i = 0; i < NLATBINS - 1 && us > (double)(1UL << i); i++)
+        ;
+    if (nthreads)
+        pthread_mutex_lock(&statlock);
+    lp->bins[i]++;
+    lp->sum += secs;
+    lp->n++;
+    if (nthreads)
+        pthread_mutex_unlock(&statlock);
+}
+
+/* print the histograms lats, one per message kind, as metric name */
+static void prLatencies(FILE *fp, const char *name, const char *help, Latency from[NMSGKINDS])
+{
+    Latency lats[NMSGKINDS];
+    int k, i;
+
+    /* the parsers and serializers keep adding, print a consistent copy */
+    if (nthreads)
+        pthread_mutex_lock(&statlock);
+    memcpy(lats, from, sizeof(lats));
+    if (nthreads)
+        pthread_mutex_unlock(&statlock);
+
+    fprintf(fp, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+    for (k = 0; k < NMSGKINDS; k++)
+    {
+        unsigned long n = 0;
+
+        for (i = 0; i < NLATBINS - 1; i++)
+        {
+            n += lats[k].bins[i];
+            fprintf(fp, "%s_bucket{type=\"%s\",le=\"%g\"} %lu\n", name, msgkinds[k], (1UL << i) * 1e-6, n);
+        }
+        fprintf(fp, "%s_bucket{type=\"%s\",le=\"+Inf\"} %lu\n", name, msgkinds[k], lats[k].n);
+        fprintf(fp, "%s_sum{type=\"%s\"} %.9f\n", name, msgkinds[k], lats[k].sum);
+        fprintf(fp, "%s_count{type=\"%s\"} %lu\n", name, msgkinds[k], lats[k].n);
+    }
+}
+
+/* print the traffic counters of every active client and driver to fp,
+ * in Prometheus text exposition format.
+ */
+static void prMetrics(FILE *fp)
+{
+    static const struct
+    {
+        const char *name, *type, *help;
+    } metrics[] = {
+        { "indiserver_bytes_in_total", "counter", "Bytes read from the connection." },
+        { "indiserver_bytes_out_total", "counter", "Bytes written to the connection." },
+        { "indiserver_messages_in_total", "counter", "Complete messages read from the connection." },
+        { "indiserver_messages_out_total", "counter", "Complete messages written to the connection." },
+        { "indiserver_queue_bytes", "gauge", "Bytes waiting to be written to the connection." },
+        { "indiserver_queue_messages", "gauge", "Messages waiting to be written to the connection." },
+        { "indiserver_blob_drops_total", "counter", "Stream BLOBs dropped because the client was behind." },
+        { "indiserver_coalesced_total", "counter", "Queued values replaced by newer ones." },
+    };
+    int m, i;
+
+    for (m = 0; m < (int)(sizeof(metrics) / sizeof(metrics[0])); m++)
+    {
+        fprintf(fp, "# HELP %s %s\n# TYPE %s %s\n", metrics[m].name, metrics[m].help, metrics[m].name,
+                metrics[m].type);
+
+        /* the client writers update their counters and queues under qlock */
+        lockQ();
+        for (i = 0; i < nclinfo; i++)
+        {
+            ClInfo *cp = &clinfo[i];
+
+            if (!cp->active)
+                continue;
+            unsigned long long v[] = { cp->stats.bytesin,          cp->stats.bytesout, cp->stats.msgsin,
+                                       cp->stats.msgsout,          0,                  nFQ(cp->msgq),
+                                       cp->stats.drops,            cp->stats.coalesced };
+            /* queue bytes walk the queue, only sum them when reported */
+            if (m == 4)
+                v[4] = msgQSize(cp->msgq);
+            fprintf(fp, "%s{client=\"%d\",peer=\"%s\"} %llu\n", metrics[m].name, cp->s, cp->peer, v[m]);
+        }
+        unlockQ();
+
+        /* drivers never drop or coalesce */
+        if (m > 5)
+            continue;
+
+        for (i = 0; i < ndvrinfo; i++)
+        {
+            DvrInfo *dp = &dvrinfo[i];
+
+            if (!dp->active)
+                continue;
+            unsigned long long v[] = { dp->stats.bytesin, dp->stats.bytesout, dp->stats.msgsin,
+                                       dp->stats.msgsout, 0,                  0 };
+            if (m == 4)
+                v[4] = msgQSize(dp->msgq);
+            if (m == 5)
+                v[5] = nFQ(dp->msgq);
+            fprintf(fp, "%s{driver=\"%s\"} %llu\n", metrics[m].name, dp->name, v[m]);
+        }
+    }
+
+    fprintf(fp, "# HELP indiserver_driver_restarts_total Times the driver was restarted.\n");
+    fprintf(fp, "# TYPE indiserver_driver_restarts_total counter\n");
+    for (i = 0; i < ndvrinfo; i++)
+        if (dvrinfo[i].active)
+            fprintf(fp, "indiserver_driver_restarts_total{driver=\"%s\"} %d\n", dvrinfo[i].name, dvrinfo[i].restarts);
+
+    fprintf(fp, "# HELP indiserver_client_shutdowns_total Clients shut down for any reason.\n");
+    fprintf(fp, "# TYPE indiserver_client_shutdowns_total counter\n");
+    fprintf(fp, "indiserver_client_shutdowns_total %lu\n", nclshutdowns);
+    fprintf(fp, "# HELP indiserver_client_behind_shutdowns_total Clients shut down for being more than maxqsiz behind.\n");
+    fprintf(fp, "# TYPE indiserver_client_behind_shutdowns_total counter\n");
+    fprintf(fp, "indiserver_client_behind_shutdowns_total %lu\n", nclbehind);
+    fprintf(fp, "# HELP indiserver_max_queue_bytes Queue bytes at which clients are shut down.\n");
+    fprintf(fp, "# TYPE indiserver_max_queue_bytes gauge\n");
+    fprintf(fp, "indiserver_max_queue_bytes %d\n", maxqsiz);
+
+    prLatencies(fp, "indiserver_parse_seconds", "Time to parse one message, by type.", parselat);
+    prLatencies(fp, "indiserver_serialize_seconds", "Time to serialize one message, by type.", serlat);
+}
+
+/* accept a metrics request. it is read and answered from indiRun() without
+ * blocking, so a slow or silent scraper does not hold up the server.
+ */
+static void newMetricsClient(void)
+{
+    MetricsCl *mp = NULL;
+    int i, s;
+
+    s = accept(msocket, NULL, NULL);
+    if (s < 0)
+    {
+        fprintf(stderr, "%s: metrics accept: %s\n", indi_tstamp(NULL), strerror(errno));
+        return;
+    }
+
+    if (fcntl(s, F_SETFL, fcntl(s, F_GETFL, 0) | O_NONBLOCK) < 0)
+    {
+        close(s);
+        return;
+    }
+
+    /* a free slot, else the oldest request gives way */
+    for (i = 0; i < MAXMETRICSCL; i++)
+    {
+        if (metricscl[i].s < 0)
+        {
+            mp = &metricscl[i];
+            break;
+        }
+        if (!mp || metricscl[i].t0 < mp->t0)
+            mp = &metricscl[i];
+    }
+    if (mp->s >= 0)
+    {
+        if (verbose > 0)
+            fprintf(stderr, "%s: metrics request on fd %d dropped\n", indi_tstamp(NULL), mp->s);
+        closeMetricsClient(mp);
+    }
+
+    memset(mp, 0, sizeof(*mp));
+    mp->s  = s;
+    mp->t0 = monoSecs();
+}
+
+/* read more of the metrics request at mp. the request itself is not
+ * examined, any path gets the same report once its headers are in.
+ */
+static void readMetricsClient(MetricsCl *mp)
+{
+    char *body = NULL;
+    size_t bl  = 0;
+    char hdr[128];
+    FILE *fp;
+    int hl;
+    ssize_t nr;
+
+    nr = read(mp->s, mp->req + mp->nreq, sizeof(mp->req) - 1 - mp->nreq);
+    if (nr < 0 && (errno == EAGAIN || errno == EINTR))
+        return;
+    if (nr < 0)
+    {
+        closeMetricsClient(mp);
+        return;
+    }
+    mp->nreq += nr;
+    mp->req[mp->nreq] = '\0';
+    if (nr > 0 && !strstr(mp->req, "\r\n\r\n") && !strstr(mp->req, "\n\n") &&
+            mp->nreq < (int)sizeof(mp->req) - 1)
+        return;
+
+    /* the whole response is made now and sent as the socket takes it */
+    fp = open_memstream(&body, &bl);
+    if (!fp)
+    {
+        closeMetricsClient(mp);
+        return;
+    }
+    prMetrics(fp);
+    fclose(fp);
+
+    hl = snprintf(hdr, sizeof(hdr),
+                  "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %lu\r\n\r\n",
+                  (unsigned long)bl);
+    mp->report = (char *)malloc(hl + bl);
+    if (!mp->report)
+    {
+        free(body);
+        closeMetricsClient(mp);
+        return;
+    }
+    memcpy(mp->report, hdr, hl);
+    memcpy(mp->report + hl, body, bl);
+    mp->len = hl + bl;
+    free(body);
+}
+
+/* send more of the metrics report at mp, close it when all is sent */
+static void sendMetricsClient(MetricsCl *mp)
+{
+    ssize_t nw = write(mp->s, mp->report + mp->nsent, mp->len - mp->nsent);
+
+    if (nw < 0 && (errno == EAGAIN || errno == EINTR))
+        return;
+    if (nw > 0)
+        mp->nsent += nw;
+    if (nw <= 0 || mp->nsent == mp->len)
+    {
+        shutdown(mp->s, SHUT_WR);
+        closeMetricsClient(mp);
+    }
+}
+
+/* release the metrics request at mp */
+static void closeMetricsClient(MetricsCl *mp)
+{
+    close(mp->s);
+    free(mp->report);
+    memset(mp, 0, sizeof(*mp));
+    mp->s = -1;
+}
+
 /* log when then exit */
 static void Bye()
 {
+    if (usocket >= 0)
+        unlink(upath);
     fprintf(stderr, "%s: good bye\n", indi_tstamp(NULL));
     exit(1);
 }
@@ -18,3 +18,106 @@
 
 #include "dsp.h"
 
+
+int dsp_type_from_bps(int bits_per_sample)
+{
+    switch (bits_per_sample) {
+    case 8:
+        return DSP_TYPE_UINT8;
+    case 16:
+        return DSP_TYPE_UINT16;
+    case 32:
+        return DSP_TYPE_UINT32;
+    case 64:
+        return DSP_TYPE_UINT64;
+    case -32:
+        return DSP_TYPE_FLOAT;
+    case -64:
+        return DSP_TYPE_DOUBLE;
+    default:
+        return -1;
+    }
+}
+
+size_t dsp_type_size(dsp_type type)
+{
+    switch (type) {
+    case DSP_TYPE_UINT8:
+        return sizeof(uint8_t);
+    case DSP_TYPE_UINT16:
+        return sizeof(uint16_t);
+    case DSP_TYPE_UINT32:
+        return sizeof(uint32_t);
+    case DSP_TYPE_UINT64:
+        return sizeof(uint64_t);
+    case DSP_TYPE_FLOAT:
+        return sizeof(float);
+    case DSP_TYPE_DOUBLE:
+        return sizeof(double);
+    case DSP_TYPE_INT16:
+        return sizeof(int16_t);
+    default:
+        return 0;
+    }
+}
+
+#define DSP_CONVERT_LOOP(Tin, Tout) \
+    for(int i = 0; i < len; i++) \
+        ((Tout*)out)[i] = (Tout)((const Tin*)in)[i];
+
+#define DSP_CONVERT_FROM(Tin) \
+    switch (outtype) { \
+    case DSP_TYPE_UINT8: \
+        DSP_CONVERT_LOOP(Tin, uint8_t); \
+        break; \
+    case DSP_TYPE_UINT16: \
+        DSP_CONVERT_LOOP(Tin, uint16_t); \
+        break; \
+    case DSP_TYPE_UINT32: \
+        DSP_CONVERT_LOOP(Tin, uint32_t); \
+        break; \
+    case DSP_TYPE_UINT64: \
+        DSP_CONVERT_LOOP(Tin, uint64_t); \
+        break; \
+    case DSP_TYPE_FLOAT: \
+        DSP_CONVERT_LOOP(Tin, float); \
+        break; \
+    case DSP_TYPE_DOUBLE: \
+        DSP_CONVERT_LOOP(Tin, double); \
+        break; \
+    case DSP_TYPE_INT16: \
+        DSP_CONVERT_LOOP(Tin, int16_t); \
+        break; \
+    }
+
+void dsp_buffer_convert(const void *in, dsp_type intype, void *out, dsp_type outtype, int len)
+{
+    if(intype == outtype) {
+        if(in != out)
+            memmove(out, in, dsp_type_size(intype) * len);
+        return;
+    }
+    switch (intype) {
+    case DSP_TYPE_UINT8:
+        DSP_CONVERT_FROM(uint8_t);
+        break;
+    case DSP_TYPE_UINT16:
+        DSP_CONVERT_FROM(uint16_t);
+        break;
+    case DSP_TYPE_UINT32:
+        DSP_CONVERT_FROM(uint32_t);
+        break;
+    case DSP_TYPE_UINT64:
+        DSP_CONVERT_FROM(uint64_t);
+        break;
+    case DSP_TYPE_FLOAT:
+        DSP_CONVERT_FROM(float);
+        break;
+    case DSP_TYPE_DOUBLE:
+        DSP_CONVERT_FROM(double);
+        break;
+    case DSP_TYPE_INT16:
+        DSP_CONVERT_FROM(int16_t);
+        break;
+    }
+}
@@ -18,16 +18,354 @@
 
 #include "dsp.h"
 
-void dsp_convolution_convolution(dsp_stream_p dst, dsp_stream_p src) {
-    double *out = calloc(sizeof(double), dst->len);
-    double mn, mx;
-    dsp_stats_minmidmax(dst, &mn, &mx);
-    for(int y = 0; y < src->len; y++) {
-        for(int x = 0; x < dst->len; x++) {
-            out[x] += dst->buf[x] * src->buf[y];
+/// Kernels up to this many elements are always convolved directly
+#define DSP_CONVOLUTION_DIRECT_MAX 32
+/// Output rows below which the direct kernels are not split across threads
+#define DSP_CONVOLUTION_MIN_ROWS 64
+
+typedef struct dsp_convolution_job_t
+{
+    const double *in;
+    double *out;
+    int dims;
+    int *sizes;
+    const double *kernel;
+    /// Kernel sizes, padded with 1 up to the stream dimensions
+    int *ksizes;
+    int klen;
+    int axis;
+} dsp_convolution_job;
+
+/// Fused multiply-add of a row, the loop the compiler vectorizes
+static void dsp_convolution_axpy(double * restrict out, const double * restrict in, double w, int len)
+{
+    int x = 0;
+    for(; x + 4 <= len; x += 4) {
+        out[x] += w * in[x];
+        out[x + 1] += w * in[x + 1];
+        out[x + 2] += w * in[x + 2];
+        out[x + 3] += w * in[x + 3];
+    }
+    for(; x < len; x++)
+        out[x] += w * in[x];
+}
+
+/// Accumulate a 1-D kernel over a contiguous row with zero padding, out[x] = sum k[i] * in[x + c - i]
+static void dsp_convolution_row(double *out, const double *in, int len, const double *kernel, int klen, int step)
+{
+    int c = klen / 2;
+    for(int i = 0; i < klen; i++) {
+        double w = kernel[i * step];
+        if(w == 0)
+            continue;
+        int off = c - i;
+        int start = Max(0, -off);
+        int end = Min(len, len - off);
+        if(end > start)
+            dsp_convolution_axpy(out + start, in + start + off, w, end - start);
+    }
+}
+
+static void dsp_convolution_direct_range(void *arg, int start, int end, int thread)
+{
+    (void)thread;
+    dsp_convolution_job *job = (dsp_convolution_job*)arg;
+    int n0 = job->sizes[0];
+    int k0 = job->ksizes[0];
+    int krows = job->klen / k0;
+    for(int row = start; row < end; row++) {
+        double *out = job->out + (size_t)row * n0;
+        memset(out, 0, sizeof(double) * n0);
+        for(int krow = 0; krow < krows; krow++) {
+            // Locate the input row matching this kernel row, skipping it when it falls in the zero padding
+            int src = 0, m = 1, r = row, kr = krow;
+            for(int d = 1; d < job->dims && src >= 0; d++) {
+                int p = r % job->sizes[d] + job->ksizes[d] / 2 - kr % job->ksizes[d];
+                r /= job->sizes[d];
+                kr /= job->ksizes[d];
+                if(p < 0 || p >= job->sizes[d])
+                    src = -1;
+                else
+                    src += p * m;
+                m *= job->sizes[d];
+            }
+            if(src >= 0)
+                dsp_convolution_row(out, job->in + (size_t)src * n0, n0, job->kernel + (size_t)krow * k0, k0, 1);
+        }
+    }
+}
+
+static void dsp_convolution_axis_range(void *arg, int start, int end, int thread)
+{
+    (void)thread;
+    dsp_convolution_job *job = (dsp_convolution_job*)arg;
+    if(job->axis == 0) {
+        int n0 = job->sizes[0];
+        for(int row = start; row < end; row++) {
+            double *out = job->out + (size_t)row * n0;
+            memset(out, 0, sizeof(double) * n0);
+            dsp_convolution_row(out, job->in + (size_t)row * n0, n0, job->kernel, job->klen, 1);
+        }
+        return;
+    }
+    // Along the other axes each tap moves a whole span of the lower dimensions, which are contiguous
+    int span = 1;
+    for(int d = 0; d < job->axis; d++)
+        span *= job->sizes[d];
+    int n = job->sizes[job->axis];
+    int c = job->klen / 2;
+    for(int line = start; line < end; line++) {
+        int p = line % n;
+        const double *in = job->in + (size_t)(line - p) * span;
+        double *out = job->out + (size_t)line * span;
+        memset(out, 0, sizeof(double) * span);
+        for(int i = 0; i < job->klen; i++) {
+            int q = p + c - i;
+            if(q >= 0 && q < n && job->kernel[i] != 0)
+                dsp_convolution_axpy(out, in + (size_t)q * span, job->kernel[i], span);
+        }
+    }
+}
+
+static int* dsp_convolution_kernel_sizes(dsp_stream_p stream, dsp_stream_p matrix)
+{
+    if(matrix->dims > stream->dims || stream->dims == 0)
+        return NULL;
+    int *ksizes = (int*)malloc(sizeof(int) * stream->dims);
+    for(int d = 0; d < stream->dims; d++)
+        ksizes[d] = (d < matrix->dims ? matrix->sizes[d] : 1);
+    return ksizes;
+}
+
+void dsp_convolution_direct(dsp_stream_p stream, dsp_stream_p matrix)
+{
+    int *ksizes = dsp_convolution_kernel_sizes(stream, matrix);
+    if(ksizes == NULL)
+        return;
+    double *out = (double*)malloc(sizeof(double) * stream->len);
+    dsp_convolution_job job = { 0 };
+    job.in = stream->buf;
+    job.out = out;
+    job.dims = stream->dims;
+    job.sizes = stream->sizes;
+    job.kernel = matrix->buf;
+    job.ksizes = ksizes;
+    job.klen = matrix->len;
+    int rows = stream->len / stream->sizes[0];
+    dsp_parallel_for(rows, dsp_parallel_threads(rows, DSP_CONVOLUTION_MIN_ROWS), dsp_convolution_direct_range, &job);
+    free(ksizes);
+    dsp_stream_free_buffer(stream);
+    dsp_stream_set_buffer(stream, out, stream->len);
+}
+
+void dsp_convolution_separable(dsp_stream_p stream, double *kernel, int len)
+{
+    if(stream->dims == 0 || len <= 0)
+        return;
+    double *buf = stream->buf;
+    double *tmp = (double*)malloc(sizeof(double) * stream->len);
+    dsp_convolution_job job = { 0 };
+    job.dims = stream->dims;
+    job.sizes = stream->sizes;
+    job.kernel = kernel;
+    job.klen = len;
+    for(int axis = 0; axis < stream->dims; axis++) {
+        job.in = stream->buf;
+        job.out = tmp;
+        job.axis = axis;
+        int lines = stream->len;
+        if(axis == 0)
+            lines /= stream->sizes[0];
+        else
+            for(int d = 0; d < axis; d++)
+                lines /= stream->sizes[d];
+        dsp_parallel_for(lines, dsp_parallel_threads(lines, DSP_CONVOLUTION_MIN_ROWS), dsp_convolution_axis_range, &job);
+        // Ping-pong between the stream buffer and the scratch buffer
+        double *swap = stream->buf;
+        stream->buf = tmp;
+        tmp = swap;
+    }
+    // Hand the result back in the original buffer
+    if(stream->buf != buf) {
+        memcpy(buf, stream->buf, sizeof(double) * stream->len);
+        tmp = stream->buf;
+        stream->buf = buf;
+    }
+    free(tmp);
+}
+
+void dsp_convolution_gaussian(dsp_stream_p stream, double sigma)
+{
+    if(sigma <= 0)
+        return;
+    int radius = (int)ceil(sigma * 3.0);
+    int len = radius * 2 + 1;
+    double *kernel = (double*)malloc(sizeof(double) * len);
+    double sum = 0;
+    for(int i = 0; i < len; i++) {
+        double x = i - radius;
+        kernel[i] = exp(-x * x / (2.0 * sigma * sigma));
+        sum += kernel[i];
+    }
+    for(int i = 0; i < len; i++)
+        kernel[i] /= sum;
+    dsp_convolution_separable(stream, kernel, len);
+    free(kernel);
+}
+
+void dsp_convolution_box(dsp_stream_p stream, int size)
+{
+    if(size <= 0)
+        return;
+    double *kernel = (double*)malloc(sizeof(double) * size);
+    for(int i = 0; i < size; i++)
+        kernel[i] = 1.0 / size;
+    dsp_convolution_separable(stream, kernel, size);
+    free(kernel);
+}
+
+/// Smallest length not below n whose only prime factors are 2, 3, 5 and 7, the sizes FFTW transforms fastest
+static int dsp_convolution_fft_size(int n)
+{
+    for(int m = Max(n, 1); ; m++) {
+        int r = m;
+        while(r % 2 == 0) r /= 2;
+        while(r % 3 == 0) r /= 3;
+        while(r % 5 == 0) r /= 5;
+        while(r % 7 == 0) r /= 7;
+        if(r == 1)
+            return m;
+    }
+}
+
+static void dsp_convolution_multiply(dsp_complex *a, const dsp_complex *b, int len)
+{
+    for(int i = 0; i < len; i++) {
+        double re = a[i].real * b[i].real - a[i].imaginary * b[i].imaginary;
+        a[i].imaginary = a[i].real * b[i].imaginary + a[i].imaginary * b[i].real;
+        a[i].real = re;
+    }
+}
+
+/// Copy src, of sizes ssizes, into the zero filled dst, of sizes dsizes, both with the same dimensions count
+static void dsp_convolution_pad(double *dst, int *dsizes, const double *src, int *ssizes, int dims)
+{
+    int rows = 1, drows = 1;
+    for(int d = 1; d < dims; d++) {
+        rows *= ssizes[d];
+        drows *= dsizes[d];
+    }
+    memset(dst, 0, sizeof(double) * drows * dsizes[0]);
+    for(int row = 0; row < rows; row++) {
+        int index = 0, m = 1, r = row;
+        for(int d = 1; d < dims; d++) {
+            index += (r % ssizes[d]) * m;
+            r /= ssizes[d];
+            m *= dsizes[d];
         }
+        memcpy(dst + (size_t)index * dsizes[0], src + (size_t)row * ssizes[0], sizeof(double) * ssizes[0]);
     }
-    dsp_stream_free_buffer(dst);
-    dsp_stream_set_buffer(dst, out, dst->len);
-    dsp_buffer_stretch(dst, mn, mx);
+}
+
+/// Overlap-add convolution of a long monodimensional stream, one cached transform size for every block
+static void dsp_convolution_overlap_add(dsp_stream_p stream, dsp_stream_p matrix, double *out)
+{
+    int n = stream->len;
+    int k = matrix->len;
+    int fftlen = dsp_convolution_fft_size(Max(k * 8, 4096));
+    int block = fftlen - k + 1;
+    int clen = dsp_fft_complex_len(1, &fftlen);
+    double *buf = (double*)malloc(sizeof(double) * fftlen);
+    double *full = (double*)calloc(sizeof(double), n + k - 1);
+    dsp_complex *kf = (dsp_complex*)malloc(sizeof(dsp_complex) * clen);
+    dsp_complex *bf = (dsp_complex*)malloc(sizeof(dsp_complex) * clen);
+    memset(buf, 0, sizeof(double) * fftlen);
+    memcpy(buf, matrix->buf, sizeof(double) * k);
+    dsp_fft_rdft_buffer(buf, 1, &fftlen, kf);
+    for(int start = 0; start < n; start += block) {
+        int len = Min(block, n - start);
+        memset(buf, 0, sizeof(double) * fftlen);
+        memcpy(buf, stream->buf + start, sizeof(double) * len);
+        dsp_fft_rdft_buffer(buf, 1, &fftlen, bf);
+        dsp_convolution_multiply(bf, kf, clen);
+        dsp_fft_irdft_buffer(bf, 1, &fftlen, buf);
+        dsp_convolution_axpy(full + start, buf, 1.0, Min(len + k - 1, n + k - 1 - start));
+    }
+    memcpy(out, full + k / 2, sizeof(double) * n);
+    free(bf);
+    free(kf);
+    free(full);
+    free(buf);
+}
+
+void dsp_convolution_fft(dsp_stream_p stream, dsp_stream_p matrix)
+{
+    int *ksizes = dsp_convolution_kernel_sizes(stream, matrix);
+    if(ksizes == NULL)
+        return;
+    int dims = stream->dims;
+    double *out = (double*)malloc(sizeof(double) * stream->len);
+    if(dims == 1 && stream->len > dsp_convolution_fft_size(Max(matrix->len * 8, 4096)) * 2) {
+        dsp_convolution_overlap_add(stream, matrix, out);
+    } else {
+        // Pad both operands to the linear convolution size, so the circular product does not wrap around
+        int *psizes = (int*)malloc(sizeof(int) * dims);
+        int plen = 1;
+        for(int d = 0; d < dims; d++) {
+            psizes[d] = dsp_convolution_fft_size(stream->sizes[d] + ksizes[d] - 1);
+            plen *= psizes[d];
+        }
+        int clen = dsp_fft_complex_len(dims, psizes);
+        double *buf = (double*)malloc(sizeof(double) * plen);
+        dsp_complex *sf = (dsp_complex*)malloc(sizeof(dsp_complex) * clen);
+        dsp_complex *kf = (dsp_complex*)malloc(sizeof(dsp_complex) * clen);
+        dsp_convolution_pad(buf, psizes, matrix->buf, ksizes, dims);
+        dsp_fft_rdft_buffer(buf, dims, psizes, kf);
+        dsp_convolution_pad(buf, psizes, stream->buf, stream->sizes, dims);
+        dsp_fft_rdft_buffer(buf, dims, psizes, sf);
+        dsp_convolution_multiply(sf, kf, clen);
+        dsp_fft_irdft_buffer(sf, dims, psizes, buf);
+        // Crop the centered "same" region
+        int rows = stream->len / stream->sizes[0];
+        for(int row = 0; row < rows; row++) {
+            int index = ksizes[0] / 2, m = psizes[0], r = row;
+            for(int d = 1; d < dims; d++) {
+                index += (r % stream->sizes[d] + ksizes[d] / 2) * m;
+                r /= stream->sizes[d];
+                m *= psizes[d];
+            }
+            memcpy(out + (size_t)row * stream->sizes[0], buf + index, sizeof(double) * stream->sizes[0]);
+        }
+        free(kf);
+        free(sf);
+        free(buf);
+        free(psizes);
+    }
+    free(ksizes);
+    dsp_stream_free_buffer(stream);
+    dsp_stream_set_buffer(stream, out, stream->len);
+}
+
+void dsp_convolution_convolve(dsp_stream_p stream, dsp_stream_p matrix)
+{
+    if(matrix->dims > stream->dims || stream->dims == 0)
+        return;
+    // Direct cost is len * klen multiply-adds, the transform roughly a few padded len * log2 passes
+    double direct = (double)stream->len * matrix->len;
+    double padded = 1;
+    for(int d = 0; d < stream->dims; d++)
+        padded *= stream->sizes[d] + (d < matrix->dims ? matrix->sizes[d] : 1) - 1;
+    double transform = 6.0 * padded * log2(Max(padded, 2.0));
+    if(matrix->len <= DSP_CONVOLUTION_DIRECT_MAX || direct <= transform)
+        dsp_convolution_direct(stream, matrix);
+    else
+        dsp_convolution_fft(stream, matrix);
+}
+
+void dsp_convolution_convolution(dsp_stream_p stream, dsp_stream_p matrix)
+{
+    double mn, mx;
+    dsp_stats_minmidmax(stream, &mn, &mx);
+    dsp_convolution_convolve(stream, matrix);
+    dsp_buffer_stretch(stream, mn, mx);
 }
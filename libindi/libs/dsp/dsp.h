@@ -32,6 +32,7 @@ extern "C" {
 #include <time.h>
 #include <assert.h>
 #include <pthread.h>
+#include <stdint.h>
 
 #ifndef Min
 #define Min(a,b) \
@@ -116,6 +117,35 @@ typedef struct dsp_star_t
 */
 typedef void *(*dsp_func_t) (void *);
 
+/**
+* \brief Range processing delegate function, called by dsp_parallel_for on each partition
+*/
+typedef void (*dsp_range_func_t) (void *arg, int start, int end, int thread);
+
+/**
+* \brief Element types of the native buffers accepted by the typed kernels
+* \sa dsp_type_from_bps
+*/
+typedef enum dsp_type_t
+{
+/// unsigned char elements
+    DSP_TYPE_UINT8 = 0,
+/// unsigned short elements
+    DSP_TYPE_UINT16,
+/// unsigned int elements
+    DSP_TYPE_UINT32,
+/// 64 bit unsigned elements
+    DSP_TYPE_UINT64,
+/// float elements
+    DSP_TYPE_FLOAT,
+/// double elements
+    DSP_TYPE_DOUBLE,
+/// signed short elements
+    DSP_TYPE_INT16,
+} dsp_type;
+
+struct dsp_stream_pool_t;
+
 /**
 * \brief Contains a set of informations and data relative to a buffer and how to use it
 * \sa dsp_stream_new
@@ -153,8 +183,82 @@ typedef struct dsp_stream_t
     dsp_region *ROI;
 /// Stars or objects identified into the buffers - TODO
     dsp_star *stars;
+/// Element type of data
+    dsp_type type;
+/// Native buffer, the same as buf on double streams
+    void *data;
+/// Non zero when data belongs to the caller
+    int view;
+/// Pool the stream returns to when freed
+    struct dsp_stream_pool_t *pool;
 } dsp_stream, *dsp_stream_p;
 
+/**
+* \brief A set of reusable streams of the same element type and sizes
+* \sa dsp_stream_pool_new
+* \sa dsp_stream_pool_get
+*/
+typedef struct dsp_stream_pool_t dsp_stream_pool, *dsp_stream_pool_p;
+
+/*@}*/
+/**
+ * \defgroup DSP_Threads DSP API Multithreading functions
+*/
+/*@{*/
+
+/**
+* \brief Set the maximum number of threads used by the DSP kernels
+* \param threads the thread count, 0 to use the number of online processors.
+*/
+extern void dsp_set_max_threads(int threads);
+
+/**
+* \brief Get the maximum number of threads used by the DSP kernels
+* \return the thread count.
+*/
+extern int dsp_get_max_threads();
+
+/**
+* \brief Get the number of threads dsp_parallel_for should use on a range
+* \param len the length of the range.
+* \param min_chunk the minimum number of elements worth a thread.
+* \return the thread count, at least 1.
+*/
+extern int dsp_parallel_threads(int len, int min_chunk);
+
+/**
+* \brief Split a range in contiguous partitions and process each one on its own thread
+* \param len the length of the range.
+* \param threads the number of partitions, obtained by dsp_parallel_threads.
+* \param func the delegate called once per partition, with the partition index as thread.
+* \param arg the argument passed to the delegate.
+*/
+extern void dsp_parallel_for(int len, int threads, dsp_range_func_t func, void *arg);
+
+/**
+* \brief Get the element type matching a bits per sample value
+* \param bits_per_sample one of 8,16,32,64 for unsigned types, -32,-64 for floating single and double types
+* \return the element type, or -1 if the value is not supported.
+*/
+extern int dsp_type_from_bps(int bits_per_sample);
+
+/**
+* \brief Get the size in bytes of an element type
+* \param type the element type.
+* \return the size of a single element.
+*/
+extern size_t dsp_type_size(dsp_type type);
+
+/**
+* \brief Convert a buffer between element types
+* \param in the input buffer.
+* \param intype the element type of the input buffer.
+* \param out the output buffer, can be the input buffer when the element sizes match.
+* \param outtype the element type of the output buffer.
+* \param len the number of elements.
+*/
+extern void dsp_buffer_convert(const void *in, dsp_type intype, void *out, dsp_type outtype, int len);
+
 /*@}*/
 /**
  * \defgroup DSP_FourierTransform DSP API Fourier transform related functions
@@ -164,11 +268,71 @@ typedef struct dsp_stream_t
 /**
 * \brief Discrete Fourier Transform of a dsp_stream
 * \param stream the input stream.
-* \return the output stream if successfull elaboration. NULL if an
+* \return the full spectrum, stream->len coefficients, if successfull elaboration. NULL if an
 * error is encountered.
 */
 extern dsp_complex* dsp_fft_dft(dsp_stream_p stream);
 
+/**
+* \brief Magnitudes of the Discrete Fourier Transform of a dsp_stream
+* \param stream the input stream.
+* \param out the buffer receiving stream->len magnitudes, can be the stream buffer itself.
+* \return 0 if successfull elaboration, -1 if an error is encountered.
+*/
+extern int dsp_fft_magnitude(dsp_stream_p stream, double* out);
+
+/**
+* \brief Number of coefficients of a real to complex transform
+* \param dims the number of dimensions.
+* \param sizes the sizes of each dimension, the first being the fastest varying.
+* \return the coefficients count, the first dimension holds sizes[0] / 2 + 1 of them.
+*/
+extern int dsp_fft_complex_len(int dims, int* sizes);
+
+/**
+* \brief Real to complex Discrete Fourier Transform of a buffer
+* \param in the real input buffer.
+* \param dims the number of dimensions.
+* \param sizes the sizes of each dimension, the first being the fastest varying.
+* \param out the buffer receiving dsp_fft_complex_len() coefficients.
+* \return 0 if successfull elaboration, -1 if an error is encountered.
+*/
+extern int dsp_fft_rdft_buffer(const double* in, int dims, int* sizes, dsp_complex* out);
+
+/**
+* \brief Normalized complex to real inverse Discrete Fourier Transform of a buffer
+* \param in the dsp_fft_complex_len() input coefficients.
+* \param dims the number of dimensions.
+* \param sizes the sizes of each dimension, the first being the fastest varying.
+* \param out the real output buffer.
+* \return 0 if successfull elaboration, -1 if an error is encountered.
+*/
+extern int dsp_fft_irdft_buffer(const dsp_complex* in, int dims, int* sizes, double* out);
+
+/**
+* \brief Select how new Fourier transform plans are made, plans are cached by type and sizes
+* \param measure 0 to estimate plans quickly, 1 to measure the fastest plan at the first transform.
+*/
+extern void dsp_fft_set_planning(int measure);
+
+/**
+* \brief Set the number of threads used by new Fourier transform plans
+* \param threads the thread count, ignored if FFTW has been built without threads support.
+*/
+extern void dsp_fft_set_threads(int threads);
+
+/**
+* \brief Load FFTW wisdom from a file, and store it there each time a measured plan is made
+* \param filename the wisdom file, NULL to stop storing wisdom.
+* \return 1 if the wisdom has been loaded or the file does not exist yet, 0 otherwise.
+*/
+extern int dsp_fft_set_wisdom_file(const char* filename);
+
+/**
+* \brief Destroy all cached Fourier transform plans and their buffers
+*/
+extern void dsp_fft_cleanup();
+
 /**
 * \brief Calculate a complex number's magnitude
 * \param n the input complex.
@@ -252,12 +416,93 @@ extern void dsp_filter_bandreject(dsp_stream_p stream, double samplingfrequency,
 */
 /*@{*/
 /**
-* \brief A cross-convolution processor
+* \brief A cross-convolution processor, the result is stretched to the range of the input stream
 * \param stream1 the first input stream.
 * \param stream2 the second input stream.
+* \sa dsp_convolution_convolve
 */
 extern void dsp_convolution_convolution(dsp_stream_p stream1, dsp_stream_p stream2);
 
+/**
+* \brief Convolve a stream with a centered kernel, picking the direct or the FFT method by cost
+* \param stream the stream to convolve, its buffer receives the result of the same sizes.
+* \param matrix the kernel, with at most as many dimensions as the stream.
+*/
+extern void dsp_convolution_convolve(dsp_stream_p stream, dsp_stream_p matrix);
+
+/**
+* \brief Convolve a stream with a centered kernel by direct summation, suited to small kernels
+* \param stream the stream to convolve, its buffer receives the result of the same sizes.
+* \param matrix the kernel, with at most as many dimensions as the stream.
+*/
+extern void dsp_convolution_direct(dsp_stream_p stream, dsp_stream_p matrix);
+
+/**
+* \brief Convolve a stream with a centered kernel through the Fourier transform, suited to large kernels.
+* Long monodimensional streams are processed in blocks by overlap-add.
+* \param stream the stream to convolve, its buffer receives the result of the same sizes.
+* \param matrix the kernel, with at most as many dimensions as the stream.
+*/
+extern void dsp_convolution_fft(dsp_stream_p stream, dsp_stream_p matrix);
+
+/**
+* \brief Convolve a stream with the same monodimensional kernel along each of its dimensions
+* \param stream the stream to convolve.
+* \param kernel the centered monodimensional kernel.
+* \param len the length of the kernel.
+*/
+extern void dsp_convolution_separable(dsp_stream_p stream, double* kernel, int len);
+
+/**
+* \brief Gaussian blur of a stream, as a separable convolution
+* \param stream the stream to blur.
+* \param sigma the standard deviation of the gaussian, in samples.
+*/
+extern void dsp_convolution_gaussian(dsp_stream_p stream, double sigma);
+
+/**
+* \brief Box (moving average) blur of a stream, as a separable convolution
+* \param stream the stream to blur.
+* \param size the width of the box, in samples.
+*/
+extern void dsp_convolution_box(dsp_stream_p stream, int size);
+
+/*@}*/
+/**
+ * \defgroup DSP_Rank DSP API Rank filtering functions
+*/
+/*@{*/
+
+/**
+* \brief Replace each element with the element of the given rank within the window centered on it.
+* Monodimensional streams use a sliding window, the others a square window on the first two
+* dimensions, each further dimension being filtered as a stack of planes. The window is clipped
+* at the borders. Views are filtered in place in their element type.
+* \param stream the stream on which execute
+* \param size the side length of the window.
+* \param rank the rank as a fraction of the window, 0 for the minimum, 0.5 for the median, 1 for the maximum.
+*/
+extern void dsp_rank_filter(dsp_stream_p stream, int size, double rank);
+
+/**
+* \brief Median filter, see dsp_rank_filter
+* \param stream the stream on which execute
+* \param size the side length of the window.
+*/
+extern void dsp_rank_median(dsp_stream_p stream, int size);
+
+/**
+* \brief Rank filter of a native buffer, see dsp_rank_filter
+* \param in the input buffer.
+* \param out the output buffer, of the same type, can be the input buffer.
+* \param dims the number of dimensions.
+* \param sizes the sizes of each dimension, the first being the fastest varying.
+* \param type the element type of both buffers.
+* \param size the side length of the window.
+* \param rank the rank as a fraction of the window, 0 for the minimum, 0.5 for the median, 1 for the maximum.
+*/
+extern void dsp_rank_filter_buffer(const void *in, void *out, int dims, int *sizes, dsp_type type, int size, double rank);
+
 /*@}*/
 /**
  * \defgroup DSP_Stats DSP API Buffer statistics functions
@@ -280,6 +525,13 @@ extern double dsp_stats_minmidmax(dsp_stream_p stream, double* min, double* max)
 */
 extern double dsp_stats_mean(dsp_stream_p stream);
 
+/**
+* \brief A variance calculator
+* \param stream the stream on which execute
+* \return the population variance of the stream.
+*/
+extern double dsp_stats_variance(dsp_stream_p stream);
+
 /**
 * \brief Counts value occurrences into stream
 * \param stream the stream on which execute
@@ -291,12 +543,43 @@ extern int dsp_stats_val_count(dsp_stream_p stream, double val);
 /**
 * \brief Histogram of the inut stream
 * \param stream the stream on which execute
-* \param size the length of the median.
-* \return the output stream if successfull elaboration. NULL if an
+* \param size the number of bins, each value v is counted into bin v, values are clamped to 0.
+* \return the histogram stretched to [0, size] if successfull elaboration. NULL if an
 * error is encountered.
 */
 extern double* dsp_stats_histogram(dsp_stream_p stream, int size);
 
+/**
+* \brief Gets minimum and maximum values of a native buffer in a single pass
+* \param buf the input buffer.
+* \param len the number of elements of the buffer.
+* \param type the element type of the buffer.
+* \param min the minimum value.
+* \param max the maximum value.
+*/
+extern void dsp_stats_minmax_buffer(const void *buf, int len, dsp_type type, double* min, double* max);
+
+/**
+* \brief Mean and population variance of a native buffer in a single pass
+* \param buf the input buffer.
+* \param len the number of elements of the buffer.
+* \param type the element type of the buffer.
+* \param mean the mean value, can be NULL.
+* \return the population variance of the buffer.
+*/
+extern double dsp_stats_variance_buffer(const void *buf, int len, dsp_type type, double* mean);
+
+/**
+* \brief Histogram of a native buffer in a single pass
+* \param buf the input buffer.
+* \param len the number of elements of the buffer.
+* \param type the element type of the buffer.
+* \param size the number of bins, each value v is counted into bin v, values are clamped to 0.
+* \return the histogram stretched to [0, size] if successfull elaboration. NULL if an
+* error is encountered.
+*/
+extern double* dsp_stats_histogram_buffer(const void *buf, int len, dsp_type type, int size);
+
 /**
 * \brief Sum each buffer's element with its previous in a fibonacci style
 * \param stream the stream on which execute
@@ -438,10 +721,11 @@ extern void dsp_buffer_mul1(dsp_stream_p stream, double val);
 extern void dsp_buffer_pow1(dsp_stream_p stream, double val);
 
 /**
-* \brief Median elements of the inut stream
+* \brief Median elements of the inut stream, the buffer is filtered as a monodimensional one
 * \param stream the stream on which execute
-* \param size the length of the median.
-* \param median the location of the median value.
+* \param size the length of the median, the window is centered on each element.
+* \param median unused, the middle element of the window is always taken.
+* \sa dsp_rank_filter
 */
 extern void dsp_buffer_median(dsp_stream_p stream, int size, int median);
 
@@ -516,18 +800,27 @@ extern void dsp_stream_alloc_buffer(dsp_stream_p stream, int len);
 /**
 * \brief Set the buffer of the stream passed as argument to a specific memory location
 * \param stream the target DSP stream.
-* \param buffer the new location of the buffer.
+* \param buffer the new location of the buffer, owned by the stream from now on.
 * \param len the new length of the buffer.
+* \sa dsp_stream_new_view
 */
 extern void dsp_stream_set_buffer(dsp_stream_p stream, void *buffer, int len);
 
 /**
 * \brief Return the buffer of the stream passed as argument
 * \param stream the target DSP stream.
-* \return the buffer
+* \return the buffer, converted from the native data on the first call on views of other types
 */
 extern double* dsp_stream_get_buffer(dsp_stream_p stream);
 
+/**
+* \brief Return the data of the stream passed as argument in its element type
+* \param stream the target DSP stream.
+* \param type filled with the element type of the returned data.
+* \return buf when the stream has a double buffer, the native data otherwise
+*/
+extern void* dsp_stream_get_data(dsp_stream_p stream, dsp_type *type);
+
 /**
 * \brief Free the buffer of the DSP Stream passed as argument
 * \param stream the target DSP stream.
@@ -548,6 +841,46 @@ extern dsp_stream_p dsp_stream_new();
 */
 extern void dsp_stream_free(dsp_stream_p stream);
 
+/**
+* \brief Create a DSP stream over a caller buffer without copying it
+* Typed kernels (statistics, rank filters, Fourier transforms) run on the native elements,
+* the other functions read buf, which dsp_stream_get_buffer converts once on demand.
+* Double views use the caller buffer as buf directly.
+* \param data the caller buffer, it must outlive the stream and it is never freed by it.
+* \param type the element type of data.
+* \param dims the number of dimensions.
+* \param sizes the sizes of each dimension.
+* \return the newly created DSP stream
+* \sa dsp_stream_free
+*/
+extern dsp_stream_p dsp_stream_new_view(void *data, dsp_type type, int dims, int *sizes);
+
+/**
+* \brief Create a pool of reusable DSP streams
+* \param capacity the maximum number of idle streams kept by the pool.
+* \return the newly created pool
+* \sa dsp_stream_pool_get
+* \sa dsp_stream_pool_free
+*/
+extern dsp_stream_pool_p dsp_stream_pool_new(int capacity);
+
+/**
+* \brief Get a stream with a native buffer from the pool, reusing an idle one of the same type and sizes
+* dsp_stream_free returns the stream to the pool. The content of a reused buffer is undefined.
+* \param pool the stream pool.
+* \param type the element type of the buffer.
+* \param dims the number of dimensions.
+* \param sizes the sizes of each dimension.
+* \return the stream
+*/
+extern dsp_stream_p dsp_stream_pool_get(dsp_stream_pool_p pool, dsp_type type, int dims, int *sizes);
+
+/**
+* \brief Free a stream pool and its idle streams, streams obtained from it must be freed before
+* \param pool the stream pool.
+*/
+extern void dsp_stream_pool_free(dsp_stream_pool_p pool);
+
 /**
 * \brief Create a copy of the DSP stream passed as argument
 * \return the copy of the DSP stream
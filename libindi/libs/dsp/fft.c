@@ -19,6 +19,9 @@
 #include "dsp.h"
 #include "fftw3.h"
 
+/// Maximum number of plans kept alive by the plan cache
+#define DSP_FFT_CACHE_SIZE 16
+
 double dsp_fft_complex_to_magnitude(dsp_complex n)
 {
     return sqrt (n.real * n.real + n.imaginary * n.imaginary);
@@ -53,17 +56,313 @@ double* dsp_fft_complex_array_to_phase(dsp_complex* in, int len)
     return out;
 }
 
+typedef enum dsp_fft_kind_t
+{
+    DSP_FFT_R2C = 0,
+    DSP_FFT_C2R,
+} dsp_fft_kind;
+
+/**
+* \brief A cached FFTW plan together with the aligned buffers it has been planned on
+*/
+typedef struct dsp_fft_plan_t
+{
+    dsp_fft_kind kind;
+    int dims;
+    int* sizes;
+    /// Real samples count
+    int len;
+    /// Half-complex coefficients count, the fastest dimension holds sizes[0] / 2 + 1 of them
+    int clen;
+    double* real;
+    fftw_complex* complex;
+    fftw_plan plan;
+    unsigned long last_used;
+    pthread_mutex_t lock;
+} dsp_fft_plan;
+
+static dsp_fft_plan* dsp_fft_cache[DSP_FFT_CACHE_SIZE];
+static unsigned long dsp_fft_cache_clock = 0;
+static pthread_mutex_t dsp_fft_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned dsp_fft_flags = FFTW_ESTIMATE;
+static char* dsp_fft_wisdom = NULL;
+static int dsp_fft_threads = 1;
+
+static void dsp_fft_plan_free(dsp_fft_plan* p)
+{
+    fftw_destroy_plan(p->plan);
+    fftw_free(p->real);
+    fftw_free(p->complex);
+    pthread_mutex_destroy(&p->lock);
+    free(p->sizes);
+    free(p);
+}
+
+static dsp_fft_plan* dsp_fft_plan_new(dsp_fft_kind kind, int dims, int* sizes)
+{
+    dsp_fft_plan* p = (dsp_fft_plan*)calloc(sizeof(dsp_fft_plan), 1);
+    // FFTW expects row-major sizes, the first stream dimension is the fastest varying one
+    int* n = (int*)malloc(sizeof(int) * dims);
+    p->kind = kind;
+    p->dims = dims;
+    p->sizes = (int*)malloc(sizeof(int) * dims);
+    p->len = 1;
+    for(int d = 0; d < dims; d++) {
+        p->sizes[d] = sizes[d];
+        n[dims - 1 - d] = sizes[d];
+        p->len *= sizes[d];
+    }
+    p->clen = p->len / sizes[0] * (sizes[0] / 2 + 1);
+    p->real = (double*)fftw_malloc(sizeof(double) * p->len);
+    p->complex = (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * p->clen);
+#ifdef HAVE_FFTW3_THREADS
+    fftw_plan_with_nthreads(dsp_fft_threads);
+#endif
+    if(kind == DSP_FFT_R2C)
+        p->plan = fftw_plan_dft_r2c(dims, n, p->real, p->complex, dsp_fft_flags);
+    else
+        p->plan = fftw_plan_dft_c2r(dims, n, p->complex, p->real, dsp_fft_flags);
+    free(n);
+    if(p->plan == NULL) {
+        fftw_free(p->real);
+        fftw_free(p->complex);
+        free(p->sizes);
+        free(p);
+        return NULL;
+    }
+    pthread_mutex_init(&p->lock, NULL);
+    if(dsp_fft_wisdom != NULL && dsp_fft_flags != FFTW_ESTIMATE) {
+        FILE* f = fopen(dsp_fft_wisdom, "w");
+        if(f != NULL) {
+            fftw_export_wisdom_to_file(f);
+            fclose(f);
+        }
+    }
+    return p;
+}
+
+/**
+* \brief Find or create the plan matching kind and sizes
+* \return the plan, locked for the caller, which must unlock it once done with its buffers
+*/
+static dsp_fft_plan* dsp_fft_plan_get(dsp_fft_kind kind, int dims, int* sizes)
+{
+    if(dims <= 0)
+        return NULL;
+    pthread_mutex_lock(&dsp_fft_cache_lock);
+    dsp_fft_plan* p = NULL;
+    int slot = -1;
+    for(int i = 0; i < DSP_FFT_CACHE_SIZE; i++) {
+        dsp_fft_plan* c = dsp_fft_cache[i];
+        if(c == NULL) {
+            if(slot < 0)
+                slot = i;
+            continue;
+        }
+        if(c->kind == kind && c->dims == dims && !memcmp(c->sizes, sizes, sizeof(int) * dims)) {
+            p = c;
+            break;
+        }
+    }
+    if(p == NULL) {
+        if(slot < 0) {
+            // Evict the least recently used plan nobody is executing
+            for(int i = 0; i < DSP_FFT_CACHE_SIZE; i++) {
+                if(pthread_mutex_trylock(&dsp_fft_cache[i]->lock))
+                    continue;
+                pthread_mutex_unlock(&dsp_fft_cache[i]->lock);
+                if(slot < 0 || dsp_fft_cache[i]->last_used < dsp_fft_cache[slot]->last_used)
+                    slot = i;
+            }
+            if(slot >= 0) {
+                dsp_fft_plan_free(dsp_fft_cache[slot]);
+                dsp_fft_cache[slot] = NULL;
+            }
+        }
+        p = dsp_fft_plan_new(kind, dims, sizes);
+        if(p != NULL && slot >= 0)
+            dsp_fft_cache[slot] = p;
+        else if(p != NULL) {
+            // Every plan is busy, this one lives only for the current call
+            p->last_used = 0;
+            pthread_mutex_lock(&p->lock);
+            pthread_mutex_unlock(&dsp_fft_cache_lock);
+            return p;
+        }
+    }
+    if(p != NULL) {
+        p->last_used = ++dsp_fft_cache_clock;
+        pthread_mutex_lock(&p->lock);
+    }
+    pthread_mutex_unlock(&dsp_fft_cache_lock);
+    return p;
+}
+
+static void dsp_fft_plan_release(dsp_fft_plan* p)
+{
+    pthread_mutex_unlock(&p->lock);
+    if(p->last_used == 0) {
+        // The FFTW planner is not thread safe, plans are only destroyed under the cache lock
+        pthread_mutex_lock(&dsp_fft_cache_lock);
+        dsp_fft_plan_free(p);
+        pthread_mutex_unlock(&dsp_fft_cache_lock);
+    }
+}
+
+void dsp_fft_set_planning(int measure)
+{
+    pthread_mutex_lock(&dsp_fft_cache_lock);
+    dsp_fft_flags = (measure ? FFTW_MEASURE : FFTW_ESTIMATE);
+    pthread_mutex_unlock(&dsp_fft_cache_lock);
+}
+
+void dsp_fft_set_threads(int threads)
+{
+    pthread_mutex_lock(&dsp_fft_cache_lock);
+#ifdef HAVE_FFTW3_THREADS
+    static int initialized = 0;
+    if(!initialized)
+        initialized = fftw_init_threads();
+    dsp_fft_threads = (initialized ? Max(threads, 1) : 1);
+#else
+    (void)threads;
+    dsp_fft_threads = 1;
+#endif
+    pthread_mutex_unlock(&dsp_fft_cache_lock);
+}
+
+int dsp_fft_set_wisdom_file(const char* filename)
+{
+    int ret = 1;
+    pthread_mutex_lock(&dsp_fft_cache_lock);
+    free(dsp_fft_wisdom);
+    dsp_fft_wisdom = NULL;
+    if(filename != NULL) {
+        dsp_fft_wisdom = strdup(filename);
+        // A missing file is fine, it is created when the first measured plan is exported
+        FILE* f = fopen(filename, "r");
+        if(f != NULL) {
+            ret = fftw_import_wisdom_from_file(f);
+            fclose(f);
+        }
+    }
+    pthread_mutex_unlock(&dsp_fft_cache_lock);
+    return ret;
+}
+
+void dsp_fft_cleanup()
+{
+    pthread_mutex_lock(&dsp_fft_cache_lock);
+    for(int i = 0; i < DSP_FFT_CACHE_SIZE; i++) {
+        if(dsp_fft_cache[i] == NULL)
+            continue;
+        pthread_mutex_lock(&dsp_fft_cache[i]->lock);
+        pthread_mutex_unlock(&dsp_fft_cache[i]->lock);
+        dsp_fft_plan_free(dsp_fft_cache[i]);
+        dsp_fft_cache[i] = NULL;
+    }
+    pthread_mutex_unlock(&dsp_fft_cache_lock);
+}
+
+int dsp_fft_complex_len(int dims, int* sizes)
+{
+    if(dims <= 0)
+        return 0;
+    int len = sizes[0] / 2 + 1;
+    for(int d = 1; d < dims; d++)
+        len *= sizes[d];
+    return len;
+}
+
+int dsp_fft_rdft_buffer(const double* in, int dims, int* sizes, dsp_complex* out)
+{
+    dsp_fft_plan* p = dsp_fft_plan_get(DSP_FFT_R2C, dims, sizes);
+    if(p == NULL)
+        return -1;
+    memcpy(p->real, in, sizeof(double) * p->len);
+    fftw_execute(p->plan);
+    memcpy(out, p->complex, sizeof(dsp_complex) * p->clen);
+    dsp_fft_plan_release(p);
+    return 0;
+}
+
+int dsp_fft_irdft_buffer(const dsp_complex* in, int dims, int* sizes, double* out)
+{
+    dsp_fft_plan* p = dsp_fft_plan_get(DSP_FFT_C2R, dims, sizes);
+    if(p == NULL)
+        return -1;
+    // c2r plans destroy their input, so the caller's coefficients always go through the plan buffer
+    memcpy(p->complex, in, sizeof(dsp_complex) * p->clen);
+    fftw_execute(p->plan);
+    double scale = 1.0 / p->len;
+    for(int x = 0; x < p->len; x++)
+        out[x] = p->real[x] * scale;
+    dsp_fft_plan_release(p);
+    return 0;
+}
+
+/**
+* \brief Index of the half-complex coefficient holding the x-th coefficient of the full spectrum
+* \return the index, negative (-index - 1) when the coefficient is the conjugate of the returned one
+*/
+static int dsp_fft_hermitian_index(dsp_fft_plan* p, int x)
+{
+    int half = p->sizes[0] / 2 + 1;
+    int k0 = x % p->sizes[0];
+    int conj = (k0 >= half);
+    int index = conj ? (p->sizes[0] - k0) : k0;
+    int m = half;
+    int rest = x / p->sizes[0];
+    for(int d = 1; d < p->dims; d++) {
+        int k = rest % p->sizes[d];
+        rest /= p->sizes[d];
+        if(conj && k != 0)
+            k = p->sizes[d] - k;
+        index += k * m;
+        m *= p->sizes[d];
+    }
+    return conj ? -index - 1 : index;
+}
+
 dsp_complex* dsp_fft_dft(dsp_stream_p stream)
 {
-    dsp_complex* dft = (dsp_complex*)calloc(sizeof(dsp_complex), stream->len);
-    dsp_complex* fft_in = (dsp_complex*)calloc(sizeof(dsp_complex), stream->len);
-    for(int x = 0; x < stream->len; x++) {
-        fft_in[x].real = stream->buf[x];
-        fft_in[x].imaginary = stream->buf[x];
+    dsp_fft_plan* p = dsp_fft_plan_get(DSP_FFT_R2C, stream->dims, stream->sizes);
+    if(p == NULL)
+        return NULL;
+    dsp_complex* dft = (dsp_complex*)malloc(sizeof(dsp_complex) * p->len);
+    dsp_type type;
+    const void *data = dsp_stream_get_data(stream, &type);
+    dsp_buffer_convert(data, type, p->real, DSP_TYPE_DOUBLE, p->len);
+    fftw_execute(p->plan);
+    // Real input spectra are hermitian, the negative frequencies are the conjugates of the positive ones
+    dsp_complex* half = (dsp_complex*)p->complex;
+    for(int x = 0; x < p->len; x++) {
+        int index = dsp_fft_hermitian_index(p, x);
+        if(index >= 0) {
+            dft[x] = half[index];
+        } else {
+            dft[x].real = half[-index - 1].real;
+            dft[x].imaginary = -half[-index - 1].imaginary;
+        }
     }
-    fftw_plan fft = fftw_plan_dft(stream->dims, stream->sizes, (fftw_complex*)fft_in, (fftw_complex*)dft, -1, FFTW_ESTIMATE);
-    fftw_execute(fft);
-    fftw_destroy_plan(fft);
+    dsp_fft_plan_release(p);
     return dft;
 }
 
+int dsp_fft_magnitude(dsp_stream_p stream, double* out)
+{
+    dsp_fft_plan* p = dsp_fft_plan_get(DSP_FFT_R2C, stream->dims, stream->sizes);
+    if(p == NULL)
+        return -1;
+    dsp_type type;
+    const void *data = dsp_stream_get_data(stream, &type);
+    dsp_buffer_convert(data, type, p->real, DSP_TYPE_DOUBLE, p->len);
+    fftw_execute(p->plan);
+    dsp_complex* half = (dsp_complex*)p->complex;
+    for(int x = 0; x < p->len; x++) {
+        int index = dsp_fft_hermitian_index(p, x);
+        out[x] = dsp_fft_complex_to_magnitude(half[index >= 0 ? index : -index - 1]);
+    }
+    dsp_fft_plan_release(p);
+    return 0;
+}
@@ -0,0 +1,359 @@
+/*
+ *   libDSPAU - a digital signal processing library for astronomy usage
+ *   Copyright (C) 2017  Ilia Platone <info@iliaplatone.com>
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dsp.h"
+
+/// Rows (or samples for monodimensional streams) below which a partition is not worth a thread
+#define DSP_RANK_MIN_ROWS 16
+/// Window size from which the constant time histograms beat the sliding tree on small value domains
+#define DSP_RANK_CONSTANT_TIME_SIZE 9
+/// Value domain handled by the constant time histograms, as 16 coarse by 16 fine bins
+#define DSP_RANK_HISTOGRAM_BINS 256
+/// Upper bound of the memory taken by the per-thread trees
+#define DSP_RANK_MAX_TREE_BYTES (256 << 20)
+
+/**
+* \brief Values of the input replaced by their rank among the distinct values, so all the
+* filters run on a dense integer domain
+*/
+typedef struct dsp_rank_job_t
+{
+    const uint32_t *in;
+    uint32_t *out;
+    /// Size of the integer domain
+    int domain;
+    int width;
+    int height;
+    int rows;
+    int size;
+    double rank;
+    /// Per-thread Fenwick trees or column histograms
+    void *scratch;
+    size_t scratch_size;
+} dsp_rank_job;
+
+static inline int dsp_rank_position(double rank, int count)
+{
+    return (int)(rank * (count - 1) + 0.5);
+}
+
+static inline void dsp_rank_tree_add(int32_t *tree, int domain, uint32_t value, int32_t delta)
+{
+    for(int i = (int)value + 1; i <= domain; i += i & -i)
+        tree[i] += delta;
+}
+
+/// Smallest value whose cumulative count exceeds k, found by binary lifting
+static inline uint32_t dsp_rank_tree_find(const int32_t *tree, int domain, int k)
+{
+    int pos = 0;
+    int step = 1;
+    while(step * 2 <= domain)
+        step *= 2;
+    for(; step > 0; step >>= 1) {
+        if(pos + step <= domain && tree[pos + step] <= k) {
+            pos += step;
+            k -= tree[pos];
+        }
+    }
+    return (uint32_t)pos;
+}
+
+static void dsp_rank_1d_range(void *arg, int start, int end, int thread)
+{
+    dsp_rank_job *job = (dsp_rank_job*)arg;
+    int32_t *tree = (int32_t*)((char*)job->scratch + job->scratch_size * thread);
+    int n = job->width;
+    int c = job->size / 2;
+    int count = 0;
+    memset(tree, 0, job->scratch_size);
+    for(int i = Max(0, start - c); i <= Min(n - 1, start - c + job->size - 1); i++, count++)
+        dsp_rank_tree_add(tree, job->domain, job->in[i], 1);
+    for(int x = start; x < end; x++) {
+        if(x > start) {
+            int r = x - c - 1;
+            int a = x - c + job->size - 1;
+            if(r >= 0) {
+                dsp_rank_tree_add(tree, job->domain, job->in[r], -1);
+                count--;
+            }
+            if(a < n) {
+                dsp_rank_tree_add(tree, job->domain, job->in[a], 1);
+                count++;
+            }
+        }
+        job->out[x] = dsp_rank_tree_find(tree, job->domain, dsp_rank_position(job->rank, count));
+    }
+}
+
+static void dsp_rank_tree_column(int32_t *tree, const dsp_rank_job *job, const uint32_t *plane, int x, int r0, int r1, int32_t delta)
+{
+    for(int r = r0; r <= r1; r++)
+        dsp_rank_tree_add(tree, job->domain, plane[(size_t)r * job->width + x], delta);
+}
+
+/// Huang's sliding window, one column in and one column out per sample, on a Fenwick tree
+static void dsp_rank_2d_range(void *arg, int start, int end, int thread)
+{
+    dsp_rank_job *job = (dsp_rank_job*)arg;
+    int32_t *tree = (int32_t*)((char*)job->scratch + job->scratch_size * thread);
+    int w = job->width;
+    int c = job->size / 2;
+    memset(tree, 0, job->scratch_size);
+    for(int row = start; row < end; row++) {
+        int y = row % job->height;
+        const uint32_t *plane = job->in + (size_t)(row - y) * w;
+        int r0 = Max(0, y - c);
+        int r1 = Min(job->height - 1, y - c + job->size - 1);
+        int rows = r1 - r0 + 1;
+        int count = 0;
+        for(int x = 0; x <= Min(w - 1, job->size - 1 - c); x++, count += rows)
+            dsp_rank_tree_column(tree, job, plane, x, r0, r1, 1);
+        for(int x = 0; x < w; x++) {
+            if(x > 0) {
+                int rc = x - c - 1;
+                int ac = x - c + job->size - 1;
+                if(rc >= 0) {
+                    dsp_rank_tree_column(tree, job, plane, rc, r0, r1, -1);
+                    count -= rows;
+                }
+                if(ac < w) {
+                    dsp_rank_tree_column(tree, job, plane, ac, r0, r1, 1);
+                    count += rows;
+                }
+            }
+            job->out[(size_t)row * w + x] = dsp_rank_tree_find(tree, job->domain, dsp_rank_position(job->rank, count));
+        }
+        // Empty the tree for the next row
+        for(int x = Max(0, w - 1 - c); x < w; x++)
+            dsp_rank_tree_column(tree, job, plane, x, r0, r1, -1);
+    }
+}
+
+static inline void dsp_rank_histogram_column(uint16_t *hist, const uint32_t *plane, int width, int x, int r, int delta)
+{
+    uint32_t v = plane[(size_t)r * width + x];
+    hist[v] += delta;
+    hist[DSP_RANK_HISTOGRAM_BINS + (v >> 4)] += delta;
+}
+
+static inline void dsp_rank_histogram_merge(uint32_t *kernel, const uint16_t *column, int sign)
+{
+    for(int i = 0; i < DSP_RANK_HISTOGRAM_BINS + 16; i++)
+        kernel[i] += sign * column[i];
+}
+
+/// Perreault and Hebert constant time filter, column histograms slide down and the kernel histogram slides right
+static void dsp_rank_histogram_range(void *arg, int start, int end, int thread)
+{
+    dsp_rank_job *job = (dsp_rank_job*)arg;
+    const int bins = DSP_RANK_HISTOGRAM_BINS + 16;
+    uint16_t *columns = (uint16_t*)((char*)job->scratch + job->scratch_size * thread);
+    uint32_t kernel[DSP_RANK_HISTOGRAM_BINS + 16];
+    int w = job->width;
+    int c = job->size / 2;
+    for(int row = start; row < end; row++) {
+        int y = row % job->height;
+        const uint32_t *plane = job->in + (size_t)(row - y) * w;
+        int r0 = Max(0, y - c);
+        int r1 = Min(job->height - 1, y - c + job->size - 1);
+        if(row == start || y == 0) {
+            memset(columns, 0, job->scratch_size);
+            for(int x = 0; x < w; x++)
+                for(int r = r0; r <= r1; r++)
+                    dsp_rank_histogram_column(&columns[(size_t)x * bins], plane, w, x, r, 1);
+        } else {
+            for(int x = 0; x < w; x++) {
+                if(y - c - 1 >= 0)
+                    dsp_rank_histogram_column(&columns[(size_t)x * bins], plane, w, x, y - c - 1, -1);
+                if(r1 == y - c + job->size - 1)
+                    dsp_rank_histogram_column(&columns[(size_t)x * bins], plane, w, x, r1, 1);
+            }
+        }
+        int rows = r1 - r0 + 1;
+        int count = 0;
+        memset(kernel, 0, sizeof(kernel));
+        for(int x = 0; x <= Min(w - 1, job->size - 1 - c); x++, count += rows)
+            dsp_rank_histogram_merge(kernel, &columns[(size_t)x * bins], 1);
+        for(int x = 0; x < w; x++) {
+            if(x > 0) {
+                int rc = x - c - 1;
+                int ac = x - c + job->size - 1;
+                if(rc >= 0) {
+                    dsp_rank_histogram_merge(kernel, &columns[(size_t)rc * bins], -1);
+                    count -= rows;
+                }
+                if(ac < w) {
+                    dsp_rank_histogram_merge(kernel, &columns[(size_t)ac * bins], 1);
+                    count += rows;
+                }
+            }
+            // Walk the 16 coarse bins first, then the 16 fine bins below the coarse one found
+            uint32_t k = dsp_rank_position(job->rank, count);
+            uint32_t acc = 0;
+            int coarse = 0;
+            while(acc + kernel[DSP_RANK_HISTOGRAM_BINS + coarse] <= k)
+                acc += kernel[DSP_RANK_HISTOGRAM_BINS + coarse++];
+            int fine = coarse * 16;
+            while(acc + kernel[fine] <= k)
+                acc += kernel[fine++];
+            job->out[(size_t)row * w + x] = fine;
+        }
+    }
+}
+
+static int dsp_rank_compare(const void *a, const void *b)
+{
+    double va = *(const double*)a;
+    double vb = *(const double*)b;
+    return (va > vb) - (va < vb);
+}
+
+#define DSP_RANK_READ(T) \
+    for(int i = 0; i < len; i++) \
+        values[i] = ((const T*)in)[i];
+
+#define DSP_RANK_WRITE(T) \
+    for(int i = 0; i < len; i++) \
+        ((T*)out)[i] = (T)(values != NULL ? values[result[i]] : result[i]);
+
+void dsp_rank_filter_buffer(const void *in, void *out, int dims, int *sizes, dsp_type type, int size, double rank)
+{
+    if(dims <= 0 || size <= 0)
+        return;
+    int len = 1;
+    for(int d = 0; d < dims; d++)
+        len *= sizes[d];
+    uint32_t *ranks = (uint32_t*)malloc(sizeof(uint32_t) * len);
+    uint32_t *result = (uint32_t*)malloc(sizeof(uint32_t) * len);
+    double *values = NULL;
+    int domain = 0;
+    if(type == DSP_TYPE_UINT8 || type == DSP_TYPE_UINT16) {
+        domain = (type == DSP_TYPE_UINT8 ? 256 : 65536);
+        for(int i = 0; i < len; i++)
+            ranks[i] = (type == DSP_TYPE_UINT8 ? ((const uint8_t*)in)[i] : ((const uint16_t*)in)[i]);
+    } else {
+        // Map each value to its rank among the sorted distinct values
+        values = (double*)malloc(sizeof(double) * len);
+        double *sorted = (double*)malloc(sizeof(double) * len);
+        switch (type) {
+        case DSP_TYPE_UINT32:
+            DSP_RANK_READ(uint32_t);
+            break;
+        case DSP_TYPE_UINT64:
+            DSP_RANK_READ(uint64_t);
+            break;
+        case DSP_TYPE_FLOAT:
+            DSP_RANK_READ(float);
+            break;
+        case DSP_TYPE_INT16:
+            DSP_RANK_READ(int16_t);
+            break;
+        default:
+            DSP_RANK_READ(double);
+            break;
+        }
+        memcpy(sorted, values, sizeof(double) * len);
+        qsort(sorted, len, sizeof(double), dsp_rank_compare);
+        for(int i = 0; i < len; i++)
+            if(domain == 0 || sorted[i] != sorted[domain - 1])
+                sorted[domain++] = sorted[i];
+        for(int i = 0; i < len; i++) {
+            int lo = 0, hi = domain - 1;
+            while(lo < hi) {
+                int mid = (lo + hi) / 2;
+                if(sorted[mid] < values[i])
+                    lo = mid + 1;
+                else
+                    hi = mid;
+            }
+            ranks[i] = lo;
+        }
+        free(values);
+        values = sorted;
+    }
+
+    dsp_rank_job job = { 0 };
+    job.in = ranks;
+    job.out = result;
+    job.domain = domain;
+    job.width = sizes[0];
+    job.height = (dims > 1 ? sizes[1] : 1);
+    job.rows = len / job.width;
+    job.size = size;
+    job.rank = Max(0.0, Min(rank, 1.0));
+    dsp_range_func_t func = dsp_rank_2d_range;
+    int items = job.rows;
+    if(dims == 1) {
+        func = dsp_rank_1d_range;
+        items = len;
+    }
+    if(dims > 1 && domain <= DSP_RANK_HISTOGRAM_BINS && size >= DSP_RANK_CONSTANT_TIME_SIZE) {
+        func = dsp_rank_histogram_range;
+        job.scratch_size = sizeof(uint16_t) * (DSP_RANK_HISTOGRAM_BINS + 16) * job.width;
+    } else {
+        job.scratch_size = sizeof(int32_t) * (domain + 1);
+    }
+    int threads = dsp_parallel_threads(items, DSP_RANK_MIN_ROWS);
+    threads = Max(1, Min(threads, (int)(DSP_RANK_MAX_TREE_BYTES / job.scratch_size)));
+    job.scratch = malloc(job.scratch_size * threads);
+    dsp_parallel_for(items, threads, func, &job);
+    free(job.scratch);
+
+    switch (type) {
+    case DSP_TYPE_UINT8:
+        DSP_RANK_WRITE(uint8_t);
+        break;
+    case DSP_TYPE_UINT16:
+        DSP_RANK_WRITE(uint16_t);
+        break;
+    case DSP_TYPE_UINT32:
+        DSP_RANK_WRITE(uint32_t);
+        break;
+    case DSP_TYPE_UINT64:
+        DSP_RANK_WRITE(uint64_t);
+        break;
+    case DSP_TYPE_FLOAT:
+        DSP_RANK_WRITE(float);
+        break;
+    case DSP_TYPE_DOUBLE:
+        DSP_RANK_WRITE(double);
+        break;
+    case DSP_TYPE_INT16:
+        DSP_RANK_WRITE(int16_t);
+        break;
+    }
+    free(values);
+    free(result);
+    free(ranks);
+}
+
+void dsp_rank_filter(dsp_stream_p stream, int size, double rank)
+{
+    dsp_type type;
+    void *data = dsp_stream_get_data(stream, &type);
+    if(stream->dims == 0)
+        dsp_rank_filter_buffer(data, data, 1, &stream->len, type, size, rank);
+    else
+        dsp_rank_filter_buffer(data, data, stream->dims, stream->sizes, type, size, rank);
+}
+
+void dsp_rank_median(dsp_stream_p stream, int size)
+{
+    dsp_rank_filter(stream, size, 0.5);
+}
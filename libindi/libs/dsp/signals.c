@@ -69,12 +69,16 @@ void dsp_signals_triwave(dsp_stream_p stream, double samplefreq, double freq)
 void dsp_modulation_frequency(dsp_stream_p stream, double samplefreq, double freq, double bandwidth)
 {
     dsp_stream_p carrier = dsp_stream_new();
+    dsp_stream_alloc_buffer(carrier, stream->len);
+    carrier->len = stream->len;
     dsp_signals_sinewave(carrier, samplefreq, freq);
     double lo = freq / samplefreq;
     double hi = freq / samplefreq;
     dsp_buffer_deviate(carrier, stream, lo - bandwidth * 0.5, hi + bandwidth * 1.5);
     dsp_stream_free_buffer(stream);
     dsp_stream_set_buffer(stream, carrier->buf, stream->len);
+    // The buffer now belongs to stream
+    carrier->buf = NULL;
     dsp_stream_free(carrier);
 
 }
@@ -82,6 +86,8 @@ void dsp_modulation_frequency(dsp_stream_p stream, double samplefreq, double fre
 void dsp_modulation_amplitude(dsp_stream_p stream, double samplefreq, double freq)
 {
     dsp_stream_p carrier = dsp_stream_new();
+    dsp_stream_alloc_buffer(carrier, stream->len);
+    carrier->len = stream->len;
     dsp_signals_sinewave(carrier, samplefreq, freq);
     dsp_buffer_sum(stream, carrier->buf, stream->len);
     dsp_stream_free_buffer(carrier);
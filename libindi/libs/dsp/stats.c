@@ -18,35 +18,293 @@
 
 #include "dsp.h"
 
-double dsp_stats_minmidmax(dsp_stream_p stream, double* min, double* max)
+/// Number of elements below which a kernel is not worth splitting across threads
+#define DSP_STATS_MIN_CHUNK 262144
+/// Independent accumulators per kernel, breaks the loop carried dependency so the loops vectorize
+#define DSP_STATS_LANES 8
+
+typedef struct dsp_stats_job_t
+{
+    const void *buf;
+    dsp_type type;
+    int size;
+    double shift;
+    double *min;
+    double *max;
+    double *sum;
+    double *sq;
+    unsigned int *hist;
+} dsp_stats_job;
+
+#define DSP_STATS_MINMAX_KERNEL(T, suffix) \
+static void dsp_stats_minmax_##suffix(const T *buf, int len, double *min, double *max) \
+{ \
+    T lo[DSP_STATS_LANES], hi[DSP_STATS_LANES]; \
+    int i = 0, k; \
+    for(k = 0; k < DSP_STATS_LANES; k++) \
+        lo[k] = hi[k] = buf[0]; \
+    for(; i + DSP_STATS_LANES <= len; i += DSP_STATS_LANES) { \
+        for(k = 0; k < DSP_STATS_LANES; k++) { \
+            lo[k] = buf[i + k] < lo[k] ? buf[i + k] : lo[k]; \
+            hi[k] = buf[i + k] > hi[k] ? buf[i + k] : hi[k]; \
+        } \
+    } \
+    for(; i < len; i++) { \
+        lo[0] = buf[i] < lo[0] ? buf[i] : lo[0]; \
+        hi[0] = buf[i] > hi[0] ? buf[i] : hi[0]; \
+    } \
+    for(k = 1; k < DSP_STATS_LANES; k++) { \
+        lo[0] = lo[k] < lo[0] ? lo[k] : lo[0]; \
+        hi[0] = hi[k] > hi[0] ? hi[k] : hi[0]; \
+    } \
+    *min = (double)lo[0]; \
+    *max = (double)hi[0]; \
+}
+
+#define DSP_STATS_MOMENTS_KERNEL(T, suffix) \
+static void dsp_stats_moments_##suffix(const T *buf, int len, double shift, double *sum, double *sq) \
+{ \
+    double s[DSP_STATS_LANES] = { 0 }, q[DSP_STATS_LANES] = { 0 }; \
+    int i = 0, k; \
+    for(; i + DSP_STATS_LANES <= len; i += DSP_STATS_LANES) { \
+        for(k = 0; k < DSP_STATS_LANES; k++) { \
+            double d = (double)buf[i + k] - shift; \
+            s[k] += d; \
+            q[k] += d * d; \
+        } \
+    } \
+    for(; i < len; i++) { \
+        double d = (double)buf[i] - shift; \
+        s[0] += d; \
+        q[0] += d * d; \
+    } \
+    for(k = 1; k < DSP_STATS_LANES; k++) { \
+        s[0] += s[k]; \
+        q[0] += q[k]; \
+    } \
+    *sum = s[0]; \
+    *sq = q[0]; \
+}
+
+#define DSP_STATS_HISTOGRAM_UINT_KERNEL(T, suffix) \
+static void dsp_stats_histogram_##suffix(const T *buf, int len, unsigned int *hist, int size) \
+{ \
+    uint64_t limit = (uint64_t)size; \
+    for(int i = 0; i < len; i++) { \
+        if((uint64_t)buf[i] < limit) \
+            hist[buf[i]]++; \
+    } \
+}
+
+#define DSP_STATS_HISTOGRAM_FLOAT_KERNEL(T, suffix) \
+static void dsp_stats_histogram_##suffix(const T *buf, int len, unsigned int *hist, int size) \
+{ \
+    T limit = (T)size; \
+    for(int i = 0; i < len; i++) { \
+        T v = buf[i]; \
+        if(v < limit) \
+            hist[v > 0 ? (int)v : 0]++; \
+    } \
+}
+
+#define DSP_STATS_HISTOGRAM_SINT_KERNEL(T, suffix) \
+static void dsp_stats_histogram_##suffix(const T *buf, int len, unsigned int *hist, int size) \
+{ \
+    for(int i = 0; i < len; i++) { \
+        int v = buf[i]; \
+        if(v < size) \
+            hist[v > 0 ? v : 0]++; \
+    } \
+}
+
+#define DSP_STATS_KERNELS(T, suffix, HISTOGRAM_KERNEL) \
+    DSP_STATS_MINMAX_KERNEL(T, suffix) \
+    DSP_STATS_MOMENTS_KERNEL(T, suffix) \
+    HISTOGRAM_KERNEL(T, suffix)
+
+DSP_STATS_KERNELS(uint8_t, uint8, DSP_STATS_HISTOGRAM_UINT_KERNEL)
+DSP_STATS_KERNELS(uint16_t, uint16, DSP_STATS_HISTOGRAM_UINT_KERNEL)
+DSP_STATS_KERNELS(uint32_t, uint32, DSP_STATS_HISTOGRAM_UINT_KERNEL)
+DSP_STATS_KERNELS(uint64_t, uint64, DSP_STATS_HISTOGRAM_UINT_KERNEL)
+DSP_STATS_KERNELS(float, float, DSP_STATS_HISTOGRAM_FLOAT_KERNEL)
+DSP_STATS_KERNELS(double, double, DSP_STATS_HISTOGRAM_FLOAT_KERNEL)
+DSP_STATS_KERNELS(int16_t, int16, DSP_STATS_HISTOGRAM_SINT_KERNEL)
+
+#define DSP_STATS_DISPATCH(kernel, job, start, end, ...) \
+    switch (job->type) { \
+    case DSP_TYPE_UINT8: \
+        kernel##_uint8(((const uint8_t*)job->buf) + start, end - start, __VA_ARGS__); \
+        break; \
+    case DSP_TYPE_UINT16: \
+        kernel##_uint16(((const uint16_t*)job->buf) + start, end - start, __VA_ARGS__); \
+        break; \
+    case DSP_TYPE_UINT32: \
+        kernel##_uint32(((const uint32_t*)job->buf) + start, end - start, __VA_ARGS__); \
+        break; \
+    case DSP_TYPE_UINT64: \
+        kernel##_uint64(((const uint64_t*)job->buf) + start, end - start, __VA_ARGS__); \
+        break; \
+    case DSP_TYPE_FLOAT: \
+        kernel##_float(((const float*)job->buf) + start, end - start, __VA_ARGS__); \
+        break; \
+    case DSP_TYPE_DOUBLE: \
+        kernel##_double(((const double*)job->buf) + start, end - start, __VA_ARGS__); \
+        break; \
+    case DSP_TYPE_INT16: \
+        kernel##_int16(((const int16_t*)job->buf) + start, end - start, __VA_ARGS__); \
+        break; \
+    }
+
+static void dsp_stats_minmax_range(void *arg, int start, int end, int thread)
+{
+    dsp_stats_job *job = (dsp_stats_job*)arg;
+    DSP_STATS_DISPATCH(dsp_stats_minmax, job, start, end, &job->min[thread], &job->max[thread]);
+}
+
+static void dsp_stats_moments_range(void *arg, int start, int end, int thread)
+{
+    dsp_stats_job *job = (dsp_stats_job*)arg;
+    DSP_STATS_DISPATCH(dsp_stats_moments, job, start, end, job->shift, &job->sum[thread], &job->sq[thread]);
+}
+
+static void dsp_stats_histogram_range(void *arg, int start, int end, int thread)
+{
+    dsp_stats_job *job = (dsp_stats_job*)arg;
+    DSP_STATS_DISPATCH(dsp_stats_histogram, job, start, end, &job->hist[(size_t)thread * job->size], job->size);
+}
+
+static double dsp_stats_first_element(const void *buf, dsp_type type)
+{
+    switch (type) {
+    case DSP_TYPE_UINT8:
+        return ((const uint8_t*)buf)[0];
+    case DSP_TYPE_UINT16:
+        return ((const uint16_t*)buf)[0];
+    case DSP_TYPE_UINT32:
+        return ((const uint32_t*)buf)[0];
+    case DSP_TYPE_UINT64:
+        return (double)((const uint64_t*)buf)[0];
+    case DSP_TYPE_FLOAT:
+        return ((const float*)buf)[0];
+    case DSP_TYPE_DOUBLE:
+        return ((const double*)buf)[0];
+    case DSP_TYPE_INT16:
+        return ((const int16_t*)buf)[0];
+    default:
+        return 0;
+    }
+}
+
+void dsp_stats_minmax_buffer(const void *buf, int len, dsp_type type, double* min, double* max)
 {
-    int i;
     *min = DBL_MAX;
-    *max = DBL_MIN;
-    for(i = 0; i < stream->len; i++) {
-        *min = Min(stream->buf[i], *min);
-        *max = Max(stream->buf[i], *max);
+    *max = -DBL_MAX;
+    if(len <= 0)
+        return;
+    int threads = dsp_parallel_threads(len, DSP_STATS_MIN_CHUNK);
+    dsp_stats_job job = { 0 };
+    job.buf = buf;
+    job.type = type;
+    job.min = (double*)calloc(sizeof(double), threads);
+    job.max = (double*)calloc(sizeof(double), threads);
+    dsp_parallel_for(len, threads, dsp_stats_minmax_range, &job);
+    for(int t = 0; t < threads; t++) {
+        *min = Min(job.min[t], *min);
+        *max = Max(job.max[t], *max);
+    }
+    free(job.min);
+    free(job.max);
+}
+
+double dsp_stats_variance_buffer(const void *buf, int len, dsp_type type, double* mean)
+{
+    if(len <= 0) {
+        if(mean != NULL)
+            *mean = 0;
+        return 0;
+    }
+    int threads = dsp_parallel_threads(len, DSP_STATS_MIN_CHUNK);
+    dsp_stats_job job = { 0 };
+    job.buf = buf;
+    job.type = type;
+    // Accumulating around the first element keeps the sum of squares well conditioned
+    job.shift = dsp_stats_first_element(buf, type);
+    job.sum = (double*)calloc(sizeof(double), threads);
+    job.sq = (double*)calloc(sizeof(double), threads);
+    dsp_parallel_for(len, threads, dsp_stats_moments_range, &job);
+    double sum = 0, sq = 0;
+    for(int t = 0; t < threads; t++) {
+        sum += job.sum[t];
+        sq += job.sq[t];
+    }
+    free(job.sum);
+    free(job.sq);
+    double delta = sum / len;
+    if(mean != NULL)
+        *mean = job.shift + delta;
+    return Max(sq / len - delta * delta, 0.0);
+}
+
+double* dsp_stats_histogram_buffer(const void *buf, int len, dsp_type type, int size)
+{
+    if(size <= 0)
+        return NULL;
+    double* out = (double*)calloc(sizeof(double), size);
+    if(len > 0) {
+        // Each thread owns a private histogram, so the partitions must outweigh the merge
+        int threads = dsp_parallel_threads(len, Max(DSP_STATS_MIN_CHUNK, size * 4));
+        dsp_stats_job job = { 0 };
+        job.buf = buf;
+        job.type = type;
+        job.size = size;
+        job.hist = (unsigned int*)calloc(sizeof(unsigned int), (size_t)size * threads);
+        dsp_parallel_for(len, threads, dsp_stats_histogram_range, &job);
+        for(int t = 0; t < threads; t++) {
+            unsigned int *hist = &job.hist[(size_t)t * size];
+            for(int k = 0; k < size; k++)
+                out[k] += hist[k];
+        }
+        free(job.hist);
     }
+    double mn, mx;
+    dsp_stats_minmax_buffer(out, size, DSP_TYPE_DOUBLE, &mn, &mx);
+    double ratio = (mx - mn);
+    if(ratio == 0) ratio = 1.0;
+    for(int k = 0; k < size; k++)
+        out[k] = (out[k] - mn) * size / ratio;
+    return out;
+}
+
+double dsp_stats_minmidmax(dsp_stream_p stream, double* min, double* max)
+{
+    dsp_type type;
+    void *data = dsp_stream_get_data(stream, &type);
+    dsp_stats_minmax_buffer(data, stream->len, type, min, max);
     return (double)((*max - *min) / 2.0 + *min);
 }
 
 double dsp_stats_mean(dsp_stream_p stream)
 {
-    int i;
-    double mean = 0.0;
-    double l = (double)stream->len;
-    for(i = 0; i < stream->len; i++) {
-        mean += stream->buf[i];
-    }
-    mean /=  l;
+    double mean;
+    dsp_type type;
+    void *data = dsp_stream_get_data(stream, &type);
+    dsp_stats_variance_buffer(data, stream->len, type, &mean);
     return mean;
 }
 
+double dsp_stats_variance(dsp_stream_p stream)
+{
+    dsp_type type;
+    void *data = dsp_stream_get_data(stream, &type);
+    return dsp_stats_variance_buffer(data, stream->len, type, NULL);
+}
+
 int dsp_stats_maximum_index(dsp_stream_p stream)
 {
     int i;
     double min, max;
     dsp_stats_minmidmax(stream, &min, &max);
+    dsp_stream_get_buffer(stream);
     for(i = 0; i < stream->len; i++) {
         if(stream->buf[i] == max) break;
     }
@@ -58,6 +316,7 @@ int dsp_stats_minimum_index(dsp_stream_p stream)
     int i;
     double min, max;
     dsp_stats_minmidmax(stream, &min, &max);
+    dsp_stream_get_buffer(stream);
     for(i = 0; i < stream->len; i++) {
         if(stream->buf[i] == min) break;
     }
@@ -68,6 +327,7 @@ int dsp_stats_val_count(dsp_stream_p stream, double val)
 {
     int x;
     int count = 0;
+    dsp_stream_get_buffer(stream);
     for(x = 0; x < stream->len; x++) {
         if(stream->buf[x] == val)
             count ++;
@@ -77,28 +337,14 @@ int dsp_stats_val_count(dsp_stream_p stream, double val)
 
 double* dsp_stats_histogram(dsp_stream_p stream, int size)
 {
-    int k;
-    dsp_stream_p o = dsp_stream_copy(stream);
-    double* out = calloc(sizeof(double), size);
-    long* i = calloc(sizeof(long), o->len);
-    dsp_buffer_normalize(o, 0.0, size);
-    dsp_buffer_copy(o->buf, i, o->len);
-    dsp_buffer_copy(i, o->buf, o->len);
-    for(k = 0; k < size; k++) {
-        out[k] = dsp_stats_val_count(o, k);
-    }
-    free(i);
-    dsp_stream_free_buffer(o);
-    dsp_stream_free(o);
-    dsp_stream_p ret = dsp_stream_new();
-    dsp_stream_set_buffer(ret, out, size);
-    dsp_buffer_stretch(ret, 0, size);
-    dsp_stream_free(ret);
-    return out;
+    dsp_type type;
+    void *data = dsp_stream_get_data(stream, &type);
+    return dsp_stats_histogram_buffer(data, stream->len, type, size);
 }
 
 double* dsp_stats_val_sum(dsp_stream_p stream)
 {
+    dsp_stream_get_buffer(stream);
     for(int i = 1; i < stream->len; i++) {
         stream->buf[i] += stream->buf[i - 1];
     }
@@ -108,6 +354,7 @@ double* dsp_stats_val_sum(dsp_stream_p stream)
 double dsp_stats_compare(dsp_stream_p stream, double* in, int inlen)
 {
     double out = 0;
+    dsp_stream_get_buffer(stream);
     for(int i = 0; i < Min(stream->len, inlen); i++) {
         out += stream->buf[i] - in[i];
     }
@@ -18,9 +18,17 @@
 
 #include "dsp.h"
 
+struct dsp_stream_pool_t
+{
+    dsp_stream_p *streams;
+    int count;
+    int capacity;
+    pthread_mutex_t lock;
+};
+
 void dsp_stream_alloc_buffer(dsp_stream_p stream, int len)
 {
-    if(stream->buf!=NULL) {
+    if(stream->buf!=NULL && stream->buf != stream->data) {
         stream->buf = (double*)realloc(stream->buf, sizeof(double) * len);
     } else {
         stream->buf = (double*)malloc(sizeof(double) * len);
@@ -30,6 +38,12 @@ void dsp_stream_alloc_buffer(dsp_stream_p stream, int len)
 
 void dsp_stream_set_buffer(dsp_stream_p stream, void *buffer, int len)
 {
+    // The double buffer supersedes the native data
+    if(!stream->view && stream->data != stream->buf)
+        free(stream->data);
+    stream->data = NULL;
+    stream->view = 0;
+    stream->type = DSP_TYPE_DOUBLE;
     stream->buf = (double*)buffer;
     stream->len = len;
 
@@ -37,97 +51,204 @@ void dsp_stream_set_buffer(dsp_stream_p stream, void *buffer, int len)
 
 double* dsp_stream_get_buffer(dsp_stream_p stream)
 {
+    if(stream->buf == NULL && stream->data != NULL) {
+        stream->buf = (double*)malloc(sizeof(double) * stream->len);
+        dsp_buffer_convert(stream->data, stream->type, stream->buf, DSP_TYPE_DOUBLE, stream->len);
+    }
     return stream->buf;
 }
 
+void* dsp_stream_get_data(dsp_stream_p stream, dsp_type *type)
+{
+    if(stream->buf != NULL || stream->data == NULL) {
+        *type = DSP_TYPE_DOUBLE;
+        return stream->buf;
+    }
+    *type = stream->type;
+    return stream->data;
+}
+
 void dsp_stream_free_buffer(dsp_stream_p stream)
 {
     if(stream->buf == NULL)
         return;
-    free(stream->buf);
+    if(stream->buf == stream->data) {
+        if(!stream->view)
+            free(stream->data);
+        stream->data = NULL;
+    } else {
+        free(stream->buf);
+    }
     stream->buf = NULL;
 }
 
 dsp_stream_p dsp_stream_new()
 {
+    // Sizes, regions and children are allocated by the first dimension or child added
     dsp_stream_p stream = (dsp_stream_p)calloc(sizeof(dsp_stream), 1);
-    stream->buf = (double*)calloc(sizeof(double), 1);
-    stream->sizes = (int*)calloc(sizeof(int), 1);
-    stream->children = calloc(sizeof(dsp_stream_p), 1);
-    stream->ROI = (dsp_region*)calloc(sizeof(dsp_region), 1);
-    stream->child_count = 0;
-    stream->parent = NULL;
-    stream->dims = 0;
     stream->len = 1;
-    stream->lambda = 0;
-    stream->samplerate = 0;
+    stream->type = DSP_TYPE_DOUBLE;
     return stream;
 }
 
+dsp_stream_p dsp_stream_new_view(void *data, dsp_type type, int dims, int *sizes)
+{
+    dsp_stream_p stream = dsp_stream_new();
+    for(int dim = 0; dim < dims; dim++)
+        dsp_stream_add_dim(stream, sizes[dim]);
+    stream->data = data;
+    stream->type = type;
+    stream->view = 1;
+    if(type == DSP_TYPE_DOUBLE)
+        stream->buf = (double*)data;
+    return stream;
+}
+
+static void dsp_stream_pool_put(dsp_stream_pool_p pool, dsp_stream_p stream)
+{
+    // Only streams still holding their native buffer can be reused
+    if(stream->data != NULL && stream->buf != stream->data) {
+        free(stream->buf);
+        stream->buf = (stream->type == DSP_TYPE_DOUBLE ? (double*)stream->data : NULL);
+    }
+    pthread_mutex_lock(&pool->lock);
+    if(stream->data != NULL && !stream->view && pool->count < pool->capacity) {
+        stream->child_count = 0;
+        stream->parent = NULL;
+        pool->streams[pool->count++] = stream;
+        stream = NULL;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    if(stream != NULL) {
+        stream->pool = NULL;
+        dsp_stream_free(stream);
+    }
+}
+
 void dsp_stream_free(dsp_stream_p stream)
 {
     if(stream == NULL)
         return;
+    if(stream->pool != NULL) {
+        dsp_stream_pool_put(stream->pool, stream);
+        return;
+    }
+    if(stream->buf != stream->data)
+        free(stream->buf);
+    if(!stream->view)
+        free(stream->data);
     free(stream->sizes);
+    free(stream->ROI);
     free(stream->children);
     free(stream);
 }
 
+dsp_stream_pool_p dsp_stream_pool_new(int capacity)
+{
+    dsp_stream_pool_p pool = (dsp_stream_pool_p)calloc(sizeof(dsp_stream_pool), 1);
+    pool->capacity = Max(capacity, 1);
+    pool->streams = (dsp_stream_p*)calloc(sizeof(dsp_stream_p), pool->capacity);
+    pthread_mutex_init(&pool->lock, NULL);
+    return pool;
+}
+
+dsp_stream_p dsp_stream_pool_get(dsp_stream_pool_p pool, dsp_type type, int dims, int *sizes)
+{
+    dsp_stream_p stream = NULL;
+    pthread_mutex_lock(&pool->lock);
+    for(int i = pool->count - 1; i >= 0 && stream == NULL; i--) {
+        dsp_stream_p s = pool->streams[i];
+        if(s->type != type || s->dims != dims || memcmp(s->sizes, sizes, sizeof(int) * dims))
+            continue;
+        stream = s;
+        pool->streams[i] = pool->streams[--pool->count];
+    }
+    pthread_mutex_unlock(&pool->lock);
+    if(stream != NULL)
+        return stream;
+    stream = dsp_stream_new();
+    for(int dim = 0; dim < dims; dim++)
+        dsp_stream_add_dim(stream, sizes[dim]);
+    stream->type = type;
+    stream->data = malloc(dsp_type_size(type) * stream->len);
+    if(type == DSP_TYPE_DOUBLE)
+        stream->buf = (double*)stream->data;
+    stream->pool = pool;
+    return stream;
+}
+
+void dsp_stream_pool_free(dsp_stream_pool_p pool)
+{
+    if(pool == NULL)
+        return;
+    for(int i = 0; i < pool->count; i++) {
+        pool->streams[i]->pool = NULL;
+        dsp_stream_free(pool->streams[i]);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->streams);
+    free(pool);
+}
+
 dsp_stream_p dsp_stream_copy(dsp_stream_p stream)
 {
     dsp_stream_p dest = dsp_stream_new();
     for(int i = 0; i < stream->dims; i++)
        dsp_stream_add_dim(dest, stream->sizes[i]);
-    dsp_stream_alloc_buffer(dest, dest->len);
+    dsp_stream_alloc_buffer(dest, stream->len);
+    dest->len = stream->len;
     dest->lambda = stream->lambda;
     dest->samplerate = stream->samplerate;
-    memcpy(dest->buf, stream->buf, sizeof(double) * stream->len);
+    memcpy(dest->buf, dsp_stream_get_buffer(stream), sizeof(double) * stream->len);
     return dest;
 }
 
 void dsp_stream_add_dim(dsp_stream_p stream, int size)
 {
+    stream->sizes = (int*)realloc(stream->sizes, sizeof(int) * (stream->dims + 1));
+    stream->ROI = (dsp_region*)realloc(stream->ROI, sizeof(dsp_region) * (stream->dims + 1));
     stream->sizes[stream->dims] = size;
+    stream->ROI[stream->dims].start = 0;
+    stream->ROI[stream->dims].len = size;
     stream->len *= size;
     stream->dims ++;
-    stream->ROI = (dsp_region*)realloc(stream->ROI, sizeof(dsp_region) * (stream->dims + 1));
-    stream->sizes = (int*)realloc(stream->sizes, sizeof(int) * (stream->dims + 1));
 }
 
 void dsp_stream_del_dim(dsp_stream_p stream, int index)
 {
-    int* sizes = (int*)calloc(sizeof(int), stream->dims);
+    int* sizes = stream->sizes;
     int dims = stream->dims;
-    memcpy(sizes, stream->sizes, sizeof(int) * stream->dims);
-    free(stream->sizes);
+    stream->sizes = NULL;
     stream->dims = 0;
+    stream->len = 1;
     for(int i = 0; i < dims; i++) {
         if(i != index) {
             dsp_stream_add_dim(stream, sizes[i]);
         }
     }
+    free(sizes);
 }
 
 void dsp_stream_add_child(dsp_stream_p stream, dsp_stream_p child)
 {
     child->parent = stream;
+    stream->children = (dsp_stream_p*)realloc(stream->children, sizeof(dsp_stream_p) * (stream->child_count + 1));
     stream->children[stream->child_count] = child;
     stream->child_count++;
-    stream->children = realloc(stream->children, sizeof(dsp_stream_p) * (stream->child_count + 1));
 }
 
 void dsp_stream_del_child(dsp_stream_p stream, int index)
 {
-    dsp_stream_p* children = (dsp_stream_p*)calloc(sizeof(dsp_stream_p), stream->child_count);
+    dsp_stream_p* children = stream->children;
     int child_count = stream->child_count;
-    memcpy(children, stream->children, sizeof(dsp_stream_p*) * stream->child_count);
-    free(stream->children);
+    stream->children = NULL;
     stream->child_count = 0;
     for(int i = 0; i < child_count; i++) {
         if(i != index) {
             dsp_stream_add_child(stream, children[i]);
         }
     }
+    free(children);
 }
 
 int* dsp_stream_get_position(dsp_stream_p stream, int index) {
@@ -0,0 +1,90 @@
+/*
+ *   libDSPAU - a digital signal processing library for astronomy usage
+ *   Copyright (C) 2017  Ilia Platone <info@iliaplatone.com>
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dsp.h"
+#include <unistd.h>
+
+static int dsp_threads_max = 0;
+
+typedef struct dsp_parallel_job_t
+{
+    dsp_range_func_t func;
+    void *arg;
+    int start;
+    int end;
+    int thread;
+} dsp_parallel_job;
+
+void dsp_set_max_threads(int threads)
+{
+    dsp_threads_max = Max(threads, 0);
+}
+
+int dsp_get_max_threads()
+{
+    if(dsp_threads_max > 0)
+        return dsp_threads_max;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return (cpus > 0 ? (int)cpus : 1);
+}
+
+int dsp_parallel_threads(int len, int min_chunk)
+{
+    int threads = dsp_get_max_threads();
+    threads = Min(threads, len / Max(min_chunk, 1));
+    return Max(threads, 1);
+}
+
+static void *dsp_parallel_worker(void *arg)
+{
+    dsp_parallel_job *job = (dsp_parallel_job*)arg;
+    job->func(job->arg, job->start, job->end, job->thread);
+    return NULL;
+}
+
+void dsp_parallel_for(int len, int threads, dsp_range_func_t func, void *arg)
+{
+    if(threads <= 1 || len < threads) {
+        func(arg, 0, len, 0);
+        return;
+    }
+    pthread_t *th = (pthread_t*)calloc(sizeof(pthread_t), threads);
+    int *started = (int*)calloc(sizeof(int), threads);
+    dsp_parallel_job *jobs = (dsp_parallel_job*)calloc(sizeof(dsp_parallel_job), threads);
+    int chunk = len / threads;
+    for(int t = 0; t < threads; t++) {
+        jobs[t].func = func;
+        jobs[t].arg = arg;
+        jobs[t].thread = t;
+        jobs[t].start = t * chunk;
+        jobs[t].end = (t == threads - 1) ? len : (t + 1) * chunk;
+    }
+    // The calling thread takes the first chunk, a failed spawn degrades to inline execution
+    for(int t = 1; t < threads; t++)
+        started[t] = (pthread_create(&th[t], NULL, dsp_parallel_worker, &jobs[t]) == 0);
+    dsp_parallel_worker(&jobs[0]);
+    for(int t = 1; t < threads; t++) {
+        if(started[t])
+            pthread_join(th[t], NULL);
+        else
+            dsp_parallel_worker(&jobs[t]);
+    }
+    free(jobs);
+    free(started);
+    free(th);
+}
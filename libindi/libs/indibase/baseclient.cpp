@@ -23,7 +23,11 @@
 #include "basedevice.h"
 #include "locale_compat.h"
 
+#include <zlib.h>
+
+#include <algorithm>
 #include <cerrno>
+#include <cctype>
 #include <fcntl.h>
 #include <cstdlib>
 #include <stdarg.h>
@@ -43,6 +47,7 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <netinet/in.h>
 #define net_read read
 #define net_write write
@@ -53,6 +58,10 @@
 # define snprintf _snprintf
 #endif
 
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
 #define MAXINDIBUF 49152
 
 INDI::BaseClient::BaseClient()
@@ -64,10 +73,24 @@ INDI::BaseClient::BaseClient()
 
     timeout_sec = 3;
     timeout_us  = 0;
+
+    stats = Statistics();
+
+    snapshot = std::make_shared<Snapshot>();
 }
 
 INDI::BaseClient::~BaseClient()
 {
+    // No notifications from here, the client subclass is already gone
+    if (sConnected.exchange(false))
+    {
+#ifdef _WINDOWS
+        shutdown(sockfd, SD_BOTH);
+#else
+        shutdown(sockfd, SHUT_RDWR);
+#endif
+    }
+    stopThreads();
     clear();
 }
 
@@ -79,6 +102,7 @@ void INDI::BaseClient::clear()
     while (!blobModes.empty())
         delete blobModes.back(), blobModes.pop_back();
     blobModes.clear();
+    clearSnapshot();
 }
 
 void INDI::BaseClient::setServer(const char *hostname, unsigned int port)
@@ -94,6 +118,12 @@ void INDI::BaseClient::watchDevice(const char *deviceName)
 
 bool INDI::BaseClient::connectServer()
 {
+    if (sConnected)
+        return true;
+
+    // Threads of a connection the server closed
+    stopThreads();
+
 #ifdef _WINDOWS
     WSADATA wsaData;
     int iResult = WSAStartup(MAKEWORD(2, 2), &wsaData);
@@ -109,31 +139,62 @@ bool INDI::BaseClient::connectServer()
     ts.tv_usec = timeout_us;
 
     struct sockaddr_in serv_addr;
+#ifndef _WINDOWS
+    struct sockaddr_un unix_addr;
+#endif
+    struct sockaddr *addr = (struct sockaddr *)&serv_addr;
+    int addrlen           = sizeof(serv_addr);
+    int domain            = AF_INET;
     struct hostent *hp;
     int ret = 0;
 
-    /* lookup host address */
-    hp = gethostbyname(cServer.c_str());
-    if (!hp)
+    if (cServer.compare(0, 5, "unix:") == 0)
     {
-        perror("gethostbyname");
+#ifdef _WINDOWS
+        IDLog("Unix domain sockets are not supported: %s\n", cServer.c_str());
+        WSACleanup();
         return false;
+#else
+        /* local server, no TCP/IP stack in the way */
+        std::string path = cServer.substr(5);
+        if (path.empty() || path.size() >= sizeof(unix_addr.sun_path))
+        {
+            IDLog("Bad unix socket path: %s\n", cServer.c_str());
+            return false;
+        }
+        (void)memset((char *)&unix_addr, 0, sizeof(unix_addr));
+        unix_addr.sun_family = AF_UNIX;
+        strncpy(unix_addr.sun_path, path.c_str(), sizeof(unix_addr.sun_path) - 1);
+        addr    = (struct sockaddr *)&unix_addr;
+        addrlen = sizeof(unix_addr);
+        domain  = AF_UNIX;
+#endif
     }
+    else
+    {
+        /* lookup host address */
+        hp = gethostbyname(cServer.c_str());
+        if (!hp)
+        {
+            perror("gethostbyname");
+            return false;
+        }
 
-    /* create a socket to the INDI server */
-    (void)memset((char *)&serv_addr, 0, sizeof(serv_addr));
-    serv_addr.sin_family      = AF_INET;
-    serv_addr.sin_addr.s_addr = ((struct in_addr *)(hp->h_addr_list[0]))->s_addr;
-    serv_addr.sin_port        = htons(cPort);
+        /* create a socket to the INDI server */
+        (void)memset((char *)&serv_addr, 0, sizeof(serv_addr));
+        serv_addr.sin_family      = AF_INET;
+        serv_addr.sin_addr.s_addr = ((struct in_addr *)(hp->h_addr_list[0]))->s_addr;
+        serv_addr.sin_port        = htons(cPort);
+    }
 #ifdef _WINDOWS
-    if ((sockfd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)) == INVALID_SOCKET)
+    if ((sockfd = socket(domain, SOCK_STREAM, IPPROTO_TCP)) == INVALID_SOCKET)
     {
         IDLog("Socket error: %d\n", WSAGetLastError());
         WSACleanup();
         return false;
     }
 #else
-    if ((sockfd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+    if ((sockfd = socket(domain, SOCK_STREAM, 0)) < 0)
     {
         perror("socket");
         return false;
@@ -167,7 +228,7 @@ bool INDI::BaseClient::connectServer()
     wset = rset; //structure assignment okok
 
     /* connect */
-    if ((ret = ::connect(sockfd, (struct sockaddr *)&serv_addr, sizeof(serv_addr))) < 0)
+    if ((ret = ::connect(sockfd, addr, addrlen)) < 0)
     {
         if (errno != EINPROGRESS)
         {
@@ -232,8 +293,11 @@ bool INDI::BaseClient::connectServer()
 
     m_receiveFd = pipefd[0];
     m_sendFd    = pipefd[1];
+    fcntl(m_sendFd, F_SETFL, fcntl(m_sendFd, F_GETFL, 0) | O_NONBLOCK);
 #endif
 
+    clear();
+
     sConnected = true;
 
     /*int result = pthread_create(&listen_thread, nullptr, &INDI::BaseClient::listenHelper, this);
@@ -246,6 +310,11 @@ bool INDI::BaseClient::connectServer()
     }*/
 
     listen_thread = new std::thread(listenHelper, this);
+    if (useDispatchThread)
+    {
+        std::lock_guard<std::mutex> lock(eventsLock);
+        dispatch_thread = new std::thread(&INDI::BaseClient::dispatchEvents, this, dispatchGeneration);
+    }
 
     serverConnected();
 
@@ -255,34 +324,99 @@ bool INDI::BaseClient::connectServer()
 bool INDI::BaseClient::disconnectServer()
 {
     //IDLog("Server disconnected called\n");
-    if (sConnected == false)
+    if (sConnected.exchange(false) == false)
+    {
+        stopThreads();
         return true;
+    }
 
-    sConnected = false;
+    {
+        // Release the I/O thread if it waits for room in the event queue
+        std::lock_guard<std::mutex> lock(eventsLock);
+        eventsCondition.notify_all();
+    }
 
 #ifdef _WINDOWS
-    net_close(sockfd);
-    WSACleanup();
+    shutdown(sockfd, SD_BOTH);
 #else
     shutdown(sockfd, SHUT_RDWR);
-    while (write(m_sendFd, "1", 1) <= 0)
+#endif
+
+    stopThreads();
+
+#ifdef _WINDOWS
+    WSACleanup();
 #endif
 
     clear();
 
     cDeviceNames.clear();
 
-    listen_thread->join();
-    delete(listen_thread);
-    listen_thread = nullptr;
-    //pthread_join(listen_thread, nullptr);
-
     int exit_code = 0;
     serverDisconnected(exit_code);
 
     return true;
 }
 
+void INDI::BaseClient::stopThreads()
+{
+    if (listen_thread)
+    {
+        wakeListener();
+        listen_thread->join();
+        delete(listen_thread);
+        listen_thread = nullptr;
+
+        net_close(sockfd);
+#ifndef _WINDOWS
+        close(m_receiveFd);
+        close(m_sendFd);
+        m_receiveFd = m_sendFd = -1;
+#endif
+    }
+
+    if (exiting_dispatch_thread && exiting_dispatch_thread->get_id() != std::this_thread::get_id())
+    {
+        exiting_dispatch_thread->join();
+        delete(exiting_dispatch_thread);
+        exiting_dispatch_thread = nullptr;
+    }
+
+    if (dispatch_thread)
+    {
+        {
+            // The end of the connection may never reach it, the queue is cleared below
+            std::lock_guard<std::mutex> lock(eventsLock);
+            dispatchGeneration++;
+            eventsCondition.notify_all();
+        }
+
+        // Stopped from a callback, the dispatcher returns right after it
+        if (dispatch_thread->get_id() == std::this_thread::get_id())
+            exiting_dispatch_thread = dispatch_thread;
+        else
+        {
+            dispatch_thread->join();
+            delete(dispatch_thread);
+        }
+        dispatch_thread = nullptr;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(eventsLock);
+        for (auto &event : events)
+        {
+            if (event.root)
+                deleteEvent(event.root);
+        }
+        events.clear();
+    }
+
+    std::lock_guard<std::mutex> lock(outputLock);
+    output.clear();
+    outputSize = 0;
+}
+
 bool INDI::BaseClient::isServerConnected() const
 {
     return sConnected;
@@ -363,13 +497,13 @@ void INDI::BaseClient::listenINDI()
 {
     char buffer[MAXINDIBUF];
     char msg[MAXRBUF];
-    int n = 0, err_code = 0;
+    int n = 0;
 #ifdef _WINDOWS
     SOCKET maxfd = 0;
 #else
     int maxfd = 0;
 #endif
-    fd_set rs;
+    fd_set rs, ws;
     XMLEle **nodes = nullptr;
     XMLEle *root = nullptr;
     int inode = 0;
@@ -394,42 +528,63 @@ void INDI::BaseClient::listenINDI()
 
     locale.Restore();
 
-    FD_ZERO(&rs);
-
-    FD_SET(sockfd, &rs);
-    if (sockfd > maxfd)
-        maxfd = sockfd;
-
+    maxfd = sockfd;
 #ifndef _WINDOWS
-    FD_SET(m_receiveFd, &rs);
     if (m_receiveFd > maxfd)
         maxfd = m_receiveFd;
 #endif
 
-    clear();
     lillp = newLilXML();
+    if (blobAllocate)
+        setXMLContentSink(lillp, blobSink, this);
 
-    /* read from server, exit if find all requested properties */
+    /* read from server, write queued messages, until disconnected */
     while (sConnected)
     {
-        n = select(maxfd + 1, &rs, nullptr, nullptr, nullptr);
+        FD_ZERO(&rs);
+        FD_ZERO(&ws);
+        FD_SET(sockfd, &rs);
+#ifndef _WINDOWS
+        FD_SET(m_receiveFd, &rs);
+#endif
+        {
+            std::lock_guard<std::mutex> lock(outputLock);
+            if (!output.empty())
+                FD_SET(sockfd, &ws);
+        }
+
+#ifdef _WINDOWS
+        // No wake up pipe, poll for queued output and disconnection
+        struct timeval tv = { 0, 50000 };
+        n = select(maxfd + 1, &rs, &ws, nullptr, &tv);
+#else
+        n = select(maxfd + 1, &rs, &ws, nullptr, nullptr);
+#endif
 
         if (n < 0)
         {
+            if (errno == EINTR)
+                continue;
             IDLog("INDI server %s/%d disconnected.\n", cServer.c_str(), cPort);
-            net_close(sockfd);
             break;
         }
 
 #ifndef _WINDOWS
-        // Received termination string from main thread
+        // Woken up by another thread, to write new output or to stop
         if (n > 0 && FD_ISSET(m_receiveFd, &rs))
         {
-            sConnected = false;
-            break;
+            while (read(m_receiveFd, buffer, sizeof(buffer)) == (ssize_t)sizeof(buffer))
+                ;
+            continue;
         }
 #endif
 
+        if (n > 0 && FD_ISSET(sockfd, &ws) && !flushOutput())
+        {
+            IDLog("INDI server %s/%d disconnected.\n", cServer.c_str(), cPort);
+            break;
+        }
+
         if (n > 0 && FD_ISSET(sockfd, &rs))
         {
 #ifdef _WINDOWS
@@ -442,7 +597,6 @@ void INDI::BaseClient::listenINDI()
                 if (n == 0)
                 {
                     IDLog("INDI server %s/%d disconnected.\n", cServer.c_str(), cPort);
-                    net_close(sockfd);
                     break;
                 }
                 else
@@ -454,44 +608,616 @@ void INDI::BaseClient::listenINDI()
             if (!nodes)
             {
                 if (msg[0])
-                {
                     IDLog("Bad XML from %s/%d: %s\n%s\n", cServer.c_str(), cPort, msg, buffer);
-                    return;
-                }
-                return;
+                break;
             }
             root = nodes[inode];
             while (root)
             {
-                if (verbose)
-                    prXMLEle(stderr, root, 0);
+                // Dispatched by the dispatch thread or processEvents()
+                queueEvent(root);
+                inode++;
+                root = nodes[inode];
+            }
+            free(nodes);
+            inode = 0;
+        }
+    }
+
+    delLilXML(lillp);
 
-                if ((err_code = dispatchCommand(root, msg)) < 0)
+    // The dispatcher reports the disconnection once the events before it are handled
+    queueEvent(nullptr);
+
+    //pthread_exit(0);
+}
+
+/* Decodes one oneBLOB from the parser into the buffer of the client.
+ * Base64 is decoded a run of whole quads at a time straight from the receive buffer, only quads split between
+ * two reads are copied. Compressed BLOBs are inflated into the buffer as they are decoded.
+ */
+class INDI::BaseClient::BLOBReceiver : public INDI::BaseDevice::ReceivedBLOB
+{
+    public:
+        BLOBReceiver(void *buffer, size_t capacity, bool binary, bool compressed)
+            : capacity(capacity), binary(binary), compressed(compressed)
+        {
+            this->buffer = buffer;
+            size         = 0;
+            valid        = true;
+
+            if (compressed)
+            {
+                memset(&stream, 0, sizeof(stream));
+                valid = (inflateInit(&stream) == Z_OK);
+            }
+        }
+        ~BLOBReceiver()
+        {
+            if (compressed)
+                inflateEnd(&stream);
+        }
+
+        void write(const char *data, size_t len)
+        {
+            if (!valid || done)
+                return;
+
+            if (binary)
+            {
+                output(data, len);
+                return;
+            }
+
+            const char *end = data + len;
+            while (data < end && valid)
+            {
+                if (isspace(*data))
+                {
+                    data++;
+                    continue;
+                }
+
+                // Complete a quad split between two reads
+                if (nquad > 0)
                 {
-                    // Silenty ignore property duplication errors
-                    if (err_code != INDI_PROPERTY_DUPLICATED)
+                    while (nquad < 4 && data < end && !isspace(*data))
+                        quad[nquad++] = *data++;
+                    if (nquad == 4)
                     {
-                        IDLog("Dispatch command error(%d): %s\n", err_code, msg);
-                        prXMLEle(stderr, root, 0);
+                        decode(quad, 4);
+                        nquad = 0;
                     }
+                    continue;
                 }
 
-                delXMLEle(root); // not yet, delete and continue
-                inode++;
-                root = nodes[inode];
+                const char *run = data;
+                while (data < end && !isspace(*data))
+                    data++;
+                size_t whole = (data - run) & ~static_cast<size_t>(3);
+                if (whole)
+                    decode(run, whole);
+                for (const char *rest = run + whole; rest < data; rest++)
+                    quad[nquad++] = *rest;
             }
-            free(nodes);
-            inode = 0;
         }
+
+        void finish()
+        {
+            if (nquad != 0 || (compressed && !done))
+                valid = false;
+        }
+
+        size_t capacity;
+
+    private:
+        // n base64 characters, a multiple of 4
+        void decode(const char *run, size_t n)
+        {
+            size_t padding = (run[n - 1] == '=') + (run[n - 2] == '=');
+
+            if (!compressed)
+            {
+                size_t bytes = n / 4 * 3 - padding;
+                if (size + bytes > capacity)
+                {
+                    valid = false;
+                    return;
+                }
+                from64tobits_fast(static_cast<char *>(buffer) + size, run, n);
+                size += bytes;
+                return;
+            }
+
+            // Inflated from a small decoded piece at a time
+            char piece[3 * 4096];
+            while (n > 0 && valid && !done)
+            {
+                size_t take = std::min(n, sizeof(piece) / 3 * 4);
+                output(piece, from64tobits_fast(piece, run, take));
+                run += take;
+                n -= take;
+            }
+        }
+
+        void output(const char *data, size_t len)
+        {
+            if (!compressed)
+            {
+                if (size + len > capacity)
+                {
+                    valid = false;
+                    return;
+                }
+                memcpy(static_cast<char *>(buffer) + size, data, len);
+                size += len;
+                return;
+            }
+
+            stream.next_in   = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+            stream.avail_in  = len;
+            stream.next_out  = static_cast<Bytef *>(buffer) + size;
+            stream.avail_out = capacity - size;
+
+            int r = inflate(&stream, Z_NO_FLUSH);
+            size  = capacity - stream.avail_out;
+            if (r == Z_STREAM_END)
+                done = true;
+            else if ((r != Z_OK && r != Z_BUF_ERROR) || stream.avail_in > 0)
+                valid = false;
+        }
+
+        bool binary, compressed;
+        bool done { false };
+        z_stream stream;
+        char quad[4];
+        int nquad { 0 };
+};
+
+int INDI::BaseClient::blobSink(void *context, XMLEle *ep, const char *data, int len)
+{
+    INDI::BaseClient *client = static_cast<INDI::BaseClient *>(context);
+    BLOBReceiver *receiver   = static_cast<BLOBReceiver *>(auxXMLEle(ep));
+
+    if (len > 0)
+        receiver->write(data, len);
+    else if (len == -1)
+        receiver->finish();
+    else if (len == -2)
+    {
+        // Incomplete message, never dispatched
+        client->releaseBLOBs(ep);
     }
+    else
+    {
+        XMLEle *parent = parentXMLEle(ep);
+        if (strcmp(tagXMLEle(ep), "oneBLOB") || !parent || strcmp(tagXMLEle(parent), "setBLOBVector"))
+            return 0;
 
-    delLilXML(lillp);
+        int size = atoi(findXMLAttValu(ep, "size"));
+        if (size <= 0)
+            return 0;
 
-    serverDisconnected((sConnected == false) ? 0 : -1);
-    sConnected = false;
+        void *buffer = client->blobAllocate(findXMLAttValu(parent, "device"), findXMLAttValu(parent, "name"),
+                                            findXMLAttValu(ep, "name"), size);
+        if (buffer == nullptr)
+            return 0;
 
+        receiver = new BLOBReceiver(buffer, size, findXMLAtt(ep, "binlen") != nullptr,
+                                    strstr(findXMLAttValu(ep, "format"), ".z") != nullptr);
+        setAuxXMLEle(ep, receiver);
+        return 1;
+    }
 
-    //pthread_exit(0);
+    return 0;
+}
+
+void INDI::BaseClient::releaseBLOBs(XMLEle *root)
+{
+    for (XMLEle *ep = nextXMLEle(root, 1); ep; ep = nextXMLEle(root, 0))
+    {
+        BLOBReceiver *receiver = static_cast<BLOBReceiver *>(auxXMLEle(ep));
+        if (receiver)
+        {
+            if (blobRelease)
+                blobRelease(receiver->buffer);
+            delete receiver;
+            setAuxXMLEle(ep, nullptr);
+        }
+    }
+}
+
+void INDI::BaseClient::deleteEvent(XMLEle *root)
+{
+    releaseBLOBs(root);
+    delXMLEle(root);
+}
+
+void INDI::BaseClient::setBLOBAllocator(std::function<void *(const char *, const char *, const char *, size_t)> allocate,
+                                        std::function<void(void *)> release)
+{
+    blobAllocate = allocate;
+    blobRelease  = release;
+}
+
+static bool isUpdate(XMLEle *root)
+{
+    return !strncmp(tagXMLEle(root), "set", 3);
+}
+
+void INDI::BaseClient::queueEvent(XMLEle *root)
+{
+    std::unique_lock<std::mutex> lock(eventsLock);
+
+    if (root && events.size() >= maxEvents && !(eventsPolicy != EVENTS_BLOCK && dropEvent(root)))
+    {
+        while (events.size() >= maxEvents && sConnected)
+        {
+            // Keep writing while the dispatcher catches up
+            eventsCondition.wait_for(lock, std::chrono::milliseconds(50));
+            lock.unlock();
+            flushOutput();
+            lock.lock();
+        }
+
+        if (!sConnected)
+        {
+            deleteEvent(root);
+            return;
+        }
+    }
+
+    events.push_back({ root, std::chrono::steady_clock::now() });
+    stats.eventsQueuedMax = std::max(stats.eventsQueuedMax, events.size());
+    eventsCondition.notify_all();
+}
+
+bool INDI::BaseClient::dropEvent(XMLEle *root)
+{
+    for (auto event = events.begin(); event != events.end(); ++event)
+    {
+        if (event->root == nullptr)
+            continue;
+
+        if (eventsPolicy == EVENTS_DROP_OLDEST)
+        {
+            if (!isUpdate(event->root) && strcmp(tagXMLEle(event->root), "message"))
+                continue;
+        }
+        else if (!isUpdate(root) || strcmp(tagXMLEle(root), tagXMLEle(event->root)) ||
+                 strcmp(findXMLAttValu(root, "device"), findXMLAttValu(event->root, "device")) ||
+                 strcmp(findXMLAttValu(root, "name"), findXMLAttValu(event->root, "name")))
+            continue;
+
+        deleteEvent(event->root);
+        events.erase(event);
+        stats.eventsDropped++;
+        return true;
+    }
+
+    return false;
+}
+
+void INDI::BaseClient::dispatchEvents(uint64_t generation)
+{
+    std::unique_lock<std::mutex> lock(eventsLock);
+
+    // Until the end of the connection, or stopThreads() let go of this dispatcher
+    while (true)
+    {
+        eventsCondition.wait(lock, [&]() { return !events.empty() || generation != dispatchGeneration; });
+        if (generation != dispatchGeneration || !dispatchNext(lock))
+            return;
+    }
+}
+
+bool INDI::BaseClient::dispatchNext(std::unique_lock<std::mutex> &lock)
+{
+    char msg[MAXRBUF];
+    int err_code = 0;
+
+    Event event = events.front();
+    events.pop_front();
+    eventsCondition.notify_all();
+
+    // End of the connection, only reported here if the server closed it
+    if (event.root == nullptr)
+    {
+        lock.unlock();
+        if (sConnected.exchange(false))
+            serverDisconnected(-1);
+        return false;
+    }
+
+    // Disconnecting, drop what is left
+    if (!sConnected)
+    {
+        deleteEvent(event.root);
+        return true;
+    }
+
+    double latency =
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - event.received).count();
+    stats.eventsDispatched++;
+    dispatchLatencySum += latency;
+    stats.dispatchLatencyMax = std::max(stats.dispatchLatencyMax, latency);
+    lock.unlock();
+
+    if (verbose)
+        prXMLEle(stderr, event.root, 0);
+
+    if ((err_code = dispatchCommand(event.root, msg)) < 0)
+    {
+        // Silenty ignore property duplication errors
+        if (err_code != INDI_PROPERTY_DUPLICATED)
+        {
+            IDLog("Dispatch command error(%d): %s\n", err_code, msg);
+            prXMLEle(stderr, event.root, 0);
+        }
+    }
+    else if (useSnapshots)
+        updateSnapshot(event.root);
+
+    deleteEvent(event.root);
+
+    lock.lock();
+    return true;
+}
+
+void INDI::BaseClient::setEventQueue(size_t maxEvents, EventQueuePolicy policy)
+{
+    std::lock_guard<std::mutex> lock(eventsLock);
+    this->maxEvents = std::max<size_t>(maxEvents, 1);
+    eventsPolicy    = policy;
+    eventsCondition.notify_all();
+}
+
+void INDI::BaseClient::setDispatchThread(bool enable)
+{
+    useDispatchThread = enable;
+}
+
+int INDI::BaseClient::processEvents(uint32_t timeout)
+{
+    if (useDispatchThread)
+        return 0;
+
+    int count = 0;
+    std::unique_lock<std::mutex> lock(eventsLock);
+
+    if (timeout > 0)
+        eventsCondition.wait_for(lock, std::chrono::milliseconds(timeout), [this]() { return !events.empty(); });
+
+    while (!events.empty())
+    {
+        if (!dispatchNext(lock))
+            break;
+        count++;
+    }
+
+    return count;
+}
+
+INDI::BaseClient::Statistics INDI::BaseClient::getStatistics()
+{
+    Statistics current;
+
+    {
+        std::lock_guard<std::mutex> lock(eventsLock);
+        current.eventsQueued       = events.size();
+        current.eventsQueuedMax    = stats.eventsQueuedMax;
+        current.eventsDispatched   = stats.eventsDispatched;
+        current.eventsDropped      = stats.eventsDropped;
+        current.dispatchLatencyAvg = stats.eventsDispatched ? dispatchLatencySum / stats.eventsDispatched : 0;
+        current.dispatchLatencyMax = stats.dispatchLatencyMax;
+    }
+
+    std::lock_guard<std::mutex> lock(outputLock);
+    current.sendQueued     = outputSize;
+    current.sendQueuedMax  = stats.sendQueuedMax;
+    current.messagesSent   = stats.messagesSent;
+    current.sendLatencyAvg = stats.messagesSent ? sendLatencySum / stats.messagesSent : 0;
+    current.sendLatencyMax = stats.sendLatencyMax;
+    return current;
+}
+
+void INDI::BaseClient::resetStatistics()
+{
+    std::lock_guard<std::mutex> eventsGuard(eventsLock);
+    std::lock_guard<std::mutex> outputGuard(outputLock);
+    stats              = Statistics();
+    dispatchLatencySum = sendLatencySum = 0;
+}
+
+void INDI::BaseClient::setSnapshots(bool enable)
+{
+    useSnapshots = enable;
+}
+
+std::shared_ptr<const INDI::BaseClient::Snapshot> INDI::BaseClient::getSnapshot() const
+{
+    return std::atomic_load(&snapshot);
+}
+
+static std::shared_ptr<const INDI::BaseClient::PropertySnapshot> copyProperty(INDI::Property *property,
+                                                                             uint64_t version)
+{
+    auto copy = std::make_shared<INDI::BaseClient::PropertySnapshot>();
+
+    copy->device    = property->getDeviceName();
+    copy->name      = property->getName();
+    copy->label     = property->getLabel();
+    copy->group     = property->getGroupName();
+    copy->timestamp = property->getTimestamp();
+    copy->type      = property->getType();
+    copy->state     = property->getState();
+    copy->perm      = property->getPermission();
+    copy->rule      = ISR_1OFMANY;
+    copy->version   = version;
+
+    auto element = [&](const char *name, const char *label) -> INDI::BaseClient::ElementSnapshot &
+    {
+        copy->elements.push_back(INDI::BaseClient::ElementSnapshot());
+        copy->elements.back().name  = name;
+        copy->elements.back().label = label;
+        return copy->elements.back();
+    };
+
+    switch (property->getType())
+    {
+        case INDI_NUMBER:
+        {
+            INumberVectorProperty *nvp = property->getNumber();
+            copy->elements.reserve(nvp->nnp);
+            for (int i = 0; i < nvp->nnp; i++)
+            {
+                INDI::BaseClient::ElementSnapshot &e = element(nvp->np[i].name, nvp->np[i].label);
+                e.text  = nvp->np[i].format;
+                e.value = nvp->np[i].value;
+                e.min   = nvp->np[i].min;
+                e.max   = nvp->np[i].max;
+                e.step  = nvp->np[i].step;
+            }
+            break;
+        }
+        case INDI_TEXT:
+        {
+            ITextVectorProperty *tvp = property->getText();
+            copy->elements.reserve(tvp->ntp);
+            for (int i = 0; i < tvp->ntp; i++)
+                element(tvp->tp[i].name, tvp->tp[i].label).text = tvp->tp[i].text ? tvp->tp[i].text : "";
+            break;
+        }
+        case INDI_SWITCH:
+        {
+            ISwitchVectorProperty *svp = property->getSwitch();
+            copy->rule = svp->r;
+            copy->elements.reserve(svp->nsp);
+            for (int i = 0; i < svp->nsp; i++)
+                element(svp->sp[i].name, svp->sp[i].label).s = svp->sp[i].s;
+            break;
+        }
+        case INDI_LIGHT:
+        {
+            ILightVectorProperty *lvp = property->getLight();
+            copy->elements.reserve(lvp->nlp);
+            for (int i = 0; i < lvp->nlp; i++)
+                element(lvp->lp[i].name, lvp->lp[i].label).light = lvp->lp[i].s;
+            break;
+        }
+        case INDI_BLOB:
+        {
+            IBLOBVectorProperty *bvp = property->getBLOB();
+            copy->elements.reserve(bvp->nbp);
+            for (int i = 0; i < bvp->nbp; i++)
+            {
+                INDI::BaseClient::ElementSnapshot &e = element(bvp->bp[i].name, bvp->bp[i].label);
+                e.text = bvp->bp[i].format;
+                e.size = bvp->bp[i].size;
+            }
+            break;
+        }
+        case INDI_UNKNOWN:
+            break;
+    }
+
+    return copy;
+}
+
+void INDI::BaseClient::updateSnapshot(XMLEle *root)
+{
+    const char *tag = tagXMLEle(root);
+    if (strncmp(tag, "def", 3) && strncmp(tag, "set", 3) && strncmp(tag, "del", 3))
+        return;
+
+    const char *device = findXMLAttValu(root, "device");
+    const char *name   = findXMLAttValu(root, "name");
+    char errmsg[MAXRBUF];
+
+    std::lock_guard<std::mutex> lock(snapshotLock);
+    std::shared_ptr<const Snapshot> current = std::atomic_load(&snapshot);
+
+    // Only the device map and the map of the device that changed are copied, the rest is shared
+    auto next     = std::make_shared<Snapshot>(*current);
+    next->version = current->version + 1;
+
+    INDI::BaseDevice *dp = findDev(device, errmsg);
+    if (dp == nullptr)
+    {
+        if (next->devices.erase(device) == 0)
+            return;
+    }
+    else
+    {
+        auto found = next->devices.find(device);
+        auto properties = found != next->devices.end() ? std::make_shared<DeviceSnapshot>(*found->second) :
+                          std::make_shared<DeviceSnapshot>();
+
+        INDI::Property *property = *name ? dp->getProperty(name) : nullptr;
+        if (property)
+            (*properties)[name] = copyProperty(property, next->version);
+        else if (properties->erase(name) == 0 && found != next->devices.end())
+            return;
+
+        next->devices[device] = properties;
+    }
+
+    std::atomic_store(&snapshot, std::shared_ptr<const Snapshot>(next));
+}
+
+void INDI::BaseClient::clearSnapshot()
+{
+    std::lock_guard<std::mutex> lock(snapshotLock);
+    std::shared_ptr<const Snapshot> current = std::atomic_load(&snapshot);
+    if (current->devices.empty())
+        return;
+
+    auto next     = std::make_shared<Snapshot>();
+    next->version = current->version + 1;
+    std::atomic_store(&snapshot, std::shared_ptr<const Snapshot>(next));
+}
+
+// Walk two maps sorted by name side by side, calling changed for each name whose entries are not shared
+template <typename Map, typename Changed>
+static void compareMaps(const Map &before, const Map &after, Changed changed)
+{
+    typename Map::mapped_type none;
+    auto b = before.begin(), a = after.begin();
+
+    while (b != before.end() || a != after.end())
+    {
+        if (a == after.end() || (b != before.end() && b->first < a->first))
+            changed(b->second, none), ++b;
+        else if (b == before.end() || a->first < b->first)
+            changed(none, a->second), ++a;
+        else
+        {
+            if (b->second != a->second)
+                changed(b->second, a->second);
+            ++b, ++a;
+        }
+    }
+}
+
+std::vector<INDI::BaseClient::PropertyChange> INDI::BaseClient::getChanges(const Snapshot *since,
+                                                                          const Snapshot &current)
+{
+    static const Snapshot empty = Snapshot();
+    std::vector<PropertyChange> changes;
+
+    compareMaps(since ? since->devices : empty.devices, current.devices,
+                [&](const std::shared_ptr<const DeviceSnapshot> &before, const std::shared_ptr<const DeviceSnapshot> &after)
+    {
+        static const DeviceSnapshot none;
+        compareMaps(before ? *before : none, after ? *after : none,
+                    [&](const std::shared_ptr<const PropertySnapshot> &b, const std::shared_ptr<const PropertySnapshot> &a)
+        {
+            const PropertySnapshot &property = a ? *a : *b;
+            changes.push_back({ property.device, property.name, b, a });
+        });
+    });
+
+    return changes;
 }
 
 int INDI::BaseClient::dispatchCommand(XMLEle *root, char *errmsg)
@@ -733,21 +1459,24 @@ void INDI::BaseClient::newUniversalMessage(std::string message)
 
 void INDI::BaseClient::sendNewText(ITextVectorProperty *tvp)
 {
+    std::string message;
+
     tvp->s = IPS_BUSY;
 
-    sendString("<newTextVector\n");
-    sendString("  device='%s'\n", tvp->device);
-    sendString("  name='%s'\n>", tvp->name);
+    appendString(message, "<newTextVector\n");
+    appendString(message, "  device='%s'\n", tvp->device);
+    appendString(message, "  name='%s'\n>", tvp->name);
 
     for (int i = 0; i < tvp->ntp; i++)
     {
-        sendString("  <oneText\n");
-        sendString("    name='%s'>\n", tvp->tp[i].name);
-        sendString("      %s\n", tvp->tp[i].text);
-        sendString("  </oneText>\n");
+        appendString(message, "  <oneText\n");
+        appendString(message, "    name='%s'>\n", tvp->tp[i].name);
+        appendString(message, "      %s\n", tvp->tp[i].text);
+        appendString(message, "  </oneText>\n");
     }
-    sendString("</newTextVector>\n");
+    appendString(message, "</newTextVector>\n");
 
+    queueOutput(std::move(message));
 }
 
 void INDI::BaseClient::sendNewText(const char *deviceName, const char *propertyName, const char *elementName,
@@ -776,21 +1505,24 @@ void INDI::BaseClient::sendNewText(const char *deviceName, const char *propertyN
 void INDI::BaseClient::sendNewNumber(INumberVectorProperty *nvp)
 {
     AutoCNumeric locale;
+    std::string message;
 
     nvp->s = IPS_BUSY;
 
-    sendString("<newNumberVector\n");
-    sendString("  device='%s'\n", nvp->device);
-    sendString("  name='%s'\n>", nvp->name);
+    appendString(message, "<newNumberVector\n");
+    appendString(message, "  device='%s'\n", nvp->device);
+    appendString(message, "  name='%s'\n>", nvp->name);
 
     for (int i = 0; i < nvp->nnp; i++)
     {
-        sendString("  <oneNumber\n");
-        sendString("    name='%s'>\n", nvp->np[i].name);
-        sendString("      %g\n", nvp->np[i].value);
-        sendString("  </oneNumber>\n");
+        appendString(message, "  <oneNumber\n");
+        appendString(message, "    name='%s'>\n", nvp->np[i].name);
+        appendString(message, "      %g\n", nvp->np[i].value);
+        appendString(message, "  </oneNumber>\n");
     }
-    sendString("</newNumberVector>\n");
+    appendString(message, "</newNumberVector>\n");
+
+    queueOutput(std::move(message));
 }
 
 void INDI::BaseClient::sendNewNumber(const char *deviceName, const char *propertyName, const char *elementName,
@@ -818,33 +1550,37 @@ void INDI::BaseClient::sendNewNumber(const char *deviceName, const char *propert
 
 void INDI::BaseClient::sendNewSwitch(ISwitchVectorProperty *svp)
 {
+    std::string message;
+
     svp->s            = IPS_BUSY;
     ISwitch *onSwitch = IUFindOnSwitch(svp);
 
-    sendString("<newSwitchVector\n");
+    appendString(message, "<newSwitchVector\n");
 
-    sendString("  device='%s'\n", svp->device);
-    sendString("  name='%s'>\n", svp->name);
+    appendString(message, "  device='%s'\n", svp->device);
+    appendString(message, "  name='%s'>\n", svp->name);
 
     if (svp->r == ISR_1OFMANY && onSwitch)
     {
-        sendString("  <oneSwitch\n");
-        sendString("    name='%s'>\n", onSwitch->name);
-        sendString("      %s\n", (onSwitch->s == ISS_ON) ? "On" : "Off");
-        sendString("  </oneSwitch>\n");
+        appendString(message, "  <oneSwitch\n");
+        appendString(message, "    name='%s'>\n", onSwitch->name);
+        appendString(message, "      %s\n", (onSwitch->s == ISS_ON) ? "On" : "Off");
+        appendString(message, "  </oneSwitch>\n");
     }
     else
     {
         for (int i = 0; i < svp->nsp; i++)
         {
-            sendString("  <oneSwitch\n");
-            sendString("    name='%s'>\n", svp->sp[i].name);
-            sendString("      %s\n", (svp->sp[i].s == ISS_ON) ? "On" : "Off");
-            sendString("  </oneSwitch>\n");
+            appendString(message, "  <oneSwitch\n");
+            appendString(message, "    name='%s'>\n", svp->sp[i].name);
+            appendString(message, "      %s\n", (svp->sp[i].s == ISS_ON) ? "On" : "Off");
+            appendString(message, "  </oneSwitch>\n");
         }
     }
 
-    sendString("</newSwitchVector>\n");
+    appendString(message, "</newSwitchVector>\n");
+
+    queueOutput(std::move(message));
 }
 
 void INDI::BaseClient::sendNewSwitch(const char *deviceName, const char *propertyName, const char *elementName)
@@ -871,83 +1607,50 @@ void INDI::BaseClient::sendNewSwitch(const char *deviceName, const char *propert
 
 void INDI::BaseClient::startBlob(const char *devName, const char *propName, const char *timestamp)
 {
-    sendString("<newBLOBVector\n");
-    sendString("  device='%s'\n", devName);
-    sendString("  name='%s'\n", propName);
-    sendString("  timestamp='%s'>\n", timestamp);
+    std::string message;
+
+    appendString(message, "<newBLOBVector\n");
+    appendString(message, "  device='%s'\n", devName);
+    appendString(message, "  name='%s'\n", propName);
+    appendString(message, "  timestamp='%s'>\n", timestamp);
+
+    queueOutput(std::move(message));
 }
 
 void INDI::BaseClient::sendOneBlob(IBLOB *bp)
 {
-    unsigned char *encblob;
-    char nl = '\n';
-    int l;
-    int ret = 0;
-
-    encblob = (unsigned char *)malloc(4 * bp->size / 3 + 4);
-    l       = to64frombits(encblob, reinterpret_cast<const unsigned char *>(bp->blob), bp->size);
-
-    sendString("  <oneBLOB\n");
-    sendString("    name='%s'\n", bp->name);
-    sendString("    size='%ud'\n", bp->size);
-    sendString("    enclen='%d'\n", l);
-    sendString("    format='%s'>\n", bp->format);
-
-    size_t written = 0;
-    size_t towrite = 0;
-    while ((int)written < l)
-    {
-        towrite   = ((l - written) > 72) ? 72 : l - written;
-        size_t wr = net_write(sockfd, encblob + written, towrite);
-        if (wr > 0)
-            written += wr;
-        if ((written % 72) == 0)
-            ret = net_write(sockfd, &nl, 1);
-    }
-
-    if ((written % 72) != 0)
-        ret = net_write(sockfd, &nl, 1);
-
-    free(encblob);
-
-    sendString("   </oneBLOB>\n");
+    sendOneBlob(bp->name, bp->size, bp->format, bp->blob);
 }
 
 void INDI::BaseClient::sendOneBlob(const char *blobName, unsigned int blobSize, const char *blobFormat,
                                    void *blobBuffer)
 {
     unsigned char *encblob;
-    char nl = '\n';
+    std::string message;
     int l;
-    int ret = 0;
 
     encblob = (unsigned char *)malloc(4 * blobSize / 3 + 4);
     l       = to64frombits(encblob, reinterpret_cast<const unsigned char *>(blobBuffer), blobSize);
 
-    sendString("  <oneBLOB\n");
-    sendString("    name='%s'\n", blobName);
-    sendString("    size='%ud'\n", blobSize);
-    sendString("    enclen='%d'\n", l);
-    sendString("    format='%s'>\n", blobFormat);
-
-    size_t written = 0;
-    size_t towrite = 0;
-    while ((int)written < l)
-    {
-        towrite   = ((l - written) > 72) ? 72 : l - written;
-        size_t wr = net_write(sockfd, encblob + written, towrite);
-        if (wr > 0)
-            written += wr;
-        if ((written % 72) == 0)
-            ret = net_write(sockfd, &nl, 1);
-    }
+    appendString(message, "  <oneBLOB\n");
+    appendString(message, "    name='%s'\n", blobName);
+    appendString(message, "    size='%ud'\n", blobSize);
+    appendString(message, "    enclen='%d'\n", l);
+    appendString(message, "    format='%s'>\n", blobFormat);
 
-    if ((written % 72) != 0)
-        ret = net_write(sockfd, &nl, 1);
+    // Base64 in lines of 72 characters
+    message.reserve(message.size() + l + l / 72 + 32);
+    for (int written = 0; written < l; written += 72)
+    {
+        message.append(reinterpret_cast<const char *>(encblob) + written, std::min(72, l - written));
+        message += '\n';
+    }
 
     free(encblob);
 
-    sendString("   </oneBLOB>\n");
+    appendString(message, "   </oneBLOB>\n");
+
+    queueOutput(std::move(message));
 }
 
 void INDI::BaseClient::finishBlob()
@@ -982,9 +1685,9 @@ void INDI::BaseClient::setBLOBMode(BLOBHandling blobH, const char *dev, const ch
     }
 
     if (prop != nullptr)
-        snprintf(blobOpenTag, MAXRBUF, "<enableBLOB device='%s' name='%s'>", dev, prop);
+        snprintf(blobOpenTag, MAXRBUF, "<enableBLOB device='%s' name='%s' binary='true'>", dev, prop);
     else
-        snprintf(blobOpenTag, MAXRBUF, "<enableBLOB device='%s'>", dev);
+        snprintf(blobOpenTag, MAXRBUF, "<enableBLOB device='%s' binary='true'>", dev);
 
     switch (blobH)
     {
@@ -1036,12 +1739,93 @@ bool INDI::BaseClient::getDevices(std::vector<INDI::BaseDevice *> &deviceList, u
 
 void INDI::BaseClient::sendString(const char *fmt, ...)
 {
-    int ret = 0;
-    char message[MAXRBUF];
+    std::string message;
+    char buffer[MAXRBUF];
     va_list ap;
 
     va_start(ap, fmt);
-    vsnprintf(message, MAXRBUF, fmt, ap);
+    vsnprintf(buffer, MAXRBUF, fmt, ap);
     va_end(ap);
-    ret = net_write(sockfd, message, strlen(message));
+
+    message = buffer;
+    queueOutput(std::move(message));
+}
+
+void INDI::BaseClient::appendString(std::string &message, const char *fmt, ...)
+{
+    char buffer[MAXRBUF];
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(buffer, MAXRBUF, fmt, ap);
+    va_end(ap);
+
+    message += buffer;
+}
+
+void INDI::BaseClient::queueOutput(std::string &&data)
+{
+    if (!sConnected || data.empty())
+        return;
+
+    bool idle;
+    {
+        std::lock_guard<std::mutex> lock(outputLock);
+        idle = output.empty();
+        outputSize += data.size();
+        stats.sendQueuedMax = std::max(stats.sendQueuedMax, outputSize);
+        output.push_back({ std::move(data), 0, std::chrono::steady_clock::now() });
+    }
+
+    // Write at once what the socket takes, the I/O thread writes the rest when it can
+    if (idle)
+        flushOutput();
+
+    std::lock_guard<std::mutex> lock(outputLock);
+    if (!output.empty())
+        wakeListener();
+}
+
+bool INDI::BaseClient::flushOutput()
+{
+    std::lock_guard<std::mutex> lock(outputLock);
+
+    while (!output.empty())
+    {
+        Output &next = output.front();
+#ifdef _WINDOWS
+        int n = send(sockfd, next.data.data() + next.written, (int)(next.data.size() - next.written), 0);
+        if (n < 0)
+            return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+        ssize_t n = send(sockfd, next.data.data() + next.written, next.data.size() - next.written,
+                         MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n < 0)
+            return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR);
+#endif
+
+        next.written += n;
+        outputSize -= n;
+        if (next.written < next.data.size())
+            return true;
+
+        double latency =
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - next.queued).count();
+        stats.messagesSent++;
+        sendLatencySum += latency;
+        stats.sendLatencyMax = std::max(stats.sendLatencyMax, latency);
+        output.pop_front();
+    }
+
+    return true;
+}
+
+void INDI::BaseClient::wakeListener()
+{
+#ifndef _WINDOWS
+    if (m_sendFd >= 0 && write(m_sendFd, "1", 1) < 0)
+    {
+        // Full, the I/O thread is awake anyway
+    }
+#endif
 }
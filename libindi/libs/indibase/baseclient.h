@@ -21,6 +21,14 @@
 #include "indiapi.h"
 #include "indibase.h"
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -41,8 +49,11 @@
    a set of INDI::BaseDevice devices, and read and write properties seamlessly. Event driven programming is possible due to
    notifications upon reception of new devices or properties.
 
-   Upon connecting to an INDI server, it creates a dedicated thread to handle all incoming traffic. The thread is terminated
-   when disconnectServer() is called or when a communication error occurs.
+   Upon connecting to an INDI server, it creates a dedicated I/O thread that reads and parses incoming traffic and writes
+   queued outgoing messages. Parsed messages go through a bounded event queue to a dispatch thread, which updates the
+   devices and calls the notification functions, so a slow handler does not stop the socket reads. Alternatively the
+   client may dispatch the events itself from its own loop with processEvents(). The threads are terminated when
+   disconnectServer() is called or when a communication error occurs.
 
    \attention All notifications functions defined in INDI::BaseMediator <b>must</b> be implemented in the client class even if
    they are not used because these are pure virtual functions.
@@ -54,14 +65,90 @@
 class INDI::BaseClient : public INDI::BaseMediator
 {
   public:
+    /** \brief What the I/O thread does with a message when the event queue is full */
+    typedef enum
+    {
+        EVENTS_BLOCK,       /*!< Wait for the dispatcher, the server then sees the client as slow. */
+        EVENTS_DROP_OLDEST, /*!< Drop the oldest queued setXXXVector or message. */
+        EVENTS_COALESCE     /*!< Replace a queued setXXXVector of the same property, the latest values win. */
+    } EventQueuePolicy;
+
+    /** \brief Event queue and output queue counters, see getStatistics() */
+    typedef struct
+    {
+        size_t eventsQueued;          /*!< Events waiting for dispatch */
+        size_t eventsQueuedMax;       /*!< Largest number of events waiting since the last reset */
+        uint64_t eventsDispatched;    /*!< Events dispatched */
+        uint64_t eventsDropped;       /*!< Events dropped or replaced because the queue was full */
+        double dispatchLatencyAvg;    /*!< Average time from parsing to dispatch, in milliseconds */
+        double dispatchLatencyMax;    /*!< Longest time from parsing to dispatch, in milliseconds */
+        size_t sendQueued;            /*!< Bytes waiting to be written to the server */
+        size_t sendQueuedMax;         /*!< Largest number of bytes waiting since the last reset */
+        uint64_t messagesSent;        /*!< Messages completely written to the server */
+        double sendLatencyAvg;        /*!< Average time from sending to written, in milliseconds */
+        double sendLatencyMax;        /*!< Longest time from sending to written, in milliseconds */
+    } Statistics;
+
+    /** \brief Copy of one element of a property, see getSnapshot() */
+    typedef struct
+    {
+        std::string name;       /*!< Element name */
+        std::string label;      /*!< Element label */
+        std::string text;       /*!< Text of a text element, format of a number or BLOB element */
+        double value;           /*!< Value of a number element */
+        double min, max, step;  /*!< Range of a number element */
+        ISState s;              /*!< State of a switch element */
+        IPState light;          /*!< State of a light element */
+        size_t size;            /*!< Size of the last BLOB received, its content is not copied */
+    } ElementSnapshot;
+
+    /** \brief Copy of one property, never modified once it is part of a Snapshot */
+    typedef struct
+    {
+        std::string device;
+        std::string name;
+        std::string label;
+        std::string group;
+        std::string timestamp;
+        INDI_PROPERTY_TYPE type;
+        IPState state;
+        IPerm perm;
+        ISRule rule;                           /*!< Rule of a switch property */
+        uint64_t version;                      /*!< Snapshot version in which the property was last defined or set */
+        std::vector<ElementSnapshot> elements;
+    } PropertySnapshot;
+
+    /** \brief Properties of one device by name */
+    typedef std::map<std::string, std::shared_ptr<const PropertySnapshot>> DeviceSnapshot;
+
+    /**
+     * \brief Immutable view of all devices and properties, see getSnapshot().
+     * A new version shares every unchanged device and property with the previous one.
+     */
+    typedef struct
+    {
+        uint64_t version;                                             /*!< Incremented with each update */
+        std::map<std::string, std::shared_ptr<const DeviceSnapshot>> devices; /*!< Devices by name */
+    } Snapshot;
+
+    /** \brief Property added, updated or removed between two snapshots, see getChanges() */
+    typedef struct
+    {
+        std::string device;
+        std::string property;
+        std::shared_ptr<const PropertySnapshot> before; /*!< nullptr if the property was added */
+        std::shared_ptr<const PropertySnapshot> after;  /*!< nullptr if the property was removed */
+    } PropertyChange;
+
     BaseClient();
     virtual ~BaseClient();
 
     /** \brief Set the server host name and port
-        \param hostname INDI server host name or IP address.
-        \param port INDI server port.
+        \param hostname INDI server host name or IP address, or unix:path to connect to the Unix domain
+        socket a local INDI server listens on (indiserver -u path).
+        \param port INDI server port, unused for unix:path.
     */
-    void setServer(const char *hostname, unsigned int port);
+    void setServer(const char *hostname, unsigned int port = 7624);
 
     /** \brief Add a device to the watch list.
 
@@ -136,6 +223,9 @@ class INDI::BaseClient : public INDI::BaseMediator
       If \e dev and \e prop are supplied, then the BLOB handling policy is set for this particular device and property.
       if \e prop is NULL, then the BLOB policy applies to the whole device.
 
+      The request also asks the server for binary BLOB framing, so BLOB contents arrive without base64 encoding.
+      Servers that do not support it keep sending base64, both are decoded transparently.
+
       \param blobH BLOB handling policy
       \param dev name of device, required.
       \param prop name of property, optional.
@@ -202,6 +292,76 @@ class INDI::BaseClient : public INDI::BaseMediator
         timeout_us  = microseconds;
     }
 
+    /**
+     * @brief setEventQueue Set the size of the queue between the I/O thread and the dispatcher, and what
+     * happens to incoming messages while it is full. By default 1024 events and EVENTS_BLOCK.
+     * Definitions and deletions of properties are never dropped, the I/O thread waits for room instead.
+     * @param maxEvents Maximum number of events waiting for dispatch.
+     * @param policy What to do with new messages when maxEvents are waiting.
+     */
+    void setEventQueue(size_t maxEvents, EventQueuePolicy policy);
+
+    /**
+     * @brief setDispatchThread Choose who dispatches the events, must be called before connectServer().
+     * @param enable If true (default), a dedicated thread calls the notification functions. If false, the client
+     * calls processEvents() from its own loop and all notifications are made from that thread.
+     */
+    void setDispatchThread(bool enable);
+
+    /**
+     * @brief processEvents Dispatch the queued events when the dispatch thread is disabled.
+     * @param timeout Milliseconds to wait for the first event, 0 to return at once if none is queued.
+     * @return Number of events dispatched.
+     */
+    int processEvents(uint32_t timeout = 0);
+
+    /**
+     * @brief setBLOBAllocator Receive BLOBs straight into buffers of the client, must be called before connectServer().
+     *
+     * When a oneBLOB starts arriving, allocate is called from the I/O thread with the device, property and element
+     * names and the size announced by the driver, uncompressed. The BLOB is decoded from the socket into the returned
+     * buffer, and decompressed into it on the fly if its format ends with .z, without intermediate copies.
+     * newBLOB() then finds the buffer in blob, with both size and bloblen set to the bytes received. The buffer goes
+     * back to the client through release once newBLOB() returned, or when the BLOB was dropped or failed to decode.
+     * The client may keep it, blob is reset afterwards.
+     * @param allocate Return a buffer of at least size bytes, or nullptr to receive this BLOB in blob as usual.
+     * @param release Called with each buffer BaseClient is done with, from the dispatching thread or the I/O thread.
+     */
+    void setBLOBAllocator(std::function<void *(const char *device, const char *property, const char *name, size_t size)> allocate,
+                          std::function<void(void *buffer)> release);
+
+    /**
+     * @brief setSnapshots Maintain versioned snapshots of all devices and properties, must be called before
+     * connectServer(). Off by default, each update then copies the property.
+     * @param enable If true, the dispatcher publishes a new Snapshot after each definition, update or deletion.
+     */
+    void setSnapshots(bool enable);
+
+    /**
+     * @brief getSnapshot Get the latest snapshot of all devices and properties, from any thread.
+     *
+     * The snapshot is never modified and stays valid as long as it is referenced, readers need no lock and
+     * do not hold back the dispatcher. It is updated after the notification of the same message was made.
+     * Keep the snapshot last processed and pass it to getChanges() to process only what changed since.
+     * @return Latest snapshot, empty with version 0 if snapshots are disabled.
+     */
+    std::shared_ptr<const Snapshot> getSnapshot() const;
+
+    /**
+     * @brief getChanges Compare two snapshots. Only devices and properties that are not shared between them are
+     * compared, so the cost depends on what changed rather than on the number of properties.
+     * @param since Older snapshot, nullptr to list every property of current as added.
+     * @param current Newer snapshot.
+     * @return Properties added, updated or removed since, at most once each with their latest values.
+     */
+    static std::vector<PropertyChange> getChanges(const Snapshot *since, const Snapshot &current);
+
+    /** @return Event queue and output queue counters. */
+    Statistics getStatistics();
+
+    /** @brief resetStatistics Reset the counters, latencies and high water marks. */
+    void resetStatistics();
+
   protected:
     /** \brief Dispatch command received from INDI server to respective devices handled by the client */
     int dispatchCommand(XMLEle *root, char *errmsg);
@@ -251,20 +411,58 @@ class INDI::BaseClient : public INDI::BaseMediator
      */
     void clear();
 
+    // Parsed message waiting for dispatch, a null root marks the end of the connection
+    typedef struct
+    {
+        XMLEle *root;
+        std::chrono::steady_clock::time_point received;
+    } Event;
+
+    // Message waiting to be written to the server
+    typedef struct
+    {
+        std::string data;
+        size_t written;
+        std::chrono::steady_clock::time_point queued;
+    } Output;
+
+    // BLOB decoded into a buffer of the client as it is parsed
+    class BLOBReceiver;
+    static int blobSink(void *context, XMLEle *ep, const char *data, int len);
+    void releaseBLOBs(XMLEle *root);
+    void deleteEvent(XMLEle *root);
+
+    void queueEvent(XMLEle *root);
+    bool dropEvent(XMLEle *root);
+    bool dispatchNext(std::unique_lock<std::mutex> &lock);
+    void dispatchEvents(uint64_t generation);
+    void stopThreads();
+
+    void updateSnapshot(XMLEle *root);
+    void clearSnapshot();
+
+    void queueOutput(std::string &&data);
+    bool flushOutput();
+    void wakeListener();
+
     std::thread *listen_thread=nullptr;
+    std::thread *dispatch_thread=nullptr;
+    // Dispatcher stopped from one of its own callbacks, joined by the next stopThreads()
+    std::thread *exiting_dispatch_thread=nullptr;
 
 #ifdef _WINDOWS
     SOCKET sockfd;
 #else
     int sockfd;
-    int m_receiveFd;
-    int m_sendFd;
+    int m_receiveFd = -1;
+    int m_sendFd = -1;
 #endif
 
     // Listen to INDI server and process incoming messages
     void listenINDI();
 
     void sendString(const char *fmt, ...);
+    static void appendString(std::string &message, const char *fmt, ...);
 
     std::vector<INDI::BaseDevice *> cDevices;
     std::vector<std::string> cDeviceNames;
@@ -272,9 +470,31 @@ class INDI::BaseClient : public INDI::BaseMediator
 
     std::string cServer;
     unsigned int cPort;
-    bool sConnected;
+    std::atomic<bool> sConnected;
     bool verbose;
 
+    std::deque<Event> events;
+    std::mutex eventsLock;
+    std::condition_variable eventsCondition;
+    size_t maxEvents = 1024;
+    EventQueuePolicy eventsPolicy = EVENTS_BLOCK;
+    bool useDispatchThread = true;
+    uint64_t dispatchGeneration = 0; // dispatchers of an older generation return
+
+    std::deque<Output> output;
+    std::mutex outputLock;
+    size_t outputSize = 0;
+
+    std::function<void *(const char *, const char *, const char *, size_t)> blobAllocate;
+    std::function<void(void *)> blobRelease;
+
+    std::shared_ptr<const Snapshot> snapshot;
+    std::mutex snapshotLock;
+    bool useSnapshots = false;
+
+    Statistics stats;
+    double dispatchLatencySum = 0, sendLatencySum = 0;
+
     // Parse & FILE buffers for IO
 
     LilXML *lillp; /* XML parser context */
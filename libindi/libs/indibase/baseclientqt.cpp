@@ -29,6 +29,13 @@
 #include <string>
 
 #include <cstdlib>
+#include <cstring>
+
+#ifndef _WINDOWS
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
 
 #define MAXINDIBUF 49152
 
@@ -83,12 +90,23 @@ void INDI::BaseClientQt::watchDevice(const char *deviceName)
 
 bool INDI::BaseClientQt::connectServer()
 {
-    client_socket.connectToHost(cServer.c_str(), cPort);
-
-    if (client_socket.waitForConnected(timeout_sec * 1000) == false)
+    if (cServer.compare(0, 5, "unix:") == 0)
     {
-        sConnected = false;
-        return false;
+        if (connectUnixSocket(cServer.substr(5)) == false)
+        {
+            sConnected = false;
+            return false;
+        }
+    }
+    else
+    {
+        client_socket.connectToHost(cServer.c_str(), cPort);
+
+        if (client_socket.waitForConnected(timeout_sec * 1000) == false)
+        {
+            sConnected = false;
+            return false;
+        }
     }
 
     clear();
@@ -127,6 +145,46 @@ bool INDI::BaseClientQt::connectServer()
     return true;
 }
 
+bool INDI::BaseClientQt::connectUnixSocket(const std::string &path)
+{
+#ifdef _WINDOWS
+    IDLog("Unix domain sockets are not supported: %s\n", path.c_str());
+    return false;
+#else
+    struct sockaddr_un addr;
+    int fd;
+
+    if (path.empty() || path.size() >= sizeof(addr.sun_path))
+    {
+        IDLog("Bad unix socket path: %s\n", path.c_str());
+        return false;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+    // A local connect completes or fails at once, then the socket is driven like any other
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+    {
+        perror("socket");
+        return false;
+    }
+    if (::connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        perror("connect");
+        close(fd);
+        return false;
+    }
+    if (client_socket.setSocketDescriptor(fd) == false)
+    {
+        IDLog("Socket Error: %s\n", client_socket.errorString().toLatin1().constData());
+        close(fd);
+        return false;
+    }
+    return true;
+#endif
+}
+
 bool INDI::BaseClientQt::disconnectServer()
 {
     if (sConnected == false)
@@ -735,9 +793,9 @@ void INDI::BaseClientQt::setBLOBMode(BLOBHandling blobH, const char *dev, const
     QString blobOpenTag;
     QString blobEnableTag;
     if (prop != nullptr)
-        blobOpenTag = QString("<enableBLOB device='%1' name='%2'>").arg(dev).arg(prop);
+        blobOpenTag = QString("<enableBLOB device='%1' name='%2' binary='true'>").arg(dev).arg(prop);
     else
-        blobOpenTag = QString("<enableBLOB device='%1'>").arg(dev);
+        blobOpenTag = QString("<enableBLOB device='%1' binary='true'>").arg(dev);
 
     switch (blobH)
     {
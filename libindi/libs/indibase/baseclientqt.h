@@ -56,10 +56,11 @@ class INDI::BaseClientQt : public QObject, public INDI::BaseMediator
     virtual ~BaseClientQt();
 
     /** \brief Set the server host name and port
-        \param hostname INDI server host name or IP address.
-        \param port INDI server port.
+        \param hostname INDI server host name or IP address, or unix:path to connect to the Unix domain
+        socket a local INDI server listens on (indiserver -u path).
+        \param port INDI server port, unused for unix:path.
     */
-    void setServer(const char *hostname, unsigned int port);
+    void setServer(const char *hostname, unsigned int port = 7624);
 
     /** \brief Add a device to the watch list.
 
@@ -134,6 +135,9 @@ class INDI::BaseClientQt : public QObject, public INDI::BaseMediator
       If \e dev and \e prop are supplied, then the BLOB handling policy is set for this particular device and property.
       if \e prop is NULL, then the BLOB policy applies to the whole device.
 
+      The request also asks the server for binary BLOB framing, so BLOB contents arrive without base64 encoding.
+      Servers that do not support it keep sending base64, both are decoded transparently.
+
       \param blobH BLOB handling policy
       \param dev name of device, required.
       \param prop name of property, optional.
@@ -242,6 +246,13 @@ class INDI::BaseClientQt : public QObject, public INDI::BaseMediator
      */
     void clear();
 
+    /**
+     * @brief connectUnixSocket Connect client_socket to the Unix domain socket of a local INDI server.
+     * @param path Path of the socket node.
+     * @return True if connected, false otherwise.
+     */
+    bool connectUnixSocket(const std::string &path);
+
     QTcpSocket client_socket;
 
     std::vector<INDI::BaseDevice *> cDevices;
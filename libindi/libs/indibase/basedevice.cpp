@@ -1155,10 +1155,48 @@ int BaseDevice::setBLOB(IBLOBVectorProperty *bvp, XMLEle *root, char *errmsg)
                     continue;
                 }
 
+                // Already decoded into a buffer of the client, which gets it back once dispatched
+                ReceivedBLOB *received = static_cast<ReceivedBLOB *>(auxXMLEle(ep));
+                if (received)
+                {
+                    if (!received->valid)
+                    {
+                        snprintf(errmsg, MAXRBUF, "INDI: %s.%s.%s could not be received.", blobEL->bvp->device,
+                                 blobEL->bvp->name, blobEL->name);
+                        return -1;
+                    }
+
+                    strncpy(blobEL->format, valuXMLAtt(fa), MAXINDIFORMAT);
+                    if (strstr(blobEL->format, ".z"))
+                        blobEL->format[strlen(blobEL->format) - 2] = '\0';
+
+                    free(blobEL->blob);
+                    blobEL->blob    = received->buffer;
+                    blobEL->bloblen = received->size;
+                    blobEL->size    = received->size;
+
+                    if (mediator)
+                        mediator->newBLOB(blobEL);
+
+                    blobEL->blob    = nullptr;
+                    blobEL->bloblen = 0;
+                    continue;
+                }
+
                 blobEL->size    = blobSize;
                 int bloblen     = pcdatalenXMLEle(ep);
-                blobEL->blob    = (unsigned char *)realloc(blobEL->blob, 3 * bloblen / 4);
-                blobEL->bloblen = from64tobits_fast(static_cast<char *>(blobEL->blob), pcdataXMLEle(ep), bloblen);
+                // Binary BLOBs carry their raw contents, others are base64 encoded
+                if (findXMLAtt(ep, "binlen"))
+                {
+                    blobEL->blob    = realloc(blobEL->blob, bloblen);
+                    blobEL->bloblen = bloblen;
+                    memcpy(blobEL->blob, pcdataXMLEle(ep), bloblen);
+                }
+                else
+                {
+                    blobEL->blob    = (unsigned char *)realloc(blobEL->blob, 3 * bloblen / 4);
+                    blobEL->bloblen = from64tobits_fast(static_cast<char *>(blobEL->blob), pcdataXMLEle(ep), bloblen);
+                }
 
                 strncpy(blobEL->format, valuXMLAtt(fa), MAXINDIFORMAT);
 
@@ -79,6 +79,18 @@ class BaseDevice
         AUX_INTERFACE           = (1 << 15), /**< Auxiliary interface */
     };
 
+    /**
+     * @brief The ReceivedBLOB struct is the content of a oneBLOB decoded straight into a buffer of the client
+     * while it was received. It is attached to the oneBLOB element with setAuxXMLEle().
+     * @see INDI::BaseClient::setBLOBAllocator()
+     */
+    typedef struct
+    {
+        void *buffer; /*!< Buffer of the client holding the BLOB */
+        size_t size;  /*!< Bytes of the BLOB in buffer, after decompression */
+        bool valid;   /*!< False if the BLOB could not be decoded, decompressed, or did not fit */
+    } ReceivedBLOB;
+
     /** \return Return vector number property given its name */
     INumberVectorProperty *getNumber(const char *name);
     /** \return Return vector text property given its name */
@@ -22,9 +22,16 @@
 #include "indilogger.h"
 
 #include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
 #include <cerrno>
+#include <climits>
+#include <cstdlib>
 #include <cstring>
 #include <algorithm>
+#include <fstream>
+#include <sstream>
 #include <thread>
 #include <chrono>
 
@@ -164,8 +171,22 @@ bool Serial::ISNewSwitch(const char *dev, const char *name, ISState *states, cha
 
 bool Serial::Connect()
 {
-    uint32_t baud = atoi(IUFindOnSwitch(&BaudRateSP)->name);
-    bool rc       = Connect(PortT[0].text, baud);
+    uint32_t baud   = atoi(IUFindOnSwitch(&BaudRateSP)->name);
+    bool autoSearch = (AutoSearchS[0].s == ISS_ON && SystemPortS != nullptr && !m_Device->isSimulation());
+
+    // Go straight to where the device was found last time, even if the ports were renumbered since
+    if (autoSearch)
+    {
+        std::string port = cachedPort();
+        if (!port.empty() && port != PortT[0].text)
+        {
+            LOGF_INFO("%s was last connected on %s, trying it first.", getDeviceName(), port.c_str());
+            IUSaveText(&PortT[0], port.c_str());
+            IDSetText(&PortTP, nullptr);
+        }
+    }
+
+    bool rc = Connect(PortT[0].text, baud);
 
     if (rc)
     {
@@ -178,15 +199,13 @@ bool Serial::Connect()
         tty_disconnect(PortFD);
 
     // Start auto-search if option was selected and IF we have system ports to try connecting to
-    if (rc == false && AutoSearchS[0].s == ISS_ON && SystemPortS != nullptr && SystemPortSP.nsp > 1)
+    if (rc == false && autoSearch && SystemPortSP.nsp > 1)
     {
         LOGF_WARN("Communication with %s @ %d failed. Starting Auto Search...", PortT[0].text,
                   baud);
 
-        std::this_thread::sleep_for(std::chrono::milliseconds(500 + (rand() % 1000)));
-
         // Try to connect "randomly" so that competing devices don't all try to connect to the same
-        // ports at the same time.
+        // ports at the same time. Ports held by other drivers are locked and fail to open right away.
         std::vector<std::string> systemPorts;
         for (int i = 0; i < SystemPortSP.nsp; i++)
         {
@@ -198,6 +217,16 @@ bool Serial::Connect()
         }
         std::random_shuffle (systemPorts.begin(), systemPorts.end());
 
+        // A device the probe missed may still pass the full handshake
+        if (Probe)
+        {
+            std::vector<std::string> answered = probePorts(systemPorts, baud);
+            if (!answered.empty())
+                systemPorts = answered;
+            else
+                LOG_DEBUG("No port answered the probe, trying all of them.");
+        }
+
         for (auto port : systemPorts)
         {
             LOGF_INFO("Trying connecting to %s @ %d ...", port.c_str(), baud);
@@ -207,21 +236,180 @@ bool Serial::Connect()
                 IDSetText(&PortTP, nullptr);
                 rc = processHandshake();
                 if (rc)
-                    return true;
+                    break;
                 else
                     tty_disconnect(PortFD);
             }
-            // sleep randomly anytime between 0.5s and ~1.5s
-            // This enables different competing devices to connect
-            std::this_thread::sleep_for(std::chrono::milliseconds(500 + (rand() % 1000)));
         }
-
-        return false;
     }
 
+    if (rc && !m_Device->isSimulation())
+        cachePort(PortT[0].text);
+
     return rc;
 }
 
+void Serial::registerProbe(std::function<bool(int)> callback)
+{
+    Probe = callback;
+}
+
+std::vector<std::string> Serial::probePorts(const std::vector<std::string> &ports, uint32_t baud)
+{
+    std::vector<char> answered(ports.size(), 0);
+    std::vector<std::thread> probes;
+
+    for (size_t i = 0; i < ports.size(); i++)
+    {
+        probes.emplace_back([&, i]()
+        {
+            int fd = -1;
+            if (tty_connect(ports[i].c_str(), baud, wordSize, parity, stopBits, &fd) != TTY_OK)
+                return;
+            answered[i] = Probe(fd);
+            tty_disconnect(fd);
+        });
+    }
+
+    for (auto &probe : probes)
+        probe.join();
+
+    std::vector<std::string> found;
+    for (size_t i = 0; i < ports.size(); i++)
+    {
+        if (answered[i])
+            found.push_back(ports[i]);
+        else
+            LOGF_DEBUG("No answer on %s.", ports[i].c_str());
+    }
+
+    LOGF_DEBUG("Probed %d port(s), %d answered.", static_cast<int>(ports.size()), static_cast<int>(found.size()));
+    return found;
+}
+
+static std::string readSysfsValue(const std::string &path)
+{
+    std::ifstream file(path);
+    std::string value;
+    std::getline(file, value);
+    return value;
+}
+
+// Vendor, product and serial number of the USB device behind port, empty if it is not one
+static std::string usbIdentity(const char *port)
+{
+#ifdef __linux__
+    char path[PATH_MAX], device[PATH_MAX];
+
+    if (realpath(port, path) == nullptr)
+        return "";
+
+    std::string sysfs = std::string("/sys/class/tty/") + (strrchr(path, '/') + 1) + "/device";
+    if (realpath(sysfs.c_str(), device) == nullptr)
+        return "";
+
+    // The interface is below the USB device, which is the first parent with a vendor id
+    for (std::string dir = device; dir.size() > strlen("/sys/devices"); dir.erase(dir.rfind('/')))
+    {
+        std::string vendor = readSysfsValue(dir + "/idVendor");
+        if (vendor.empty())
+            continue;
+
+        return vendor + ":" + readSysfsValue(dir + "/idProduct") + ":" + readSysfsValue(dir + "/serial");
+    }
+#else
+    INDI_UNUSED(port);
+#endif
+    return "";
+}
+
+static std::string portCacheFileName()
+{
+    if (getenv("INDIPORTCACHE"))
+        return getenv("INDIPORTCACHE");
+
+    // No cache without a home directory
+    if (getenv("HOME") == nullptr)
+        return "";
+
+    return std::string(getenv("HOME")) + "/.indi/SerialPorts.cache";
+}
+
+std::string Serial::cachedPort()
+{
+    std::string fileName = portCacheFileName();
+    if (fileName.empty())
+        return "";
+
+    // One line per device: name, USB identity and port, separated by tabs
+    std::ifstream cache(fileName);
+    std::string line, identity, port;
+    const std::string prefix = std::string(getDeviceName()) + "\t";
+
+    while (std::getline(cache, line))
+    {
+        if (line.compare(0, prefix.size(), prefix) != 0)
+            continue;
+
+        std::istringstream fields(line.substr(prefix.size()));
+        std::getline(fields, identity, '\t');
+        std::getline(fields, port);
+    }
+
+    if (identity.empty())
+        return "";
+
+    if (usbIdentity(port.c_str()) == identity)
+        return port;
+
+    for (int i = 0; i < SystemPortSP.nsp; i++)
+    {
+        if (usbIdentity(SystemPortS[i].name) == identity)
+            return SystemPortS[i].name;
+    }
+
+    return "";
+}
+
+void Serial::cachePort(const char *port)
+{
+    std::string identity = usbIdentity(port);
+    std::string fileName = portCacheFileName();
+    if (identity.empty() || fileName.empty())
+        return;
+
+    int fd = open(fileName.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        LOGF_DEBUG("Failed to open port cache %s: %s", fileName.c_str(), strerror(errno));
+        return;
+    }
+
+    // Other drivers update the same file
+    flock(fd, LOCK_EX);
+
+    std::string content, kept;
+    char buf[4096];
+    ssize_t nr;
+    while ((nr = read(fd, buf, sizeof(buf))) > 0)
+        content.append(buf, nr);
+
+    const std::string prefix = std::string(getDeviceName()) + "\t";
+    std::istringstream lines(content);
+    std::string line;
+    while (std::getline(lines, line))
+    {
+        if (!line.empty() && line.compare(0, prefix.size(), prefix) != 0)
+            kept += line + "\n";
+    }
+    kept += prefix + identity + "\t" + port + "\n";
+
+    if (ftruncate(fd, 0) != 0 || pwrite(fd, kept.data(), kept.size(), 0) != static_cast<ssize_t>(kept.size()))
+        LOGF_DEBUG("Failed to update port cache: %s", strerror(errno));
+
+    close(fd);
+}
+
 bool Serial::processHandshake()
 {
     LOG_DEBUG("Connection successful, attempting handshake...");
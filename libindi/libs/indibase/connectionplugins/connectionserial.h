@@ -23,6 +23,7 @@
 #include "connectioninterface.h"
 
 #include <string>
+#include <vector>
 
 namespace Connection
 {
@@ -98,6 +99,22 @@ class Serial : public Interface
      */
     bool Refresh(bool silent = false);
 
+    /**
+     * @brief registerProbe Register a quick check that the device answers on a port. Auto search runs
+     * it on all candidate ports at once and only handshakes the ports that passed, or all of them if none did.
+     * @param callback Probe function, returns true if the device answered on the given file descriptor.
+     * @note The probe runs in its own thread for each port, so it must not use the driver state. It should give
+     * up within a few seconds, allowing for devices that reset when the port is opened.
+     */
+    void registerProbe(std::function<bool(int fd)> callback);
+
+    /**
+     * @brief probePorts Open ports concurrently and run the registered probe on each. Ports another
+     * driver holds are skipped.
+     * @return Ports the device answered on, in the given order.
+     */
+    std::vector<std::string> probePorts(const std::vector<std::string> &ports, uint32_t baud);
+
     uint8_t getWordSize() const { return wordSize; }
     /**
      * @brief setWordSize Set word size to be used in the serial connection. Default 8
@@ -130,6 +147,19 @@ protected:
 
     virtual bool processHandshake();
 
+    /**
+     * @return Port this device was last connected to, found by its USB vendor, product and serial number
+     * in case ports were renumbered since. Empty if unknown or no longer attached.
+     */
+    std::string cachedPort();
+
+    /**
+     * @brief cachePort Record the USB identity of the port this device is connected to, so the next
+     * connection goes straight to it. The cache is shared by all drivers, in ~/.indi/SerialPorts.cache
+     * unless INDIPORTCACHE is set.
+     */
+    void cachePort(const char *port);
+
     // Device physical port
     ITextVectorProperty PortTP;
     IText PortT[1] {};
@@ -148,6 +178,8 @@ protected:
 
     int PortFD = -1;
 
+    std::function<bool(int)> Probe;
+
     // Default 8N1 parameters
     uint8_t wordSize=8;
     uint8_t parity=0;
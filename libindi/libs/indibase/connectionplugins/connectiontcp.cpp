@@ -18,6 +18,7 @@
 
 #include "connectiontcp.h"
 
+#include "indicom.h"
 #include "indilogger.h"
 #include "indistandardproperty.h"
 
@@ -171,6 +172,7 @@ bool TCP::Disconnect()
 {
     if (sockfd > 0)
     {
+        tty_clear_buffer(sockfd);
         close(sockfd);
         sockfd = PortFD = -1;
     }
@@ -28,6 +28,7 @@
 
 #include "ttybase.h"
 
+#include "indicom.h"
 #include "locale_compat.h"
 
 #include <errno.h>
@@ -81,43 +82,6 @@ TTYBase::~TTYBase()
         disconnect();
 }
 
-TTYBase::TTY_RESPONSE TTYBase::checkTimeout(uint8_t timeout)
-{
-#if defined(_WIN32) || defined(ANDROID)
-    INDI_UNUSED(timeout);
-    return TTY_ERRNO;
-#else
-
-    if (m_PortFD == -1)
-        return TTY_ERRNO;
-
-    struct timeval tv;
-    fd_set readout;
-    int retval;
-
-    FD_ZERO(&readout);
-    FD_SET(m_PortFD, &readout);
-
-    /* wait for 'timeout' seconds */
-    tv.tv_sec  = timeout;
-    tv.tv_usec = 0;
-
-    /* Wait till we have a change in the m_PortFD status */
-    retval = select(m_PortFD + 1, &readout, nullptr, nullptr, &tv);
-
-    /* Return 0 on successful m_PortFD change */
-    if (retval > 0)
-        return TTY_OK;
-    /* Return -1 due to an error */
-    else if (retval == -1)
-        return TTY_SELECT_ERROR;
-    /* Return -2 if time expires before anything interesting happens */
-    else
-        return TTY_TIME_OUT;
-
-#endif
-}
-
 TTYBase::TTY_RESPONSE TTYBase::write(const uint8_t *buffer, uint32_t nbytes, uint32_t *nbytes_written)
 {
 #ifdef _WIN32
@@ -127,6 +91,9 @@ TTYBase::TTY_RESPONSE TTYBase::write(const uint8_t *buffer, uint32_t nbytes, uin
     if (m_PortFD == -1)
         return TTY_ERRNO;
 
+    // A new command, what is left of earlier replies is stale
+    tty_clear_buffer(m_PortFD);
+
     int bytes_w     = 0;
     *nbytes_written = 0;
 
@@ -164,35 +131,19 @@ TTYBase::TTY_RESPONSE TTYBase::read(uint8_t *buffer, uint32_t nbytes, uint8_t ti
     if (m_PortFD == -1)
         return TTY_ERRNO;
 
-    uint32_t numBytesToRead =  nbytes;
-    int bytesRead = 0;
-    TTY_RESPONSE timeoutResponse = TTY_OK;
-    *nbytes_read  = 0;
-
     if (nbytes <= 0)
         return TTY_PARAM_ERROR;
 
     DEBUGFDEVICE(m_DriverName, m_DebugChannel, "%s: Request to read %d bytes with %d timeout for m_PortFD %d", __FUNCTION__, nbytes, timeout, m_PortFD);
 
-    while (numBytesToRead > 0)
-    {
-        if ((timeoutResponse = checkTimeout(timeout)))
-            return timeoutResponse;
-
-        bytesRead = ::read(m_PortFD, buffer + (*nbytes_read), numBytesToRead);
-
-        if (bytesRead < 0)
-            return TTY_READ_ERROR;
-
-        DEBUGFDEVICE(m_DriverName, m_DebugChannel, "%d bytes read and %d bytes remaining...", bytesRead, numBytesToRead - bytesRead);
-        for (uint32_t i = *nbytes_read; i < (*nbytes_read + bytesRead); i++)
-            DEBUGFDEVICE(m_DriverName, m_DebugChannel, "%s: buffer[%d]=%#X (%c)", __FUNCTION__, i, buffer[i], buffer[i]);
+    int bytesRead = 0;
+    TTY_RESPONSE rc = static_cast<TTY_RESPONSE>(tty_read_buffered(m_PortFD, reinterpret_cast<char *>(buffer), nbytes, timeout, 0, &bytesRead));
+    *nbytes_read = bytesRead;
 
-        *nbytes_read += bytesRead;
-        numBytesToRead -= bytesRead;
-    }
+    for (uint32_t i = 0; i < *nbytes_read; i++)
+        DEBUGFDEVICE(m_DriverName, m_DebugChannel, "%s: buffer[%d]=%#X (%c)", __FUNCTION__, i, buffer[i], buffer[i]);
 
-    return TTY_OK;
+    return rc;
 
 #endif
 }
@@ -206,35 +157,18 @@ TTYBase::TTY_RESPONSE TTYBase::readSection(uint8_t *buffer, uint32_t nsize, uint
     if (m_PortFD == -1)
         return TTY_ERRNO;
 
-    int bytesRead = 0;
-    TTY_RESPONSE timeoutResponse = TTY_OK;
-    *nbytes_read  = 0;
     memset(buffer, 0, nsize);
 
-    uint8_t *read_char = nullptr;
-
     DEBUGFDEVICE(m_DriverName, m_DebugChannel, "%s: Request to read until stop char '%#02X' with %d timeout for m_PortFD %d", __FUNCTION__, stop_byte, timeout, m_PortFD);
 
-    for (;;)
-    {
-        if ((timeoutResponse = checkTimeout(timeout)))
-            return timeoutResponse;
-
-        read_char = reinterpret_cast<uint8_t*>(buffer + *nbytes_read);
-        bytesRead = ::read(m_PortFD, read_char, 1);
-
-        if (bytesRead < 0)
-            return TTY_READ_ERROR;
-
-        DEBUGFDEVICE(m_DriverName, m_DebugChannel, "%s: buffer[%d]=%#X (%c)", __FUNCTION__, (*nbytes_read), *read_char, *read_char);
+    int bytesRead = 0;
+    TTY_RESPONSE rc = static_cast<TTY_RESPONSE>(tty_read_section_buffered(m_PortFD, reinterpret_cast<char *>(buffer), nsize, stop_byte, timeout, 0, &bytesRead));
+    *nbytes_read = bytesRead;
 
-        (*nbytes_read)++;
+    for (uint32_t i = 0; i < *nbytes_read; i++)
+        DEBUGFDEVICE(m_DriverName, m_DebugChannel, "%s: buffer[%d]=%#X (%c)", __FUNCTION__, i, buffer[i], buffer[i]);
 
-        if (*read_char == stop_byte)
-            return TTY_OK;
-        else if (*nbytes_read >= nsize)
-            return TTY_OVERFLOW;
-    }
+    return rc;
 
 #endif
 }
@@ -688,6 +622,7 @@ TTYBase::TTY_RESPONSE TTYBase::disconnect()
     return TTY_ERRNO;
 #else
     tcflush(m_PortFD, TCIOFLUSH);
+    tty_clear_buffer(m_PortFD);
     int err = close(m_PortFD);
 
     if (err != 0)
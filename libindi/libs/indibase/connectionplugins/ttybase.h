@@ -131,8 +131,6 @@ public:
 
 private:
 
-    TTY_RESPONSE checkTimeout(uint8_t timeout);
-
     int m_PortFD { -1 };
     bool m_Debug { false };
     INDI::Logger::VerbosityLevel m_DebugChannel { INDI::Logger::DBG_IGNORE };
@@ -21,8 +21,11 @@
 #include "indistandardproperty.h"
 #include "connectionplugins/connectionserial.h"
 
+#include <algorithm>
+#include <cmath>
 #include <cstdlib>
 #include <cstring>
+#include <mutex>
 #include <assert.h>
 
 const char *COMMUNICATION_TAB = "Communication";
@@ -38,23 +41,13 @@ const char *GUIDE_TAB         = "Guide";
 const char *ALIGNMENT_TAB     = "Alignment";
 const char *INFO_TAB          = "General Info";
 
-void timerfunc(void *t)
-{
-    //fprintf(stderr,"Got a timer hit with %x\n",t);
-    INDI::DefaultDevice *devPtr = static_cast<INDI::DefaultDevice *>(t);
-    if (devPtr != nullptr)
-    {
-        //  this was for my device
-        //  but we dont have a way of telling
-        //  WHICH timer was hit :(
-        devPtr->TimerHit();
-    }
-    return;
-}
-
 namespace INDI
 {
 
+// Devices whose published properties IDSetNumber() reports to, guarded with their published lists
+static std::vector<DefaultDevice *> publishingDevices;
+static std::recursive_mutex publishedLock;
+
 DefaultDevice::DefaultDevice()
 {
     pDebug      = false;
@@ -65,10 +58,17 @@ DefaultDevice::DefaultDevice()
     minorVersion        = 0;
     interfaceDescriptor = GENERAL_INTERFACE;
     memset(&ConnectionModeSP, 0, sizeof(ConnectionModeSP));
+
+    std::lock_guard<std::recursive_mutex> lock(publishedLock);
+    publishingDevices.push_back(this);
+    IDSetNumberHook(numberSent);
 }
 
 DefaultDevice::~DefaultDevice()
 {
+    std::lock_guard<std::recursive_mutex> lock(publishedLock);
+    publishingDevices.erase(std::remove(publishingDevices.begin(), publishingDevices.end(), this),
+                            publishingDevices.end());
 }
 
 bool DefaultDevice::loadConfig(bool silent, const char *property)
@@ -870,7 +870,23 @@ void DefaultDevice::setConnected(bool status, IPState state, const char *msg)
 //  that just encapsulates the Indi way into our clean c++ way of doing things
 int DefaultDevice::SetTimer(uint32_t ms)
 {
-    return IEAddTimer(ms, timerfunc, this);
+    return IEAddTimer(ms, timerCallback, this);
+}
+
+void DefaultDevice::timerCallback(void *context)
+{
+    DefaultDevice *devPtr = static_cast<DefaultDevice *>(context);
+    if (devPtr != nullptr)
+    {
+        //  this was for my device
+        //  but we dont have a way of telling
+        //  WHICH timer was hit :(
+        devPtr->inTimerHit = true;
+        devPtr->TimerHit();
+        devPtr->inTimerHit = false;
+
+        devPtr->flushPublished();
+    }
 }
 
 //  Just another helper to help encapsulate indi into a clean class
@@ -888,6 +904,154 @@ void DefaultDevice::TimerHit()
     return;
 }
 
+DefaultDevice::PublishedProperty *DefaultDevice::findPublished(void *property, INDI_PROPERTY_TYPE type)
+{
+    for (auto &one : published)
+    {
+        if (one.property == property)
+            return &one;
+    }
+
+    PublishedProperty one;
+    one.property    = property;
+    one.type        = type;
+    one.pending     = false;
+    one.force       = false;
+    one.sent        = false;
+    one.sentState   = IPS_IDLE;
+    one.minInterval = std::chrono::milliseconds(0);
+    published.push_back(one);
+
+    return &published.back();
+}
+
+void DefaultDevice::publish(void *property, INDI_PROPERTY_TYPE type, bool force)
+{
+    std::lock_guard<std::recursive_mutex> lock(publishedLock);
+    PublishedProperty *one = findPublished(property, type);
+    one->pending           = true;
+    one->force             = one->force || force;
+
+    if (inTimerHit == false)
+        flushPublished();
+}
+
+void DefaultDevice::publishNumber(INumberVectorProperty *nvp, bool force)
+{
+    publish(nvp, INDI_NUMBER, force);
+}
+
+void DefaultDevice::publishSwitch(ISwitchVectorProperty *svp)
+{
+    publish(svp, INDI_SWITCH);
+}
+
+void DefaultDevice::publishText(ITextVectorProperty *tvp)
+{
+    publish(tvp, INDI_TEXT);
+}
+
+void DefaultDevice::publishLight(ILightVectorProperty *lvp)
+{
+    publish(lvp, INDI_LIGHT);
+}
+
+void DefaultDevice::setPublishLimits(INumberVectorProperty *nvp, uint32_t minInterval,
+                                     const std::vector<double> &deadband)
+{
+    std::lock_guard<std::recursive_mutex> lock(publishedLock);
+    PublishedProperty *one = findPublished(nvp, INDI_NUMBER);
+    one->minInterval       = std::chrono::milliseconds(minInterval);
+    one->deadband          = deadband;
+}
+
+bool DefaultDevice::sendPublished(PublishedProperty &one, std::chrono::steady_clock::time_point now)
+{
+    if (one.type != INDI_NUMBER)
+    {
+        switch (one.type)
+        {
+            case INDI_SWITCH:
+                IDSetSwitch(static_cast<ISwitchVectorProperty *>(one.property), nullptr);
+                break;
+            case INDI_TEXT:
+                IDSetText(static_cast<ITextVectorProperty *>(one.property), nullptr);
+                break;
+            case INDI_LIGHT:
+                IDSetLight(static_cast<ILightVectorProperty *>(one.property), nullptr);
+                break;
+            default:
+                break;
+        }
+        return true;
+    }
+
+    INumberVectorProperty *nvp = static_cast<INumberVectorProperty *>(one.property);
+
+    // State changes always go out at once
+    if (one.force == false && one.sent && nvp->s == one.sentState &&
+        static_cast<int>(one.sentValues.size()) == nvp->nnp)
+    {
+        bool moved = false;
+        for (int i = 0; i < nvp->nnp && moved == false; i++)
+        {
+            double deadband = 0;
+            if (one.deadband.empty() == false)
+                deadband = one.deadband[std::min<size_t>(i, one.deadband.size() - 1)];
+
+            if (std::fabs(nvp->np[i].value - one.sentValues[i]) > deadband)
+                moved = true;
+        }
+
+        // Nothing the client does not know yet
+        if (moved == false)
+            return true;
+
+        // Try again on a later flush
+        if (now - one.sentTime < one.minInterval)
+            return false;
+    }
+
+    // Recorded as sent by numberSent()
+    IDSetNumber(nvp, nullptr);
+    return true;
+}
+
+void DefaultDevice::numberSent(const INumberVectorProperty *nvp)
+{
+    std::lock_guard<std::recursive_mutex> lock(publishedLock);
+
+    // Whoever sent it, later updates are compared with what clients have now
+    for (auto device : publishingDevices)
+    {
+        for (auto &one : device->published)
+        {
+            if (one.property != nvp)
+                continue;
+
+            one.sent      = true;
+            one.sentState = nvp->s;
+            one.sentTime  = std::chrono::steady_clock::now();
+            one.sentValues.resize(nvp->nnp);
+            for (int i = 0; i < nvp->nnp; i++)
+                one.sentValues[i] = nvp->np[i].value;
+            return;
+        }
+    }
+}
+
+void DefaultDevice::flushPublished()
+{
+    std::lock_guard<std::recursive_mutex> lock(publishedLock);
+    auto now = std::chrono::steady_clock::now();
+
+    for (auto &one : published)
+    {
+        if (one.pending && sendPublished(one, now))
+            one.pending = one.force = false;
+    }
+}
+
 bool DefaultDevice::updateProperties()
 {
     //  The base device has no properties to update
@@ -980,6 +1144,19 @@ bool DefaultDevice::deleteProperty(const char *propertyName)
         }
     }
 
+    // Define it afresh if it comes back
+    {
+        std::lock_guard<std::recursive_mutex> lock(publishedLock);
+        for (auto &one : published)
+        {
+            INDI::Property property;
+            property.setProperty(one.property);
+            property.setType(one.type);
+            if (!strcmp(property.getName(), propertyName))
+                one.pending = one.force = one.sent = false;
+        }
+    }
+
     if (removeProperty(propertyName, errmsg) == 0)
     {
         IDDelete(getDeviceName(), propertyName, nullptr);
@@ -22,7 +22,9 @@
 #include "indidriver.h"
 #include "indilogger.h"
 
+#include <chrono>
 #include <stdint.h>
+#include <vector>
 
 namespace Connection
 {
@@ -202,6 +204,13 @@ class INDI::DefaultDevice : public INDI::BaseDevice
     /** \brief Callback function to be called once SetTimer duration elapses. */
     virtual void TimerHit();
 
+    /**
+     * \brief Send the properties published with publishNumber() and related functions since the
+     * last flush. Called after each TimerHit(), so everything published during one poll reaches
+     * clients together.
+     */
+    void flushPublished();
+
     /** \return driver executable filename */
     virtual const char *getDriverExec() { return me; }
 
@@ -394,6 +403,39 @@ class INDI::DefaultDevice : public INDI::BaseDevice
     /** \return True if Simulation is on, False otherwise. */
     bool isSimulation();
 
+    // Publication
+
+    /**
+     * \brief Send a number vector to clients. Within TimerHit() the update is queued and sent with
+     * everything else published during the same poll, once, after TimerHit() returns. Elsewhere it
+     * is sent right away.
+     * Unless its state changed, the update is dropped if no value moved by more than its deadband
+     * since clients were last sent the property, including by IDSetNumber(), and held back until
+     * the minimum interval since then passed.
+     * \param nvp The number vector property to publish
+     * \param force Send even if nothing moved or the interval did not pass, e.g. to answer a client.
+     * \see setPublishLimits()
+     */
+    void publishNumber(INumberVectorProperty *nvp, bool force = false);
+
+    /** \brief Send a switch vector to clients, queued like publishNumber() within TimerHit(). */
+    void publishSwitch(ISwitchVectorProperty *svp);
+
+    /** \brief Send a text vector to clients, queued like publishNumber() within TimerHit(). */
+    void publishText(ITextVectorProperty *tvp);
+
+    /** \brief Send a light vector to clients, queued like publishNumber() within TimerHit(). */
+    void publishLight(ILightVectorProperty *lvp);
+
+    /**
+     * \brief Throttle the updates of a number vector sent by publishNumber().
+     * \param nvp The number vector property
+     * \param minInterval Minimum time between two updates in milliseconds, 0 for none.
+     * \param deadband Smallest change worth sending, one per element, or a single one for all
+     * elements. By default any change is sent.
+     */
+    void setPublishLimits(INumberVectorProperty *nvp, uint32_t minInterval, const std::vector<double> &deadband);
+
     /**
      * \brief Initilize properties initial state and value. The child class must implement this function.
      * \return True if initilization is successful, false otherwise.
@@ -488,4 +530,28 @@ class INDI::DefaultDevice : public INDI::BaseDevice
 
     bool defineDynamicProperties = true;
     bool deleteDynamicProperties = true;
+
+    // Properties sent through publishNumber() and related functions
+    typedef struct
+    {
+        void *property;
+        INDI_PROPERTY_TYPE type;
+        bool pending;
+        bool force;
+        bool sent;
+        IPState sentState;
+        std::vector<double> sentValues;
+        std::chrono::steady_clock::time_point sentTime;
+        std::chrono::milliseconds minInterval;
+        std::vector<double> deadband;
+    } PublishedProperty;
+
+    PublishedProperty *findPublished(void *property, INDI_PROPERTY_TYPE type);
+    void publish(void *property, INDI_PROPERTY_TYPE type, bool force = false);
+    bool sendPublished(PublishedProperty &one, std::chrono::steady_clock::time_point now);
+    static void numberSent(const INumberVectorProperty *nvp);
+    static void timerCallback(void *context);
+
+    std::vector<PublishedProperty> published;
+    bool inTimerHit = false;
 };
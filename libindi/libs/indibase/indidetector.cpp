@@ -271,10 +271,13 @@ Detector::Detector()
     Dec             = -1000;
     MPSAS           = -1000;
     primaryAperture = primaryFocalLength - 1;
+
+    dspPool = dsp_stream_pool_new(4);
 }
 
 Detector::~Detector()
 {
+    dsp_stream_pool_free(dspPool);
 }
 
 void Detector::SetDetectorCapability(uint32_t cap)
@@ -1336,204 +1339,60 @@ void Detector::Spectrum(void *buf, void *out, int len, int size, int bits_per_sa
 }
 
 void Detector::Histogram(void *buf, void *out, int buf_len, int histogram_size, int bits_per_sample) {
-    //Create the dsp stream
-    dsp_stream_p stream = dsp_stream_new();
-    dsp_stream_add_dim(stream, buf_len * 8 / abs(bits_per_sample));
-    dsp_stream_alloc_buffer(stream, stream->len);
-    //Create the spectrum
-    switch (bits_per_sample) {
-    case 8:
-        dsp_buffer_copy((static_cast<unsigned char *>(buf)), stream->buf, stream->len);
-        break;
-    case 16:
-        dsp_buffer_copy((static_cast<unsigned short *>(buf)), stream->buf, stream->len);
-        break;
-    case 32:
-        dsp_buffer_copy((static_cast<unsigned int *>(buf)), stream->buf, stream->len);
-        break;
-    case 64:
-        dsp_buffer_copy((static_cast<unsigned long *>(buf)), stream->buf, stream->len);
-        break;
-    case -32:
-        dsp_buffer_copy((static_cast<float *>(buf)), stream->buf, stream->len);
-        break;
-    case -64:
-        dsp_buffer_copy((static_cast<double *>(buf)), stream->buf, stream->len);
-        break;
-    default:
+    //The histogram kernels run directly on the native sample type
+    int type = dsp_type_from_bps(bits_per_sample);
+    if (type < 0) {
         DEBUGF(Logger::DBG_ERROR, "Unsupported bits per sample value %d", bits_per_sample);
-        dsp_stream_free_buffer(stream);
-        //Destroy the dsp stream
-        dsp_stream_free(stream);
         return;
     }
-    double *histo = dsp_stats_histogram(stream, histogram_size);
-    dsp_stream_free_buffer(stream);
-    //Destroy the dsp stream
-    dsp_stream_free(stream);
-    switch (bits_per_sample) {
-    case 8:
-        dsp_buffer_copy(histo, (static_cast<unsigned char *>(out)), histogram_size);
-        break;
-    case 16:
-        dsp_buffer_copy(histo, (static_cast<unsigned short *>(out)), histogram_size);
-        break;
-    case 32:
-        dsp_buffer_copy(histo, (static_cast<unsigned int *>(out)), histogram_size);
-        break;
-    case 64:
-        dsp_buffer_copy(histo, (static_cast<unsigned long *>(out)), histogram_size);
-        break;
-    case -32:
-        dsp_buffer_copy(histo, (static_cast<float *>(out)), histogram_size);
-        break;
-    case -64:
-        dsp_buffer_copy(histo, (static_cast<double *>(out)), histogram_size);
-        break;
-    default:
-        break;
-    }
+    int len = buf_len * 8 / abs(bits_per_sample);
+    double *histo = dsp_stats_histogram_buffer(buf, len, static_cast<dsp_type>(type), histogram_size);
+    if (histo == nullptr)
+        return;
+    dsp_buffer_convert(histo, DSP_TYPE_DOUBLE, out, static_cast<dsp_type>(type), histogram_size);
     free(histo);
 }
 
 void Detector::FourierTransform(void *buf, void *out, int dims, int *sizes, int bits_per_sample) {
-    //Create the dsp stream
-    dsp_stream_p stream = dsp_stream_new();
-    for(int dim = 0; dim < dims; dim++)
-        dsp_stream_add_dim(stream, sizes[dim]);
-    dsp_stream_alloc_buffer(stream, stream->len);
-    switch (bits_per_sample) {
-    case 8:
-        dsp_buffer_copy((static_cast<unsigned char *>(buf)), stream->buf, stream->len);
-        break;
-    case 16:
-        dsp_buffer_copy((static_cast<unsigned short *>(buf)), stream->buf, stream->len);
-        break;
-    case 32:
-        dsp_buffer_copy((static_cast<unsigned int *>(buf)), stream->buf, stream->len);
-        break;
-    case 64:
-        dsp_buffer_copy((static_cast<unsigned long *>(buf)), stream->buf, stream->len);
-        break;
-    case -32:
-        dsp_buffer_copy((static_cast<float *>(buf)), stream->buf, stream->len);
-        break;
-    case -64:
-        dsp_buffer_copy((static_cast<double *>(buf)), stream->buf, stream->len);
-        break;
-    default:
+    int type = dsp_type_from_bps(bits_per_sample);
+    if (type < 0) {
         DEBUGF(Logger::DBG_ERROR, "Unsupported bits per sample value %d", bits_per_sample);
-        dsp_stream_free_buffer(stream);
-        //Destroy the dsp stream
-        dsp_stream_free(stream);
         return;
     }
+    //The capture is read in place, the magnitudes go to a buffer reused across captures
+    dsp_stream_p stream = dsp_stream_new_view(buf, static_cast<dsp_type>(type), dims, sizes);
+    dsp_stream_p magnitude = dsp_stream_pool_get(dspPool, DSP_TYPE_DOUBLE, dims, sizes);
     double mn, mx;
     dsp_stats_minmidmax(stream, &mn, &mx);
-    dsp_complex *dft = dsp_fft_dft(stream);
-    double *mag = dsp_fft_complex_array_to_magnitude(dft, stream->len);
-    free(dft);
-    dsp_stream_free_buffer(stream);
-    dsp_stream_set_buffer(stream, mag, stream->len);
-    dsp_buffer_stretch(stream, mn, mx);
-    switch (bits_per_sample) {
-    case 8:
-        dsp_buffer_copy(stream->buf, (static_cast<unsigned char *>(out)), stream->len);
-        break;
-    case 16:
-        dsp_buffer_copy(stream->buf, (static_cast<unsigned short *>(out)), stream->len);
-        break;
-    case 32:
-        dsp_buffer_copy(stream->buf, (static_cast<unsigned int *>(out)), stream->len);
-        break;
-    case 64:
-        dsp_buffer_copy(stream->buf, (static_cast<unsigned long *>(out)), stream->len);
-        break;
-    case -32:
-        dsp_buffer_copy(stream->buf, (static_cast<float *>(out)), stream->len);
-        break;
-    case -64:
-        dsp_buffer_copy(stream->buf, (static_cast<double *>(out)), stream->len);
-        break;
-    default:
-        break;
+    if (dsp_fft_magnitude(stream, magnitude->buf) < 0) {
+        DEBUG(Logger::DBG_ERROR, "Unable to create the Fourier transform plan");
+    } else {
+        dsp_buffer_stretch(magnitude, mn, mx);
+        dsp_buffer_convert(magnitude->buf, DSP_TYPE_DOUBLE, out, static_cast<dsp_type>(type), magnitude->len);
     }
-    //Destroy the dsp stream
-    dsp_stream_free_buffer(stream);
+    //Destroy the dsp streams
+    dsp_stream_free(magnitude);
     dsp_stream_free(stream);
 }
 
 void Detector::Convolution(void *buf, void *matrix, void *out, int dims, int *sizes, int matrix_dims, int *matrix_sizes, int bits_per_sample) {
-    //Create the dsp stream
+    int type = dsp_type_from_bps(bits_per_sample);
+    if (type < 0) {
+        DEBUGF(Logger::DBG_ERROR, "Unsupported bits per sample value %d", bits_per_sample);
+        return;
+    }
+    //Create the dsp streams, the capture is converted since the result replaces it
     dsp_stream_p stream = dsp_stream_new();
     for(int dim = 0; dim < dims; dim++)
         dsp_stream_add_dim(stream, sizes[dim]);
     dsp_stream_alloc_buffer(stream, stream->len);
-    dsp_stream_p matrix_stream = dsp_stream_new();
-    for(int dim = 0; dim < matrix_dims; dim++)
-        dsp_stream_add_dim(matrix_stream, matrix_sizes[dim]);
-    dsp_stream_alloc_buffer(matrix_stream, matrix_stream->len);
-    switch (bits_per_sample) {
-    case 8:
-        dsp_buffer_copy((static_cast<unsigned char *>(buf)), stream->buf, stream->len);
-        dsp_buffer_copy((static_cast<unsigned char *>(matrix)), matrix_stream->buf, matrix_stream->len);
-        break;
-    case 16:
-        dsp_buffer_copy((static_cast<unsigned short *>(buf)), stream->buf, stream->len);
-        dsp_buffer_copy((static_cast<unsigned short *>(matrix)), matrix_stream->buf, matrix_stream->len);
-        break;
-    case 32:
-        dsp_buffer_copy((static_cast<unsigned int *>(buf)), stream->buf, stream->len);
-        dsp_buffer_copy((static_cast<unsigned int *>(matrix)), matrix_stream->buf, matrix_stream->len);
-        break;
-    case 64:
-        dsp_buffer_copy((static_cast<unsigned long *>(buf)), stream->buf, stream->len);
-        dsp_buffer_copy((static_cast<unsigned long *>(matrix)), matrix_stream->buf, matrix_stream->len);
-        break;
-    case -32:
-        dsp_buffer_copy((static_cast<float *>(buf)), stream->buf, stream->len);
-        dsp_buffer_copy((static_cast<float *>(matrix)), matrix_stream->buf, matrix_stream->len);
-        break;
-    case -64:
-        dsp_buffer_copy((static_cast<double *>(buf)), stream->buf, stream->len);
-        dsp_buffer_copy((static_cast<double *>(matrix)), matrix_stream->buf, matrix_stream->len);
-        break;
-    default:
-        DEBUGF(Logger::DBG_ERROR, "Unsupported bits per sample value %d", bits_per_sample);
-        //Destroy the dsp streams
-        dsp_stream_free_buffer(stream);
-        dsp_stream_free_buffer(matrix_stream);
-        dsp_stream_free(stream);
-        dsp_stream_free(matrix_stream);
-        return;
-    }
+    dsp_buffer_convert(buf, static_cast<dsp_type>(type), stream->buf, DSP_TYPE_DOUBLE, stream->len);
+    dsp_stream_p matrix_stream = dsp_stream_new_view(matrix, static_cast<dsp_type>(type), matrix_dims, matrix_sizes);
+    dsp_stream_get_buffer(matrix_stream);
     dsp_convolution_convolution(stream, matrix_stream);
-    switch (bits_per_sample) {
-    case 8:
-        dsp_buffer_copy(stream->buf, (static_cast<unsigned char *>(out)), stream->len);
-        break;
-    case 16:
-        dsp_buffer_copy(stream->buf, (static_cast<unsigned short *>(out)), stream->len);
-        break;
-    case 32:
-        dsp_buffer_copy(stream->buf, (static_cast<unsigned int *>(out)), stream->len);
-        break;
-    case 64:
-        dsp_buffer_copy(stream->buf, (static_cast<unsigned long *>(out)), stream->len);
-        break;
-    case -32:
-        dsp_buffer_copy(stream->buf, (static_cast<float *>(out)), stream->len);
-        break;
-    case -64:
-        dsp_buffer_copy(stream->buf, (static_cast<double *>(out)), stream->len);
-        break;
-    default:
-        break;
-    }
+    dsp_buffer_convert(stream->buf, DSP_TYPE_DOUBLE, out, static_cast<dsp_type>(type), stream->len);
     //Destroy the dsp streams
-    dsp_stream_free_buffer(stream);
     dsp_stream_free(stream);
-    dsp_stream_free_buffer(matrix_stream);
     dsp_stream_free(matrix_stream);
 }
 
@@ -699,6 +699,7 @@ class Detector : public DefaultDevice
 
     private:
         uint32_t capability;
+        dsp_stream_pool_p dspPool;
 
         bool uploadFile(DetectorDevice *targetDevice, const void *fitsData, size_t totalBytes, bool sendCapture, bool saveCapture, int blobindex);
         void getMinMax(double *min, double *max, uint8_t *buf, int len, int bpp);
@@ -197,6 +197,13 @@ bool Telescope::initProperties()
     IUFillNumberVector(&ScopeParametersNP, ScopeParametersN, 4, getDeviceName(), "TELESCOPE_INFO", "Scope Properties",
                        OPTIONS_TAB, IP_RW, 60, IPS_OK);
 
+    // Equatorial coordinate updates
+    IUFillNumber(&EqUpdatesN[0], "DEADBAND", "Deadband (arcsecs)", "%.2f", 0, 3600, 0.1, 0.1);
+    IUFillNumber(&EqUpdatesN[1], "MIN_INTERVAL", "Min Interval (ms)", "%.f", 0, 60000, 100, 0);
+    IUFillNumberVector(&EqUpdatesNP, EqUpdatesN, 2, getDeviceName(), "EQUATORIAL_UPDATES", "Coord Updates",
+                       OPTIONS_TAB, IP_RW, 60, IPS_IDLE);
+    applyEqUpdateLimits();
+
     // Scope config name
     IUFillText(&ScopeConfigNameT[0], "SCOPE_CONFIG_NAME", "Config Name", "");
     IUFillTextVector(&ScopeConfigNameTP, ScopeConfigNameT, 1, getDeviceName(), "SCOPE_CONFIG_NAME", "Scope Name",
@@ -279,6 +286,9 @@ void Telescope::ISGetProperties(const char *dev)
     defineNumber(&ScopeParametersNP);
     defineText(&ScopeConfigNameTP);
 
+    defineNumber(&EqUpdatesNP);
+    loadConfig(true, EqUpdatesNP.name);
+
     if (HasDefaultScopeConfig())
     {
         LoadScopeConfig();
@@ -617,6 +627,7 @@ bool Telescope::saveConfigItems(FILE *fp)
 
     if (HasLocation())
         IUSaveConfigNumber(fp, &LocationNP);
+    IUSaveConfigNumber(fp, &EqUpdatesNP);
 
     if (!HasDefaultScopeConfig())
     {
@@ -668,23 +679,28 @@ void Telescope::NewRaDec(double ra, double dec)
         TrackStateSP.s = IPS_IDLE;
         TrackStateS[TRACK_ON].s = ISS_OFF;
         TrackStateS[TRACK_OFF].s = ISS_ON;
-        IDSetSwitch(&TrackStateSP, nullptr);
+        publishSwitch(&TrackStateSP);
     }
     else if (TrackState == SCOPE_TRACKING && CanControlTrack() && TrackStateS[TRACK_OFF].s == ISS_ON)
     {
         TrackStateSP.s = IPS_BUSY;
         TrackStateS[TRACK_ON].s = ISS_ON;
         TrackStateS[TRACK_OFF].s = ISS_OFF;
-        IDSetSwitch(&TrackStateSP, nullptr);
+        publishSwitch(&TrackStateSP);
     }
 
-    if (EqN[AXIS_RA].value != ra || EqN[AXIS_DE].value != dec || EqNP.s != lastEqState)
-    {
-        EqN[AXIS_RA].value = ra;
-        EqN[AXIS_DE].value = dec;
-        lastEqState        = EqNP.s;
-        IDSetNumber(&EqNP, nullptr);
-    }
+    // Sent at the end of the poll unless within the deadband, see EQUATORIAL_UPDATES
+    EqN[AXIS_RA].value = ra;
+    EqN[AXIS_DE].value = dec;
+    lastEqState        = EqNP.s;
+    publishNumber(&EqNP);
+}
+
+void Telescope::applyEqUpdateLimits()
+{
+    // RA is in hours, 15 degrees each
+    double deadband = EqUpdatesN[0].value / 3600.0;
+    setPublishLimits(&EqNP, static_cast<uint32_t>(EqUpdatesN[1].value), { deadband / 15.0, deadband });
 }
 
 bool Telescope::Sync(double ra, double dec)
@@ -804,7 +820,7 @@ bool Telescope::ISNewNumber(const char *dev, const char *name, double values[],
                         DEBUG(Logger::DBG_WARNING,
                               "Please unpark the mount before issuing any motion/sync commands.");
                         EqNP.s = lastEqState = IPS_IDLE;
-                        IDSetNumber(&EqNP, nullptr);
+                        publishNumber(&EqNP, true);
                         return false;
                     }
                 }
@@ -821,7 +837,7 @@ bool Telescope::ISNewNumber(const char *dev, const char *name, double values[],
                             EqNP.s = lastEqState = IPS_OK;
                         else
                             EqNP.s = lastEqState = IPS_ALERT;
-                        IDSetNumber(&EqNP, nullptr);
+                        publishNumber(&EqNP, true);
                         return rc;
                     }
                 }
@@ -842,7 +858,8 @@ bool Telescope::ISNewNumber(const char *dev, const char *name, double values[],
                 {
                     EqNP.s = lastEqState = IPS_ALERT;
                 }
-                IDSetNumber(&EqNP, nullptr);
+                // Always answer the client, even with nothing new
+                publishNumber(&EqNP, true);
             }
             return rc;
         }
@@ -882,6 +899,18 @@ bool Telescope::ISNewNumber(const char *dev, const char *name, double values[],
             return true;
         }
 
+        ///////////////////////////////////
+        // Equatorial coordinate updates
+        ///////////////////////////////////
+        if (strcmp(name, EqUpdatesNP.name) == 0)
+        {
+            IUUpdateNumber(&EqUpdatesNP, values, names, n);
+            EqUpdatesNP.s = IPS_OK;
+            IDSetNumber(&EqUpdatesNP, nullptr);
+            applyEqUpdateLimits();
+            return true;
+        }
+
         ///////////////////////////////////
         // Park Position
         ///////////////////////////////////
@@ -1240,7 +1269,7 @@ bool Telescope::ISNewSwitch(const char *dev, const char *name, ISState *states,
                 if (EqNP.s == IPS_BUSY)
                 {
                     EqNP.s = lastEqState = IPS_IDLE;
-                    IDSetNumber(&EqNP, nullptr);
+                    publishNumber(&EqNP);
                     DEBUG(Logger::DBG_SESSION, "Slew/Track aborted.");
                 }
                 if (MovementWESP.s == IPS_BUSY)
@@ -1536,7 +1565,7 @@ void Telescope::TimerHit()
         {
             //  read was not good
             EqNP.s = lastEqState = IPS_ALERT;
-            IDSetNumber(&EqNP, nullptr);
+            publishNumber(&EqNP);
         }
 
         SetTimer(POLLMS);
@@ -2499,7 +2528,7 @@ void Telescope::setPierSide(TelescopePierSide side)
         PierSideS[PIER_WEST].s = (side == PIER_WEST) ? ISS_ON : ISS_OFF;
         PierSideS[PIER_EAST].s = (side == PIER_EAST) ? ISS_ON : ISS_OFF;
         PierSideSP.s           = IPS_OK;
-        IDSetSwitch(&PierSideSP, nullptr);
+        publishSwitch(&PierSideSP);
 
         lastPierSide = currentPierSide;
     }
@@ -662,6 +662,11 @@ class Telescope : public DefaultDevice
     INumber ScopeParametersN[4];
     INumberVectorProperty ScopeParametersNP;
 
+    // Smallest coordinate change in arcsecs and minimum interval between updates sent to clients
+    INumber EqUpdatesN[2];
+    INumberVectorProperty EqUpdatesNP;
+    void applyEqUpdateLimits();
+
     // UTC and UTC Offset
     IText TimeT[2] {};
     ITextVectorProperty TimeTP;
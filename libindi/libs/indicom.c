@@ -67,8 +67,11 @@
 #endif
 
 #ifndef _WIN32
+#include <poll.h>
+#include <pthread.h>
 #include <unistd.h>
 #include <termios.h>
+#include <sys/file.h>
 #include <sys/param.h>
 #define PARITY_NONE 0
 #define PARITY_EVEN 1
@@ -303,6 +306,312 @@ int numberFormat(char *buf, const char *format, double value)
     }
 }
 
+/* Shortest round-trip formatting of doubles, after Grisu2 by Florian Loitsch,
+ * "Printing Floating-Point Numbers Quickly and Accurately with Integers", 2010.
+ * A diyfp is f * 2^e with a 64 bit f; all arithmetic is integer so the result
+ * is the same in every locale and on every FPU.
+ */
+typedef struct
+{
+    uint64_t f;
+    int e;
+} diyfp;
+
+/* normalized 10^k = f * 2^e, for k = -300, -292, ... 324 */
+static const struct
+{
+    uint64_t f;
+    int e;
+    int k;
+} cachedPow10[] = {
+    { 0xAB70FE17C79AC6CA, -1060, -300 },
+    { 0xFF77B1FCBEBCDC4F, -1034, -292 },
+    { 0xBE5691EF416BD60C, -1007, -284 },
+    { 0x8DD01FAD907FFC3C,  -980, -276 },
+    { 0xD3515C2831559A83,  -954, -268 },
+    { 0x9D71AC8FADA6C9B5,  -927, -260 },
+    { 0xEA9C227723EE8BCB,  -901, -252 },
+    { 0xAECC49914078536D,  -874, -244 },
+    { 0x823C12795DB6CE57,  -847, -236 },
+    { 0xC21094364DFB5637,  -821, -228 },
+    { 0x9096EA6F3848984F,  -794, -220 },
+    { 0xD77485CB25823AC7,  -768, -212 },
+    { 0xA086CFCD97BF97F4,  -741, -204 },
+    { 0xEF340A98172AACE5,  -715, -196 },
+    { 0xB23867FB2A35B28E,  -688, -188 },
+    { 0x84C8D4DFD2C63F3B,  -661, -180 },
+    { 0xC5DD44271AD3CDBA,  -635, -172 },
+    { 0x936B9FCEBB25C996,  -608, -164 },
+    { 0xDBAC6C247D62A584,  -582, -156 },
+    { 0xA3AB66580D5FDAF6,  -555, -148 },
+    { 0xF3E2F893DEC3F126,  -529, -140 },
+    { 0xB5B5ADA8AAFF80B8,  -502, -132 },
+    { 0x87625F056C7C4A8B,  -475, -124 },
+    { 0xC9BCFF6034C13053,  -449, -116 },
+    { 0x964E858C91BA2655,  -422, -108 },
+    { 0xDFF9772470297EBD,  -396, -100 },
+    { 0xA6DFBD9FB8E5B88F,  -369,  -92 },
+    { 0xF8A95FCF88747D94,  -343,  -84 },
+    { 0xB94470938FA89BCF,  -316,  -76 },
+    { 0x8A08F0F8BF0F156B,  -289,  -68 },
+    { 0xCDB02555653131B6,  -263,  -60 },
+    { 0x993FE2C6D07B7FAC,  -236,  -52 },
+    { 0xE45C10C42A2B3B06,  -210,  -44 },
+    { 0xAA242499697392D3,  -183,  -36 },
+    { 0xFD87B5F28300CA0E,  -157,  -28 },
+    { 0xBCE5086492111AEB,  -130,  -20 },
+    { 0x8CBCCC096F5088CC,  -103,  -12 },
+    { 0xD1B71758E219652C,   -77,   -4 },
+    { 0x9C40000000000000,   -50,    4 },
+    { 0xE8D4A51000000000,   -24,   12 },
+    { 0xAD78EBC5AC620000,     3,   20 },
+    { 0x813F3978F8940984,    30,   28 },
+    { 0xC097CE7BC90715B3,    56,   36 },
+    { 0x8F7E32CE7BEA5C70,    83,   44 },
+    { 0xD5D238A4ABE98068,   109,   52 },
+    { 0x9F4F2726179A2245,   136,   60 },
+    { 0xED63A231D4C4FB27,   162,   68 },
+    { 0xB0DE65388CC8ADA8,   189,   76 },
+    { 0x83C7088E1AAB65DB,   216,   84 },
+    { 0xC45D1DF942711D9A,   242,   92 },
+    { 0x924D692CA61BE758,   269,  100 },
+    { 0xDA01EE641A708DEA,   295,  108 },
+    { 0xA26DA3999AEF774A,   322,  116 },
+    { 0xF209787BB47D6B85,   348,  124 },
+    { 0xB454E4A179DD1877,   375,  132 },
+    { 0x865B86925B9BC5C2,   402,  140 },
+    { 0xC83553C5C8965D3D,   428,  148 },
+    { 0x952AB45CFA97A0B3,   455,  156 },
+    { 0xDE469FBD99A05FE3,   481,  164 },
+    { 0xA59BC234DB398C25,   508,  172 },
+    { 0xF6C69A72A3989F5C,   534,  180 },
+    { 0xB7DCBF5354E9BECE,   561,  188 },
+    { 0x88FCF317F22241E2,   588,  196 },
+    { 0xCC20CE9BD35C78A5,   614,  204 },
+    { 0x98165AF37B2153DF,   641,  212 },
+    { 0xE2A0B5DC971F303A,   667,  220 },
+    { 0xA8D9D1535CE3B396,   694,  228 },
+    { 0xFB9B7CD9A4A7443C,   720,  236 },
+    { 0xBB764C4CA7A44410,   747,  244 },
+    { 0x8BAB8EEFB6409C1A,   774,  252 },
+    { 0xD01FEF10A657842C,   800,  260 },
+    { 0x9B10A4E5E9913129,   827,  268 },
+    { 0xE7109BFBA19C0C9D,   853,  276 },
+    { 0xAC2820D9623BF429,   880,  284 },
+    { 0x80444B5E7AA7CF85,   907,  292 },
+    { 0xBF21E44003ACDD2D,   933,  300 },
+    { 0x8E679C2F5E44FF8F,   960,  308 },
+    { 0xD433179D9C8CB841,   986,  316 },
+    { 0x9E19DB92B4E31BA9,  1013,  324 },
+};
+
+/* x * y rounded to the upper 64 bits of the product */
+static diyfp diyMul(diyfp x, diyfp y)
+{
+    uint64_t a = x.f >> 32, b = x.f & 0xFFFFFFFFu;
+    uint64_t c = y.f >> 32, d = y.f & 0xFFFFFFFFu;
+    uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+    uint64_t mid = (bd >> 32) + (ad & 0xFFFFFFFFu) + (bc & 0xFFFFFFFFu) + (1u << 31);
+    diyfp r;
+
+    r.f = ac + (ad >> 32) + (bc >> 32) + (mid >> 32);
+    r.e = x.e + y.e + 64;
+    return r;
+}
+
+static diyfp diyNormalize(diyfp x)
+{
+    while (!(x.f >> 63))
+    {
+        x.f <<= 1;
+        x.e--;
+    }
+    return x;
+}
+
+/* nudge the last digit of buf towards the exact value while still inside the bounds */
+static void grisuRound(char *buf, int len, uint64_t dist, uint64_t delta, uint64_t rest, uint64_t tenk)
+{
+    while (rest < dist && delta - rest >= tenk && (rest + tenk < dist || dist - rest > rest + tenk - dist))
+    {
+        buf[len - 1]--;
+        rest += tenk;
+    }
+}
+
+/* fill buf with the shortest digits of positive finite v, such that
+ * v == digits * 10^*dexp when read back. return number of digits.
+ */
+static int grisu2(char *buf, double v, int *dexp)
+{
+    uint64_t bits, F, delta, dist, p2;
+    uint32_t p1, pow10;
+    diyfp w, mminus, mplus, one, c;
+    int E, f, k, i, n, len = 0;
+
+    memcpy(&bits, &v, sizeof(bits));
+    E = (int)(bits >> 52);
+    F = bits & ((UINT64_C(1) << 52) - 1);
+    if (E)
+    {
+        w.f = F + (UINT64_C(1) << 52);
+        w.e = E - 1075;
+    }
+    else
+    {
+        w.f = F;
+        w.e = -1074;
+    }
+
+    /* boundaries halfway to the neighbouring doubles */
+    mplus.f = 2 * w.f + 1;
+    mplus.e = w.e - 1;
+    if (F == 0 && E > 1)
+    {
+        mminus.f = 4 * w.f - 1;
+        mminus.e = w.e - 2;
+    }
+    else
+    {
+        mminus.f = 2 * w.f - 1;
+        mminus.e = w.e - 1;
+    }
+    mplus = diyNormalize(mplus);
+    mminus.f <<= mminus.e - mplus.e;
+    mminus.e = mplus.e;
+    w        = diyNormalize(w);
+
+    /* scale by a cached power of ten into [2^-60, 2^-32] */
+    f = -60 - mplus.e - 1;
+    k = (f * 78913) / (1 << 18) + (f > 0);
+    i = (300 + k + 7) / 8;
+    c.f   = cachedPow10[i].f;
+    c.e   = cachedPow10[i].e;
+    *dexp = -cachedPow10[i].k;
+
+    w      = diyMul(w, c);
+    mminus = diyMul(mminus, c);
+    mplus  = diyMul(mplus, c);
+    mminus.f++;
+    mplus.f--;
+
+    delta = mplus.f - mminus.f;
+    dist  = mplus.f - w.f;
+    one.e = mplus.e;
+    one.f = UINT64_C(1) << -one.e;
+    p1    = (uint32_t)(mplus.f >> -one.e);
+    p2    = mplus.f & (one.f - 1);
+
+    /* integral digits */
+    for (n = 10, pow10 = 1000000000; n > 1 && p1 < pow10; n--)
+        pow10 /= 10;
+    while (n > 0)
+    {
+        uint64_t rest;
+
+        buf[len++] = (char)('0' + p1 / pow10);
+        p1 %= pow10;
+        n--;
+        rest = ((uint64_t)p1 << -one.e) + p2;
+        if (rest <= delta)
+        {
+            *dexp += n;
+            grisuRound(buf, len, dist, delta, rest, (uint64_t)pow10 << -one.e);
+            return len;
+        }
+        pow10 /= 10;
+    }
+
+    /* fractional digits */
+    for (n = 0;;)
+    {
+        p2 *= 10;
+        buf[len++] = (char)('0' + (p2 >> -one.e));
+        p2 &= one.f - 1;
+        n++;
+        delta *= 10;
+        dist *= 10;
+        if (p2 <= delta)
+            break;
+    }
+    *dexp -= n;
+    grisuRound(buf, len, dist, delta, p2, one.f);
+    return len;
+}
+
+/* print value with the fewest significant digits that read back as exactly
+ * value, %g style, always with '.' as decimal point. return length.
+ */
+int fs_double(char *out, double value)
+{
+    char digits[24];
+    char *o = out;
+    int n, dexp, x, i;
+
+    if (value != value)
+        return sprintf(out, "nan");
+    if (signbit(value))
+    {
+        *o++  = '-';
+        value = -value;
+    }
+    if (value == 0)
+    {
+        *o++ = '0';
+        *o   = '\0';
+        return o - out;
+    }
+    if (isinf(value))
+        return o - out + sprintf(o, "inf");
+
+    n = grisu2(digits, value, &dexp);
+    x = n + dexp - 1; /* exponent of the leading digit */
+
+    /* whole numbers below 1e20 keep their plain digits, as %.20g printed them */
+    if (x < -4 || x >= 20)
+    {
+        /* d.ddde+xx */
+        *o++ = digits[0];
+        if (n > 1)
+        {
+            *o++ = '.';
+            memcpy(o, digits + 1, n - 1);
+            o += n - 1;
+        }
+        o += sprintf(o, "e%c%02d", x < 0 ? '-' : '+', x < 0 ? -x : x);
+    }
+    else if (x < 0)
+    {
+        /* 0.000ddd */
+        *o++ = '0';
+        *o++ = '.';
+        for (i = x; i < -1; i++)
+            *o++ = '0';
+        memcpy(o, digits, n);
+        o += n;
+    }
+    else if (x + 1 >= n)
+    {
+        /* ddd000 */
+        memcpy(o, digits, n);
+        o += n;
+        for (i = n; i <= x; i++)
+            *o++ = '0';
+    }
+    else
+    {
+        /* ddd.ddd */
+        memcpy(o, digits, x + 1);
+        o += x + 1;
+        *o++ = '.';
+        memcpy(o, digits + x + 1, n - x - 1);
+        o += n - x - 1;
+    }
+
+    *o = '\0';
+    return o - out;
+}
+
 /* log message locally.
  * this has nothing to do with XML or any Clients.
  */
@@ -349,6 +658,199 @@ void tty_clr_trailing_read_lf(int enabled)
     ttyClrTrailingLF = enabled;
 }
 
+#ifndef _WIN32
+/* Replies are read through a buffer per descriptor: each read(2) takes whatever
+ * the port has available, complete sections are handed out from the buffer and
+ * the bytes after them are kept for the next call. Leftovers are dropped when a
+ * command is written to the port, as the tcflush() most drivers issue before
+ * each command would have done.
+ */
+#define TTY_RBUF_SIZE 512
+
+typedef struct
+{
+    int start;                         /* first unread byte */
+    int end;                           /* one past the last unread byte */
+    unsigned char data[TTY_RBUF_SIZE]; /* bytes read from the port */
+} tty_rbuf;
+
+static tty_rbuf **ttyRbufs;  /* indexed by fd, malloced as needed */
+static int nttyRbufs;        /* n entries in ttyRbufs */
+static pthread_mutex_t ttyRbufLock = PTHREAD_MUTEX_INITIALIZER;
+
+/* return the read buffer of fd, creating it if needed */
+static tty_rbuf *tty_rbuf_get(int fd)
+{
+    tty_rbuf *rb;
+
+    pthread_mutex_lock(&ttyRbufLock);
+    if (fd >= nttyRbufs)
+    {
+        int n = fd + 16;
+
+        ttyRbufs = (tty_rbuf **)realloc(ttyRbufs, n * sizeof(tty_rbuf *));
+        memset(ttyRbufs + nttyRbufs, 0, (n - nttyRbufs) * sizeof(tty_rbuf *));
+        nttyRbufs = n;
+    }
+    if (!ttyRbufs[fd])
+        ttyRbufs[fd] = (tty_rbuf *)calloc(1, sizeof(tty_rbuf));
+    rb = ttyRbufs[fd];
+    pthread_mutex_unlock(&ttyRbufLock);
+
+    return rb;
+}
+
+/* return the number of bytes buffered for fd */
+static int tty_rbuf_pending(int fd)
+{
+    int n = 0;
+
+    pthread_mutex_lock(&ttyRbufLock);
+    if (fd >= 0 && fd < nttyRbufs && ttyRbufs[fd])
+        n = ttyRbufs[fd]->end - ttyRbufs[fd]->start;
+    pthread_mutex_unlock(&ttyRbufLock);
+
+    return n;
+}
+
+/* return the current time in ms on a clock that is not set */
+static int64_t tty_now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* wait until fd is readable or the deadline passes */
+static int tty_wait(int fd, int64_t deadline)
+{
+    struct pollfd pfd;
+    int retval;
+
+    pfd.fd     = fd;
+    pfd.events = POLLIN;
+
+    do
+    {
+        int64_t left = deadline - tty_now_ms();
+
+        retval = poll(&pfd, 1, left > 0 ? (int)left : 0);
+    } while (retval < 0 && errno == EINTR);
+
+    if (retval > 0)
+        return TTY_OK;
+    else if (retval < 0)
+        return TTY_SELECT_ERROR;
+    else
+        return TTY_TIME_OUT;
+}
+
+void tty_clear_buffer(int fd)
+{
+    pthread_mutex_lock(&ttyRbufLock);
+    if (fd >= 0 && fd < nttyRbufs && ttyRbufs[fd])
+        ttyRbufs[fd]->start = ttyRbufs[fd]->end = 0;
+    pthread_mutex_unlock(&ttyRbufLock);
+}
+
+int tty_read_buffered(int fd, char *buf, int nbytes, int timeout, int clear_lf, int *nbytes_read)
+{
+    tty_rbuf *rb;
+    int64_t deadline;
+
+    *nbytes_read = 0;
+
+    if (fd == -1)
+        return TTY_ERRNO;
+    if (nbytes <= 0)
+        return TTY_PARAM_ERROR;
+
+    rb       = tty_rbuf_get(fd);
+    deadline = tty_now_ms() + timeout * 1000;
+
+    /* whatever a section read left over comes first */
+    while (rb->start < rb->end && *nbytes_read < nbytes)
+    {
+        unsigned char c = rb->data[rb->start++];
+
+        if (clear_lf && c == 0x0A && *nbytes_read == 0)
+            continue;
+        buf[(*nbytes_read)++] = c;
+    }
+
+    /* the rest goes straight to buf, no need to read ahead of a known length */
+    while (*nbytes_read < nbytes)
+    {
+        int err, bytesRead;
+
+        if ((err = tty_wait(fd, deadline)))
+            return err;
+
+        bytesRead = read(fd, buf + *nbytes_read, nbytes - *nbytes_read);
+
+        if (bytesRead <= 0)
+            return TTY_READ_ERROR;
+
+        if (*nbytes_read == 0 && clear_lf && buf[0] == 0x0A)
+        {
+            memmove(buf, buf + 1, bytesRead - 1);
+            --bytesRead;
+        }
+
+        *nbytes_read += bytesRead;
+    }
+
+    return TTY_OK;
+}
+
+int tty_read_section_buffered(int fd, char *buf, int nsize, char stop_char, int timeout, int clear_lf, int *nbytes_read)
+{
+    tty_rbuf *rb;
+    int64_t deadline;
+
+    *nbytes_read = 0;
+
+    if (fd == -1)
+        return TTY_ERRNO;
+
+    rb       = tty_rbuf_get(fd);
+    deadline = tty_now_ms() + timeout * 1000;
+
+    for (;;)
+    {
+        int err, bytesRead;
+
+        while (rb->start < rb->end)
+        {
+            unsigned char c = rb->data[rb->start++];
+
+            if (clear_lf && c == 0x0A && *nbytes_read == 0)
+                continue;
+
+            buf[(*nbytes_read)++] = c;
+
+            if (c == (unsigned char)stop_char)
+                return TTY_OK;
+            else if (nsize > 0 && *nbytes_read >= nsize)
+                return TTY_OVERFLOW;
+        }
+
+        rb->start = rb->end = 0;
+
+        if ((err = tty_wait(fd, deadline)))
+            return err;
+
+        bytesRead = read(fd, rb->data, TTY_RBUF_SIZE);
+
+        if (bytesRead <= 0)
+            return TTY_READ_ERROR;
+
+        rb->end = bytesRead;
+    }
+}
+#endif
+
 int tty_timeout(int fd, int timeout)
 {
 #if defined(_WIN32) || defined(ANDROID)
@@ -360,6 +862,10 @@ int tty_timeout(int fd, int timeout)
     if (fd == -1)
         return TTY_ERRNO;
 
+    /* bytes already read by a previous section read */
+    if (tty_rbuf_pending(fd) > 0)
+        return TTY_OK;
+
     struct timeval tv;
     fd_set readout;
     int retval;
@@ -408,6 +914,9 @@ int tty_write(int fd, const char *buf, int nbytes, int *nbytes_written)
     if (fd == -1)
         return TTY_ERRNO;
 
+    /* a new command, what is left of earlier replies is stale */
+    tty_clear_buffer(fd);
+
     int bytes_w     = 0;
     *nbytes_written = 0;
 
@@ -465,15 +974,25 @@ int tty_read(int fd, char *buf, int nbytes, int timeout, int *nbytes_read)
     if (tty_debug)
         IDLog("%s: Request to read %d bytes with %d timeout for fd %d\n", __FUNCTION__, nbytes, timeout, fd);
 
-    char geminiBuffer[257]={0};
-    char* buffer = buf;
-
-    if (ttyGeminiUdpFormat)
+    if (!ttyGeminiUdpFormat)
     {
-        numBytesToRead = nbytes + 8;
-        buffer = geminiBuffer;
+        err = tty_read_buffered(fd, buf, nbytes, timeout, ttyClrTrailingLF, nbytes_read);
+
+        if (tty_debug)
+        {
+            int i = 0;
+            for (i = 0; i < *nbytes_read; i++)
+                IDLog("%s: buffer[%d]=%#X (%c)\n", __FUNCTION__, i, (unsigned char)buf[i], buf[i]);
+        }
+
+        return err;
     }
 
+    char geminiBuffer[257]={0};
+    char* buffer = geminiBuffer;
+
+    numBytesToRead = nbytes + 8;
+
     while (numBytesToRead > 0)
     {
         if ((err = tty_timeout(fd, timeout)))
@@ -539,8 +1058,6 @@ int tty_read_section(int fd, char *buf, char stop_char, int timeout, int *nbytes
     int err       = TTY_OK;
     *nbytes_read  = 0;
 
-    uint8_t *read_char = 0;
-
     if (tty_debug)
         IDLog("%s: Request to read until stop char '%#02X' with %d timeout for fd %d\n", __FUNCTION__, stop_char, timeout, fd);
 
@@ -587,31 +1104,16 @@ int tty_read_section(int fd, char *buf, char stop_char, int timeout, int *nbytes
     }
     else
     {
-        for (;;)
-        {
-            if ((err = tty_timeout(fd, timeout)))
-                return err;
-
-            read_char = (uint8_t*)(buf + *nbytes_read);
-            bytesRead = read(fd, read_char, 1);
+        err = tty_read_section_buffered(fd, buf, 0, stop_char, timeout, ttyClrTrailingLF, nbytes_read);
 
-            if (bytesRead < 0)
-                return TTY_READ_ERROR;
-
-            if (tty_debug)
-                IDLog("%s: buffer[%d]=%#X (%c)\n", __FUNCTION__, (*nbytes_read), *read_char, *read_char);
-
-            if (!(ttyClrTrailingLF && *read_char == 0X0A && *nbytes_read == 0))
-                (*nbytes_read)++;
-            else {
-                if (tty_debug)
-                    IDLog("%s: Cleared LF char left in buf\n", __FUNCTION__);
-            }
-
-            if (*read_char == stop_char) {
-                return TTY_OK;
-            }
+        if (tty_debug)
+        {
+            int i = 0;
+            for (i = 0; i < *nbytes_read; i++)
+                IDLog("%s: buffer[%d]=%#X (%c)\n", __FUNCTION__, i, (unsigned char)buf[i], buf[i]);
         }
+
+        return err;
     }
 
     return TTY_TIME_OUT;
@@ -632,43 +1134,22 @@ int tty_nread_section(int fd, char *buf, int nsize, char stop_char, int timeout,
     if (ttyGeminiUdpFormat)
         return tty_read_section(fd, buf, stop_char, timeout, nbytes_read);
 
-    int bytesRead = 0;
-    int err       = TTY_OK;
-    *nbytes_read  = 0;
-    uint8_t *read_char = 0;
+    int err = TTY_OK;
     memset(buf, 0, nsize);
 
     if (tty_debug)
         IDLog("%s: Request to read until stop char '%#02X' with %d timeout for fd %d\n", __FUNCTION__, stop_char, timeout, fd);
 
-    for (;;)
-    {
-        if ((err = tty_timeout(fd, timeout)))
-            return err;
-
-        read_char = (uint8_t*)(buf + *nbytes_read);
-        bytesRead = read(fd, read_char, 1);
-
-        if (bytesRead < 0)
-            return TTY_READ_ERROR;
-
-        if (tty_debug)
-            IDLog("%s: buffer[%d]=%#X (%c)\n", __FUNCTION__, (*nbytes_read), *read_char, *read_char);
+    err = tty_read_section_buffered(fd, buf, nsize, stop_char, timeout, ttyClrTrailingLF, nbytes_read);
 
-        if (!(ttyClrTrailingLF && *read_char == 0X0A && *nbytes_read == 0))
-            (*nbytes_read)++;
-        else {
-            if (tty_debug)
-                IDLog("%s: Cleared LF char left in buf\n", __FUNCTION__);
-        }
-
-        if (*read_char == stop_char)
-            return TTY_OK;
-        else if (*nbytes_read >= nsize)
-            return TTY_OVERFLOW;
+    if (tty_debug)
+    {
+        int i = 0;
+        for (i = 0; i < *nbytes_read; i++)
+            IDLog("%s: buffer[%d]=%#X (%c)\n", __FUNCTION__, i, (unsigned char)buf[i], buf[i]);
     }
 
-    return TTY_TIME_OUT;
+    return err;
 
 #endif
 }
@@ -984,6 +1465,15 @@ int tty_connect(const char *device, int bit_rate, int word_size, int parity, int
         return TTY_PORT_FAILURE;
     }
 
+    // TIOCEXCL does not stop root, so also take an advisory lock. Drivers probing
+    // ports then skip those already claimed by another driver whoever runs them.
+    if (flock(t_fd, LOCK_EX | LOCK_NB) == -1 && errno == EWOULDBLOCK)
+    {
+        close(t_fd);
+        *fd = -1;
+        return TTY_PORT_BUSY;
+    }
+
     // Get the current options and save them so we can restore the default settings later.
     if (tcgetattr(t_fd, &tty_setting) == -1)
     {
@@ -1190,6 +1680,7 @@ int tty_disconnect(int fd)
 #else
     int err;
     tcflush(fd, TCIOFLUSH);
+    tty_clear_buffer(fd);
     err = close(fd);
 
     if (err != 0)
@@ -127,6 +127,41 @@ int tty_read_section(int fd, char *buf, char stop_char, int timeout, int *nbytes
 
 int tty_nread_section(int fd, char *buf, int nsize, char stop_char, int timeout, int *nbytes_read);
 
+/** \brief read exactly nbytes from terminal, starting with bytes a section read left over.
+    \param fd file descriptor
+    \param buf pointer to store data. Must be initilized and big enough to hold data.
+    \param nbytes number of bytes to read.
+    \param timeout number of seconds to wait for the whole read before a timeout error is issued.
+    \param clear_lf if nonzero, a LF received before any other byte is dropped.
+    \param nbytes_read the number of bytes read.
+    \return On success, it returns TTY_OK, otherwise, a TTY_ERROR code.
+    \note tty_read() and TTYBase use this unless a UDP format is set.
+*/
+int tty_read_buffered(int fd, char *buf, int nbytes, int timeout, int clear_lf, int *nbytes_read);
+
+/** \brief read buffer from terminal with a delimiter, through the read buffer of fd.
+    Each read(2) takes whatever the terminal has available, bytes after \e stop_char are kept for the
+    next read from fd and dropped when a command is written with tty_write().
+    \param fd file descriptor
+    \param buf pointer to store data. Must be initilized and big enough to hold data.
+    \param nsize size of buf, or 0 if unbounded. If stop character is not encountered before nsize, the function aborts.
+    \param stop_char if the function encounters \e stop_char then it stops reading and returns the buffer.
+    \param timeout number of seconds to wait for the whole section before a timeout error is issued.
+    \param clear_lf if nonzero, a LF received before any other byte is dropped.
+    \param nbytes_read the number of bytes read.
+    \return On success, it returns TTY_OK, otherwise, a TTY_ERROR code.
+    \note tty_read_section(), tty_nread_section() and TTYBase use this unless a UDP format is set.
+*/
+int tty_read_section_buffered(int fd, char *buf, int nsize, char stop_char, int timeout, int clear_lf,
+                              int *nbytes_read);
+
+/** \brief Drop the bytes held in the read buffer of fd.
+    Drivers that talk to fd with plain read(2) or flush it with tcflush() outside of tty_write() should call
+    this as well.
+    \param fd file descriptor
+*/
+void tty_clear_buffer(int fd);
+
 /** \brief Writes a buffer to fd.
     \param fd file descriptor
     \param buffer a null-terminated buffer to write to fd.
@@ -151,7 +186,8 @@ int tty_write_string(int fd, const char *buffer, int *nbytes_written);
     \param parity 0=no parity, 1=parity EVEN, 2=parity ODD
     \param stop_bits number of stop bits : 1 or 2
     \param fd \e fd is set to the file descriptor value on success.
-    \return On success, it returns TTY_OK, otherwise, a TTY_ERROR code.
+    \return On success, it returns TTY_OK, otherwise, a TTY_ERROR code. TTY_PORT_BUSY if another
+    process holds the port; the port is locked with flock() until tty_disconnect().
     \author Wildi Markus
 */
 
@@ -237,6 +273,16 @@ void getSexComponentsIID(double value, int *d, int *m, double *s);
 */
 int numberFormat(char *buf, const char *format, double value);
 
+/** \brief Fill buffer with the shortest string that reads back as exactly value.
+    \param out buffer to store the formatted string, at least 32 characters long.
+    \param value the number to format.
+    \return length of string.
+
+    The string is in %g style with up to 17 significant digits, and always uses '.' as decimal point
+    whatever the current locale. Numbers below 1e20 are written without exponent, like %.20g does.
+*/
+int fs_double(char *out, double value);
+
 /** \brief Create an ISO 8601 formatted time stamp. The format is YYYY-MM-DDTHH:MM:SS
     \return The formatted time stamp.
 */
@@ -58,6 +58,10 @@ static void initParser(LilXML *lp);
 static void pushXMLEle(LilXML *lp);
 static void popXMLEle(LilXML *lp);
 static void resetEndTag(LilXML *lp);
+static void startContent(LilXML *lp);
+static void sinkContent(LilXML *lp, const char *data, int len);
+static void endSink(LilXML *lp);
+static void discardSink(LilXML *lp);
 static XMLAtt *growAtt(XMLEle *e);
 static XMLEle *growEle(XMLEle *pe);
 static void freeAtt(XMLAtt *a);
@@ -98,6 +102,10 @@ struct LilXML_
     int lastc;     /* last char (just used wiht skipping)*/
     int skipping;  /* in comment or declaration */
     int inblob;    /* in oneBLOB element */
+    int binleft;   /* raw oneBLOB content bytes still to read */
+    int sinking;   /* content of ce goes to sink */
+    XMLContentSink sink; /* receives the content of the elements it accepts */
+    void *sinkcontext;
 };
 
 /* internal representation of a (possibly nested) XML element */
@@ -113,6 +121,7 @@ struct xml_ele_
     int eit;           /* used to iterate over el[] */
     String pcdata;     /* character data in this element */
     int pcdata_hasent; /* 1 if pcdata contains an entity char*/
+    void *aux;         /* owned by the application */
 };
 
 /* internal representation of an attribute */
@@ -155,6 +164,7 @@ LilXML *newLilXML()
 /* discard */
 void delLilXML(LilXML *lp)
 {
+    discardSink(lp);
     delXMLEle(lp->ce);
     freeString(&lp->endtag);
     (*myfree)(lp);
@@ -249,7 +259,7 @@ XMLEle **parseXMLChunk(LilXML *lp, char *buf, int size, char ynot[])
         if (lp->ce)
         {
             char *ctag = tagXMLEle(lp->ce);
-            if (ctag && !(strcmp(ctag, "oneBLOB")) && (lp->cs == INCON))
+            if (ctag && !(strcmp(ctag, "oneBLOB")) && (lp->cs == INCON) && !lp->sinking)
             {
 #ifdef WITH_ENCLEN
                 XMLAtt *blenatt = findXMLAtt(lp->ce, "enclen");
@@ -294,6 +304,39 @@ XMLEle **parseXMLChunk(LilXML *lp, char *buf, int size, char ynot[])
     while (curr - buf < size)
     {
         char newc = *curr;
+
+        /* raw oneBLOB content is copied as is */
+        if (lp->binleft > 0)
+        {
+            int n = size - (curr - buf);
+            if (n > lp->binleft)
+                n = lp->binleft;
+            if (lp->sinking)
+                sinkContent(lp, curr, n);
+            else
+            {
+                memcpy(lp->ce->pcdata.s + lp->ce->pcdata.sl, curr, n);
+                lp->ce->pcdata.sl += n;
+                lp->ce->pcdata.s[lp->ce->pcdata.sl] = '\0';
+                lp->binleft -= n;
+            }
+            curr += n;
+            continue;
+        }
+
+        /* sunk content goes to the sink in one piece up to the next tag */
+        if (lp->sinking && (lp->cs == LOOK4CON || lp->cs == INCON) && lp->lastc != '<' && newc != '<')
+        {
+            int n    = size - (curr - buf);
+            char *lt = memchr(curr, '<', n);
+            if (lt)
+                n = lt - curr;
+            sinkContent(lp, curr, n);
+            lp->cs = INCON;
+            curr += n;
+            continue;
+        }
+
         /* EOF? */
         if (newc == 0)
         {
@@ -388,6 +431,21 @@ XMLEle *readXMLEle(LilXML *lp, int newc, char ynot[])
     /* start optimistic */
     ynot[0] = '\0';
 
+    /* raw oneBLOB content is copied as is */
+    if (lp->binleft > 0)
+    {
+        char c = newc;
+        if (lp->sinking)
+            sinkContent(lp, &c, 1);
+        else
+        {
+            lp->ce->pcdata.s[lp->ce->pcdata.sl++] = newc;
+            lp->ce->pcdata.s[lp->ce->pcdata.sl]   = '\0';
+            lp->binleft--;
+        }
+        return (NULL);
+    }
+
     /* EOF? */
     if (newc == 0)
     {
@@ -565,6 +623,22 @@ XMLEle *parentXMLAtt(XMLAtt *ap)
 
 /* access functions */
 
+void setXMLContentSink(LilXML *lp, XMLContentSink sink, void *context)
+{
+    lp->sink        = sink;
+    lp->sinkcontext = context;
+}
+
+void *auxXMLEle(XMLEle *ep)
+{
+    return (ep->aux);
+}
+
+void setAuxXMLEle(XMLEle *ep, void *aux)
+{
+    ep->aux = aux;
+}
+
 /* return the tag name of the given element */
 char *tagXMLEle(XMLEle *ep)
 {
@@ -810,11 +884,12 @@ int sprlXMLEle(XMLEle *ep, int level)
 
 /* return a string with all xml-sensitive characters within the passed string s
  * replaced with their entity sequence equivalents.
- * N.B. caller must use the returned string before calling us again.
+ * N.B. caller must use the returned string before calling us again in the
+ * same thread.
  */
 char *entityXML(char *s)
 {
-    static char *malbuf;
+    static __thread char *malbuf;
     int nmalbuf = 0;
     char *sret = NULL;
     char *ep = NULL;
@@ -930,7 +1005,7 @@ static int oneXMLchar(LilXML *lp, int c, char ynot[])
             if (isTokenChar(0, c))
                 growString(&lp->ce->tag, c);
             else if (c == '>')
-                lp->cs = LOOK4CON;
+                startContent(lp);
             else if (c == '/')
                 lp->cs = SAWSLASH;
             else
@@ -939,7 +1014,7 @@ static int oneXMLchar(LilXML *lp, int c, char ynot[])
 
         case LOOK4ATTRN: /* looking for attr name, > or / */
             if (c == '>')
-                lp->cs = LOOK4CON;
+                startContent(lp);
             else if (c == '/')
                 lp->cs = SAWSLASH;
             else if (isTokenChar(1, c))
@@ -1026,10 +1101,19 @@ static int oneXMLchar(LilXML *lp, int c, char ynot[])
 
         case LOOK4CON: /* skipping leading content whitespace*/
             if (c == '<')
+            {
+                endSink(lp);
                 lp->cs = SAWLTINCON;
+            }
             else if (!isspace(c))
             {
-                growString(&lp->ce->pcdata, c);
+                if (lp->sinking)
+                {
+                    char sc = c;
+                    sinkContent(lp, &sc, 1);
+                }
+                else
+                    growString(&lp->ce->pcdata, c);
                 lp->cs = INCON;
             }
             break;
@@ -1043,11 +1127,17 @@ static int oneXMLchar(LilXML *lp, int c, char ynot[])
             }
             else if (c == '<')
             {
+                endSink(lp);
                 /* chomp trailing whitespace */
                 while (lp->ce->pcdata.sl > 0 && isspace(lp->ce->pcdata.s[lp->ce->pcdata.sl - 1]))
                     lp->ce->pcdata.s[--(lp->ce->pcdata.sl)] = '\0';
                 lp->cs = SAWLTINCON;
             }
+            else if (lp->sinking)
+            {
+                char sc = c;
+                sinkContent(lp, &sc, 1);
+            }
             else
             {
                 growString(&lp->ce->pcdata, c);
@@ -1138,15 +1228,86 @@ static int oneXMLchar(LilXML *lp, int c, char ynot[])
     return (0);
 }
 
-/* set up for a fresh start again */
+/* end of an element opening tag: look for its content.
+ * the sink is offered the content first.
+ * a oneBLOB with a binlen attribute is followed by exactly that many raw bytes
+ * of content, which are read without any XML processing.
+ */
+static void startContent(LilXML *lp)
+{
+    XMLAtt *ap;
+    int binlen;
+
+    lp->cs      = LOOK4CON;
+    lp->sinking = lp->sink && (*lp->sink)(lp->sinkcontext, lp->ce, NULL, 0) > 0;
+
+    if (strcmp(lp->ce->tag.s, "oneBLOB") || !(ap = findXMLAtt(lp->ce, "binlen")))
+        return;
+
+    binlen = atoi(ap->valu.s);
+    if (binlen <= 0)
+        return;
+
+    if (!lp->sinking)
+    {
+        lp->ce->pcdata.s  = (char *)moremem(lp->ce->pcdata.s, binlen + 1);
+        lp->ce->pcdata.sm = binlen + 1;
+        lp->ce->pcdata.sl = 0;
+    }
+    lp->binleft = binlen;
+}
+
+/* pass content of ce to the sink.
+ * raw content ends after binlen bytes, what follows is markup again.
+ */
+static void sinkContent(LilXML *lp, const char *data, int len)
+{
+    (*lp->sink)(lp->sinkcontext, lp->ce, data, len);
+
+    if (lp->binleft > 0)
+    {
+        lp->binleft -= len;
+        if (lp->binleft == 0)
+            endSink(lp);
+    }
+}
+
+/* tell the sink the content of ce is complete */
+static void endSink(LilXML *lp)
+{
+    if (!lp->sinking)
+        return;
+    lp->sinking = 0;
+    (*lp->sink)(lp->sinkcontext, lp->ce, NULL, -1);
+}
+
+/* tell the sink the incomplete tree ce is part of is discarded */
+static void discardSink(LilXML *lp)
+{
+    XMLEle *root = lp->ce;
+
+    if (!lp->sink || !root)
+        return;
+    while (root->pe)
+        root = root->pe;
+    (*lp->sink)(lp->sinkcontext, root, NULL, -2);
+}
+
+/* set up for a fresh start again, the sink stays */
 static void initParser(LilXML *lp)
 {
+    XMLContentSink sink = lp->sink;
+    void *sinkcontext   = lp->sinkcontext;
+
+    discardSink(lp);
     delXMLEle(lp->ce);
     freeString(&lp->endtag);
     memset(lp, 0, sizeof(*lp));
     newString(&lp->endtag);
-    lp->cs = LOOK4START;
-    lp->ln = 1;
+    lp->cs          = LOOK4START;
+    lp->ln          = 1;
+    lp->sink        = sink;
+    lp->sinkcontext = sinkcontext;
 }
 
 /* start a new XMLEle.
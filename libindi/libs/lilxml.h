@@ -74,6 +74,17 @@ typedef struct xml_att_ XMLAtt;
 typedef struct xml_ele_ XMLEle;
 typedef struct LilXML_ LilXML;
 
+/** \brief Receives the content of an XML element while it is parsed.
+
+    The sink is called with data NULL and len 0 when the opening tag of an element is complete. If it returns
+    1, the content of the element is passed to it as it arrives, in one or more calls with len bytes at data,
+    and is not stored in the element pcdata. A final call with data NULL and len -1 marks the end of the
+    content. The element and its attributes are available throughout, the element is not complete yet.
+    If parsing fails, or the parser is deleted, before the root element containing it is complete, the sink is
+    called with that root, data NULL and len -2, and the root is discarded.
+*/
+typedef int (*XMLContentSink)(void *context, XMLEle *ep, const char *data, int len);
+
 /**
  * \defgroup lilxmlFunctions XML Functions: Functions to parse, process, and search XML.
  */
@@ -115,6 +126,13 @@ extern XMLEle **parseXMLChunk(LilXML *lp, char *buf, int size, char errmsg[]);
 extern XMLEle *readXMLEle(LilXML *lp, int c, char errmsg[]);
 
 /* search functions */
+/** \brief Set the sink that receives the content of the elements it accepts.
+    \param lp Parser the sink applies to.
+    \param sink Sink function, NULL to keep all content in pcdata.
+    \param context Passed as first argument to sink.
+*/
+extern void setXMLContentSink(LilXML *lp, XMLContentSink sink, void *context);
+
 /** \brief Find an XML attribute within an XML element.
     \param e a pointer to the XML element to search.
     \param name the attribute name to search for.
@@ -180,6 +198,12 @@ extern char *nameXMLAtt(XMLAtt *ap);
 */
 extern char *valuXMLAtt(XMLAtt *ap);
 
+/** \brief Return the application data attached to an XML element, NULL if none. */
+extern void *auxXMLEle(XMLEle *ep);
+
+/** \brief Attach application data to an XML element. It is not freed with the element. */
+extern void setAuxXMLEle(XMLEle *ep, void *aux);
+
 /** \brief Return the number of characters in pcdata in an XML element.
     \param ep a pointer to an XML element.
     \return the length of the pcdata string.
@@ -230,7 +254,7 @@ extern void rmXMLAtt(XMLEle *ep, const char *name);
 extern void editXMLAtt(XMLAtt *ap, const char *str);
 
 /** \brief return a string with all xml-sensitive characters within the passed string replaced with their entity sequence equivalents.
-*   N.B. caller must use the returned string before calling us again.
+*   N.B. caller must use the returned string before calling us again from the same thread.
 */
 extern char *entityXML(char *str);
 
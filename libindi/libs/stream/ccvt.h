@@ -191,6 +191,72 @@ void bayer_grbg_to_rgb24(unsigned char *dst, unsigned char *srcc, long int WIDTH
 
 /*@}*/
 
+/**
+ * \defgroup colorSpaceSimd Vectorized color space conversion functions
+    Row based conversions using SSE2, AVX2 or NEON when available at run time, with a plain C fallback.
+    Rows of large frames are converted in parallel threads.
+
+    Source strides are given in bytes, destinations are packed. 4:2:2 and 4:2:0 conversions require an even
+    width, and an even height for 4:2:0. YUV to RGB conversions give the same results as ccvt_420p_rgb24().
+
+    Bayer frames are demosaiced with a bilinear interpolation, the frame borders being reflected.
+    16 bit Bayer frames are converted to RGB48, three 16 bit words per pixel.
+ */
+
+/*@{*/
+
+/** Byte order of packed 4:2:2 YUV formats */
+enum
+{
+    CCVT_YUYV,
+    CCVT_UYVY,
+    CCVT_YVYU,
+    CCVT_VYUY
+};
+
+/** Bayer patterns, named after the colors of the top left 2x2 square */
+enum
+{
+    CCVT_BAYER_RGGB,
+    CCVT_BAYER_GRBG,
+    CCVT_BAYER_GBRG,
+    CCVT_BAYER_BGGR
+};
+
+/** Instruction set levels, see ccvt_set_simd() */
+enum
+{
+    CCVT_SIMD_NONE,
+    CCVT_SIMD_BASE, /*!< SSE2 or NEON */
+    CCVT_SIMD_AVX2,
+    CCVT_SIMD_BEST = CCVT_SIMD_AVX2
+};
+
+/** Set the maximum number of threads used by the conversions, 0 to use all processors */
+void ccvt_set_max_threads(int threads);
+/** Limit the instruction sets used by the conversions, CCVT_SIMD_BEST by default */
+void ccvt_set_simd(int level);
+
+/** Packed 4:2:2 YUV in the given byte order to RGB24 */
+void ccvt_yuv422_rgb24(int width, int height, int stride, int order, const void *src, void *dst);
+/** Luminance of packed 4:2:2 YUV in the given byte order */
+void ccvt_yuv422_y8(int width, int height, int stride, int order, const void *src, void *dst);
+/** Packed 4:2:2 YUV in the given byte order to 4:2:0 YUV planar, chroma is averaged over pairs of rows */
+void ccvt_yuv422_420p(int width, int height, int stride, int order, const void *src, void *dsty, void *dstu,
+                      void *dstv);
+/** 4:2:0 YUV planar, given as separate Y, U and V planes, to RGB24 */
+void ccvt_yuv420p_rgb24(int width, int height, const void *srcy, const void *srcu, const void *srcv, void *dst);
+/** NV12 (or NV21 if swapuv) to RGB24. The interleaved chroma plane follows the luminance plane, with the same stride */
+void ccvt_nv12_rgb24(int width, int height, int stride, int swapuv, const void *src, void *dst);
+/** Most significant bytes of 16 bit little endian luminance */
+void ccvt_y16_y8(int width, int height, int stride, const void *src, void *dst);
+/** Bayer 8 bit to RGB24 */
+void ccvt_bayer8_rgb24(int width, int height, int stride, int pattern, const void *src, void *dst);
+/** Bayer 16 bit to RGB48 */
+void ccvt_bayer16_rgb48(int width, int height, int stride, int pattern, const void *src, void *dst);
+
+/*@}*/
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,913 @@
+/*  CCVT_SIMD: vectorized colour space conversion and demosaicing
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/*
+ All conversions work row by row: a row kernel is selected once per call according to the instruction
+ sets available at run time (AVX2, SSE2 or NEON, plain C otherwise), and the rows of large frames are
+ split between threads. The YUV to RGB arithmetic is the fixed point arithmetic of ccvt_420p_rgb24() and
+ ccvt_yuyv_rgb24(), so that both give the same results. Bayer frames are demosaiced by bilinear
+ interpolation, the borders reflecting the frame so that every pixel keeps its color neighbours.
+*/
+
+#include "ccvt.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#if defined(__GNUC__)
+#include <immintrin.h>
+#define CCVT_SIMD_X86_AVX2
+#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define CCVT_SIMD_ARM_NEON
+#endif
+
+/* Frames are split between threads by chunks of at least this number of pixels */
+#define CCVT_MIN_THREAD_PIXELS (256 * 1024)
+#define CCVT_MAX_THREADS       64
+
+static int ccvt_threads_max = 0;
+static int ccvt_simd_max    = CCVT_SIMD_BEST;
+
+void ccvt_set_max_threads(int threads)
+{
+    ccvt_threads_max = (threads > 0) ? threads : 0;
+}
+
+void ccvt_set_simd(int level)
+{
+    ccvt_simd_max = level;
+}
+
+static int ccvt_simd_level(void)
+{
+    int level = CCVT_SIMD_NONE;
+#if defined(__SSE2__) || defined(CCVT_SIMD_ARM_NEON)
+    level = CCVT_SIMD_BASE;
+#endif
+#ifdef CCVT_SIMD_X86_AVX2
+    if (__builtin_cpu_supports("avx2"))
+        level = CCVT_SIMD_AVX2;
+#endif
+    return (level < ccvt_simd_max) ? level : ccvt_simd_max;
+}
+
+/* Threads */
+
+typedef void (*ccvt_rows_func)(void *arg, int start, int end);
+
+typedef struct
+{
+    ccvt_rows_func func;
+    void *arg;
+    int start;
+    int end;
+} ccvt_rows_job;
+
+static void *ccvt_rows_worker(void *arg)
+{
+    ccvt_rows_job *job = (ccvt_rows_job *)arg;
+    job->func(job->arg, job->start, job->end);
+    return NULL;
+}
+
+/* Run func over [0, height), in chunks of an even number of rows so that 4:2:0 chroma rows are not shared */
+static void ccvt_parallel_rows(int width, int height, ccvt_rows_func func, void *arg)
+{
+    pthread_t threads[CCVT_MAX_THREADS];
+    ccvt_rows_job jobs[CCVT_MAX_THREADS];
+    int started[CCVT_MAX_THREADS];
+    long cpus  = sysconf(_SC_NPROCESSORS_ONLN);
+    long count = ccvt_threads_max > 0 ? ccvt_threads_max : (cpus > 0 ? cpus : 1);
+    long limit = ((long)width * height) / CCVT_MIN_THREAD_PIXELS;
+    int chunk, t;
+
+    if (count > limit)
+        count = limit;
+    if (count > height / 2)
+        count = height / 2;
+    if (count > CCVT_MAX_THREADS)
+        count = CCVT_MAX_THREADS;
+    if (count <= 1)
+    {
+        func(arg, 0, height);
+        return;
+    }
+
+    chunk = (height / count) & ~1;
+    for (t = 0; t < count; t++)
+    {
+        jobs[t].func  = func;
+        jobs[t].arg   = arg;
+        jobs[t].start = t * chunk;
+        jobs[t].end   = (t == count - 1) ? height : (t + 1) * chunk;
+    }
+    /* The calling thread takes the first chunk, a failed spawn degrades to inline execution */
+    for (t = 1; t < count; t++)
+        started[t] = (pthread_create(&threads[t], NULL, ccvt_rows_worker, &jobs[t]) == 0);
+    ccvt_rows_worker(&jobs[0]);
+    for (t = 1; t < count; t++)
+    {
+        if (started[t])
+            pthread_join(threads[t], NULL);
+        else
+            ccvt_rows_worker(&jobs[t]);
+    }
+}
+
+/* Row kernels: YUV with horizontally subsampled chroma to RGB24 */
+
+typedef void (*ccvt_yuv_row_func)(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, int width);
+
+static inline uint8_t ccvt_clamp8(int c)
+{
+    return (c < 0) ? 0 : ((c > 255) ? 255 : c);
+}
+
+static void ccvt_yuv_row_c(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, int width)
+{
+    int i, k;
+    for (i = 0; i < width; i += 2)
+    {
+        int du = u[i >> 1] - 128;
+        int dv = v[i >> 1] - 128;
+        int cb = (du * 454) >> 8;
+        int cr = (dv * 359) >> 8;
+        int cg = (dv * 183 + du * 88) >> 8;
+        for (k = i; k < i + 2 && k < width; k++)
+        {
+            dst[3 * k]     = ccvt_clamp8(y[k] + cr);
+            dst[3 * k + 1] = ccvt_clamp8(y[k] - cg);
+            dst[3 * k + 2] = ccvt_clamp8(y[k] + cb);
+        }
+    }
+}
+
+/* Deinterleave pairs of bytes: a[i] = src[2i], b[i] = src[2i + 1] */
+static void ccvt_deinterleave_c(const uint8_t *src, uint8_t *a, uint8_t *b, int count)
+{
+    int i;
+    for (i = 0; i < count; i++)
+    {
+        a[i] = src[2 * i];
+        b[i] = src[2 * i + 1];
+    }
+}
+
+#if defined(__SSE2__)
+
+/* Store 16 pixels given as planes, as RGB24. Each pixel is written as 4 bytes, the 4th being overwritten by the next one */
+static inline void ccvt_store_rgb24_sse2(uint8_t *dst, __m128i r, __m128i g, __m128i b)
+{
+    uint32_t px[16];
+    const __m128i zero = _mm_setzero_si128();
+    __m128i rg_lo = _mm_unpacklo_epi8(r, g), rg_hi = _mm_unpackhi_epi8(r, g);
+    __m128i bz_lo = _mm_unpacklo_epi8(b, zero), bz_hi = _mm_unpackhi_epi8(b, zero);
+    int i;
+
+    _mm_storeu_si128((__m128i *)px, _mm_unpacklo_epi16(rg_lo, bz_lo));
+    _mm_storeu_si128((__m128i *)(px + 4), _mm_unpackhi_epi16(rg_lo, bz_lo));
+    _mm_storeu_si128((__m128i *)(px + 8), _mm_unpacklo_epi16(rg_hi, bz_hi));
+    _mm_storeu_si128((__m128i *)(px + 12), _mm_unpackhi_epi16(rg_hi, bz_hi));
+    for (i = 0; i < 15; i++)
+        memcpy(dst + 3 * i, px + i, 4);
+    memcpy(dst + 45, px + 15, 3);
+}
+
+static void ccvt_yuv_row_sse2(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, int width)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i c128 = _mm_set1_epi16(128);
+    const __m128i kcb  = _mm_set1_epi16(454);
+    const __m128i kcr  = _mm_set1_epi16(359);
+    const __m128i kcg  = _mm_set1_epi32((88 << 16) | 183);
+    int i;
+
+    for (i = 0; i + 16 <= width; i += 16)
+    {
+        __m128i yv  = _mm_loadu_si128((const __m128i *)(y + i));
+        __m128i du  = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(u + i / 2)), zero), c128);
+        __m128i dv  = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(v + i / 2)), zero), c128);
+        /* (d * k) >> 8 is the high half of (d << 8) * k */
+        __m128i cb  = _mm_mulhi_epi16(_mm_slli_epi16(du, 8), kcb);
+        __m128i cr  = _mm_mulhi_epi16(_mm_slli_epi16(dv, 8), kcr);
+        __m128i cg  = _mm_packs_epi32(_mm_srai_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(dv, du), kcg), 8),
+                                      _mm_srai_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(dv, du), kcg), 8));
+        __m128i ylo = _mm_unpacklo_epi8(yv, zero);
+        __m128i yhi = _mm_unpackhi_epi8(yv, zero);
+        __m128i r   = _mm_packus_epi16(_mm_add_epi16(ylo, _mm_unpacklo_epi16(cr, cr)),
+                                       _mm_add_epi16(yhi, _mm_unpackhi_epi16(cr, cr)));
+        __m128i g   = _mm_packus_epi16(_mm_sub_epi16(ylo, _mm_unpacklo_epi16(cg, cg)),
+                                       _mm_sub_epi16(yhi, _mm_unpackhi_epi16(cg, cg)));
+        __m128i b   = _mm_packus_epi16(_mm_add_epi16(ylo, _mm_unpacklo_epi16(cb, cb)),
+                                       _mm_add_epi16(yhi, _mm_unpackhi_epi16(cb, cb)));
+        ccvt_store_rgb24_sse2(dst + 3 * i, r, g, b);
+    }
+    ccvt_yuv_row_c(y + i, u + i / 2, v + i / 2, dst + 3 * i, width - i);
+}
+
+static void ccvt_deinterleave_sse2(const uint8_t *src, uint8_t *a, uint8_t *b, int count)
+{
+    const __m128i mask = _mm_set1_epi16(0x00FF);
+    int i;
+
+    for (i = 0; i + 16 <= count; i += 16)
+    {
+        __m128i s0 = _mm_loadu_si128((const __m128i *)(src + 2 * i));
+        __m128i s1 = _mm_loadu_si128((const __m128i *)(src + 2 * i + 16));
+        _mm_storeu_si128((__m128i *)(a + i), _mm_packus_epi16(_mm_and_si128(s0, mask), _mm_and_si128(s1, mask)));
+        _mm_storeu_si128((__m128i *)(b + i), _mm_packus_epi16(_mm_srli_epi16(s0, 8), _mm_srli_epi16(s1, 8)));
+    }
+    ccvt_deinterleave_c(src + 2 * i, a + i, b + i, count - i);
+}
+
+#ifdef CCVT_SIMD_X86_AVX2
+
+__attribute__((target("avx2"))) static inline void ccvt_store_rgb24_ssse3(uint8_t *dst, __m128i r, __m128i g, __m128i b)
+{
+    const __m128i zero    = _mm_setzero_si128();
+    const __m128i pack    = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    __m128i rg_lo = _mm_unpacklo_epi8(r, g), rg_hi = _mm_unpackhi_epi8(r, g);
+    __m128i bz_lo = _mm_unpacklo_epi8(b, zero), bz_hi = _mm_unpackhi_epi8(b, zero);
+    __m128i p0 = _mm_shuffle_epi8(_mm_unpacklo_epi16(rg_lo, bz_lo), pack);
+    __m128i p1 = _mm_shuffle_epi8(_mm_unpackhi_epi16(rg_lo, bz_lo), pack);
+    __m128i p2 = _mm_shuffle_epi8(_mm_unpacklo_epi16(rg_hi, bz_hi), pack);
+    __m128i p3 = _mm_shuffle_epi8(_mm_unpackhi_epi16(rg_hi, bz_hi), pack);
+
+    _mm_storeu_si128((__m128i *)dst, _mm_or_si128(p0, _mm_slli_si128(p1, 12)));
+    _mm_storeu_si128((__m128i *)(dst + 16), _mm_or_si128(_mm_srli_si128(p1, 4), _mm_slli_si128(p2, 8)));
+    _mm_storeu_si128((__m128i *)(dst + 32), _mm_or_si128(_mm_srli_si128(p2, 8), _mm_slli_si128(p3, 4)));
+}
+
+__attribute__((target("avx2"))) static void ccvt_yuv_row_avx2(const uint8_t *y, const uint8_t *u, const uint8_t *v,
+                                                                uint8_t *dst, int width)
+{
+    const __m256i c128 = _mm256_set1_epi16(128);
+    const __m256i kcb  = _mm256_set1_epi16(454);
+    const __m256i kcr  = _mm256_set1_epi16(359);
+    const __m256i kcg  = _mm256_set1_epi32((88 << 16) | 183);
+    int i;
+
+    for (i = 0; i + 32 <= width; i += 32)
+    {
+        __m256i ylo = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(y + i)));
+        __m256i yhi = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(y + i + 16)));
+        __m256i du  = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(u + i / 2))), c128);
+        __m256i dv  = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(v + i / 2))), c128);
+        __m256i cb  = _mm256_mulhi_epi16(_mm256_slli_epi16(du, 8), kcb);
+        __m256i cr  = _mm256_mulhi_epi16(_mm256_slli_epi16(dv, 8), kcr);
+        __m256i cg  = _mm256_packs_epi32(_mm256_srai_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi16(dv, du), kcg), 8),
+                                         _mm256_srai_epi32(_mm256_madd_epi16(_mm256_unpackhi_epi16(dv, du), kcg), 8));
+        __m256i r, g, b;
+
+        /* Unpacking works within 128 bit lanes: reorder the chroma quadwords so that
+           the low unpack doubles chroma 0-7 and the high unpack chroma 8-15 */
+        cb = _mm256_permute4x64_epi64(cb, 0xD8);
+        cr = _mm256_permute4x64_epi64(cr, 0xD8);
+        cg = _mm256_permute4x64_epi64(cg, 0xD8);
+
+        r = _mm256_packus_epi16(_mm256_add_epi16(ylo, _mm256_unpacklo_epi16(cr, cr)),
+                                _mm256_add_epi16(yhi, _mm256_unpackhi_epi16(cr, cr)));
+        g = _mm256_packus_epi16(_mm256_sub_epi16(ylo, _mm256_unpacklo_epi16(cg, cg)),
+                                _mm256_sub_epi16(yhi, _mm256_unpackhi_epi16(cg, cg)));
+        b = _mm256_packus_epi16(_mm256_add_epi16(ylo, _mm256_unpacklo_epi16(cb, cb)),
+                                _mm256_add_epi16(yhi, _mm256_unpackhi_epi16(cb, cb)));
+        r = _mm256_permute4x64_epi64(r, 0xD8);
+        g = _mm256_permute4x64_epi64(g, 0xD8);
+        b = _mm256_permute4x64_epi64(b, 0xD8);
+
+        ccvt_store_rgb24_ssse3(dst + 3 * i, _mm256_castsi256_si128(r), _mm256_castsi256_si128(g),
+                               _mm256_castsi256_si128(b));
+        ccvt_store_rgb24_ssse3(dst + 3 * i + 48, _mm256_extracti128_si256(r, 1), _mm256_extracti128_si256(g, 1),
+                               _mm256_extracti128_si256(b, 1));
+    }
+    ccvt_yuv_row_sse2(y + i, u + i / 2, v + i / 2, dst + 3 * i, width - i);
+}
+
+#endif /* CCVT_SIMD_X86_AVX2 */
+
+#elif defined(CCVT_SIMD_ARM_NEON)
+
+static void ccvt_yuv_row_neon(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, int width)
+{
+    const int16x8_t c128 = vdupq_n_s16(128);
+    int i;
+
+    for (i = 0; i + 16 <= width; i += 16)
+    {
+        uint8x16_t yv = vld1q_u8(y + i);
+        int16x8_t du  = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vld1_u8(u + i / 2))), c128);
+        int16x8_t dv  = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vld1_u8(v + i / 2))), c128);
+        int16x8_t cb  = vcombine_s16(vshrn_n_s32(vmull_n_s16(vget_low_s16(du), 454), 8),
+                                     vshrn_n_s32(vmull_n_s16(vget_high_s16(du), 454), 8));
+        int16x8_t cr  = vcombine_s16(vshrn_n_s32(vmull_n_s16(vget_low_s16(dv), 359), 8),
+                                     vshrn_n_s32(vmull_n_s16(vget_high_s16(dv), 359), 8));
+        int16x8_t cg  = vcombine_s16(
+                            vshrn_n_s32(vmlal_n_s16(vmull_n_s16(vget_low_s16(dv), 183), vget_low_s16(du), 88), 8),
+                            vshrn_n_s32(vmlal_n_s16(vmull_n_s16(vget_high_s16(dv), 183), vget_high_s16(du), 88), 8));
+        int16x8_t ylo = vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(yv)));
+        int16x8_t yhi = vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(yv)));
+        int16x8x2_t crz = vzipq_s16(cr, cr), cgz = vzipq_s16(cg, cg), cbz = vzipq_s16(cb, cb);
+        uint8x16x3_t rgb;
+
+        rgb.val[0] = vcombine_u8(vqmovun_s16(vaddq_s16(ylo, crz.val[0])), vqmovun_s16(vaddq_s16(yhi, crz.val[1])));
+        rgb.val[1] = vcombine_u8(vqmovun_s16(vsubq_s16(ylo, cgz.val[0])), vqmovun_s16(vsubq_s16(yhi, cgz.val[1])));
+        rgb.val[2] = vcombine_u8(vqmovun_s16(vaddq_s16(ylo, cbz.val[0])), vqmovun_s16(vaddq_s16(yhi, cbz.val[1])));
+        vst3q_u8(dst + 3 * i, rgb);
+    }
+    ccvt_yuv_row_c(y + i, u + i / 2, v + i / 2, dst + 3 * i, width - i);
+}
+
+static void ccvt_deinterleave_neon(const uint8_t *src, uint8_t *a, uint8_t *b, int count)
+{
+    int i;
+    for (i = 0; i + 16 <= count; i += 16)
+    {
+        uint8x16x2_t s = vld2q_u8(src + 2 * i);
+        vst1q_u8(a + i, s.val[0]);
+        vst1q_u8(b + i, s.val[1]);
+    }
+    ccvt_deinterleave_c(src + 2 * i, a + i, b + i, count - i);
+}
+
+#endif
+
+typedef void (*ccvt_deinterleave_func)(const uint8_t *src, uint8_t *a, uint8_t *b, int count);
+
+static ccvt_yuv_row_func ccvt_yuv_row_kernel(void)
+{
+    int level = ccvt_simd_level();
+#ifdef CCVT_SIMD_X86_AVX2
+    if (level >= CCVT_SIMD_AVX2)
+        return ccvt_yuv_row_avx2;
+#endif
+#if defined(__SSE2__)
+    if (level >= CCVT_SIMD_BASE)
+        return ccvt_yuv_row_sse2;
+#elif defined(CCVT_SIMD_ARM_NEON)
+    if (level >= CCVT_SIMD_BASE)
+        return ccvt_yuv_row_neon;
+#endif
+    (void)level;
+    return ccvt_yuv_row_c;
+}
+
+static ccvt_deinterleave_func ccvt_deinterleave_kernel(void)
+{
+    int level = ccvt_simd_level();
+#if defined(__SSE2__)
+    if (level >= CCVT_SIMD_BASE)
+        return ccvt_deinterleave_sse2;
+#elif defined(CCVT_SIMD_ARM_NEON)
+    if (level >= CCVT_SIMD_BASE)
+        return ccvt_deinterleave_neon;
+#endif
+    (void)level;
+    return ccvt_deinterleave_c;
+}
+
+/* YUV conversions */
+
+typedef struct
+{
+    const uint8_t *src;
+    const uint8_t *u;
+    const uint8_t *v;
+    uint8_t *dst;
+    uint8_t *dstu;
+    uint8_t *dstv;
+    int width;
+    int stride;
+    int order;
+    ccvt_yuv_row_func row;
+    ccvt_deinterleave_func split;
+} ccvt_yuv_job;
+
+/* Split a packed 4:2:2 row into its Y, U and V planes */
+static void ccvt_yuv422_split(const ccvt_yuv_job *job, const uint8_t *src, uint8_t *y, uint8_t *u, uint8_t *v,
+                              uint8_t *chroma)
+{
+    int luma_first = (job->order == CCVT_YUYV || job->order == CCVT_YVYU);
+    int u_first    = (job->order == CCVT_YUYV || job->order == CCVT_UYVY);
+
+    if (luma_first)
+        job->split(src, y, chroma, job->width);
+    else
+        job->split(src, chroma, y, job->width);
+    if (u_first)
+        job->split(chroma, u, v, job->width / 2);
+    else
+        job->split(chroma, v, u, job->width / 2);
+}
+
+static void ccvt_yuv422_rgb24_rows(void *arg, int start, int end)
+{
+    const ccvt_yuv_job *job = (const ccvt_yuv_job *)arg;
+    uint8_t *buffer = (uint8_t *)malloc(3 * job->width);
+    uint8_t *y = buffer, *chroma = buffer + job->width, *u = chroma + job->width, *v = u + job->width / 2;
+    int r;
+
+    for (r = start; r < end; r++)
+    {
+        ccvt_yuv422_split(job, job->src + (long)r * job->stride, y, u, v, chroma);
+        job->row(y, u, v, job->dst + (long)r * job->width * 3, job->width);
+    }
+    free(buffer);
+}
+
+static void ccvt_yuv422_y8_rows(void *arg, int start, int end)
+{
+    const ccvt_yuv_job *job = (const ccvt_yuv_job *)arg;
+    int luma_first  = (job->order == CCVT_YUYV || job->order == CCVT_YVYU);
+    uint8_t *chroma = (uint8_t *)malloc(job->width);
+    int r;
+
+    for (r = start; r < end; r++)
+    {
+        const uint8_t *src = job->src + (long)r * job->stride;
+        uint8_t *y         = job->dst + (long)r * job->width;
+        if (luma_first)
+            job->split(src, y, chroma, job->width);
+        else
+            job->split(src, chroma, y, job->width);
+    }
+    free(chroma);
+}
+
+static void ccvt_yuv422_420p_rows(void *arg, int start, int end)
+{
+    const ccvt_yuv_job *job = (const ccvt_yuv_job *)arg;
+    int half        = job->width / 2;
+    uint8_t *buffer = (uint8_t *)malloc(3 * job->width);
+    uint8_t *chroma = buffer, *u = buffer + job->width, *v = u + half;
+    int r, i;
+
+    /* Chroma is averaged over pairs of rows, as ccvt_yuyv_420p() does */
+    for (r = start; r + 1 < end; r += 2)
+    {
+        uint8_t *du = job->dstu + (long)(r / 2) * half;
+        uint8_t *dv = job->dstv + (long)(r / 2) * half;
+        ccvt_yuv422_split(job, job->src + (long)r * job->stride, job->dst + (long)r * job->width, du, dv, chroma);
+        ccvt_yuv422_split(job, job->src + (long)(r + 1) * job->stride, job->dst + (long)(r + 1) * job->width, u, v,
+                          chroma);
+        for (i = 0; i < half; i++)
+        {
+            du[i] = (du[i] + u[i]) / 2;
+            dv[i] = (dv[i] + v[i]) / 2;
+        }
+    }
+    free(buffer);
+}
+
+static void ccvt_yuv420p_rgb24_rows(void *arg, int start, int end)
+{
+    const ccvt_yuv_job *job = (const ccvt_yuv_job *)arg;
+    int half = job->width / 2;
+    int r;
+
+    for (r = start; r < end; r++)
+        job->row(job->src + (long)r * job->width, job->u + (long)(r / 2) * half, job->v + (long)(r / 2) * half,
+                 job->dst + (long)r * job->width * 3, job->width);
+}
+
+static void ccvt_nv12_rgb24_rows(void *arg, int start, int end)
+{
+    const ccvt_yuv_job *job = (const ccvt_yuv_job *)arg;
+    uint8_t *buffer = (uint8_t *)malloc(job->width);
+    uint8_t *u = buffer, *v = buffer + job->width / 2;
+    int r;
+
+    for (r = start; r < end; r++)
+    {
+        if (r == start || (r & 1) == 0)
+        {
+            const uint8_t *uv = job->u + (long)(r / 2) * job->stride;
+            if (job->order)
+                job->split(uv, v, u, job->width / 2);
+            else
+                job->split(uv, u, v, job->width / 2);
+        }
+        job->row(job->src + (long)r * job->stride, u, v, job->dst + (long)r * job->width * 3, job->width);
+    }
+    free(buffer);
+}
+
+void ccvt_yuv422_rgb24(int width, int height, int stride, int order, const void *src, void *dst)
+{
+    ccvt_yuv_job job = { 0 };
+    if ((width & 1) || width <= 0 || height <= 0)
+        return;
+    job.src    = (const uint8_t *)src;
+    job.dst    = (uint8_t *)dst;
+    job.width  = width;
+    job.stride = stride;
+    job.order  = order;
+    job.row    = ccvt_yuv_row_kernel();
+    job.split  = ccvt_deinterleave_kernel();
+    ccvt_parallel_rows(width, height, ccvt_yuv422_rgb24_rows, &job);
+}
+
+void ccvt_yuv422_y8(int width, int height, int stride, int order, const void *src, void *dst)
+{
+    ccvt_yuv_job job = { 0 };
+    if ((width & 1) || width <= 0 || height <= 0)
+        return;
+    job.src    = (const uint8_t *)src;
+    job.dst    = (uint8_t *)dst;
+    job.width  = width;
+    job.stride = stride;
+    job.order  = order;
+    job.split  = ccvt_deinterleave_kernel();
+    ccvt_parallel_rows(width, height, ccvt_yuv422_y8_rows, &job);
+}
+
+void ccvt_yuv422_420p(int width, int height, int stride, int order, const void *src, void *dsty, void *dstu,
+                      void *dstv)
+{
+    ccvt_yuv_job job = { 0 };
+    if ((width & 1) || (height & 1) || width <= 0 || height <= 0)
+        return;
+    job.src    = (const uint8_t *)src;
+    job.dst    = (uint8_t *)dsty;
+    job.dstu   = (uint8_t *)dstu;
+    job.dstv   = (uint8_t *)dstv;
+    job.width  = width;
+    job.stride = stride;
+    job.order  = order;
+    job.split  = ccvt_deinterleave_kernel();
+    ccvt_parallel_rows(width, height, ccvt_yuv422_420p_rows, &job);
+}
+
+void ccvt_yuv420p_rgb24(int width, int height, const void *srcy, const void *srcu, const void *srcv, void *dst)
+{
+    ccvt_yuv_job job = { 0 };
+    if ((width & 1) || (height & 1) || width <= 0 || height <= 0)
+        return;
+    job.src   = (const uint8_t *)srcy;
+    job.u     = (const uint8_t *)srcu;
+    job.v     = (const uint8_t *)srcv;
+    job.dst   = (uint8_t *)dst;
+    job.width = width;
+    job.row   = ccvt_yuv_row_kernel();
+    ccvt_parallel_rows(width, height, ccvt_yuv420p_rgb24_rows, &job);
+}
+
+void ccvt_nv12_rgb24(int width, int height, int stride, int swapuv, const void *src, void *dst)
+{
+    ccvt_yuv_job job = { 0 };
+    if ((width & 1) || (height & 1) || width <= 0 || height <= 0)
+        return;
+    job.src    = (const uint8_t *)src;
+    job.u      = (const uint8_t *)src + (long)stride * height;
+    job.dst    = (uint8_t *)dst;
+    job.width  = width;
+    job.stride = stride;
+    job.order  = swapuv;
+    job.row    = ccvt_yuv_row_kernel();
+    job.split  = ccvt_deinterleave_kernel();
+    ccvt_parallel_rows(width, height, ccvt_nv12_rgb24_rows, &job);
+}
+
+/* 16 bit luminance */
+
+static void ccvt_y16_y8_row_c(const uint8_t *src, uint8_t *dst, int width)
+{
+    int i;
+    for (i = 0; i < width; i++)
+        dst[i] = src[2 * i + 1];
+}
+
+typedef struct
+{
+    const uint8_t *src;
+    uint8_t *dst;
+    int width;
+    int stride;
+    int simd;
+} ccvt_y16_job;
+
+static void ccvt_y16_y8_rows(void *arg, int start, int end)
+{
+    const ccvt_y16_job *job = (const ccvt_y16_job *)arg;
+    int r, i;
+
+    for (r = start; r < end; r++)
+    {
+        const uint8_t *src = job->src + (long)r * job->stride;
+        uint8_t *dst       = job->dst + (long)r * job->width;
+        i = 0;
+#if defined(__SSE2__)
+        if (job->simd)
+        {
+            for (; i + 16 <= job->width; i += 16)
+            {
+                __m128i s0 = _mm_loadu_si128((const __m128i *)(src + 2 * i));
+                __m128i s1 = _mm_loadu_si128((const __m128i *)(src + 2 * i + 16));
+                _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(_mm_srli_epi16(s0, 8), _mm_srli_epi16(s1, 8)));
+            }
+        }
+#elif defined(CCVT_SIMD_ARM_NEON)
+        if (job->simd)
+        {
+            for (; i + 16 <= job->width; i += 16)
+                vst1q_u8(dst + i, vld2q_u8(src + 2 * i).val[1]);
+        }
+#endif
+        ccvt_y16_y8_row_c(src + 2 * i, dst + i, job->width - i);
+    }
+}
+
+void ccvt_y16_y8(int width, int height, int stride, const void *src, void *dst)
+{
+    ccvt_y16_job job;
+    if (width <= 0 || height <= 0)
+        return;
+    job.src    = (const uint8_t *)src;
+    job.dst    = (uint8_t *)dst;
+    job.width  = width;
+    job.stride = stride;
+    job.simd   = ccvt_simd_level() >= CCVT_SIMD_BASE;
+    ccvt_parallel_rows(width, height, ccvt_y16_y8_rows, &job);
+}
+
+/* Bilinear demosaicing
+
+   For each pixel, with l/r the left and right neighbours in the row and u/d the ones in the rows above and below:
+     C = center, H = (l + r) / 2, V = (u + d) / 2, P = (l + r + u + d) / 4, X = average of the 4 diagonal neighbours
+   On a red or blue site, the site color is C, green is P and the opposite color is X.
+   On a green site, green is C, the color of the row is H and the color of the column is V.
+   Averages are truncated, as in bayer2rgb24(). */
+
+typedef void (*ccvt_bayer_row_func)(const void *up, const void *row, const void *down, void *dst, int width, int np,
+                                    int red);
+
+#define CCVT_BAYER_ROW_C(NAME, TYPE)                                                                            \
+    static void NAME(const TYPE *up, const TYPE *row, const TYPE *down, TYPE *dst, int width, int np, int red,  \
+                     int from, int to)                                                                          \
+    {                                                                                                           \
+        int c;                                                                                                  \
+        for (c = from; c < to; c++)                                                                             \
+        {                                                                                                       \
+            int l = (c > 0) ? c - 1 : 1;                                                                        \
+            int r = (c < width - 1) ? c + 1 : width - 2;                                                        \
+            unsigned int rowcolor, green, other;                                                                \
+            if ((c & 1) == np)                                                                                  \
+            {                                                                                                   \
+                rowcolor = row[c];                                                                              \
+                green    = (row[l] + row[r] + up[c] + down[c]) / 4;                                             \
+                other    = (up[l] + up[r] + down[l] + down[r]) / 4;                                             \
+            }                                                                                                   \
+            else                                                                                                \
+            {                                                                                                   \
+                rowcolor = (row[l] + row[r]) / 2;                                                               \
+                green    = row[c];                                                                              \
+                other    = (up[c] + down[c]) / 2;                                                               \
+            }                                                                                                   \
+            dst[3 * c + 1]             = green;                                                                 \
+            dst[3 * c + (red ? 0 : 2)] = rowcolor;                                                              \
+            dst[3 * c + (red ? 2 : 0)] = other;                                                                 \
+        }                                                                                                       \
+    }
+
+CCVT_BAYER_ROW_C(ccvt_bayer8_row_range, uint8_t)
+CCVT_BAYER_ROW_C(ccvt_bayer16_row_range, uint16_t)
+
+static void ccvt_bayer8_row_c(const void *up, const void *row, const void *down, void *dst, int width, int np, int red)
+{
+    ccvt_bayer8_row_range((const uint8_t *)up, (const uint8_t *)row, (const uint8_t *)down, (uint8_t *)dst, width, np,
+                          red, 0, width);
+}
+
+static void ccvt_bayer16_row_c(const void *up, const void *row, const void *down, void *dst, int width, int np, int red)
+{
+    ccvt_bayer16_row_range((const uint16_t *)up, (const uint16_t *)row, (const uint16_t *)down, (uint16_t *)dst, width,
+                           np, red, 0, width);
+}
+
+#if defined(__SSE2__)
+
+/* Truncated averages without overflow: (a + b) / 2 = (a & b) + (a ^ b) / 2, and the 4 terms average
+   is the average of both pair averages, plus one when the three discarded low bits are all set. */
+#define CCVT_BAYER_SSE2(NAME, BITS, SRL1, ADD, ONE, STORE, TYPE, LANES)                                             \
+    static inline __m128i NAME##_avg(__m128i a, __m128i b)                                                         \
+    {                                                                                                              \
+        return ADD(_mm_and_si128(a, b), SRL1(_mm_xor_si128(a, b)));                                                \
+    }                                                                                                              \
+    static inline __m128i NAME##_avg4(__m128i a, __m128i b, __m128i c, __m128i d)                                  \
+    {                                                                                                              \
+        __m128i h1 = NAME##_avg(a, b), h2 = NAME##_avg(c, d);                                                      \
+        __m128i carry = _mm_and_si128(_mm_and_si128(_mm_xor_si128(a, b), _mm_xor_si128(c, d)),                     \
+                                      _mm_and_si128(_mm_xor_si128(h1, h2), ONE));                                  \
+        return ADD(NAME##_avg(h1, h2), carry);                                                                     \
+    }                                                                                                              \
+    static void NAME(const void *vup, const void *vrow, const void *vdown, void *vdst, int width, int np, int red) \
+    {                                                                                                              \
+        const TYPE *up = (const TYPE *)vup, *row = (const TYPE *)vrow, *down = (const TYPE *)vdown;                \
+        TYPE *dst = (TYPE *)vdst;                                                                                  \
+        /* Chunks start on odd columns, the first lane holds a red or blue site when np is 1 */                    \
+        const __m128i site = (np == 1) ? ccvt_set1_epi##BITS##x2(-1, 0) : ccvt_set1_epi##BITS##x2(0, -1);            \
+        int c = 1;                                                                                                 \
+        ccvt_bayer##BITS##_row_range(up, row, down, dst, width, np, red, 0, 1);                                    \
+        for (; c + LANES + 1 <= width; c += LANES)                                                                 \
+        {                                                                                                          \
+            __m128i l  = _mm_loadu_si128((const __m128i *)(row + c - 1));                                          \
+            __m128i m  = _mm_loadu_si128((const __m128i *)(row + c));                                              \
+            __m128i r  = _mm_loadu_si128((const __m128i *)(row + c + 1));                                          \
+            __m128i ul = _mm_loadu_si128((const __m128i *)(up + c - 1));                                           \
+            __m128i um = _mm_loadu_si128((const __m128i *)(up + c));                                               \
+            __m128i ur = _mm_loadu_si128((const __m128i *)(up + c + 1));                                           \
+            __m128i dl = _mm_loadu_si128((const __m128i *)(down + c - 1));                                         \
+            __m128i dm = _mm_loadu_si128((const __m128i *)(down + c));                                             \
+            __m128i dr = _mm_loadu_si128((const __m128i *)(down + c + 1));                                         \
+            __m128i h  = NAME##_avg(l, r);                                                                         \
+            __m128i v  = NAME##_avg(um, dm);                                                                       \
+            __m128i p  = NAME##_avg4(l, r, um, dm);                                                                \
+            __m128i x  = NAME##_avg4(ul, ur, dl, dr);                                                              \
+            __m128i rowcolor = _mm_or_si128(_mm_and_si128(site, m), _mm_andnot_si128(site, h));                    \
+            __m128i green    = _mm_or_si128(_mm_and_si128(site, p), _mm_andnot_si128(site, m));                    \
+            __m128i other    = _mm_or_si128(_mm_and_si128(site, x), _mm_andnot_si128(site, v));                    \
+            if (red)                                                                                               \
+                STORE(dst + 3 * c, rowcolor, green, other);                                                        \
+            else                                                                                                   \
+                STORE(dst + 3 * c, other, green, rowcolor);                                                        \
+        }                                                                                                          \
+        ccvt_bayer##BITS##_row_range(up, row, down, dst, width, np, red, c, width);                                \
+    }
+
+static inline __m128i ccvt_set1_epi8x2(char even, char odd)
+{
+    return _mm_set1_epi16((short)(((uint8_t)odd << 8) | (uint8_t)even));
+}
+
+static inline __m128i ccvt_set1_epi16x2(short even, short odd)
+{
+    return _mm_set1_epi32((int)(((uint32_t)(uint16_t)odd << 16) | (uint16_t)even));
+}
+
+static inline __m128i ccvt_srl1_epi8(__m128i x)
+{
+    return _mm_and_si128(_mm_srli_epi16(x, 1), _mm_set1_epi8(0x7F));
+}
+
+static inline __m128i ccvt_srl1_epi16(__m128i x)
+{
+    return _mm_srli_epi16(x, 1);
+}
+
+/* Store 8 pixels of 16 bit planes as RGB48, each pixel written as 8 bytes overwritten by the next one */
+static inline void ccvt_store_rgb48_sse2(uint16_t *dst, __m128i r, __m128i g, __m128i b)
+{
+    uint64_t px[8];
+    const __m128i zero = _mm_setzero_si128();
+    __m128i rg_lo = _mm_unpacklo_epi16(r, g), rg_hi = _mm_unpackhi_epi16(r, g);
+    __m128i bz_lo = _mm_unpacklo_epi16(b, zero), bz_hi = _mm_unpackhi_epi16(b, zero);
+    int i;
+
+    _mm_storeu_si128((__m128i *)px, _mm_unpacklo_epi32(rg_lo, bz_lo));
+    _mm_storeu_si128((__m128i *)(px + 2), _mm_unpackhi_epi32(rg_lo, bz_lo));
+    _mm_storeu_si128((__m128i *)(px + 4), _mm_unpacklo_epi32(rg_hi, bz_hi));
+    _mm_storeu_si128((__m128i *)(px + 6), _mm_unpackhi_epi32(rg_hi, bz_hi));
+    for (i = 0; i < 7; i++)
+        memcpy(dst + 3 * i, px + i, 8);
+    memcpy(dst + 21, px + 7, 6);
+}
+
+CCVT_BAYER_SSE2(ccvt_bayer8_row_sse2, 8, ccvt_srl1_epi8, _mm_add_epi8, _mm_set1_epi8(1), ccvt_store_rgb24_sse2,
+                uint8_t, 16)
+CCVT_BAYER_SSE2(ccvt_bayer16_row_sse2, 16, ccvt_srl1_epi16, _mm_add_epi16, _mm_set1_epi16(1), ccvt_store_rgb48_sse2,
+                uint16_t, 8)
+
+#undef CCVT_BAYER_SSE2
+
+#elif defined(CCVT_SIMD_ARM_NEON)
+
+#define CCVT_BAYER_NEON(NAME, BITS, TYPE, VEC, Q, LANES, STORE, VECX3)                                             \
+    static inline VEC NAME##_avg4(VEC a, VEC b, VEC c, VEC d)                                                      \
+    {                                                                                                              \
+        VEC h1 = vhaddq_##Q(a, b), h2 = vhaddq_##Q(c, d);                                                          \
+        VEC carry = vandq_##Q(vandq_##Q(veorq_##Q(a, b), veorq_##Q(c, d)),                                         \
+                              vandq_##Q(veorq_##Q(h1, h2), vdupq_n_##Q(1)));                                       \
+        return vaddq_##Q(vhaddq_##Q(h1, h2), carry);                                                               \
+    }                                                                                                              \
+    static void NAME(const void *vup, const void *vrow, const void *vdown, void *vdst, int width, int np, int red) \
+    {                                                                                                              \
+        const TYPE *up = (const TYPE *)vup, *row = (const TYPE *)vrow, *down = (const TYPE *)vdown;                \
+        TYPE *dst = (TYPE *)vdst;                                                                                  \
+        TYPE pattern[LANES];                                                                                       \
+        VEC site;                                                                                                  \
+        int c = 1, k;                                                                                              \
+        for (k = 0; k < LANES; k++)                                                                                \
+            pattern[k] = (((1 + k) & 1) == np) ? (TYPE)-1 : 0;                                                     \
+        site = vld1q_##Q(pattern);                                                                                 \
+        ccvt_bayer##BITS##_row_range(up, row, down, dst, width, np, red, 0, 1);                                    \
+        for (; c + LANES + 1 <= width; c += LANES)                                                                 \
+        {                                                                                                          \
+            VEC l = vld1q_##Q(row + c - 1), m = vld1q_##Q(row + c), r = vld1q_##Q(row + c + 1);                    \
+            VEC um = vld1q_##Q(up + c), dm = vld1q_##Q(down + c);                                                  \
+            VEC x = NAME##_avg4(vld1q_##Q(up + c - 1), vld1q_##Q(up + c + 1), vld1q_##Q(down + c - 1),             \
+                                vld1q_##Q(down + c + 1));                                                          \
+            VEC h = vhaddq_##Q(l, r), v = vhaddq_##Q(um, dm), p = NAME##_avg4(l, r, um, dm);                       \
+            VECX3 rgb;                                                                                             \
+            rgb.val[red ? 0 : 2] = vbslq_##Q(site, m, h);                                                          \
+            rgb.val[1]           = vbslq_##Q(site, p, m);                                                          \
+            rgb.val[red ? 2 : 0] = vbslq_##Q(site, x, v);                                                          \
+            STORE(dst + 3 * c, rgb);                                                                               \
+        }                                                                                                          \
+        ccvt_bayer##BITS##_row_range(up, row, down, dst, width, np, red, c, width);                                \
+    }
+
+CCVT_BAYER_NEON(ccvt_bayer8_row_neon, 8, uint8_t, uint8x16_t, u8, 16, vst3q_u8, uint8x16x3_t)
+CCVT_BAYER_NEON(ccvt_bayer16_row_neon, 16, uint16_t, uint16x8_t, u16, 8, vst3q_u16, uint16x8x3_t)
+
+#undef CCVT_BAYER_NEON
+
+#endif
+
+#undef CCVT_BAYER_ROW_C
+
+typedef struct
+{
+    const uint8_t *src;
+    uint8_t *dst;
+    int width;
+    int height;
+    int stride;
+    int pixel;
+    int np;
+    int red;
+    ccvt_bayer_row_func row;
+} ccvt_bayer_job;
+
+static void ccvt_bayer_rows(void *arg, int start, int end)
+{
+    const ccvt_bayer_job *job = (const ccvt_bayer_job *)arg;
+    int r;
+
+    for (r = start; r < end; r++)
+    {
+        /* The first and last rows take the row inside the frame as their missing neighbour */
+        int up   = (r > 0) ? r - 1 : 1;
+        int down = (r < job->height - 1) ? r + 1 : job->height - 2;
+        int odd  = r & 1;
+        job->row(job->src + (long)up * job->stride, job->src + (long)r * job->stride, job->src + (long)down * job->stride,
+                 job->dst + (long)r * job->width * 3 * job->pixel, job->width, job->np ^ odd, job->red ^ odd);
+    }
+}
+
+static void ccvt_bayer(int width, int height, int stride, int pattern, int pixel, const void *src, void *dst)
+{
+    /* Column of the red or blue site, and whether it is red, on even rows */
+    static const int sites[4][2] = { { 0, 1 }, { 1, 1 }, { 1, 0 }, { 0, 0 } };
+    ccvt_bayer_job job;
+    int level = ccvt_simd_level();
+
+    if (width < 2 || height < 2 || pattern < CCVT_BAYER_RGGB || pattern > CCVT_BAYER_BGGR)
+        return;
+    job.src    = (const uint8_t *)src;
+    job.dst    = (uint8_t *)dst;
+    job.width  = width;
+    job.height = height;
+    job.stride = stride;
+    job.pixel  = pixel;
+    job.np     = sites[pattern][0];
+    job.red    = sites[pattern][1];
+    job.row    = (pixel == 1) ? ccvt_bayer8_row_c : ccvt_bayer16_row_c;
+#if defined(__SSE2__)
+    if (level >= CCVT_SIMD_BASE)
+        job.row = (pixel == 1) ? ccvt_bayer8_row_sse2 : ccvt_bayer16_row_sse2;
+#elif defined(CCVT_SIMD_ARM_NEON)
+    if (level >= CCVT_SIMD_BASE)
+        job.row = (pixel == 1) ? ccvt_bayer8_row_neon : ccvt_bayer16_row_neon;
+#endif
+    (void)level;
+    ccvt_parallel_rows(width, height, ccvt_bayer_rows, &job);
+}
+
+void ccvt_bayer8_rgb24(int width, int height, int stride, int pattern, const void *src, void *dst)
+{
+    ccvt_bayer(width, height, stride, pattern, 1, src, dst);
+}
+
+void ccvt_bayer16_rgb48(int width, int height, int stride, int pattern, const void *src, void *dst)
+{
+    ccvt_bayer(width, height, stride, pattern, 2, src, dst);
+}
@@ -23,40 +23,188 @@
 #include "stream/streammanager.h"
 #include "indiccd.h"
 
-#include <zlib.h>
+#include <config.h>
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
 #include <jpeglib.h>
 #include <jerror.h>
 
-static void init_destination(j_compress_ptr cinfo)
+#ifdef HAVE_TURBOJPEG
+#include <turbojpeg.h>
+#endif
+
+// Frames smaller than this number of pixels per stripe are not worth splitting
+#define MJPEG_MIN_STRIPE_PIXELS (512 * 1024)
+
+namespace INDI
+{
+
+/**
+ * @brief The Stripe struct holds the compressor of one horizontal band of the frame. It is created once and
+ * reused for every frame, so that neither the compressor nor its output buffer are allocated per frame.
+ */
+struct MJPEGEncoder::Stripe
+{
+    Stripe();
+    ~Stripe();
+
+    bool encode(const uint8_t *src, uint16_t width, uint16_t height, bool color, int quality, Subsampling subsampling);
+
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+
+#ifdef HAVE_TURBOJPEG
+    tjhandle handle = nullptr;
+    unsigned char *output = nullptr;
+    unsigned long capacity = 0;
+#else
+    static void initDestination(j_compress_ptr cinfo);
+    static boolean emptyOutputBuffer(j_compress_ptr cinfo);
+    static void termDestination(j_compress_ptr cinfo);
+
+    struct jpeg_compress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+    struct jpeg_destination_mgr jdest;
+    std::vector<uint8_t> output;
+    std::vector<JSAMPROW> rows;
+#endif
+};
+
+#ifdef HAVE_TURBOJPEG
+
+MJPEGEncoder::Stripe::Stripe()
+{
+    handle = tjInitCompress();
+}
+
+MJPEGEncoder::Stripe::~Stripe()
+{
+    tjFree(output);
+    if (handle)
+        tjDestroy(handle);
+}
+
+bool MJPEGEncoder::Stripe::encode(const uint8_t *src, uint16_t width, uint16_t height, bool color, int quality,
+                                  Subsampling subsampling)
+{
+    static const int samplings[] = { TJSAMP_444, TJSAMP_422, TJSAMP_420 };
+    int sampling = color ? samplings[subsampling] : TJSAMP_GRAY;
+
+    if (handle == nullptr)
+        return false;
+
+    // Preallocate the worst case so that the compressor never reallocates
+    unsigned long required = tjBufSize(width, height, sampling);
+    if (required > capacity)
+    {
+        tjFree(output);
+        output   = tjAlloc(required);
+        capacity = output ? required : 0;
+        if (output == nullptr)
+            return false;
+    }
+
+    unsigned long length = capacity;
+    if (tjCompress2(handle, const_cast<uint8_t *>(src), width, width * (color ? 3 : 1), height,
+                    color ? TJPF_RGB : TJPF_GRAY, &output, &length, sampling, quality, TJFLAG_NOREALLOC) != 0)
+        return false;
+
+    data = output;
+    size = length;
+    return true;
+}
+
+#else
+
+MJPEGEncoder::Stripe::Stripe()
+{
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_compress(&cinfo);
+    cinfo.client_data = this;
+
+    jdest.init_destination    = initDestination;
+    jdest.empty_output_buffer = emptyOutputBuffer;
+    jdest.term_destination    = termDestination;
+    cinfo.dest = &jdest;
+}
+
+MJPEGEncoder::Stripe::~Stripe()
 {
-    INDI_UNUSED(cinfo);
-    /* No work necessary here */
+    jpeg_destroy_compress(&cinfo);
 }
 
-static boolean empty_output_buffer(j_compress_ptr cinfo)
+void MJPEGEncoder::Stripe::initDestination(j_compress_ptr cinfo)
 {
-    INDI_UNUSED(cinfo);
-    /* No work necessary here */
+    Stripe *stripe = static_cast<Stripe *>(cinfo->client_data);
+    stripe->jdest.next_output_byte = stripe->output.data();
+    stripe->jdest.free_in_buffer   = stripe->output.size();
+}
+
+boolean MJPEGEncoder::Stripe::emptyOutputBuffer(j_compress_ptr cinfo)
+{
+    // The whole buffer is full, grow it instead of overflowing
+    Stripe *stripe = static_cast<Stripe *>(cinfo->client_data);
+    size_t used    = stripe->output.size();
+    stripe->output.resize(used * 2);
+    stripe->jdest.next_output_byte = stripe->output.data() + used;
+    stripe->jdest.free_in_buffer   = stripe->output.size() - used;
     return TRUE;
 }
 
-static void term_destination(j_compress_ptr cinfo)
+void MJPEGEncoder::Stripe::termDestination(j_compress_ptr cinfo)
 {
-    INDI_UNUSED(cinfo);
-    /* no work necessary here */
+    Stripe *stripe = static_cast<Stripe *>(cinfo->client_data);
+    stripe->data   = stripe->output.data();
+    stripe->size   = stripe->output.size() - stripe->jdest.free_in_buffer;
 }
 
-namespace INDI
+bool MJPEGEncoder::Stripe::encode(const uint8_t *src, uint16_t width, uint16_t height, bool color, int quality,
+                                  Subsampling subsampling)
 {
+    static const int factors[][2] = { { 1, 1 }, { 2, 1 }, { 2, 2 } };
+    int components = color ? 3 : 1;
+
+    // Start from a quarter of the raw size, the buffer grows if needed and is kept for the next frames
+    if (output.size() < 4096)
+        output.resize(std::max<size_t>(4096, width * height * components / 4));
+
+    cinfo.image_width      = width;
+    cinfo.image_height     = height;
+    cinfo.input_components = components;
+    cinfo.in_color_space   = color ? JCS_RGB : JCS_GRAYSCALE;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, quality, TRUE);
+    if (color)
+    {
+        cinfo.comp_info[0].h_samp_factor = factors[subsampling][0];
+        cinfo.comp_info[0].v_samp_factor = factors[subsampling][1];
+    }
+
+    rows.resize(height);
+    for (uint16_t i = 0; i < height; i++)
+        rows[i] = const_cast<JSAMPROW>(src + i * width * components);
+
+    jpeg_start_compress(&cinfo, TRUE);
+    while (cinfo.next_scanline < cinfo.image_height)
+        jpeg_write_scanlines(&cinfo, rows.data() + cinfo.next_scanline, cinfo.image_height - cinfo.next_scanline);
+    jpeg_finish_compress(&cinfo);
+    return true;
+}
+
+#endif
 
 MJPEGEncoder::MJPEGEncoder()
 {
-    name = "MJPEG";    
+    name = "MJPEG";
 }
 
 MJPEGEncoder::~MJPEGEncoder()
 {
-    delete [] jpegBuffer;
+    for (Stripe *stripe : stripes)
+        delete stripe;
 }
 
 const char *MJPEGEncoder::getDeviceName()
@@ -64,6 +212,11 @@ const char *MJPEGEncoder::getDeviceName()
     return currentCCD->getDeviceName();
 }
 
+void MJPEGEncoder::setQuality(int quality)
+{
+    m_Quality = std::min(std::max(quality, 1), 100);
+}
+
 bool MJPEGEncoder::upload(IBLOB *bp, const uint8_t *buffer, uint32_t nbytes, bool isCompressed)
 {
     // We do not support compression
@@ -74,117 +227,141 @@ bool MJPEGEncoder::upload(IBLOB *bp, const uint8_t *buffer, uint32_t nbytes, boo
     }
 
     INDI_UNUSED(nbytes);
-    int bufsize = rawWidth * rawHeight * ((pixelFormat == INDI_RGB) ? 3 : 1);
-    if (bufsize != jpegBufferSize)
+    if (encode(buffer, rawWidth, rawHeight, pixelFormat == INDI_RGB) == false)
     {
-        delete [] jpegBuffer;
-        jpegBuffer = new uint8_t[bufsize];
-        jpegBufferSize = bufsize;
+        LOG_ERROR("Failed to encode JPEG frame.");
+        return false;
     }
 
-    if (pixelFormat == INDI_RGB)
-        jpeg_compress_8u_rgb(buffer, rawWidth, rawHeight, rawWidth*3, jpegBuffer, &bufsize, 70);
-    else
-        jpeg_compress_8u_gray(buffer, rawWidth, rawHeight, rawWidth, jpegBuffer, &bufsize, 70);
-
-    bp->blob    = jpegBuffer;
-    bp->bloblen = bufsize;
-    bp->size    = bufsize;
+    bp->blob    = const_cast<uint8_t *>(jpegData);
+    bp->bloblen = jpegSize;
+    bp->size    = jpegSize;
     strcpy(bp->format, ".stream_jpg");
 
     return true;
 }
 
-/*
-FROM: https://svn.csail.mit.edu/rrg_pods/jpeg-utils/
-
-Name:         jpeg-utils
-Maintainers:  Albert Huang <albert@csail.mit.edu>
-Summary:      Wrapper functions around libjpeg to simplify JPEG compression and
-              decompression with in-memory buffers.
-Description:
-  note: This is a simple enough library that you could just copy the .c
-  and .h files in to your own programs.
-
-  To use the library, link against -ljpeg-utils, or use
-  pkg-config --cflags --libs jpeg-utils
-
-Requirements:
-  libjpeg62
-
-  For faster performance, install libjpeg-turbo, an SSE-accelerated
-  library that is ABI compatible with libjpeg62.
-*/
-
-int MJPEGEncoder::jpeg_compress_8u_gray (const uint8_t * src, uint16_t width, uint16_t height, int stride, uint8_t * dest, int * destsize, int quality)
+bool MJPEGEncoder::encode(const uint8_t *src, uint16_t width, uint16_t height, bool color)
 {
-    struct jpeg_compress_struct cinfo;
-    struct jpeg_error_mgr jerr;
-    struct jpeg_destination_mgr jdest;
-    int out_size = *destsize;
-
-    cinfo.err = jpeg_std_error (&jerr);
-    jpeg_create_compress (&cinfo);
-    jdest.next_output_byte = dest;
-    jdest.free_in_buffer = out_size;
-    jdest.init_destination = init_destination;
-    jdest.empty_output_buffer = empty_output_buffer;
-    jdest.term_destination = term_destination;
-    cinfo.dest = &jdest;
-
-    cinfo.image_width = width;
-    cinfo.image_height = height;
-    cinfo.input_components = 1;
-    cinfo.in_color_space = JCS_GRAYSCALE;
-    jpeg_set_defaults (&cinfo);
-    jpeg_set_quality (&cinfo, quality, TRUE);
+    int quality             = m_Quality;
+    Subsampling subsampling = m_Subsampling;
+    int threads             = m_MaxThreads > 0 ? m_MaxThreads.load() : static_cast<int>(std::thread::hardware_concurrency());
+    int components          = color ? 3 : 1;
+
+    // Stripes are made of whole MCU rows, and the restart interval counting the MCUs of a stripe must fit 16 bits
+    int mcuWidth  = (color && subsampling != SUBSAMPLING_444) ? 16 : 8;
+    int mcuHeight = (color && subsampling == SUBSAMPLING_420) ? 16 : 8;
+    int mcuPerRow = (width + mcuWidth - 1) / mcuWidth;
+    int mcuRows   = (height + mcuHeight - 1) / mcuHeight;
+
+    int count = std::min(threads, static_cast<int>(static_cast<size_t>(width) * height / MJPEG_MIN_STRIPE_PIXELS));
+    count = std::max(std::min(count, mcuRows), 1);
+    int stripeRows = (mcuRows + count - 1) / count;
+    stripeRows = std::min(stripeRows, 65535 / mcuPerRow);
+    count = (mcuRows + stripeRows - 1) / stripeRows;
+    if (count == 1)
+        stripeRows = mcuRows;
+
+    while (static_cast<int>(stripes.size()) < count)
+        stripes.push_back(new Stripe());
+
+    std::vector<char> results(count, false);
+    auto encodeStripe = [&](int i)
+    {
+        int top    = i * stripeRows * mcuHeight;
+        int bottom = std::min<int>(top + stripeRows * mcuHeight, height);
+        results[i] = stripes[i]->encode(src + static_cast<size_t>(top) * width * components, width, bottom - top, color,
+                                        quality, subsampling);
+    };
+
+    // The calling thread encodes the first stripe
+    std::vector<std::thread> workers;
+    for (int i = 1; i < count; i++)
+        workers.emplace_back(encodeStripe, i);
+    encodeStripe(0);
+    for (std::thread &worker : workers)
+        worker.join();
+
+    if (std::find(results.begin(), results.end(), false) != results.end())
+        return false;
 
-    jpeg_start_compress (&cinfo, TRUE);
-    while (cinfo.next_scanline < height)
+    if (count == 1)
     {
-        JSAMPROW row = (JSAMPROW)(src + cinfo.next_scanline * stride);
-        jpeg_write_scanlines (&cinfo, &row, 1);
+        jpegData = stripes[0]->data;
+        jpegSize = stripes[0]->size;
+        return true;
     }
 
-    jpeg_finish_compress (&cinfo);
-    *destsize = out_size - jdest.free_in_buffer;
-    jpeg_destroy_compress (&cinfo);
-    return 0;
+    return joinStripes(count, height, stripeRows * mcuPerRow);
 }
 
-int MJPEGEncoder::jpeg_compress_8u_rgb (const uint8_t * src, uint16_t width, uint16_t height, int stride, uint8_t * dest, int * destsize, int quality)
+// Locate the frame header and the scan header of an encoded stripe
+static bool findSegments(const uint8_t *data, size_t size, size_t *sof, size_t *sos, size_t *scan)
 {
-    struct jpeg_compress_struct cinfo;
-    struct jpeg_error_mgr jerr;
-    struct jpeg_destination_mgr jdest;
-    int out_size = *destsize;
-
-    cinfo.err = jpeg_std_error (&jerr);
-    jpeg_create_compress (&cinfo);
-    jdest.next_output_byte = dest;
-    jdest.free_in_buffer = out_size;
-    jdest.init_destination = init_destination;
-    jdest.empty_output_buffer = empty_output_buffer;
-    jdest.term_destination = term_destination;
-    cinfo.dest = &jdest;
+    size_t pos = 2;
+    *sof = 0;
+    while (pos + 4 <= size && data[pos] == 0xFF)
+    {
+        uint8_t marker = data[pos + 1];
+        size_t length  = (data[pos + 2] << 8) | data[pos + 3];
+        if (marker == 0xC0)
+            *sof = pos;
+        else if (marker == 0xDA)
+        {
+            *sos  = pos;
+            *scan = pos + 2 + length;
+            return *sof != 0 && *scan + 2 <= size && data[size - 2] == 0xFF && data[size - 1] == 0xD9;
+        }
+        pos += 2 + length;
+    }
+    return false;
+}
 
-    cinfo.image_width = width;
-    cinfo.image_height = height;
-    cinfo.input_components = 3;
-    cinfo.in_color_space = JCS_RGB;
-    jpeg_set_defaults (&cinfo);
-    jpeg_set_quality (&cinfo, quality, TRUE);
+bool MJPEGEncoder::joinStripes(int count, uint16_t height, int restartInterval)
+{
+    size_t sof, sos, scan;
+    const Stripe *first = stripes[0];
+    if (findSegments(first->data, first->size, &sof, &sos, &scan) == false)
+        return false;
 
-    jpeg_start_compress (&cinfo, TRUE);
-    while (cinfo.next_scanline < height)
+    size_t total = first->size + 6 + 2 * count;
+    for (int i = 1; i < count; i++)
+        total += stripes[i]->size;
+    jpegBuffer.resize(total);
+
+    // Headers of the first stripe, with the full frame height and a restart interval of one stripe
+    uint8_t *out = jpegBuffer.data();
+    memcpy(out, first->data, sos);
+    out[sof + 5] = height >> 8;
+    out[sof + 6] = height & 0xFF;
+    out += sos;
+
+    const uint8_t dri[6] = { 0xFF, 0xDD, 0x00, 0x04, static_cast<uint8_t>(restartInterval >> 8),
+                             static_cast<uint8_t>(restartInterval & 0xFF) };
+    memcpy(out, dri, sizeof(dri));
+    out += sizeof(dri);
+    memcpy(out, first->data + sos, scan - sos);
+    out += scan - sos;
+
+    // Entropy coded data of each stripe, separated by restart markers. Each stripe starts with reset
+    // DC predictions and ends byte aligned, exactly as required after a restart marker.
+    for (int i = 0; i < count; i++)
     {
-        JSAMPROW row = (JSAMPROW)(src + cinfo.next_scanline * stride);
-        jpeg_write_scanlines (&cinfo, &row, 1);
+        const Stripe *stripe = stripes[i];
+        size_t sofStripe, sosStripe, scanStripe;
+        if (i > 0 && findSegments(stripe->data, stripe->size, &sofStripe, &sosStripe, &scanStripe) == false)
+            return false;
+        size_t start = (i == 0) ? scan : scanStripe;
+        size_t length = stripe->size - 2 - start;
+        memcpy(out, stripe->data + start, length);
+        out += length;
+        *out++ = 0xFF;
+        *out++ = (i == count - 1) ? 0xD9 : 0xD0 + (i % 8);
     }
-    jpeg_finish_compress (&cinfo);
-    *destsize = out_size - jdest.free_in_buffer;
-    jpeg_destroy_compress (&cinfo);
-    return 0;
+
+    jpegData = jpegBuffer.data();
+    jpegSize = out - jpegBuffer.data();
+    return true;
 }
 
 }
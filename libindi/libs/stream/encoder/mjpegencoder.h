@@ -23,29 +23,63 @@
 
 #include "encoderinterface.h"
 
+#include <atomic>
+#include <vector>
+
 namespace INDI
 {
 
 /**
  * @brief The MJPEGEncoder class encodes frames in JPEG format before transmitting them to the client.
  *
- * The quality is now hard-coded at 70 when encoding the JPEG image. Further compression is not supported.
+ * The compressor state and output buffers are kept across frames. The TurboJPEG API of libjpeg-turbo
+ * is used when available, libjpeg otherwise. Large frames are split in horizontal stripes encoded in
+ * parallel and joined with restart markers into a single baseline JPEG image.
  */
 class MJPEGEncoder : public EncoderInterface
 {
 public:
+    enum Subsampling
+    {
+        SUBSAMPLING_444,
+        SUBSAMPLING_422,
+        SUBSAMPLING_420
+    };
+
     MJPEGEncoder();
     ~MJPEGEncoder();
 
     virtual bool upload(IBLOB *bp, const uint8_t *buffer, uint32_t nbytes, bool isCompressed=false) override;
 
+    /**
+     * @brief setQuality Set the JPEG quality, from 1 to 100. Default is 70.
+     */
+    void setQuality(int quality);
+    /**
+     * @brief setSubsampling Set the chroma subsampling of color frames. Default is 4:2:0.
+     */
+    void setSubsampling(Subsampling subsampling) { m_Subsampling = subsampling; }
+    /**
+     * @brief setMaxThreads Set the maximum number of stripes encoded in parallel, 0 to use all processors.
+     */
+    void setMaxThreads(int threads) { m_MaxThreads = threads; }
+
 private:
+    struct Stripe;
+
     const char *getDeviceName();
-    int jpeg_compress_8u_gray (const uint8_t * src, uint16_t width, uint16_t height, int stride, uint8_t * dest, int * destsize, int quality);
-    int jpeg_compress_8u_rgb (const uint8_t * src, uint16_t width, uint16_t height, int stride, uint8_t * dest, int * destsize, int quality);
-    uint8_t *jpegBuffer = nullptr;
-    uint16_t jpegBufferSize=1;
+    bool encode(const uint8_t *src, uint16_t width, uint16_t height, bool color);
+    // Concatenate the stripes scans into jpegBuffer
+    bool joinStripes(int count, uint16_t height, int restartInterval);
+
+    std::vector<Stripe *> stripes;
+    std::vector<uint8_t> jpegBuffer;
+    const uint8_t *jpegData = nullptr;
+    size_t jpegSize = 0;
 
+    std::atomic<int> m_Quality { 70 };
+    std::atomic<Subsampling> m_Subsampling { SUBSAMPLING_420 };
+    std::atomic<int> m_MaxThreads { 0 };
 };
 
 }
@@ -50,6 +50,21 @@
 
 namespace INDI
 {
+/**
+ * @brief Statistics of the recorders writing frames asynchronously.
+ */
+struct RecorderStatistics
+{
+    /// Frames dropped because the write queue was full
+    uint32_t framesDropped = 0;
+    /// Frames waiting in the write queue
+    uint32_t framesQueued = 0;
+    /// Average time in milliseconds between queueing a frame and writing it
+    double writeLatency = 0;
+    /// Maximum time in milliseconds between queueing a frame and writing it
+    double writeLatencyMax = 0;
+};
+
 /**
  * @brief The RecorderInterface class is the base class for recorders.
  */
@@ -75,6 +90,8 @@ class RecorderInterface
     // and no need to do any further subframing operations. Otherwise, subframing must be done.
     // This is to reduce process time and save memory for a dedicated subframe buffer
     virtual void setStreamEnabled(bool enable) = 0;
+    // Fill in the write statistics, false if the recorder writes synchronously
+    virtual bool getStatistics(RecorderStatistics &stats) { (void)stats; return false; }
 
   protected:
     const char *name;
@@ -28,14 +28,25 @@
 #include "serrecorder.h"
 #include "jpegutils.h"
 
+#include <algorithm>
 #include <ctime>
 #include <cerrno>
 #include <cstring>
+#include <fcntl.h>
 #include <sys/time.h>
+#include <unistd.h>
 
 
 #define ERRMSGSIZ 1024
 
+// Size of the aggregated writes, a multiple of the O_DIRECT alignment
+#define SER_STAGING_SIZE      (8 * 1024 * 1024)
+#define SER_DIRECT_ALIGNMENT  4096
+// File space reserved ahead of the writes
+#define SER_PREALLOCATE_SIZE  (256 * 1024 * 1024)
+// Timestamps kept in memory before being spilled to the side file
+#define SER_STAMPS_BUFFER     (8192 * sizeof(uint64_t))
+
 namespace INDI
 {
 
@@ -54,13 +65,15 @@ SER_Recorder::SER_Recorder()
     else
         serh.LittleEndian = SER_BIG_ENDIAN;
     isRecordingActive = false;
-    f                 = nullptr;
 
     jpegBuffer = static_cast<uint8_t*>(malloc(1));
 }
 
 SER_Recorder::~SER_Recorder()
 {
+    close();
+    for (auto frame : freeFrames)
+        delete frame;
     free(jpegBuffer);
 }
 
@@ -71,49 +84,36 @@ bool SER_Recorder::is_little_endian()
     return black_magic == 0x01;
 }
 
-void SER_Recorder::write_int_le(uint32_t *i)
+uint8_t *SER_Recorder::write_int_le(uint8_t *out, uint32_t i)
 {
-    if (is_little_endian())
-        fwrite((const void *)(i), sizeof(uint32_t), 1, f);
-    else
-    {
-        unsigned char *c = (unsigned char *)i;
-        fwrite((const void *)(c + 3), sizeof(char), 1, f);
-        fwrite((const void *)(c + 2), sizeof(char), 1, f);
-        fwrite((const void *)(c + 1), sizeof(char), 1, f);
-        fwrite((const void *)(c), sizeof(char), 1, f);
-    }
+    out[0] = i & 0xFF;
+    out[1] = (i >> 8) & 0xFF;
+    out[2] = (i >> 16) & 0xFF;
+    out[3] = (i >> 24) & 0xFF;
+    return out + 4;
 }
 
-void SER_Recorder::write_long_int_le(uint64_t *i)
+uint8_t *SER_Recorder::write_long_int_le(uint8_t *out, uint64_t i)
 {
-    if (is_little_endian())
-    {
-        fwrite((const void *)((uint32_t *)i), sizeof(int), 1, f);
-        fwrite((const void *)((uint32_t *)(i) + 1), sizeof(int), 1, f);
-    }
-    else
-    {
-        write_int_le((uint32_t *)(i) + 1);
-        write_int_le((uint32_t *)(i));
-    }
+    out = write_int_le(out, static_cast<uint32_t>(i));
+    return write_int_le(out, static_cast<uint32_t>(i >> 32));
 }
 
-void SER_Recorder::write_header(ser_header *s)
+void SER_Recorder::write_header(ser_header *s, uint8_t *out)
 {
-    fwrite((const void *)(s->FileID), sizeof(char), 14, f);
-    write_int_le(&(s->LuID));
-    write_int_le(&(s->ColorID));
-    write_int_le(&(s->LittleEndian));
-    write_int_le(&(s->ImageWidth));
-    write_int_le(&(s->ImageHeight));
-    write_int_le(&(s->PixelDepth));
-    write_int_le(&(s->FrameCount));
-    fwrite((const void *)(s->Observer), sizeof(char), 40, f);
-    fwrite((const void *)(s->Instrume), sizeof(char), 40, f);
-    fwrite((const void *)(s->Telescope), sizeof(char), 40, f);
-    write_long_int_le(&(s->DateTime));
-    write_long_int_le(&(s->DateTime_UTC));
+    memcpy(out, s->FileID, 14);
+    out = write_int_le(out + 14, s->LuID);
+    out = write_int_le(out, s->ColorID);
+    out = write_int_le(out, s->LittleEndian);
+    out = write_int_le(out, s->ImageWidth);
+    out = write_int_le(out, s->ImageHeight);
+    out = write_int_le(out, s->PixelDepth);
+    out = write_int_le(out, s->FrameCount);
+    memcpy(out, s->Observer, 40);
+    memcpy(out + 40, s->Instrume, 40);
+    memcpy(out + 80, s->Telescope, 40);
+    out = write_long_int_le(out + 120, s->DateTime);
+    write_long_int_le(out, s->DateTime_UTC);
 }
 
 bool SER_Recorder::setPixelFormat(INDI_PIXEL_FORMAT pixelFormat, uint8_t pixelDepth)
@@ -176,40 +176,109 @@ bool SER_Recorder::open(const char *filename, char *errmsg)
     if (isRecordingActive)
         return false;
     serh.FrameCount = 0;
-    if ((f = fopen(filename, "w")) == nullptr)
+
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+    directIOActive = false;
+#ifdef O_DIRECT
+    if (useDirectIO)
+    {
+        fd = ::open(filename, flags | O_DIRECT, 0644);
+        // Some filesystems such as tmpfs do not support O_DIRECT
+        directIOActive = (fd >= 0);
+    }
+#endif
+    if (fd < 0 && (fd = ::open(filename, flags, 0644)) < 0)
     {
         snprintf(errmsg, ERRMSGSIZ, "recorder open error %d, %s\n", errno, strerror(errno));
         return false;
     }
 
+    // Timestamps spill next to the recording, the file is removed as soon as it is created
+    stampsFilename = std::string(filename) + ".stamps";
+    stampsFd = ::open(stampsFilename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (stampsFd < 0)
+    {
+        snprintf(errmsg, ERRMSGSIZ, "recorder timestamps open error %d, %s\n", errno, strerror(errno));
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+    unlink(stampsFilename.c_str());
+    stampBuffer.clear();
+    stampBuffer.reserve(SER_STAMPS_BUFFER);
+    stampsSpilled = 0;
+
+    if (staging == nullptr && posix_memalign(reinterpret_cast<void **>(&staging), SER_DIRECT_ALIGNMENT, SER_STAGING_SIZE) != 0)
+    {
+        staging = nullptr;
+        snprintf(errmsg, ERRMSGSIZ, "recorder cannot allocate write buffer\n");
+        ::close(stampsFd);
+        ::close(fd);
+        stampsFd = fd = -1;
+        return false;
+    }
+    stagingFill   = 0;
+    fileOffset    = 0;
+    fileAllocated = 0;
+
     serh.DateTime     = getLocalTimeStamp();
     serh.DateTime_UTC = getUTCTimeStamp();
-    write_header(&serh);
+    // The header is rewritten on close with the final frame count
+    write_header(&serh, staging);
+    stagingFill = SER_HEADER_SIZE;
     frame_size        = serh.ImageWidth * serh.ImageHeight * (serh.PixelDepth <= 8 ? 1 : 2) * number_of_planes;
-    isRecordingActive = true;
 
-    frameStamps.clear();
+    maxFrames = std::max(2u, std::min(1024u, queueBytes / std::max(frame_size, 1u)));
+    {
+        std::lock_guard<std::mutex> guard(queueLock);
+        statistics = RecorderStatistics();
+        latencySum = 0;
+        framesWritten = 0;
+        stopWriter = writeError = false;
+    }
+    writer = std::thread(&SER_Recorder::writerLoop, this);
+
+    isRecordingActive = true;
 
     return true;
 }
 
 bool SER_Recorder::close()
 {
-    if (f)
+    if (writer.joinable())
     {
-        // Write all timestamps
-        for (auto value : frameStamps)
-            write_long_int_le(&value);
-
-        frameStamps.clear();
+        {
+            std::lock_guard<std::mutex> guard(queueLock);
+            stopWriter = true;
+        }
+        queueCondition.notify_one();
+        writer.join();
+    }
 
-        fseek(f, 0L, SEEK_SET);
-        write_header(&serh);
-        fclose(f);
-        f = nullptr;
+    bool rc = true;
+    if (fd >= 0)
+    {
+        rc = !writeError && writeTrailer();
+        ::close(fd);
+        fd = -1;
     }
+    if (stampsFd >= 0)
+    {
+        ::close(stampsFd);
+        stampsFd = -1;
+    }
+    free(staging);
+    staging = nullptr;
 
     isRecordingActive = false;
+    return rc;
+}
+
+bool SER_Recorder::getStatistics(RecorderStatistics &stats)
+{
+    std::lock_guard<std::mutex> guard(queueLock);
+    stats = statistics;
+    stats.framesQueued = pendingFrames.size();
     return true;
 }
 
@@ -218,6 +287,30 @@ bool SER_Recorder::writeFrame(const uint8_t *frame, uint32_t nbytes)
     if (!isRecordingActive)
         return false;
 
+    uint64_t timestamp = getUTCTimeStamp();
+    QueuedFrame *queued = nullptr;
+    {
+        std::lock_guard<std::mutex> guard(queueLock);
+        if (writeError || stopWriter)
+            return false;
+        if (!freeFrames.empty())
+        {
+            queued = freeFrames.back();
+            freeFrames.pop_back();
+        }
+        else if (allocatedFrames < maxFrames)
+        {
+            queued = new QueuedFrame();
+            allocatedFrames++;
+        }
+        else
+        {
+            // The disk does not keep up, losing a frame is better than stalling the capture
+            statistics.framesDropped++;
+            return true;
+        }
+    }
+
 #if 0
     if (serh.ColorID == SER_MONO)
     {
@@ -254,27 +347,171 @@ bool SER_Recorder::writeFrame(const uint8_t *frame, uint32_t nbytes)
    }
 #endif
 
-    frameStamps.push_back(getUTCTimeStamp());
+    queued->data.assign(frame, frame + nbytes);
+    queued->timestamp = timestamp;
+    queued->queued    = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> guard(queueLock);
+        pendingFrames.push_back(queued);
+    }
+    queueCondition.notify_one();
+    return true;
+}
+
+void SER_Recorder::writerLoop()
+{
+    std::unique_lock<std::mutex> guard(queueLock);
+    while (true)
+    {
+        queueCondition.wait(guard, [this] { return stopWriter || !pendingFrames.empty(); });
+        // Frames queued before close() are all written
+        if (pendingFrames.empty())
+            break;
+        QueuedFrame *frame = pendingFrames.front();
+        pendingFrames.pop_front();
+        bool failed = writeError;
+        guard.unlock();
+
+        if (!failed)
+            failed = !writeQueuedFrame(frame);
+        double latency = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frame->queued).count();
+
+        guard.lock();
+        writeError = failed;
+        freeFrames.push_back(frame);
+        if (!failed)
+        {
+            framesWritten++;
+            latencySum += latency;
+            statistics.writeLatency    = latencySum / framesWritten;
+            statistics.writeLatencyMax = std::max(statistics.writeLatencyMax, latency);
+        }
+    }
+}
+
+bool SER_Recorder::writeQueuedFrame(QueuedFrame *frame)
+{
+    const uint8_t *data = frame->data.data();
+    size_t len = frame->data.size();
 
     // Not technically pixel format, but let's use this for now.
     if (m_PixelFormat == INDI_JPG)
     {
         int w=0,h=0,naxis=1;
         size_t memsize=0;
-        if (decode_jpeg_rgb(const_cast<uint8_t *>(frame), nbytes, &jpegBuffer, &memsize, &naxis, &w, &h) < 0)
+        if (decode_jpeg_rgb(frame->data.data(), len, &jpegBuffer, &memsize, &naxis, &w, &h) < 0)
             return false;
 
         serh.ImageWidth = w;
         serh.ImageHeight = h;
         serh.ColorID = (naxis == 3) ? SER_RGB : SER_MONO;
-        fwrite(jpegBuffer, memsize, 1, f);
+        data = jpegBuffer;
+        len  = memsize;
     }
-    else
-        fwrite(frame, nbytes, 1, f);
+
+    if (!appendBytes(data, len) || !appendTimestamp(frame->timestamp))
+        return false;
     serh.FrameCount += 1;
     return true;
 }
 
+bool SER_Recorder::appendBytes(const uint8_t *data, size_t len)
+{
+    while (len > 0)
+    {
+        size_t n = std::min(len, static_cast<size_t>(SER_STAGING_SIZE) - stagingFill);
+        memcpy(staging + stagingFill, data, n);
+        stagingFill += n;
+        data += n;
+        len -= n;
+        if (stagingFill == SER_STAGING_SIZE && !flushStaging(false))
+            return false;
+    }
+    return true;
+}
+
+bool SER_Recorder::flushStaging(bool final)
+{
+    size_t len = stagingFill;
+    if (directIOActive)
+    {
+        if (final)
+        {
+            // The tail is not a whole block, finish without O_DIRECT
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+            directIOActive = false;
+        }
+        else
+            len -= len % SER_DIRECT_ALIGNMENT;
+    }
+
+#ifdef __linux__
+    if (fileOffset + static_cast<off_t>(len) > fileAllocated)
+    {
+        // Reserving the space ahead keeps the extents contiguous and the writes from waiting on allocation.
+        // Not every filesystem supports it, the writes work regardless.
+        off_t reserve = std::max(static_cast<off_t>(SER_PREALLOCATE_SIZE), static_cast<off_t>(len));
+        if (fallocate(fd, 0, fileAllocated, fileOffset + reserve - fileAllocated) == 0)
+            fileAllocated = fileOffset + reserve;
+        else
+            fileAllocated = fileOffset + len;
+    }
+#endif
+
+    size_t written = 0;
+    while (written < len)
+    {
+        ssize_t rc = pwrite(fd, staging + written, len - written, fileOffset + written);
+        if (rc < 0 && errno == EINTR)
+            continue;
+        if (rc <= 0)
+            return false;
+        written += rc;
+    }
+    fileOffset += len;
+    stagingFill -= len;
+    memmove(staging, staging + len, stagingFill);
+    return true;
+}
+
+bool SER_Recorder::appendTimestamp(uint64_t timestamp)
+{
+    uint8_t le[8];
+    write_long_int_le(le, timestamp);
+    stampBuffer.insert(stampBuffer.end(), le, le + 8);
+    if (stampBuffer.size() < SER_STAMPS_BUFFER)
+        return true;
+
+    if (pwrite(stampsFd, stampBuffer.data(), stampBuffer.size(), stampsSpilled) != static_cast<ssize_t>(stampBuffer.size()))
+        return false;
+    stampsSpilled += stampBuffer.size();
+    stampBuffer.clear();
+    return true;
+}
+
+bool SER_Recorder::writeTrailer()
+{
+    // Timestamps follow the last frame, the spilled ones first
+    std::vector<uint8_t> chunk(SER_STAMPS_BUFFER);
+    for (off_t offset = 0; offset < stampsSpilled; offset += chunk.size())
+    {
+        size_t len = std::min(static_cast<off_t>(chunk.size()), stampsSpilled - offset);
+        if (pread(stampsFd, chunk.data(), len, offset) != static_cast<ssize_t>(len) || !appendBytes(chunk.data(), len))
+            return false;
+    }
+    if (!appendBytes(stampBuffer.data(), stampBuffer.size()) || !flushStaging(true))
+        return false;
+    stampBuffer.clear();
+
+    uint8_t header[SER_HEADER_SIZE];
+    write_header(&serh, header);
+    if (pwrite(fd, header, SER_HEADER_SIZE, 0) != SER_HEADER_SIZE)
+        return false;
+
+    // Release the space preallocated past the last write
+    return ftruncate(fd, fileOffset) == 0;
+}
+
 // Copyright (C) 2015 Chris Garry
 //
 
@@ -23,8 +23,14 @@
 
 #include "recorderinterface.h"
 
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
+#include <deque>
+#include <mutex>
 #include <stdio.h>
+#include <string>
+#include <thread>
 
 typedef struct ser_header
 {
@@ -61,11 +67,18 @@ enum ser_color_id
 #define SER_BIG_ENDIAN    0
 #define SER_LITTLE_ENDIAN 1
 
+#define SER_HEADER_SIZE   178
+
 namespace INDI
 {
 
 /**
  * @brief The SER_Recorder class implements recording of video streams in SER format.
+ *
+ * Frames are copied to a bounded queue and written by a dedicated thread, so a slow disk
+ * never stalls the streaming thread: when the queue is full the frame is dropped and counted.
+ * The writer aggregates frames into large aligned writes, preallocates the file ahead of them
+ * and spills the timestamps to a side file appended as the SER trailer on close().
  */
 class SER_Recorder : public RecorderInterface
 {
@@ -80,6 +93,16 @@ class SER_Recorder : public RecorderInterface
     virtual bool close();
     virtual bool writeFrame(const uint8_t *frame, uint32_t nbytes);
     virtual void setStreamEnabled(bool enable) { isStreamingActive = enable; }
+    virtual bool getStatistics(RecorderStatistics &stats);
+
+    /**
+     * @brief setDirectIO Write the file with O_DIRECT, bypassing the page cache. Effective on the next open().
+     */
+    void setDirectIO(bool enable) { useDirectIO = enable; }
+    /**
+     * @brief setQueueSize Set the memory in bytes allowed for frames waiting to be written. Effective on the next open().
+     */
+    void setQueueSize(uint32_t bytes) { queueBytes = bytes; }
 
     // Public constants
     static const uint64_t C_SEPASECONDS_PER_SECOND = 10000000;
@@ -87,16 +110,17 @@ class SER_Recorder : public RecorderInterface
   protected:
     uint64_t utcTo64BitTS();
     bool is_little_endian();
-    void write_int_le(uint32_t *i);
-    void write_long_int_le(uint64_t *i);
-    void write_header(ser_header *s);
+    // Serialize in little endian order, return the position following the value
+    uint8_t *write_int_le(uint8_t *out, uint32_t i);
+    uint8_t *write_long_int_le(uint8_t *out, uint64_t i);
+    // Serialize the SER_HEADER_SIZE bytes of the header
+    void write_header(ser_header *s, uint8_t *out);
     ser_header serh;
     bool isRecordingActive = false, isStreamingActive = false;
-    FILE *f;
+    int fd = -1;
     uint32_t frame_size;
     uint32_t number_of_planes;
     uint16_t rawWidth = 0, rawHeight = 0;
-    std::vector<uint64_t> frameStamps;
 
   private:
     // From pipp_timestamp.h
@@ -124,5 +148,46 @@ class SER_Recorder : public RecorderInterface
 
     uint8_t *jpegBuffer=nullptr;
     INDI_PIXEL_FORMAT m_PixelFormat;
+
+    struct QueuedFrame
+    {
+        std::vector<uint8_t> data;
+        uint64_t timestamp;
+        std::chrono::steady_clock::time_point queued;
+    };
+
+    void writerLoop();
+    bool writeQueuedFrame(QueuedFrame *frame);
+    // Append to the staging buffer, flushing it to the file when full
+    bool appendBytes(const uint8_t *data, size_t len);
+    // Write the staging buffer, only whole aligned blocks unless final
+    bool flushStaging(bool final);
+    bool appendTimestamp(uint64_t timestamp);
+    bool writeTrailer();
+
+    // Writer thread and frame queue
+    std::thread writer;
+    std::mutex queueLock;
+    std::condition_variable queueCondition;
+    std::deque<QueuedFrame *> pendingFrames;
+    std::vector<QueuedFrame *> freeFrames;
+    uint32_t allocatedFrames = 0, maxFrames = 0;
+    uint32_t queueBytes = 256 * 1024 * 1024;
+    bool stopWriter = false, writeError = false;
+    RecorderStatistics statistics;
+    double latencySum = 0;
+    uint32_t framesWritten = 0;
+
+    // File output, only accessed by the writer thread while recording
+    bool useDirectIO = false, directIOActive = false;
+    uint8_t *staging = nullptr;
+    size_t stagingFill = 0;
+    off_t fileOffset = 0, fileAllocated = 0;
+
+    // Timestamps, spilled to a side file when the buffer is full
+    std::string stampsFilename;
+    int stampsFd = -1;
+    std::vector<uint8_t> stampBuffer;
+    off_t stampsSpilled = 0;
 };
 }
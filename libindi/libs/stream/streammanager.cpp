@@ -23,6 +23,7 @@
 #include <config.h>
 
 #include "streammanager.h"
+#include "encoder/mjpegencoder.h"
 #include "indiccd.h"
 #include "indilogger.h"
 
@@ -67,7 +68,8 @@ StreamManager::StreamManager(CCD * mainCCD)
 
     encoderManager = new EncoderManager();
     encoder = encoderManager->getDefaultEncoder();
-    encoder->init(mainCCD);
+    for (EncoderInterface * oneEncoder : encoderManager->getEncoderList())
+        oneEncoder->init(mainCCD);
 
     LOGF_DEBUG("Using default encoder (%s)", encoder->getName());
 }
@@ -115,6 +117,14 @@ bool StreamManager::initProperties()
     IUFillNumberVector(&RecordOptionsNP, RecordOptionsN, NARRAY(RecordOptionsN), getDeviceName(), "RECORD_OPTIONS",
                        "Record Options", STREAM_TAB, IP_RW, 60, IPS_IDLE);
 
+    /* Record Statistics */
+    IUFillNumber(&RecordStatsN[RECORD_STATS_DROPPED], "RECORD_FRAMES_DROPPED", "Dropped frames", "%9.0f", 0, 999999999.0, 0, 0);
+    IUFillNumber(&RecordStatsN[RECORD_STATS_QUEUED], "RECORD_FRAMES_QUEUED", "Queued frames", "%6.0f", 0, 999999.0, 0, 0);
+    IUFillNumber(&RecordStatsN[RECORD_STATS_LATENCY], "RECORD_WRITE_LATENCY", "Write latency (ms)", "%8.2f", 0, 999999.0, 0, 0);
+    IUFillNumber(&RecordStatsN[RECORD_STATS_LATENCY_MAX], "RECORD_WRITE_LATENCY_MAX", "Max latency (ms)", "%8.2f", 0, 999999.0, 0, 0);
+    IUFillNumberVector(&RecordStatsNP, RecordStatsN, NARRAY(RecordStatsN), getDeviceName(), "RECORD_STATISTICS",
+                       "Record Statistics", STREAM_TAB, IP_RO, 60, IPS_IDLE);
+
     /* Record Switch */
     IUFillSwitch(&RecordStreamS[0], "RECORD_ON", "Record On", ISS_OFF);
     IUFillSwitch(&RecordStreamS[1], "RECORD_DURATION_ON", "Record (Duration)", ISS_OFF);
@@ -136,6 +146,16 @@ bool StreamManager::initProperties()
     IUFillSwitch(&EncoderS[ENCODER_MJPEG], "MJPEG", "MJPEG", ISS_OFF);
     IUFillSwitchVector(&EncoderSP, EncoderS, NARRAY(EncoderS), getDeviceName(), "CCD_STREAM_ENCODER", "Encoder", STREAM_TAB, IP_RW, ISR_1OFMANY, 0, IPS_IDLE);
 
+    // MJPEG Encoder options
+    IUFillNumber(&EncoderQualityN[0], "JPEG_QUALITY", "Quality", "%3.0f", 1, 100, 5, 70);
+    IUFillNumberVector(&EncoderQualityNP, EncoderQualityN, NARRAY(EncoderQualityN), getDeviceName(), "CCD_STREAM_JPEG_QUALITY", "JPEG",
+                       STREAM_TAB, IP_RW, 60, IPS_IDLE);
+    IUFillSwitch(&EncoderSubsamplingS[MJPEGEncoder::SUBSAMPLING_444], "SUBSAMPLING_444", "4:4:4", ISS_OFF);
+    IUFillSwitch(&EncoderSubsamplingS[MJPEGEncoder::SUBSAMPLING_422], "SUBSAMPLING_422", "4:2:2", ISS_OFF);
+    IUFillSwitch(&EncoderSubsamplingS[MJPEGEncoder::SUBSAMPLING_420], "SUBSAMPLING_420", "4:2:0", ISS_ON);
+    IUFillSwitchVector(&EncoderSubsamplingSP, EncoderSubsamplingS, NARRAY(EncoderSubsamplingS), getDeviceName(), "CCD_STREAM_JPEG_SUBSAMPLING",
+                       "Subsampling", STREAM_TAB, IP_RW, ISR_1OFMANY, 0, IPS_IDLE);
+
     // Recorder Selector
     IUFillSwitch(&RecorderS[RECORDER_RAW], "SER", "SER", ISS_ON);
     IUFillSwitch(&RecorderS[RECORDER_OGV], "OGV", "OGV", ISS_OFF);
@@ -163,8 +183,11 @@ void StreamManager::ISGetProperties(const char * dev)
         currentCCD->defineSwitch(&RecordStreamSP);
         currentCCD->defineText(&RecordFileTP);
         currentCCD->defineNumber(&RecordOptionsNP);
+        currentCCD->defineNumber(&RecordStatsNP);
         currentCCD->defineNumber(&StreamFrameNP);
         currentCCD->defineSwitch(&EncoderSP);
+        currentCCD->defineNumber(&EncoderQualityNP);
+        currentCCD->defineSwitch(&EncoderSubsamplingSP);
         currentCCD->defineSwitch(&RecorderSP);
     }
 }
@@ -183,8 +206,11 @@ bool StreamManager::updateProperties()
         currentCCD->defineSwitch(&RecordStreamSP);
         currentCCD->defineText(&RecordFileTP);
         currentCCD->defineNumber(&RecordOptionsNP);
+        currentCCD->defineNumber(&RecordStatsNP);
         currentCCD->defineNumber(&StreamFrameNP);
         currentCCD->defineSwitch(&EncoderSP);
+        currentCCD->defineNumber(&EncoderQualityNP);
+        currentCCD->defineSwitch(&EncoderSubsamplingSP);
         currentCCD->defineSwitch(&RecorderSP);
     }
     else
@@ -196,8 +222,11 @@ bool StreamManager::updateProperties()
         currentCCD->deleteProperty(RecordFileTP.name);
         currentCCD->deleteProperty(RecordStreamSP.name);
         currentCCD->deleteProperty(RecordOptionsNP.name);
+        currentCCD->deleteProperty(RecordStatsNP.name);
         currentCCD->deleteProperty(StreamFrameNP.name);
         currentCCD->deleteProperty(EncoderSP.name);
+        currentCCD->deleteProperty(EncoderQualityNP.name);
+        currentCCD->deleteProperty(EncoderSubsamplingSP.name);
         currentCCD->deleteProperty(RecorderSP.name);
 
         return true;
@@ -441,6 +470,14 @@ bool StreamManager::recordStream(const uint8_t * buffer, uint32_t nbytes, double
     m_RecordingFrameDuration += deltams;
     m_RecordingFrameTotal += 1;
 
+    // Statistics of asynchronous recorders are published once per second
+    m_RecordingStatsDuration += deltams;
+    if (m_RecordingStatsDuration >= 1000.0)
+    {
+        m_RecordingStatsDuration = 0;
+        updateRecordStatistics();
+    }
+
     if ((RecordStreamSP.sp[1].s == ISS_ON) && (m_RecordingFrameDuration >= (RecordOptionsNP.np[0].value * 1000.0)))
     {
         LOGF_INFO("Ending record after %g millisecs", m_RecordingFrameDuration);
@@ -621,6 +658,7 @@ bool StreamManager::startRecording()
 #endif
     m_RecordingFrameDuration   = 0.0;
     m_RecordingFrameTotal = 0;
+    m_RecordingStatsDuration = 0.0;
 
     getitimer(ITIMER_REAL, &tframe1);
     mssum         = 0;
@@ -645,16 +683,36 @@ bool StreamManager::stopRecording(bool force)
         currentCCD->StopStreaming();
 
     m_isRecording = false;
-    recorder->close();
+    if (recorder->close() == false)
+        LOG_ERROR("Failed to write the end of the record file.");
+
+    // Final values, once all queued frames are written
+    updateRecordStatistics();
 
     if (force)
         return false;
 
     LOGF_INFO("Record Duration(millisec): %g -- Frame count: %d", m_RecordingFrameDuration,
               m_RecordingFrameTotal);
+    if (RecordStatsN[RECORD_STATS_DROPPED].value > 0)
+        LOGF_WARN("%g frames were dropped because the disk could not keep up.", RecordStatsN[RECORD_STATS_DROPPED].value);
     return true;
 }
 
+void StreamManager::updateRecordStatistics()
+{
+    RecorderStatistics stats;
+    if (recorder->getStatistics(stats) == false)
+        return;
+
+    RecordStatsN[RECORD_STATS_DROPPED].value     = stats.framesDropped;
+    RecordStatsN[RECORD_STATS_QUEUED].value      = stats.framesQueued;
+    RecordStatsN[RECORD_STATS_LATENCY].value     = stats.writeLatency;
+    RecordStatsN[RECORD_STATS_LATENCY_MAX].value = stats.writeLatencyMax;
+    RecordStatsNP.s = (stats.framesDropped > 0) ? IPS_ALERT : IPS_OK;
+    IDSetNumber(&RecordStatsNP, nullptr);
+}
+
 bool StreamManager::ISNewSwitch(const char * dev, const char * name, ISState * states, char * names[], int n)
 {
     if (dev != nullptr && strcmp(getDeviceName(), dev))
@@ -757,6 +815,22 @@ bool StreamManager::ISNewSwitch(const char * dev, const char * name, ISState * s
         IDSetSwitch(&EncoderSP, nullptr);
     }
 
+    // JPEG Subsampling
+    if (!strcmp(name, EncoderSubsamplingSP.name))
+    {
+        IUUpdateSwitch(&EncoderSubsamplingSP, states, names, n);
+        int subsampling = IUFindOnSwitchIndex(&EncoderSubsamplingSP);
+        for (EncoderInterface * oneEncoder : encoderManager->getEncoderList())
+        {
+            MJPEGEncoder *mjpeg = dynamic_cast<MJPEGEncoder *>(oneEncoder);
+            if (mjpeg)
+                mjpeg->setSubsampling(static_cast<MJPEGEncoder::Subsampling>(subsampling));
+        }
+        EncoderSubsamplingSP.s = IPS_OK;
+        IDSetSwitch(&EncoderSubsamplingSP, nullptr);
+        return true;
+    }
+
     // Recorder Selection
     if (!strcmp(name, RecorderSP.name))
     {
@@ -835,6 +909,21 @@ bool StreamManager::ISNewNumber(const char * dev, const char * name, double valu
         return true;
     }
 
+    /* JPEG Quality */
+    if (!strcmp(EncoderQualityNP.name, name))
+    {
+        IUUpdateNumber(&EncoderQualityNP, values, names, n);
+        for (EncoderInterface * oneEncoder : encoderManager->getEncoderList())
+        {
+            MJPEGEncoder *mjpeg = dynamic_cast<MJPEGEncoder *>(oneEncoder);
+            if (mjpeg)
+                mjpeg->setQuality(static_cast<int>(EncoderQualityN[0].value));
+        }
+        EncoderQualityNP.s = IPS_OK;
+        IDSetNumber(&EncoderQualityNP, nullptr);
+        return true;
+    }
+
     /* Stream Frame */
     if (!strcmp(StreamFrameNP.name, name))
     {
@@ -949,6 +1038,8 @@ bool StreamManager::setStream(bool enable)
 bool StreamManager::saveConfigItems(FILE * fp)
 {
     IUSaveConfigSwitch(fp, &EncoderSP);
+    IUSaveConfigNumber(fp, &EncoderQualityNP);
+    IUSaveConfigSwitch(fp, &EncoderSubsamplingSP);
     IUSaveConfigText(fp, &RecordFileTP);
     IUSaveConfigNumber(fp, &RecordOptionsNP);
     IUSaveConfigSwitch(fp, &RecorderSP);
@@ -61,6 +61,9 @@
    and compressed format is ".stream.z"
    2. MJPEG Encoder: Frame is encoded to a JPEG image before being transmitted. Format is ".stream_jpg"
 
+   The JPEG quality and the chroma subsampling of color frames are set via the CCD_STREAM_JPEG_QUALITY and
+   CCD_STREAM_JPEG_SUBSAMPLING properties. Large frames are encoded in parallel stripes.
+
    \section Recorders
 
    Recorders are responsible for recording the video stream to a file. The recording file directory and name can be set via the RECORD_FILE
@@ -77,6 +80,9 @@
    2. OGV recorder: Saves video streams in libtheora OGV files. INDI must be compiled with the optional OGG Theora support for this functionality to be
    available. Frame rate is estimated from the average FPS.
 
+   The SER recorder queues the frames and writes them from a dedicated thread. If the disk cannot keep up, frames are dropped
+   rather than stalling the stream. The RECORD_STATISTICS property reports the dropped frames, the queue depth and the write latency.
+
    \section Subframing
 
    By default, the full image width and height are used for transmitting the data. Subframing is possible by updating the CCD_STREAM_FRAME
@@ -213,6 +219,11 @@ class StreamManager
              */
         bool recordStream(const uint8_t *buffer, uint32_t nbytes, double deltams);
 
+        /**
+             * @brief updateRecordStatistics Publish the dropped frames and write latency of the recorder.
+             */
+        void updateRecordStatistics();
+
         /* Stream switch */
         ISwitch StreamS[2];
         ISwitchVectorProperty StreamSP;
@@ -242,6 +253,17 @@ class StreamManager
         INumber RecordOptionsN[2];
         INumberVectorProperty RecordOptionsNP;
 
+        /* Record Statistics */
+        INumber RecordStatsN[4];
+        INumberVectorProperty RecordStatsNP;
+        enum
+        {
+            RECORD_STATS_DROPPED,
+            RECORD_STATS_QUEUED,
+            RECORD_STATS_LATENCY,
+            RECORD_STATS_LATENCY_MAX
+        };
+
         // Stream Frame
         INumberVectorProperty StreamFrameNP;
         INumber StreamFrameN[4];
@@ -255,6 +277,12 @@ class StreamManager
         ISwitchVectorProperty EncoderSP;
         enum { ENCODER_RAW, ENCODER_MJPEG };
 
+        // MJPEG Encoder options
+        INumber EncoderQualityN[1];
+        INumberVectorProperty EncoderQualityNP;
+        ISwitch EncoderSubsamplingS[3];
+        ISwitchVectorProperty EncoderSubsamplingSP;
+
         // Recorder Selector. Static but should be implmeneted as a dynamic plugin interface
         ISwitch RecorderS[2];
         ISwitchVectorProperty RecorderSP;
@@ -266,6 +294,7 @@ class StreamManager
 
         uint32_t m_RecordingFrameTotal {0};
         double m_RecordingFrameDuration {0};
+        double m_RecordingStatsDuration {0};
 
         // Recorder
         RecorderManager *recorderManager = nullptr;
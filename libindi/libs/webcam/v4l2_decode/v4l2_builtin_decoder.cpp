@@ -65,6 +65,37 @@
 
 #include <cstring> // memcpy
 
+// Byte order of packed 4:2:2 formats
+static int yuv422Order(unsigned int pixelformat)
+{
+    switch (pixelformat)
+    {
+        case V4L2_PIX_FMT_UYVY:
+            return CCVT_UYVY;
+        case V4L2_PIX_FMT_YVYU:
+            return CCVT_YVYU;
+        case V4L2_PIX_FMT_VYUY:
+            return CCVT_VYUY;
+        default:
+            return CCVT_YUYV;
+    }
+}
+
+static int bayerPattern(unsigned int pixelformat)
+{
+    switch (pixelformat)
+    {
+        case V4L2_PIX_FMT_SGBRG8:
+            return CCVT_BAYER_GBRG;
+        case V4L2_PIX_FMT_SGRBG8:
+            return CCVT_BAYER_GRBG;
+        case V4L2_PIX_FMT_SRGGB8:
+            return CCVT_BAYER_RGGB;
+        default:
+            return CCVT_BAYER_BGGR;
+    }
+}
+
 V4L2_Builtin_Decoder::V4L2_Builtin_Decoder()
 {
     unsigned int i;
@@ -300,6 +331,10 @@ void V4L2_Builtin_Decoder::decode(unsigned char *frame, struct v4l2_buffer *buf)
             break;
 
         case V4L2_PIX_FMT_YUYV:
+        case V4L2_PIX_FMT_UYVY:
+        case V4L2_PIX_FMT_VYUY:
+        case V4L2_PIX_FMT_YVYU:
+            // Packed 4:2:2 frames are kept in their byte order, the conversions handle all of them
             if (useSoftCrop && doCrop)
             {
                 unsigned char *src  = frame + 2 * (crop.c.left) + (crop.c.top * fmt.fmt.pix.bytesperline);
@@ -314,67 +349,17 @@ void V4L2_Builtin_Decoder::decode(unsigned char *frame, struct v4l2_buffer *buf)
             }
             else
             {
-                memcpy(yuyvBuffer, frame, 2 * bufwidth * bufheight);
-            }
-            break;
-
-        case V4L2_PIX_FMT_UYVY:
-        case V4L2_PIX_FMT_VYUY:
-        case V4L2_PIX_FMT_YVYU:
-        {
-            unsigned char *src = nullptr;
-            unsigned char *dest = yuyvBuffer;
-            unsigned char *s = nullptr, *s1 = nullptr, *s2 = nullptr, *s3 = nullptr, *s4 = nullptr;
+                unsigned char *src  = frame;
+                unsigned char *dest = yuyvBuffer;
 
-            if (useSoftCrop && doCrop)
-            {
-                src = frame + 2 * (crop.c.left) + (crop.c.top * fmt.fmt.pix.bytesperline);
-                //IDLog("Decoding UYVY with cropping %dx%d frame at %lx\n", width, height, src);
-            }
-            else
-            {
-                src = frame;
-                //IDLog("Decoding UYVY  %dx%d frame at %lx\n", width, height, src);
-            }
-            for (int i = 0; i < (int)bufheight; i++)
-            {
-                s = src;
-                switch (fmt.fmt.pix.pixelformat)
-                {
-                    case V4L2_PIX_FMT_UYVY:
-                        s1 = (s + 1);
-                        s2 = (s);
-                        s3 = (s + 3);
-                        s4 = (s + 2);
-                        break;
-                    case V4L2_PIX_FMT_VYUY:
-                        s1 = (s + 1);
-                        s2 = (s + 2);
-                        s3 = (s + 3);
-                        s4 = (s);
-                        break;
-                    case V4L2_PIX_FMT_YVYU:
-                        s1 = (s);
-                        s2 = (s + 3);
-                        s3 = (s + 2);
-                        s4 = (s + 1);
-                        break;
-                }
-                for (int j = 0; j < (int)(bufwidth / 2); j++)
+                for (unsigned int i = 0; i < bufheight; i++)
                 {
-                    *(dest++) = *(s1);
-                    *(dest++) = *(s2);
-                    *(dest++) = *(s3);
-                    *(dest++) = *(s4);
-                    s1 += 4;
-                    s2 += 4;
-                    s3 += 4;
-                    s4 += 4;
+                    memcpy(dest, src, 2 * bufwidth);
+                    src += fmt.fmt.pix.bytesperline;
+                    dest += 2 * bufwidth;
                 }
-                src += fmt.fmt.pix.bytesperline;
             }
-        }
-        break;
+            break;
 
         case V4L2_PIX_FMT_RGB24:
         {
@@ -453,18 +438,18 @@ void V4L2_Builtin_Decoder::decode(unsigned char *frame, struct v4l2_buffer *buf)
         break;
 
         case V4L2_PIX_FMT_SBGGR8:
-            bayer2rgb24(rgb24_buffer, frame, fmt.fmt.pix.width, fmt.fmt.pix.height);
-            break;
-
+        case V4L2_PIX_FMT_SGBRG8:
+        case V4L2_PIX_FMT_SGRBG8:
         case V4L2_PIX_FMT_SRGGB8:
-            bayer_rggb_2rgb24(rgb24_buffer, frame, fmt.fmt.pix.width, fmt.fmt.pix.height);
+            ccvt_bayer8_rgb24(fmt.fmt.pix.width, fmt.fmt.pix.height,
+                              fmt.fmt.pix.bytesperline ? fmt.fmt.pix.bytesperline : fmt.fmt.pix.width,
+                              bayerPattern(fmt.fmt.pix.pixelformat), frame, rgb24_buffer);
             break;
-	case V4L2_PIX_FMT_SGRBG8:
-		bayer_grbg_to_rgb24(rgb24_buffer, frame, fmt.fmt.pix.width, fmt.fmt.pix.height);
-		break;
+
         case V4L2_PIX_FMT_SBGGR16:
-            bayer16_2_rgb24((unsigned short *)rgb24_buffer, (unsigned short *)frame, fmt.fmt.pix.width,
-                            fmt.fmt.pix.height);
+            ccvt_bayer16_rgb48(fmt.fmt.pix.width, fmt.fmt.pix.height,
+                               fmt.fmt.pix.bytesperline ? fmt.fmt.pix.bytesperline : 2 * fmt.fmt.pix.width,
+                               CCVT_BAYER_BGGR, frame, rgb24_buffer);
             break;
 
         case V4L2_PIX_FMT_JPEG:
@@ -608,8 +593,9 @@ void V4L2_Builtin_Decoder::allocBuffers()
         case V4L2_PIX_FMT_RGB555:
         case V4L2_PIX_FMT_RGB565:
         case V4L2_PIX_FMT_SBGGR8:
+        case V4L2_PIX_FMT_SGBRG8:
         case V4L2_PIX_FMT_SRGGB8:
-	case V4L2_PIX_FMT_SGRBG8:
+        case V4L2_PIX_FMT_SGRBG8:
         case V4L2_PIX_FMT_SBGGR16:
             rgb24_buffer = new unsigned char[(bufwidth * bufheight) * (bpp / 8) * 3];
             break;
@@ -652,16 +638,35 @@ void V4L2_Builtin_Decoder::makeY()
         case V4L2_PIX_FMT_RGB555:
         case V4L2_PIX_FMT_RGB565:
         case V4L2_PIX_FMT_SBGGR8:
+        case V4L2_PIX_FMT_SGBRG8:
         case V4L2_PIX_FMT_SRGGB8:
-	case V4L2_PIX_FMT_SGRBG8:
+        case V4L2_PIX_FMT_SGRBG8:
             RGB2YUV(bufwidth, bufheight, rgb24_buffer, YBuf, UBuf, VBuf, 0);
             break;
         case V4L2_PIX_FMT_YUYV:
         case V4L2_PIX_FMT_UYVY:
         case V4L2_PIX_FMT_VYUY:
         case V4L2_PIX_FMT_YVYU:
-            // todo handcopy only Ybuf using an int, byfwidth should be even
-            ccvt_yuyv_420p(bufwidth, bufheight, yuyvBuffer, YBuf, UBuf, VBuf);
+            // Chroma is only computed when requested, see makeUV()
+            ccvt_yuv422_y8(bufwidth, bufheight, 2 * bufwidth, yuv422Order(fmt.fmt.pix.pixelformat), yuyvBuffer, YBuf);
+            break;
+        case V4L2_PIX_FMT_Y16:
+            ccvt_y16_y8(bufwidth, bufheight, 2 * bufwidth, yuyvBuffer, YBuf);
+            break;
+    }
+}
+
+void V4L2_Builtin_Decoder::makeUV()
+{
+    switch (fmt.fmt.pix.pixelformat)
+    {
+        case V4L2_PIX_FMT_YUYV:
+        case V4L2_PIX_FMT_UYVY:
+        case V4L2_PIX_FMT_VYUY:
+        case V4L2_PIX_FMT_YVYU:
+            makeY();
+            ccvt_yuv422_420p(bufwidth, bufheight, 2 * bufwidth, yuv422Order(fmt.fmt.pix.pixelformat), yuyvBuffer, YBuf,
+                             UBuf, VBuf);
             break;
     }
 }
@@ -701,11 +706,13 @@ float *V4L2_Builtin_Decoder::getLinearY()
 
 unsigned char *V4L2_Builtin_Decoder::getU()
 {
+    makeUV();
     return UBuf;
 }
 
 unsigned char *V4L2_Builtin_Decoder::getV()
 {
+    makeUV();
     return VBuf;
 }
 
@@ -800,34 +807,37 @@ unsigned char *V4L2_Builtin_Decoder::getRGBBuffer()
         rgb24_buffer = new unsigned char[(bufwidth * bufheight) * 3];
     switch (fmt.fmt.pix.pixelformat)
     {
-        case V4L2_PIX_FMT_GREY:
-        case V4L2_PIX_FMT_JPEG:
-        case V4L2_PIX_FMT_MJPEG:
-        case V4L2_PIX_FMT_YUV420:
-        case V4L2_PIX_FMT_YVU420:
-        case V4L2_PIX_FMT_NV12:
-        case V4L2_PIX_FMT_NV21:
-            ccvt_420p_rgb24(bufwidth, bufheight, (void *)yuvBuffer, (void *)rgb24_buffer);
-            break;
         case V4L2_PIX_FMT_YUYV:
         case V4L2_PIX_FMT_UYVY:
         case V4L2_PIX_FMT_VYUY:
         case V4L2_PIX_FMT_YVYU:
-            //if (!colorBuffer) colorBuffer = new unsigned char[(bufwidth * bufheight) * 4];
-            //ccvt_yuyv_bgr32(bufwidth, bufheight, yuyvBuffer, rgb24_buffer);
-            //ccvt_bgr32_rgb24(bufwidth, bufheight, colorBuffer, (void*)rgb24_buffer);
-            ccvt_yuyv_rgb24(bufwidth, bufheight, yuyvBuffer, (void *)rgb24_buffer);
+            ccvt_yuv422_rgb24(bufwidth, bufheight, 2 * bufwidth, yuv422Order(fmt.fmt.pix.pixelformat), yuyvBuffer,
+                              rgb24_buffer);
+            break;
+        case V4L2_PIX_FMT_Y16:
+            // Neutral chroma, the RGB frame is gray
+            makeY();
+            memset(UBuf, 128, (bufwidth * bufheight) / 2);
+            ccvt_yuv420p_rgb24(bufwidth, bufheight, YBuf, UBuf, VBuf, rgb24_buffer);
             break;
         case V4L2_PIX_FMT_RGB24:
         case V4L2_PIX_FMT_RGB555:
         case V4L2_PIX_FMT_RGB565:
         case V4L2_PIX_FMT_SBGGR8:
+        case V4L2_PIX_FMT_SGBRG8:
         case V4L2_PIX_FMT_SRGGB8:
-	case V4L2_PIX_FMT_SGRBG8:
+        case V4L2_PIX_FMT_SGRBG8:
         case V4L2_PIX_FMT_SBGGR16:
             break;
+        case V4L2_PIX_FMT_GREY:
+        case V4L2_PIX_FMT_JPEG:
+        case V4L2_PIX_FMT_MJPEG:
+        case V4L2_PIX_FMT_YUV420:
+        case V4L2_PIX_FMT_YVU420:
+        case V4L2_PIX_FMT_NV12:
+        case V4L2_PIX_FMT_NV21:
         default:
-            ccvt_420p_rgb24(bufwidth, bufheight, (void *)yuvBuffer, (void *)rgb24_buffer);
+            ccvt_yuv420p_rgb24(bufwidth, bufheight, YBuf, UBuf, VBuf, rgb24_buffer);
             break;
     }
     return rgb24_buffer;
@@ -953,6 +963,8 @@ void V4L2_Builtin_Decoder::init_supported_formats()
     supported_formats.insert(
         std::make_pair(V4L2_PIX_FMT_SBGGR8, new V4L2_Builtin_Decoder::format(V4L2_PIX_FMT_SBGGR8, 8, false)));
     // V4L2_PIX_FMT_SGBRG8  , // v4l2_fourcc('G', 'B', 'R', 'G') /*  8  GBGB.. RGRG.. */
+    supported_formats.insert(
+        std::make_pair(V4L2_PIX_FMT_SGBRG8, new V4L2_Builtin_Decoder::format(V4L2_PIX_FMT_SGBRG8, 8, false)));
     // V4L2_PIX_FMT_SGRBG8  , // v4l2_fourcc('G', 'R', 'B', 'G') /*  8  GRGR.. BGBG.. */
     supported_formats.insert(
 	    std::make_pair(V4L2_PIX_FMT_SGRBG8, new V4L2_Builtin_Decoder::format(V4L2_PIX_FMT_SGRBG8, 8, false)));
@@ -63,6 +63,7 @@ class V4L2_Builtin_Decoder : public V4L2_Decoder
     std::vector<unsigned int> vsuppformats;
     void allocBuffers();
     void makeY();
+    void makeUV();
     void makeLinearY();
 
     struct v4l2_crop crop;
@@ -0,0 +1,616 @@
+/*******************************************************************************
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "base64.h"
+#include "baseclient.h"
+#include "basedevice.h"
+
+// Server end of a unix socket the client connects to
+class FakeServer
+{
+    public:
+        FakeServer()
+        {
+            snprintf(path, sizeof(path), "/tmp/indi_test_baseclient_%d", getpid());
+            unlink(path);
+
+            struct sockaddr_un addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sun_family = AF_UNIX;
+            strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+            lsocket = socket(AF_UNIX, SOCK_STREAM, 0);
+            bind(lsocket, (struct sockaddr *)&addr, sizeof(addr));
+            listen(lsocket, 1);
+        }
+        ~FakeServer()
+        {
+            if (fd >= 0)
+                close(fd);
+            close(lsocket);
+            unlink(path);
+        }
+
+        std::string address() const
+        {
+            return std::string("unix:") + path;
+        }
+
+        void accept()
+        {
+            fd = ::accept(lsocket, nullptr, nullptr);
+        }
+
+        void send(const std::string &text)
+        {
+            for (size_t sent = 0; sent < text.size();)
+            {
+                ssize_t n = write(fd, text.data() + sent, text.size() - sent);
+                if (n <= 0)
+                    return;
+                sent += n;
+            }
+        }
+
+        // Read until text ends with what, or nothing comes for a second
+        std::string receive(const std::string &what)
+        {
+            std::string text;
+            char buffer[65536];
+            struct timeval tv = { 1, 0 };
+            setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+            while (text.size() < what.size() || text.compare(text.size() - what.size(), what.size(), what))
+            {
+                ssize_t n = read(fd, buffer, sizeof(buffer));
+                if (n <= 0)
+                    break;
+                text.append(buffer, n);
+            }
+            return text;
+        }
+
+        void disconnect()
+        {
+            close(fd);
+            fd = -1;
+        }
+
+    private:
+        char path[64];
+        int lsocket { -1 };
+        int fd { -1 };
+};
+
+static std::string defNumber()
+{
+    return "<defNumberVector device='Mount' name='COORD' state='Ok' perm='ro'>\n"
+           "  <defNumber name='RA' format='%g' min='0' max='24' step='0'>\n0\n</defNumber>\n"
+           "</defNumberVector>\n";
+}
+
+static std::string defBLOB()
+{
+    return "<defBLOBVector device='Camera' name='CCD1' state='Idle' perm='ro'>\n"
+           "  <defBLOB name='ENCODED'/>\n  <defBLOB name='RAW'/>\n  <defBLOB name='PACKED'/>\n  <defBLOB name='SKIP'/>\n"
+           "</defBLOBVector>\n";
+}
+
+// base64 in lines of 72 characters as drivers send it
+static std::string oneBLOB(const char *name, const std::string &data, const char *format, size_t size)
+{
+    std::vector<unsigned char> encoded(4 * data.size() / 3 + 4);
+    int len = to64frombits(encoded.data(), reinterpret_cast<const unsigned char *>(data.data()), data.size());
+
+    std::string text = std::string("  <oneBLOB name='") + name + "' size='" + std::to_string(size) + "' format='" +
+                       format + "' enclen='" + std::to_string(len) + "'>\n";
+    for (int i = 0; i < len; i += 72)
+        text += std::string(reinterpret_cast<char *>(encoded.data()) + i, std::min(72, len - i)) + "\n";
+    return text + "  </oneBLOB>\n";
+}
+
+static std::string randomData(size_t size)
+{
+    std::string data(size, 0);
+    for (auto &c : data)
+        c = rand();
+    return data;
+}
+
+static std::string setNumber(int value)
+{
+    return "<setNumberVector device='Mount' name='COORD' state='Ok'>\n"
+           "  <oneNumber name='RA'>\n" + std::to_string(value) + "\n</oneNumber>\n"
+           "</setNumberVector>\n";
+}
+
+class TestClient : public INDI::BaseClient
+{
+    public:
+        void newDevice(INDI::BaseDevice *) override {}
+        void removeDevice(INDI::BaseDevice *) override {}
+        void newProperty(INDI::Property *) override
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            properties++;
+        }
+        void removeProperty(INDI::Property *) override {}
+        void newBLOB(IBLOB *bp) override
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            blobs.push_back({ bp->name, bp->blob, std::string(static_cast<char *>(bp->blob), bp->bloblen) });
+            ASSERT_EQ(bp->size, bp->bloblen);
+        }
+        void newSwitch(ISwitchVectorProperty *) override {}
+        void newText(ITextVectorProperty *) override {}
+        void newLight(ILightVectorProperty *) override {}
+        void newMessage(INDI::BaseDevice *, int) override {}
+        void serverConnected() override {}
+
+        void newNumber(INumberVectorProperty *nvp) override
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            values.push_back(nvp->np[0].value);
+            threads.push_back(std::this_thread::get_id());
+            condition.wait(lock, [this]() { return !blocked; });
+            lock.unlock();
+
+            if (onNumber)
+                onNumber(nvp->np[0].value);
+        }
+
+        void serverDisconnected(int exit_code) override
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            exitCodes.push_back(exit_code);
+        }
+
+        // Hold newNumber() until release()
+        void block()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            blocked = true;
+        }
+        void release()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            blocked = false;
+            condition.notify_all();
+        }
+
+        // Wait until n events were dispatched
+        bool waitDispatched(uint64_t n)
+        {
+            auto start = std::chrono::steady_clock::now();
+            while (getStatistics().eventsDispatched < n)
+            {
+                if (std::chrono::steady_clock::now() - start > std::chrono::seconds(5))
+                    return false;
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            }
+            return true;
+        }
+
+        // Wait until done() is true, checked with the handlers held
+        bool waitFor(std::function<bool()> done)
+        {
+            auto start = std::chrono::steady_clock::now();
+            while (std::chrono::steady_clock::now() - start < std::chrono::seconds(5))
+            {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (done())
+                        return true;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            }
+            return false;
+        }
+
+        // Called from newNumber() without the handlers held
+        std::function<void(double)> onNumber;
+
+        std::mutex mutex;
+        std::condition_variable condition;
+        bool blocked { false };
+        std::vector<double> values;
+        std::vector<std::thread::id> threads;
+        std::vector<int> exitCodes;
+        int properties { 0 };
+
+        struct Received
+        {
+            std::string name;
+            void *buffer;
+            std::string data;
+        };
+        std::vector<Received> blobs;
+};
+
+static void connect(TestClient &client, FakeServer &server)
+{
+    client.setServer(server.address().c_str());
+    std::thread accepting([&]() { server.accept(); });
+    ASSERT_TRUE(client.connectServer());
+    accepting.join();
+    ASSERT_NE(std::string::npos, server.receive("/>\n").find("<getProperties"));
+}
+
+TEST(BASECLIENT, Test_slow_handler_does_not_stop_reads)
+{
+    const int n = 5000;
+    FakeServer server;
+    TestClient client;
+    client.setEventQueue(n + 1, INDI::BaseClient::EVENTS_BLOCK);
+    connect(client, server);
+
+    // More than the socket buffers hold, sent while the first update is being handled
+    client.block();
+    std::string updates = defNumber();
+    for (int i = 1; i <= n; i++)
+        updates += setNumber(i);
+
+    auto start = std::chrono::steady_clock::now();
+    server.send(updates);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    ASSERT_LT(elapsed, std::chrono::seconds(2));
+
+    // All of them parsed while the handler is still busy
+    start = std::chrono::steady_clock::now();
+    while (client.getStatistics().eventsQueued < size_t(n - 1) &&
+            std::chrono::steady_clock::now() - start < std::chrono::seconds(2))
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    ASSERT_EQ(size_t(n - 1), client.getStatistics().eventsQueued);
+
+    client.release();
+    ASSERT_TRUE(client.waitFor([&]() { return client.values.size() == size_t(n); }));
+    ASSERT_EQ(n, client.values.back());
+    ASSERT_NE(std::this_thread::get_id(), client.threads.back());
+    ASSERT_EQ(0u, client.getStatistics().eventsDropped);
+
+    client.disconnectServer();
+    ASSERT_EQ(std::vector<int>({ 0 }), client.exitCodes);
+}
+
+TEST(BASECLIENT, Test_coalesce_when_full)
+{
+    FakeServer server;
+    TestClient client;
+    client.setEventQueue(4, INDI::BaseClient::EVENTS_COALESCE);
+    connect(client, server);
+
+    client.block();
+    server.send(defNumber() + setNumber(1));
+    ASSERT_TRUE(client.waitDispatched(2));
+
+    std::string updates;
+    for (int i = 2; i <= 100; i++)
+        updates += setNumber(i);
+    server.send(updates);
+
+    // Only the latest updates are left once the handler is done
+    auto start = std::chrono::steady_clock::now();
+    while (client.getStatistics().eventsDropped < 95 && std::chrono::steady_clock::now() - start < std::chrono::seconds(5))
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    client.release();
+
+    auto stats = client.getStatistics();
+    ASSERT_EQ(95u, stats.eventsDropped);
+    ASSERT_EQ(4u, stats.eventsQueuedMax);
+    ASSERT_TRUE(client.waitFor([&]() { return client.values.size() == 5; }));
+    ASSERT_EQ(100, client.values.back());
+    ASSERT_EQ(100, client.getDevice("Mount")->getNumber("COORD")->np[0].value);
+
+    client.disconnectServer();
+}
+
+TEST(BASECLIENT, Test_process_events)
+{
+    FakeServer server;
+    TestClient client;
+    client.setDispatchThread(false);
+    connect(client, server);
+
+    server.send(defNumber() + setNumber(1) + setNumber(2) + setNumber(3));
+
+    int dispatched = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (dispatched < 4 && std::chrono::steady_clock::now() - start < std::chrono::seconds(5))
+        dispatched += client.processEvents(100);
+
+    ASSERT_EQ(4, dispatched);
+    ASSERT_EQ(std::vector<double>({ 1, 2, 3 }), client.values);
+    ASSERT_EQ(std::this_thread::get_id(), client.threads.back());
+
+    // The disconnection is reported by processEvents() too
+    server.disconnect();
+    start = std::chrono::steady_clock::now();
+    while (client.isServerConnected() && std::chrono::steady_clock::now() - start < std::chrono::seconds(5))
+        client.processEvents(100);
+    ASSERT_EQ(std::vector<int>({ -1 }), client.exitCodes);
+}
+
+TEST(BASECLIENT, Test_send_does_not_block)
+{
+    FakeServer server;
+    TestClient client;
+    connect(client, server);
+
+    server.send(defNumber());
+    ASSERT_TRUE(client.waitFor([&]() { return client.properties == 1; }));
+
+    // Several megabytes the server does not read yet
+    std::vector<char> blob(4 * 1024 * 1024, 'x');
+    auto start = std::chrono::steady_clock::now();
+    client.startBlob("Mount", "UPLOAD", "2018-01-01T00:00:00");
+    client.sendOneBlob("DATA", blob.size(), ".bin", blob.data());
+    client.finishBlob();
+    client.sendNewNumber("Mount", "COORD", "RA", 12);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    ASSERT_LT(elapsed, std::chrono::seconds(1));
+
+    auto stats = client.getStatistics();
+    ASSERT_GT(stats.sendQueued, 0u);
+
+    std::string text = server.receive("</newNumberVector>\n");
+    ASSERT_GT(text.size(), blob.size() * 4 / 3);
+    ASSERT_NE(std::string::npos, text.find("</newBLOBVector>\n<newNumberVector"));
+
+    stats = client.getStatistics();
+    ASSERT_EQ(0u, stats.sendQueued);
+    ASSERT_GE(stats.messagesSent, 5u);
+    ASSERT_GE(stats.sendQueuedMax, blob.size() * 4 / 3);
+
+    client.disconnectServer();
+}
+
+TEST(BASECLIENT, Test_server_disconnect)
+{
+    FakeServer server;
+    TestClient client;
+    connect(client, server);
+
+    server.send(defNumber() + setNumber(1));
+    ASSERT_TRUE(client.waitDispatched(2));
+    server.disconnect();
+
+    auto start = std::chrono::steady_clock::now();
+    while (client.isServerConnected() && std::chrono::steady_clock::now() - start < std::chrono::seconds(5))
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    ASSERT_FALSE(client.isServerConnected());
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    client.disconnectServer();
+    ASSERT_EQ(std::vector<int>({ -1 }), client.exitCodes);
+}
+
+TEST(BASECLIENT, Test_disconnect_from_callback)
+{
+    FakeServer server;
+    TestClient client;
+    connect(client, server);
+
+    client.onNumber = [&](double value)
+    {
+        if (value == 1)
+            client.disconnectServer();
+    };
+    server.send(defNumber() + setNumber(1) + setNumber(2));
+    ASSERT_TRUE(client.waitFor([&]() { return client.exitCodes.size() == 1; }));
+    ASSERT_FALSE(client.isServerConnected());
+    server.disconnect();
+
+    // A single dispatcher serves the new connection, in order
+    client.onNumber = nullptr;
+    connect(client, server);
+    std::string updates = defNumber();
+    for (int i = 3; i <= 200; i++)
+        updates += setNumber(i);
+    server.send(updates);
+    ASSERT_TRUE(client.waitFor([&]() { return client.values.size() == 199; }));
+
+    std::vector<double> expected({ 1 });
+    for (int i = 3; i <= 200; i++)
+        expected.push_back(i);
+    ASSERT_EQ(expected, client.values);
+    for (size_t i = 2; i < client.threads.size(); i++)
+        ASSERT_EQ(client.threads[1], client.threads[i]);
+
+    client.disconnectServer();
+    ASSERT_EQ(std::vector<int>({ 0, 0 }), client.exitCodes);
+}
+
+TEST(BASECLIENT, Test_blob_allocator)
+{
+    FakeServer server;
+    TestClient client;
+
+    std::mutex mutex;
+    std::vector<std::pair<std::string, void *>> allocated;
+    std::vector<void *> released;
+    client.setBLOBAllocator([&](const char *device, const char *property, const char *name, size_t size) -> void *
+    {
+        EXPECT_STREQ("Camera", device);
+        EXPECT_STREQ("CCD1", property);
+        if (!strcmp(name, "SKIP"))
+            return nullptr;
+        std::lock_guard<std::mutex> lock(mutex);
+        allocated.push_back({ name, malloc(size) });
+        return allocated.back().second;
+    },
+    [&](void *buffer)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        released.push_back(buffer);
+        free(buffer);
+    });
+    connect(client, server);
+
+    std::string encoded = randomData(1000000);
+    std::string raw     = randomData(300000);
+    std::string image(1000000, 0);
+    for (size_t i = 0; i < image.size(); i++)
+        image[i] = (i / 1000) & 0xff;
+    std::vector<unsigned char> packed(compressBound(image.size()));
+    uLongf packedSize = packed.size();
+    compress(packed.data(), &packedSize, reinterpret_cast<const unsigned char *>(image.data()), image.size());
+
+    std::string text = defBLOB() + "<setBLOBVector device='Camera' name='CCD1' state='Ok'>\n" +
+                       oneBLOB("ENCODED", encoded, ".bin", encoded.size()) +
+                       "  <oneBLOB name='RAW' size='" + std::to_string(raw.size()) + "' format='.bin' binlen='" +
+                       std::to_string(raw.size()) + "'>" + raw + "</oneBLOB>\n" +
+                       oneBLOB("PACKED", std::string(reinterpret_cast<char *>(packed.data()), packedSize), ".bin.z",
+                               image.size()) +
+                       oneBLOB("SKIP", "legacy", ".txt", 6) +
+                       "</setBLOBVector>\n";
+
+    // Pieces of odd sizes, so quads and lines are split between reads
+    for (size_t i = 0; i < text.size(); i += 4093)
+    {
+        server.send(text.substr(i, 4093));
+        if (i % 40930 == 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    // Given back once dispatched
+    auto waitReleased = [&](size_t n)
+    {
+        auto start = std::chrono::steady_clock::now();
+        while (std::chrono::steady_clock::now() - start < std::chrono::seconds(5))
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (released.size() == n)
+                    return true;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        return false;
+    };
+    ASSERT_TRUE(waitReleased(3));
+
+    ASSERT_EQ(4u, client.blobs.size());
+    ASSERT_EQ(3u, allocated.size());
+    for (int i = 0; i < 3; i++)
+    {
+        ASSERT_EQ(allocated[i].first, client.blobs[i].name);
+        ASSERT_EQ(allocated[i].second, client.blobs[i].buffer);
+    }
+    ASSERT_TRUE(client.blobs[0].data == encoded);
+    ASSERT_TRUE(client.blobs[1].data == raw);
+    ASSERT_TRUE(client.blobs[2].data == image);
+    ASSERT_EQ("legacy", client.blobs[3].data);
+
+    // Not referenced any more
+    ASSERT_EQ(nullptr, client.getDevice("Camera")->getBLOB("CCD1")->bp[0].blob);
+
+    // Content larger than announced is not delivered
+    allocated.clear();
+    server.send("<setBLOBVector device='Camera' name='CCD1' state='Ok'>\n" +
+                oneBLOB("ENCODED", encoded, ".bin", 1000) + "</setBLOBVector>\n");
+    ASSERT_TRUE(waitReleased(4));
+    ASSERT_EQ(4u, client.blobs.size());
+    ASSERT_EQ(1u, allocated.size());
+
+    client.disconnectServer();
+}
+
+TEST(BASECLIENT, Test_snapshots)
+{
+    FakeServer server;
+    TestClient client;
+    client.setDispatchThread(false);
+    client.setSnapshots(true);
+    connect(client, server);
+
+    auto process = [&](int n)
+    {
+        auto start = std::chrono::steady_clock::now();
+        while (n > 0 && std::chrono::steady_clock::now() - start < std::chrono::seconds(5))
+            n -= client.processEvents(100);
+        ASSERT_EQ(0, n);
+    };
+
+    server.send(defNumber() + setNumber(1) +
+                "<defSwitchVector device='Mount' name='TRACK' state='Ok' perm='rw' rule='OneOfMany'>\n"
+                "  <defSwitch name='ON'>On</defSwitch>\n  <defSwitch name='OFF'>Off</defSwitch>\n"
+                "</defSwitchVector>\n");
+    process(3);
+
+    auto first = client.getSnapshot();
+    ASSERT_EQ(3u, first->version);
+    ASSERT_EQ(1u, first->devices.size());
+    auto coord = first->devices.at("Mount")->at("COORD");
+    ASSERT_EQ(INDI_NUMBER, coord->type);
+    ASSERT_EQ(2u, coord->version);
+    ASSERT_EQ("RA", coord->elements[0].name);
+    ASSERT_EQ(1, coord->elements[0].value);
+    ASSERT_EQ(24, coord->elements[0].max);
+    auto track = first->devices.at("Mount")->at("TRACK");
+    ASSERT_EQ(ISS_ON, track->elements[0].s);
+    ASSERT_EQ(ISS_OFF, track->elements[1].s);
+    ASSERT_EQ(2u, INDI::BaseClient::getChanges(nullptr, *first).size());
+
+    // Two updates of the same property are one change
+    server.send(setNumber(2) + setNumber(3) + defBLOB());
+    process(3);
+
+    auto second = client.getSnapshot();
+    ASSERT_EQ(6u, second->version);
+    ASSERT_EQ(track, second->devices.at("Mount")->at("TRACK"));
+    auto changes = INDI::BaseClient::getChanges(first.get(), *second);
+    ASSERT_EQ(2u, changes.size());
+    ASSERT_EQ("Camera", changes[0].device);
+    ASSERT_EQ("CCD1", changes[0].property);
+    ASSERT_EQ(nullptr, changes[0].before);
+    ASSERT_EQ(4u, changes[0].after->elements.size());
+    ASSERT_EQ("COORD", changes[1].property);
+    ASSERT_EQ(coord, changes[1].before);
+    ASSERT_EQ(3, changes[1].after->elements[0].value);
+
+    server.send("<delProperty device='Mount' name='COORD'/>\n");
+    process(1);
+
+    auto third = client.getSnapshot();
+    changes = INDI::BaseClient::getChanges(second.get(), *third);
+    ASSERT_EQ(1u, changes.size());
+    ASSERT_EQ("COORD", changes[0].property);
+    ASSERT_EQ(nullptr, changes[0].after);
+    ASSERT_EQ(0u, third->devices.at("Mount")->count("COORD"));
+
+    // Earlier snapshots are left as they were
+    ASSERT_EQ(1, first->devices.at("Mount")->at("COORD")->elements[0].value);
+
+    client.disconnectServer();
+    ASSERT_TRUE(client.getSnapshot()->devices.empty());
+    ASSERT_GT(client.getSnapshot()->version, third->version);
+}
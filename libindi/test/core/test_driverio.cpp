@@ -0,0 +1,364 @@
+/*******************************************************************************
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <clocale>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "base64.h"
+#include "indidevapi.h"
+#include "indicom.h"
+#include "locale_compat.h"
+
+// Run f with stdout going to a temporary file, return what it wrote
+template <typename F> static std::string capture_stdout(F f)
+{
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    FILE *tmp = tmpfile();
+    dup2(fileno(tmp), STDOUT_FILENO);
+
+    f();
+
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+
+    std::string out;
+    char buf[4096];
+    size_t nr;
+    rewind(tmp);
+    while ((nr = fread(buf, 1, sizeof(buf), tmp)) > 0)
+        out.append(buf, nr);
+    fclose(tmp);
+    return out;
+}
+
+// Numbers in order of appearance between the oneNumber tags
+static std::vector<std::string> one_numbers(const std::string &xml)
+{
+    std::vector<std::string> values;
+    for (size_t p = 0; (p = xml.find("<oneNumber name=", p)) != std::string::npos;)
+    {
+        size_t start = xml.find(">\n      ", p) + 8;
+        size_t end   = xml.find('\n', start);
+        values.push_back(xml.substr(start, end - start));
+        p = end;
+    }
+    return values;
+}
+
+// Per-line stdio IDSetNumber the buffered serializer replaced, kept as reference
+static void reference_IDSetNumber(const INumberVectorProperty *nvp)
+{
+    xmlv1();
+    locale_char_t *orig = indi_locale_C_numeric_push();
+    printf("<setNumberVector\n");
+    printf("  device='%s'\n", nvp->device);
+    printf("  name='%s'\n", nvp->name);
+    printf("  state='%s'\n", pstateStr(nvp->s));
+    printf("  timeout='%g'\n", nvp->timeout);
+    printf("  timestamp='%s'\n", timestamp());
+    printf(">\n");
+    for (int i = 0; i < nvp->nnp; i++)
+    {
+        printf("  <oneNumber name='%s'>\n", nvp->np[i].name);
+        printf("      %.20g\n", nvp->np[i].value);
+        printf("  </oneNumber>\n");
+    }
+    printf("</setNumberVector>\n");
+    indi_locale_C_numeric_pop(orig);
+    fflush(stdout);
+}
+
+TEST(DRIVER_IO, Test_fs_double_round_trip)
+{
+    char buf[32];
+
+    ASSERT_EQ(3, fs_double(buf, 0.1));
+    ASSERT_STREQ("0.1", buf);
+    fs_double(buf, -2.5e-7);
+    ASSERT_STREQ("-2.5e-07", buf);
+    fs_double(buf, 1e17);
+    ASSERT_STREQ("100000000000000000", buf);
+    fs_double(buf, -1.5e19);
+    ASSERT_STREQ("-15000000000000000000", buf);
+    fs_double(buf, 1e20);
+    ASSERT_STREQ("1e+20", buf);
+    fs_double(buf, 5e-324);
+    ASSERT_STREQ("5e-324", buf);
+
+    srand(7);
+    for (int i = 0; i < 200000; i++)
+    {
+        uint64_t bits = (uint64_t(rand()) << 42) ^ (uint64_t(rand()) << 21) ^ uint64_t(rand());
+        bits ^= uint64_t(rand()) << 62;
+        double v;
+        memcpy(&v, &bits, sizeof(v));
+        if (std::isnan(v) || std::isinf(v))
+            continue;
+        ASSERT_GT(25, fs_double(buf, v));
+        ASSERT_EQ(v, strtod(buf, nullptr)) << buf;
+    }
+}
+
+class DriverIO : public ::testing::Test
+{
+  protected:
+    void SetUp() override
+    {
+        IUFillNumber(&np[0], "RA", "RA", "%10.6m", 0, 24, 0, 0);
+        IUFillNumber(&np[1], "DEC", "DEC", "%10.6m", -90, 90, 0, 0);
+        IUFillNumber(&np[2], "COUNT", "Count", "%g", 0, 1e6, 1, 0);
+        IUFillNumberVector(&nvp, np, 3, "Mount", "EQUATORIAL_EOD_COORD", "Eq. Coordinates", "Main", IP_RW, 60,
+                           IPS_OK);
+    }
+
+    INumber np[3];
+    INumberVectorProperty nvp;
+};
+
+TEST_F(DriverIO, Test_set_number_round_trip)
+{
+    const double values[] = { 0.1, 1.0 / 3.0, -12.345678901234567, 5e-324, 1e300, -0.0, 42, -7 };
+
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i += 3)
+    {
+        for (int k = 0; k < 3; k++)
+            np[k].value = values[(i + k) % (sizeof(values) / sizeof(values[0]))];
+
+        std::string out = capture_stdout([&] { IDSetNumber(&nvp, "slew <%d> done", 2); });
+        ASSERT_EQ(0u, out.find("<?xml version='1.0'?>\n<setNumberVector\n  device='Mount'\n"));
+        ASSERT_NE(std::string::npos, out.find("  timeout='60'\n"));
+        ASSERT_NE(std::string::npos, out.find("  message='slew &lt;2&gt; done'\n>\n"));
+
+        std::vector<std::string> got = one_numbers(out);
+        ASSERT_EQ(3u, got.size());
+        for (int k = 0; k < 3; k++)
+        {
+            ASSERT_EQ(np[k].value, strtod(got[k].c_str(), nullptr)) << got[k];
+            ASSERT_LE(got[k].size(), 24u) << got[k];
+        }
+    }
+
+    // Whole numbers and short fractions print as before
+    np[0].value = 0.5;
+    np[1].value = -90;
+    np[2].value = 123456;
+    std::vector<std::string> got = one_numbers(capture_stdout([&] { IDSetNumber(&nvp, nullptr); }));
+    ASSERT_EQ("0.5", got[0]);
+    ASSERT_EQ("-90", got[1]);
+    ASSERT_EQ("123456", got[2]);
+}
+
+TEST_F(DriverIO, Test_matches_reference_layout)
+{
+    np[0].value = 1;
+    np[1].value = 2;
+    np[2].value = 3;
+
+    std::string out = capture_stdout([&] { IDSetNumber(&nvp, nullptr); });
+    std::string ref = capture_stdout([&] { reference_IDSetNumber(&nvp); });
+    // Timestamps may differ by a second
+    out.erase(out.find("timestamp='"), 32);
+    ref.erase(ref.find("timestamp='"), 32);
+    ASSERT_EQ(ref, out);
+}
+
+TEST_F(DriverIO, Test_locale_free_numbers)
+{
+    std::string prev = setlocale(LC_NUMERIC, nullptr);
+    if (!setlocale(LC_NUMERIC, "de_DE.UTF-8") && !setlocale(LC_NUMERIC, "fr_FR.UTF-8"))
+        return; // no locale with a decimal comma installed
+
+    np[0].value = 0.25;
+    std::vector<std::string> got = one_numbers(capture_stdout([&] { IDSetNumber(&nvp, nullptr); }));
+    setlocale(LC_NUMERIC, prev.c_str());
+    ASSERT_EQ("0.25", got[0]);
+}
+
+TEST_F(DriverIO, Test_updates_pass_queued_blobs)
+{
+    std::vector<unsigned char> image(3 << 20);
+    for (size_t i = 0; i < image.size(); i++)
+        image[i] = (i * 7919) >> 5;
+
+    IBLOB bp;
+    IBLOBVectorProperty bvp;
+    IUFillBLOB(&bp, "CCD1", "Image", ".fits");
+    IUFillBLOBVector(&bvp, &bp, 1, "CCD", "CCD1", "Image", "Main", IP_RO, 60, IPS_OK);
+    bp.blob    = image.data();
+    bp.bloblen = bp.size = image.size();
+
+    int fds[2];
+    ASSERT_EQ(0, pipe(fds));
+    int saved = dup(STDOUT_FILENO);
+    fflush(stdout);
+    dup2(fds[1], STDOUT_FILENO);
+    close(fds[1]);
+
+    // Nobody reads the pipe until both images are queued and the update is sent
+    std::atomic<bool> sent(false);
+    std::thread sender([&] {
+        IDSetBLOB(&bvp, nullptr);
+        IDSetBLOB(&bvp, nullptr);
+        IDSetNumber(&nvp, nullptr);
+        sent = true;
+    });
+    for (int i = 0; i < 1000 && !sent; i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    bool queued = sent;
+
+    std::string out;
+    std::thread reader([&] {
+        char buf[65536];
+        ssize_t nr;
+        size_t first;
+        while ((first = out.find("</setBLOBVector>")) == std::string::npos ||
+               out.find("</setBLOBVector>", first + 1) == std::string::npos ||
+               out.find("</setNumberVector>") == std::string::npos)
+        {
+            if ((nr = read(fds[0], buf, sizeof(buf))) <= 0)
+                break;
+            out.append(buf, nr);
+        }
+    });
+    reader.join();
+    sender.join();
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    close(fds[0]);
+
+    // The update was queued behind the image being written, not waiting for the reader
+    ASSERT_TRUE(queued);
+
+    // The update is written whole, before the second image
+    size_t first  = out.find("<setBLOBVector");
+    size_t second = out.find("<setBLOBVector", first + 1);
+    size_t update = out.find("<setNumberVector");
+    ASSERT_NE(std::string::npos, second);
+    ASSERT_EQ(std::string::npos, out.find("<setBLOBVector", second + 1));
+    ASSERT_LT(update, second);
+    ASSERT_TRUE(update < first || update > out.find("</setBLOBVector>", first));
+
+    // Images arrive intact
+    for (size_t p : { first, second })
+    {
+        size_t b = out.find("'>\n", out.find("<oneBLOB", p)) + 3;
+        size_t e = out.find("  </oneBLOB>", b);
+        std::string enc;
+        for (size_t i = b; i < e; i++)
+            if (out[i] != '\n')
+                enc += out[i];
+        std::vector<char> dec(enc.size());
+        ASSERT_EQ(int(image.size()), from64tobits_fast(dec.data(), enc.data(), enc.size()));
+        ASSERT_EQ(0, memcmp(image.data(), dec.data(), image.size()));
+    }
+}
+
+TEST_F(DriverIO, Test_updates_keep_order_after_delete)
+{
+    std::vector<unsigned char> image(4 << 20, 0x5a);
+
+    IBLOB bp;
+    IBLOBVectorProperty bvp;
+    IUFillBLOB(&bp, "CCD1", "Image", ".fits");
+    IUFillBLOBVector(&bvp, &bp, 1, "CCD", "CCD1", "Image", "Main", IP_RO, 60, IPS_OK);
+    bp.blob    = image.data();
+    bp.bloblen = bp.size = image.size();
+
+    int fds[2];
+    ASSERT_EQ(0, pipe(fds));
+    int saved = dup(STDOUT_FILENO);
+    fflush(stdout);
+    dup2(fds[1], STDOUT_FILENO);
+    close(fds[1]);
+
+    // The delete waits behind the queued image, the definition after it must too
+    std::thread sender([&] {
+        IDSetBLOB(&bvp, nullptr);
+        IDSetBLOB(&bvp, nullptr);
+        IDDelete(nvp.device, nvp.name, nullptr);
+        IDDefNumber(&nvp, nullptr);
+    });
+
+    std::string out;
+    char buf[65536];
+    ssize_t nr;
+    while (out.find("</defNumberVector>") == std::string::npos || out.find("<delProperty") == std::string::npos)
+    {
+        if ((nr = read(fds[0], buf, sizeof(buf))) <= 0)
+            break;
+        out.append(buf, nr);
+    }
+    sender.join();
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    close(fds[0]);
+
+    size_t del = out.find("<delProperty");
+    size_t def = out.find("<defNumberVector");
+    ASSERT_NE(std::string::npos, del);
+    ASSERT_NE(std::string::npos, def);
+    ASSERT_LT(del, def);
+    ASSERT_LT(out.rfind("</setBLOBVector>"), del);
+}
+
+// Timing only, run with --gtest_also_run_disabled_tests
+TEST_F(DriverIO, DISABLED_Benchmark_set_number)
+{
+    const int n = 50000;
+    int devnull = open("/dev/null", O_WRONLY);
+    int saved   = dup(STDOUT_FILENO);
+    fflush(stdout);
+    dup2(devnull, STDOUT_FILENO);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < n; i++)
+    {
+        np[0].value = i * 1e-4;
+        reference_IDSetNumber(&nvp);
+    }
+    auto reference = std::chrono::steady_clock::now();
+    for (int i = 0; i < n; i++)
+    {
+        np[0].value = i * 1e-4;
+        IDSetNumber(&nvp, nullptr);
+    }
+    auto buffered = std::chrono::steady_clock::now();
+
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    close(devnull);
+
+    double t_reference = std::chrono::duration<double>(reference - start).count();
+    double t_buffered  = std::chrono::duration<double>(buffered - reference).count();
+    printf("IDSetNumber %d updates: stdio %.0f/s, buffered %.0f/s\n", n, n / t_reference, n / t_buffered);
+}
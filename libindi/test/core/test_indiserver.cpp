@@ -0,0 +1,286 @@
+/*******************************************************************************
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "lilxml.h"
+
+#ifndef INDISERVER
+#define INDISERVER "indiserver"
+#endif
+
+// Values of one setNumberVector received by the client
+struct Update
+{
+    std::map<std::string, double> values;
+    std::string message;
+};
+
+// indiserver running a scripted driver that writes its output once the test says go
+class IndiServer : public ::testing::Test
+{
+    protected:
+        void SetUp() override
+        {
+            snprintf(dir, sizeof(dir), "/tmp/indi_test_server_%d", getpid());
+            mkdir(dir, 0700);
+
+            std::ofstream driver(path("test_driver"));
+            driver << "#!/bin/sh\n"
+                   << "while [ ! -f " << path("go") << " ]; do sleep 0.05; done\n"
+                   << "cat " << path("output") << "\n"
+                   << "touch " << path("done") << "\n"
+                   << "exec sleep 60\n";
+            driver.close();
+            chmod(path("test_driver").c_str(), 0700);
+        }
+
+        void TearDown() override
+        {
+            if (fd >= 0)
+                close(fd);
+            if (pid > 0)
+            {
+                kill(pid, SIGTERM);
+                waitpid(pid, nullptr, 0);
+            }
+            for (const char *name : { "test_driver", "go", "output", "done", "socket" })
+                unlink(path(name).c_str());
+            rmdir(dir);
+        }
+
+        std::string path(const char *name) const
+        {
+            return std::string(dir) + "/" + name;
+        }
+
+        // Start indiserver with the given extra option, if any, and connect to it
+        void start(const char *option)
+        {
+            std::string socket = path("socket");
+            std::string port   = std::to_string(freePort());
+
+            pid = fork();
+            if (pid == 0)
+            {
+                setenv("PATH", (std::string(dir) + ":" + getenv("PATH")).c_str(), 1);
+                int null = open("/dev/null", O_WRONLY);
+                dup2(null, STDERR_FILENO);
+                if (option)
+                    execl(INDISERVER, "indiserver", "-r", "0", "-p", port.c_str(), "-u", socket.c_str(), option,
+                          "test_driver", (char *)nullptr);
+                else
+                    execl(INDISERVER, "indiserver", "-r", "0", "-p", port.c_str(), "-u", socket.c_str(),
+                          "test_driver", (char *)nullptr);
+                _exit(127);
+            }
+
+            struct sockaddr_un addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sun_family = AF_UNIX;
+            strncpy(addr.sun_path, socket.c_str(), sizeof(addr.sun_path) - 1);
+            for (int i = 0; i < 100; i++)
+            {
+                fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+                if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0)
+                    return;
+                close(fd);
+                fd = -1;
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            }
+            FAIL() << "Cannot connect to " << INDISERVER;
+        }
+
+        static int freePort()
+        {
+            struct sockaddr_in addr;
+            socklen_t len = sizeof(addr);
+            memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            int s = ::socket(AF_INET, SOCK_STREAM, 0);
+            bind(s, (struct sockaddr *)&addr, sizeof(addr));
+            getsockname(s, (struct sockaddr *)&addr, &len);
+            close(s);
+            return ntohs(addr.sin_port);
+        }
+
+        void send(const std::string &text)
+        {
+            ASSERT_EQ(ssize_t(text.size()), write(fd, text.data(), text.size()));
+        }
+
+        // Let the driver write output, and wait until indiserver queued it while the client did not read
+        void runDriver(const std::string &output)
+        {
+            std::ofstream(path("output")) << output;
+            std::ofstream(path("go")).close();
+
+            auto start = std::chrono::steady_clock::now();
+            while (access(path("done").c_str(), F_OK) != 0 && std::chrono::steady_clock::now() - start < std::chrono::seconds(10))
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        }
+
+        // Read COORD updates until one carries a message
+        std::vector<Update> receive()
+        {
+            std::vector<Update> updates;
+            LilXML *lp = newLilXML();
+            char buf[65536], errmsg[1024];
+            struct timeval tv = { 5, 0 };
+            setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+            while (updates.empty() || updates.back().message.empty())
+            {
+                ssize_t n = read(fd, buf, sizeof(buf));
+                if (n <= 0)
+                    break;
+                XMLEle **nodes = parseXMLChunk(lp, buf, n, errmsg);
+                if (!nodes)
+                    break;
+                for (XMLEle **root = nodes; *root; root++)
+                {
+                    if (!strcmp(tagXMLEle(*root), "setNumberVector"))
+                    {
+                        Update update;
+                        update.message = findXMLAttValu(*root, "message");
+                        for (XMLEle *ep = nextXMLEle(*root, 1); ep; ep = nextXMLEle(*root, 0))
+                            update.values[findXMLAttValu(ep, "name")] = atof(pcdataXMLEle(ep));
+                        updates.push_back(update);
+                    }
+                    delXMLEle(*root);
+                }
+                free(nodes);
+            }
+            delLilXML(lp);
+            return updates;
+        }
+
+        char dir[64];
+        pid_t pid { -1 };
+        int fd { -1 };
+};
+
+static std::string setCoord(const std::string &elements, const char *message = nullptr)
+{
+    return std::string("<setNumberVector device='Mount' name='COORD' state='Ok'") +
+           (message ? std::string(" message='") + message + "'" : "") + ">\n" + elements + "</setNumberVector>\n";
+}
+
+static std::string oneNumber(const char *name, double value)
+{
+    return std::string("  <oneNumber name='") + name + "'>" + std::to_string(value) + "</oneNumber>\n";
+}
+
+// Definitions that fill the client socket, then two runs of full updates with a partial update between them
+static std::string driverOutput()
+{
+    std::string output;
+    for (int i = 0; i < 16; i++)
+        output += "<defTextVector device='Filler' name='TEXT" + std::to_string(i) + "' state='Ok' perm='ro'>\n"
+                  "  <defText name='T'>" + std::string(256 * 1024, 'x') + "</defText>\n</defTextVector>\n";
+    output += "<defNumberVector device='Mount' name='COORD' state='Ok' perm='ro'>\n"
+              "  <defNumber name='RA' format='%g' min='0' max='1000' step='0'>0</defNumber>\n"
+              "  <defNumber name='DEC' format='%g' min='0' max='1000' step='0'>0</defNumber>\n"
+              "</defNumberVector>\n";
+    for (int i = 1; i <= 50; i++)
+        output += setCoord(oneNumber("RA", i) + oneNumber("DEC", i));
+    output += setCoord(oneNumber("DEC", 1000));
+    for (int i = 101; i <= 150; i++)
+        output += setCoord(oneNumber("RA", i) + oneNumber("DEC", i));
+    output += setCoord(oneNumber("RA", 500) + oneNumber("DEC", 500), "Done");
+    return output;
+}
+
+// Check the updates are in order, with the partial one and the last value of each run
+static void checkOrder(const std::vector<Update> &updates)
+{
+    ASSERT_GE(updates.size(), 4u);
+
+    size_t partial = 0;
+    while (partial < updates.size() && updates[partial].values.size() == 2)
+        partial++;
+    ASSERT_GT(partial, 0u);
+    ASSERT_LT(partial, updates.size());
+    ASSERT_EQ(1u, updates[partial].values.size());
+    ASSERT_EQ(1000, updates[partial].values.at("DEC"));
+
+    ASSERT_EQ(50, updates[partial - 1].values.at("RA"));
+    ASSERT_EQ(150, updates[updates.size() - 2].values.at("RA"));
+    ASSERT_EQ(500, updates.back().values.at("RA"));
+    ASSERT_EQ("Done", updates.back().message);
+
+    for (size_t i = 1; i < updates.size(); i++)
+    {
+        if (i != partial && i != partial + 1)
+        {
+            ASSERT_LT(updates[i - 1].values.at("RA"), updates[i].values.at("RA"));
+        }
+    }
+}
+
+TEST_F(IndiServer, Test_no_coalescing_by_default)
+{
+    start(nullptr);
+    send("<getProperties version='1.7'/>\n");
+    runDriver(driverOutput());
+
+    std::vector<Update> updates = receive();
+    ASSERT_EQ(102u, updates.size());
+    checkOrder(updates);
+}
+
+TEST_F(IndiServer, Test_coalesce_requested_by_client)
+{
+    start(nullptr);
+    send("<getProperties version='1.7' coalesce='true'/>\n");
+    runDriver(driverOutput());
+
+    // Queued values are replaced, but not across the partial update or by it
+    std::vector<Update> updates = receive();
+    ASSERT_LT(updates.size(), 20u);
+    checkOrder(updates);
+}
+
+TEST_F(IndiServer, Test_coalesce_option)
+{
+    start("-c");
+    send("<getProperties version='1.7'/>\n");
+    runDriver(driverOutput());
+
+    std::vector<Update> updates = receive();
+    ASSERT_LT(updates.size(), 20u);
+    checkOrder(updates);
+}
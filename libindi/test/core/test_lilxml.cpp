@@ -0,0 +1,137 @@
+/*******************************************************************************
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "lilxml.h"
+
+// setBLOBVector with one oneBLOB in binary framing, followed by a number update
+static std::string binaryBLOB(const std::string &data)
+{
+    return "<setBLOBVector device='Camera' name='CCD1'>\n"
+           "  <oneBLOB name='CCD1' size='" + std::to_string(data.size()) + "' format='.bin' binlen='" +
+           std::to_string(data.size()) + "'>" + data + "</oneBLOB>\n"
+           "</setBLOBVector>\n"
+           "<setNumberVector device='Camera' name='TEMP'><oneNumber name='T'>-10</oneNumber></setNumberVector>\n";
+}
+
+// Raw content that would not parse as XML, with NUL bytes and closing tags in it
+static std::string awkwardData()
+{
+    std::string data("<oneBLOB name='x'>&amp;</oneBLOB></setBLOBVector>\n<<", 52);
+    data += std::string("\0\0>\0<", 5);
+    for (int i = 0; i < 1000; i++)
+        data += char(i * 31);
+    return data;
+}
+
+// Feed text to the parser in pieces of chunk bytes, return the elements parsed
+static std::vector<XMLEle *> parse(LilXML *lp, const std::string &text, size_t chunk)
+{
+    std::vector<XMLEle *> parsed;
+    std::vector<char> buf(text.begin(), text.end());
+    char errmsg[1024];
+
+    for (size_t i = 0; i < buf.size(); i += chunk)
+    {
+        int n = std::min(chunk, buf.size() - i);
+        XMLEle **nodes = parseXMLChunk(lp, buf.data() + i, n, errmsg);
+        EXPECT_NE(nullptr, nodes) << errmsg;
+        if (!nodes)
+            break;
+        for (XMLEle **ep = nodes; *ep; ep++)
+            parsed.push_back(*ep);
+        free(nodes);
+    }
+    return parsed;
+}
+
+static void checkParsed(const std::vector<XMLEle *> &parsed, const std::string &data)
+{
+    ASSERT_EQ(2u, parsed.size());
+    ASSERT_STREQ("setBLOBVector", tagXMLEle(parsed[0]));
+    XMLEle *blob = findXMLEle(parsed[0], "oneBLOB");
+    ASSERT_NE(nullptr, blob);
+    ASSERT_EQ(int(data.size()), pcdatalenXMLEle(blob));
+    ASSERT_EQ(data, std::string(pcdataXMLEle(blob), pcdatalenXMLEle(blob)));
+    ASSERT_STREQ("setNumberVector", tagXMLEle(parsed[1]));
+    ASSERT_STREQ("-10", pcdataXMLEle(findXMLEle(parsed[1], "oneNumber")));
+}
+
+TEST(CORE_LILXML, Test_binary_blob_split_across_chunks)
+{
+    std::string data = awkwardData();
+    std::string text = binaryBLOB(data);
+
+    for (size_t chunk : { size_t(1), size_t(3), size_t(7), size_t(64), size_t(4093), text.size() })
+    {
+        LilXML *lp = newLilXML();
+        std::vector<XMLEle *> parsed = parse(lp, text, chunk);
+        checkParsed(parsed, data);
+        for (XMLEle *ep : parsed)
+            delXMLEle(ep);
+        delLilXML(lp);
+    }
+}
+
+TEST(CORE_LILXML, Test_binary_blob_read_by_character)
+{
+    std::string data = awkwardData();
+    std::string text = binaryBLOB(data);
+    std::vector<XMLEle *> parsed;
+    char errmsg[1024];
+
+    LilXML *lp = newLilXML();
+    for (char c : text)
+    {
+        XMLEle *root = readXMLEle(lp, static_cast<unsigned char>(c), errmsg);
+        ASSERT_STREQ("", errmsg);
+        if (root)
+            parsed.push_back(root);
+    }
+    checkParsed(parsed, data);
+    for (XMLEle *ep : parsed)
+        delXMLEle(ep);
+    delLilXML(lp);
+}
+
+TEST(CORE_LILXML, Test_binary_blob_empty)
+{
+    LilXML *lp = newLilXML();
+    std::vector<XMLEle *> parsed = parse(lp, binaryBLOB(""), 5);
+    checkParsed(parsed, "");
+    for (XMLEle *ep : parsed)
+        delXMLEle(ep);
+    delLilXML(lp);
+}
+
+TEST(CORE_LILXML, Test_base64_blob_unchanged)
+{
+    // Without binlen, markup in the content still ends it
+    std::string text = "<setBLOBVector device='Camera' name='CCD1'>"
+                       "<oneBLOB name='CCD1' size='3' format='.bin' enclen='4'>\nAAEC\n</oneBLOB></setBLOBVector>";
+    LilXML *lp = newLilXML();
+    std::vector<XMLEle *> parsed = parse(lp, text, 2);
+    ASSERT_EQ(1u, parsed.size());
+    ASSERT_STREQ("AAEC", pcdataXMLEle(findXMLEle(parsed[0], "oneBLOB")));
+    delXMLEle(parsed[0]);
+    delLilXML(lp);
+}
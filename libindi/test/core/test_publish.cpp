@@ -0,0 +1,297 @@
+/*******************************************************************************
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <thread>
+
+#include <unistd.h>
+
+#include "defaultdevice.h"
+#include "indidevapi.h"
+
+// Device callbacks the driver library expects, nothing is dispatched to them here
+void ISGetProperties(const char *dev)
+{
+    INDI_UNUSED(dev);
+}
+void ISNewSwitch(const char *dev, const char *name, ISState *states, char *names[], int n)
+{
+    INDI_UNUSED(dev);
+    INDI_UNUSED(name);
+    INDI_UNUSED(states);
+    INDI_UNUSED(names);
+    INDI_UNUSED(n);
+}
+void ISNewText(const char *dev, const char *name, char *texts[], char *names[], int n)
+{
+    INDI_UNUSED(dev);
+    INDI_UNUSED(name);
+    INDI_UNUSED(texts);
+    INDI_UNUSED(names);
+    INDI_UNUSED(n);
+}
+void ISNewNumber(const char *dev, const char *name, double values[], char *names[], int n)
+{
+    INDI_UNUSED(dev);
+    INDI_UNUSED(name);
+    INDI_UNUSED(values);
+    INDI_UNUSED(names);
+    INDI_UNUSED(n);
+}
+void ISNewBLOB(const char *dev, const char *name, int sizes[], int blobsizes[], char *blobs[], char *formats[],
+               char *names[], int n)
+{
+    INDI_UNUSED(dev);
+    INDI_UNUSED(name);
+    INDI_UNUSED(sizes);
+    INDI_UNUSED(blobsizes);
+    INDI_UNUSED(blobs);
+    INDI_UNUSED(formats);
+    INDI_UNUSED(names);
+    INDI_UNUSED(n);
+}
+void ISSnoopDevice(XMLEle *root)
+{
+    INDI_UNUSED(root);
+}
+
+// Run f with stdout going to a temporary file, return what it wrote
+template <typename F> static std::string capture_stdout(F f)
+{
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    FILE *tmp = tmpfile();
+    dup2(fileno(tmp), STDOUT_FILENO);
+
+    f();
+
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+
+    std::string out;
+    char buf[4096];
+    size_t nr;
+    rewind(tmp);
+    while ((nr = fread(buf, 1, sizeof(buf), tmp)) > 0)
+        out.append(buf, nr);
+    fclose(tmp);
+    return out;
+}
+
+static int count(const std::string &text, const std::string &what)
+{
+    int n = 0;
+    for (size_t p = 0; (p = text.find(what, p)) != std::string::npos; p += what.size())
+        n++;
+    return n;
+}
+
+class PublishingDevice : public INDI::DefaultDevice
+{
+    public:
+        PublishingDevice()
+        {
+            IUFillNumber(&CoordN[0], "RA", "RA", "%g", 0, 24, 0, 0);
+            IUFillNumber(&CoordN[1], "DEC", "DEC", "%g", -90, 90, 0, 0);
+            IUFillNumberVector(&CoordNP, CoordN, 2, "Publisher", "COORD", "Coord", "Main", IP_RO, 0, IPS_OK);
+            IUFillSwitch(&TrackS[0], "ON", "On", ISS_ON);
+            IUFillSwitch(&TrackS[1], "OFF", "Off", ISS_OFF);
+            IUFillSwitchVector(&TrackSP, TrackS, 2, "Publisher", "TRACK", "Track", "Main", IP_RW, ISR_1OFMANY, 0,
+                               IPS_OK);
+        }
+
+        const char *getDefaultName() override
+        {
+            return "Publisher";
+        }
+
+        // Run poll as TimerHit() from the event loop and wait for it
+        void runTimer(std::function<void()> poll)
+        {
+            onTimer = poll;
+            done    = 0;
+            SetTimer(1);
+            IEDeferLoop(1000, &done);
+        }
+
+        void TimerHit() override
+        {
+            onTimer();
+            done = 1;
+        }
+
+        using DefaultDevice::publishNumber;
+        using DefaultDevice::publishSwitch;
+        using DefaultDevice::setPublishLimits;
+
+        INumber CoordN[2];
+        INumberVectorProperty CoordNP;
+        ISwitch TrackS[2];
+        ISwitchVectorProperty TrackSP;
+
+    private:
+        std::function<void()> onTimer;
+        int done { 0 };
+};
+
+TEST(PUBLISH, Test_one_update_per_poll)
+{
+    PublishingDevice device;
+
+    std::string out = capture_stdout([&]()
+    {
+        device.runTimer([&]()
+        {
+            for (int i = 1; i <= 5; i++)
+            {
+                device.CoordN[0].value = i;
+                device.publishNumber(&device.CoordNP);
+                device.publishSwitch(&device.TrackSP);
+            }
+            // Nothing is sent before the poll ends
+            fflush(stdout);
+            ASSERT_EQ(0, lseek(STDOUT_FILENO, 0, SEEK_CUR));
+        });
+    });
+
+    ASSERT_EQ(1, count(out, "<setNumberVector"));
+    ASSERT_EQ(1, count(out, "<setSwitchVector"));
+    ASSERT_NE(std::string::npos, out.find("      5\n"));
+}
+
+TEST(PUBLISH, Test_sent_at_once_outside_poll)
+{
+    PublishingDevice device;
+
+    std::string out = capture_stdout([&]()
+    {
+        device.CoordN[0].value = 1;
+        device.publishNumber(&device.CoordNP);
+        // Unchanged, the client already has it
+        device.publishNumber(&device.CoordNP);
+        device.CoordN[0].value = 2;
+        device.publishNumber(&device.CoordNP);
+    });
+
+    ASSERT_EQ(2, count(out, "<setNumberVector"));
+}
+
+TEST(PUBLISH, Test_deadband)
+{
+    PublishingDevice device;
+    device.setPublishLimits(&device.CoordNP, 0, { 0.1 / 3600 / 15, 0.1 / 3600 });
+
+    std::string out = capture_stdout([&]()
+    {
+        device.publishNumber(&device.CoordNP);
+        // 0.05 arcsec in RA and DEC
+        device.CoordN[0].value += 0.05 / 3600 / 15;
+        device.CoordN[1].value += 0.05 / 3600;
+        device.publishNumber(&device.CoordNP);
+    });
+    ASSERT_EQ(1, count(out, "<setNumberVector"));
+
+    // Past the deadband since the last update sent, or a new state
+    out = capture_stdout([&]()
+    {
+        device.CoordN[1].value += 0.06 / 3600;
+        device.publishNumber(&device.CoordNP);
+        device.CoordNP.s = IPS_BUSY;
+        device.publishNumber(&device.CoordNP);
+    });
+    ASSERT_EQ(2, count(out, "<setNumberVector"));
+}
+
+TEST(PUBLISH, Test_min_interval)
+{
+    PublishingDevice device;
+    device.setPublishLimits(&device.CoordNP, 200, { 0 });
+
+    std::string out = capture_stdout([&]()
+    {
+        device.publishNumber(&device.CoordNP);
+        for (int i = 1; i <= 3; i++)
+        {
+            device.CoordN[0].value = i;
+            device.publishNumber(&device.CoordNP);
+        }
+    });
+    ASSERT_EQ(1, count(out, "<setNumberVector"));
+
+    // The latest values go out with the first flush after the interval
+    std::this_thread::sleep_for(std::chrono::milliseconds(250));
+    out = capture_stdout([&]() { device.flushPublished(); });
+    ASSERT_EQ(1, count(out, "<setNumberVector"));
+    ASSERT_NE(std::string::npos, out.find("      3\n"));
+
+    out = capture_stdout([&]() { device.flushPublished(); });
+    ASSERT_EQ(0, count(out, "<setNumberVector"));
+}
+
+TEST(PUBLISH, Test_forced_reply)
+{
+    PublishingDevice device;
+    device.setPublishLimits(&device.CoordNP, 10000, { 1 });
+
+    // A client asking twice for the same is answered twice, even within the interval
+    std::string out = capture_stdout([&]()
+    {
+        device.publishNumber(&device.CoordNP, true);
+        device.publishNumber(&device.CoordNP, true);
+    });
+    ASSERT_EQ(2, count(out, "<setNumberVector"));
+
+    // and the replies count as sent
+    out = capture_stdout([&]() { device.publishNumber(&device.CoordNP); });
+    ASSERT_EQ(0, count(out, "<setNumberVector"));
+}
+
+TEST(PUBLISH, Test_direct_send)
+{
+    PublishingDevice device;
+    device.setPublishLimits(&device.CoordNP, 0, { 5 });
+
+    // A short move reported busy with IDSetNumber, then done within the deadband
+    std::string out = capture_stdout([&]()
+    {
+        device.CoordN[0].value = 100;
+        device.publishNumber(&device.CoordNP);
+        device.CoordNP.s = IPS_BUSY;
+        IDSetNumber(&device.CoordNP, nullptr);
+        device.CoordN[0].value = 103;
+        device.CoordNP.s       = IPS_OK;
+        device.publishNumber(&device.CoordNP);
+    });
+    ASSERT_EQ(3, count(out, "<setNumberVector"));
+    ASSERT_NE(std::string::npos, out.rfind("state='Ok'"));
+    ASSERT_GT(out.rfind("state='Ok'"), out.find("state='Busy'"));
+
+    // Values sent directly are the new reference for the deadband
+    out = capture_stdout([&]()
+    {
+        device.CoordN[0].value = 110;
+        IDSetNumber(&device.CoordNP, nullptr);
+        device.CoordN[0].value = 112;
+        device.publishNumber(&device.CoordNP);
+    });
+    ASSERT_EQ(1, count(out, "<setNumberVector"));
+}
@@ -0,0 +1,146 @@
+/*******************************************************************************
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "base64.h"
+#include "indidevapi.h"
+
+// Kept in its own test program, whether BLOBs are shared is decided once per process
+
+static int count(const std::string &text, const std::string &what)
+{
+    int n = 0;
+    for (size_t p = 0; (p = text.find(what, p)) != std::string::npos; p += what.size())
+        n++;
+    return n;
+}
+
+// Read the text and descriptors the driver sends up to the end of the first BLOB vector
+static void receive(int fd, std::string &text, std::vector<int> &fds)
+{
+    while (text.find("</setBLOBVector>") == std::string::npos)
+    {
+        char buf[65536];
+        union
+        {
+            struct cmsghdr align;
+            char buf[CMSG_SPACE(64 * sizeof(int))];
+        } ctl;
+        struct iovec iov = { buf, sizeof(buf) };
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov        = &iov;
+        msg.msg_iovlen     = 1;
+        msg.msg_control    = ctl.buf;
+        msg.msg_controllen = sizeof(ctl.buf);
+
+        ssize_t nr = recvmsg(fd, &msg, 0);
+        if (nr <= 0)
+            return;
+        text.append(buf, nr);
+
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+        {
+            int n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            for (int i = 0; i < n; i++)
+            {
+                int one;
+                memcpy(&one, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+                fds.push_back(one);
+            }
+        }
+    }
+}
+
+TEST(SHARED_BLOB, Test_many_elements)
+{
+    // More elements than indiserver takes descriptors for at once
+    const int n = 20;
+    std::vector<std::string> data(n);
+    std::vector<IBLOB> bp(n);
+    std::vector<std::string> names(n);
+    IBLOBVectorProperty bvp;
+
+    for (int i = 0; i < n; i++)
+    {
+        names[i] = "B" + std::to_string(i);
+        data[i]  = std::string(1000 + i, 'a' + i);
+        IUFillBLOB(&bp[i], names[i].c_str(), names[i].c_str(), ".bin");
+        bp[i].blob    = &data[i][0];
+        bp[i].bloblen = bp[i].size = data[i].size();
+    }
+    IUFillBLOBVector(&bvp, bp.data(), n, "Camera", "CCD1", "Image", "Main", IP_RO, 60, IPS_OK);
+
+    int sv[2];
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+    setenv("INDISHAREDBLOB", "1", 1);
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    dup2(sv[1], STDOUT_FILENO);
+    close(sv[1]);
+
+    IDSetBLOB(&bvp, nullptr);
+
+    std::string text;
+    std::vector<int> fds;
+    receive(sv[0], text, fds);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    close(sv[0]);
+
+    // The first ones are attached, the rest sent inline
+    ASSERT_EQ(16u, fds.size());
+    ASSERT_EQ(16, count(text, "attached='true'"));
+    ASSERT_EQ(4, count(text, "enclen='"));
+
+    for (int i = 0; i < 16; i++)
+    {
+        struct stat st;
+        ASSERT_EQ(0, fstat(fds[i], &st));
+        ASSERT_EQ(off_t(data[i].size()), st.st_size);
+        std::string got(st.st_size, 0);
+        ASSERT_EQ(st.st_size, pread(fds[i], &got[0], st.st_size, 0));
+        ASSERT_EQ(data[i], got);
+        close(fds[i]);
+    }
+
+    for (int i = 16; i < n; i++)
+    {
+        size_t p = text.find("name='" + names[i] + "'");
+        ASSERT_NE(std::string::npos, p);
+        size_t b = text.find("'>\n", p) + 3;
+        size_t e = text.find("  </oneBLOB>", b);
+        std::string enc;
+        for (size_t k = b; k < e; k++)
+            if (text[k] != '\n')
+                enc += text[k];
+        std::vector<char> dec(enc.size());
+        ASSERT_EQ(int(data[i].size()), from64tobits_fast(dec.data(), enc.data(), enc.size()));
+        ASSERT_EQ(data[i], std::string(dec.data(), data[i].size()));
+    }
+}
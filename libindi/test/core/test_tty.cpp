@@ -0,0 +1,157 @@
+/*******************************************************************************
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "indicom.h"
+
+// Byte at a time section reader the buffered reader replaced, kept as reference
+static int reference_read_section(int fd, char *buf, char stop_char, int timeout, int *nbytes_read)
+{
+    *nbytes_read = 0;
+    for (;;)
+    {
+        int err = tty_timeout(fd, timeout);
+        if (err)
+            return err;
+        if (read(fd, buf + *nbytes_read, 1) < 0)
+            return TTY_READ_ERROR;
+        if (buf[(*nbytes_read)++] == stop_char)
+            return TTY_OK;
+    }
+}
+
+class TTYBuffered : public ::testing::Test
+{
+  protected:
+    void SetUp() override { ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds)); }
+    void TearDown() override
+    {
+        tty_clear_buffer(fds[0]);
+        close(fds[0]);
+        close(fds[1]);
+    }
+
+    void device(const char *reply) { ASSERT_EQ(ssize_t(strlen(reply)), ::write(fds[1], reply, strlen(reply))); }
+
+    int pending()
+    {
+        int n = 0;
+        ioctl(fds[0], FIONREAD, &n);
+        return n;
+    }
+
+    int fds[2];
+};
+
+TEST_F(TTYBuffered, Test_sections_from_one_read)
+{
+    char buf[64] = { 0 };
+    int nr = 0;
+
+    device("12:34:56#+45*12:00#1");
+    ASSERT_EQ(TTY_OK, tty_nread_section(fds[0], buf, sizeof(buf), '#', 1, &nr));
+    ASSERT_EQ(9, nr);
+    ASSERT_STREQ("12:34:56#", buf);
+    // Everything the port had was taken in one read, the rest is served from the buffer
+    ASSERT_EQ(0, pending());
+
+    ASSERT_EQ(TTY_OK, tty_nread_section(fds[0], buf, sizeof(buf), '#', 1, &nr));
+    ASSERT_STREQ("+45*12:00#", buf);
+
+    // Fixed length reads take leftovers first
+    device("23");
+    ASSERT_EQ(TTY_OK, tty_read(fds[0], buf, 3, 1, &nr));
+    ASSERT_EQ(3, nr);
+    ASSERT_EQ(0, memcmp("123", buf, 3));
+}
+
+TEST_F(TTYBuffered, Test_overflow_and_split_replies)
+{
+    char buf[64] = { 0 };
+    int nr = 0;
+
+    device("ABCDEFGH#");
+    ASSERT_EQ(TTY_OVERFLOW, tty_nread_section(fds[0], buf, 4, '#', 1, &nr));
+    ASSERT_EQ(4, nr);
+    ASSERT_EQ(TTY_OK, tty_nread_section(fds[0], buf, sizeof(buf), '#', 1, &nr));
+    ASSERT_STREQ("EFGH#", buf);
+
+    // A reply arriving in pieces is assembled within one deadline
+    std::thread slow([this] {
+        for (const char *piece : { "0.", "25", "0#" })
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            device(piece);
+        }
+    });
+    ASSERT_EQ(TTY_OK, tty_nread_section(fds[0], buf, sizeof(buf), '#', 1, &nr));
+    slow.join();
+    ASSERT_STREQ("0.250#", buf);
+
+    ASSERT_EQ(TTY_TIME_OUT, tty_nread_section(fds[0], buf, sizeof(buf), '#', 0, &nr));
+}
+
+TEST_F(TTYBuffered, Test_write_drops_stale_bytes)
+{
+    char buf[64] = { 0 };
+    int nr = 0, nw = 0;
+
+    device("1#garbage");
+    ASSERT_EQ(TTY_OK, tty_nread_section(fds[0], buf, sizeof(buf), '#', 1, &nr));
+    ASSERT_EQ(TTY_OK, tty_timeout(fds[0], 0));
+
+    ASSERT_EQ(TTY_OK, tty_write_string(fds[0], ":GR#", &nw));
+    device("12:00:00#");
+    ASSERT_EQ(TTY_OK, tty_nread_section(fds[0], buf, sizeof(buf), '#', 1, &nr));
+    ASSERT_STREQ("12:00:00#", buf);
+}
+
+// Timing only, run with --gtest_also_run_disabled_tests
+TEST_F(TTYBuffered, DISABLED_Benchmark_read_section)
+{
+    const int n = 20000;
+    const std::string reply = "+12*34:56#";
+    char buf[64];
+    int nr;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < n; i++)
+    {
+        device(reply.c_str());
+        ASSERT_EQ(TTY_OK, reference_read_section(fds[0], buf, '#', 1, &nr));
+    }
+    auto reference = std::chrono::steady_clock::now();
+    for (int i = 0; i < n; i++)
+    {
+        device(reply.c_str());
+        ASSERT_EQ(TTY_OK, tty_nread_section(fds[0], buf, sizeof(buf), '#', 1, &nr));
+    }
+    auto buffered = std::chrono::steady_clock::now();
+
+    double t_reference = std::chrono::duration<double>(reference - start).count();
+    double t_buffered  = std::chrono::duration<double>(buffered - reference).count();
+    printf("tty_nread_section %d replies: per byte %.0f/s, buffered %.0f/s\n", n, n / t_reference, n / t_buffered);
+}
@@ -0,0 +1,128 @@
+/*******************************************************************************
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <vector>
+
+#include "dsp.h"
+
+static dsp_stream_p make_stream(int dims, const int *sizes)
+{
+    dsp_stream_p stream = dsp_stream_new();
+    for (int d = 0; d < dims; d++)
+        dsp_stream_add_dim(stream, sizes[d]);
+    dsp_stream_alloc_buffer(stream, stream->len);
+    return stream;
+}
+
+static void free_stream(dsp_stream_p stream)
+{
+    dsp_stream_free_buffer(stream);
+    dsp_stream_free(stream);
+}
+
+// Zero padded "same" 2-D convolution by definition
+static std::vector<double> reference_convolution(dsp_stream_p stream, dsp_stream_p matrix)
+{
+    int w = stream->sizes[0], h = stream->sizes[1], kw = matrix->sizes[0], kh = matrix->sizes[1];
+    std::vector<double> out(stream->len);
+    for (int y = 0; y < h; y++)
+        for (int x = 0; x < w; x++)
+            for (int j = 0; j < kh; j++)
+                for (int i = 0; i < kw; i++)
+                {
+                    int yy = y + kh / 2 - j, xx = x + kw / 2 - i;
+                    if (yy >= 0 && yy < h && xx >= 0 && xx < w)
+                        out[y * w + x] += matrix->buf[j * kw + i] * stream->buf[yy * w + xx];
+                }
+    return out;
+}
+
+class DSP_CONVOLUTION : public ::testing::Test
+{
+    protected:
+        void SetUp() override
+        {
+            const int sizes[2] = { 37, 23 }, ksizes[2] = { 5, 4 };
+            stream = make_stream(2, sizes);
+            matrix = make_stream(2, ksizes);
+            for (int i = 0; i < stream->len; i++)
+                stream->buf[i] = (i * 31) % 17 - 4.0;
+            for (int i = 0; i < matrix->len; i++)
+                matrix->buf[i] = (i * 7) % 5 - 1.5;
+            expected = reference_convolution(stream, matrix);
+        }
+        void TearDown() override
+        {
+            free_stream(stream);
+            free_stream(matrix);
+        }
+        dsp_stream_p stream { nullptr };
+        dsp_stream_p matrix { nullptr };
+        std::vector<double> expected;
+};
+
+TEST_F(DSP_CONVOLUTION, Test_direct)
+{
+    dsp_convolution_direct(stream, matrix);
+    for (int i = 0; i < stream->len; i++)
+        ASSERT_NEAR(expected[i], stream->buf[i], 1e-9) << "sample " << i;
+}
+
+TEST_F(DSP_CONVOLUTION, Test_fft)
+{
+    dsp_convolution_fft(stream, matrix);
+    for (int i = 0; i < stream->len; i++)
+        ASSERT_NEAR(expected[i], stream->buf[i], 1e-9) << "sample " << i;
+}
+
+TEST_F(DSP_CONVOLUTION, Test_separable)
+{
+    double kernel[5] = { 1, 4, 6, 4, 1 };
+    const int ksizes[2] = { 5, 5 };
+    dsp_stream_p square = make_stream(2, ksizes);
+    for (int j = 0; j < 5; j++)
+        for (int i = 0; i < 5; i++)
+            square->buf[j * 5 + i] = kernel[i] * kernel[j];
+    expected = reference_convolution(stream, square);
+    free_stream(square);
+
+    dsp_convolution_separable(stream, kernel, 5);
+    for (int i = 0; i < stream->len; i++)
+        ASSERT_NEAR(expected[i], stream->buf[i], 1e-9) << "sample " << i;
+}
+
+TEST(DSP_CONVOLUTION_1D, Test_overlap_add)
+{
+    const int len = 100000, klen = 301;
+    dsp_stream_p stream = make_stream(1, &len);
+    dsp_stream_p matrix = make_stream(1, &klen);
+    for (int i = 0; i < len; i++)
+        stream->buf[i] = sin(i * 0.01) + i % 13;
+    for (int i = 0; i < klen; i++)
+        matrix->buf[i] = i % 7 - 3.0;
+    dsp_stream_p direct = dsp_stream_copy(stream);
+    dsp_convolution_direct(direct, matrix);
+    dsp_convolution_fft(stream, matrix);
+    for (int i = 0; i < len; i++)
+        ASSERT_NEAR(direct->buf[i], stream->buf[i], 1e-6) << "sample " << i;
+    free_stream(direct);
+    free_stream(stream);
+    free_stream(matrix);
+}
@@ -0,0 +1,65 @@
+/*******************************************************************************
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <numeric>
+#include <vector>
+
+#include "dsp.h"
+
+TEST(DSP_FFT, Test_dft_real_signal)
+{
+    const int len = 64;
+    dsp_stream_p stream = dsp_stream_new();
+    dsp_stream_add_dim(stream, len);
+    dsp_stream_alloc_buffer(stream, stream->len);
+    for (int i = 0; i < len; i++)
+        stream->buf[i] = cos(2.0 * M_PI * 5 * i / len);
+
+    dsp_complex *dft = dsp_fft_dft(stream);
+    ASSERT_NE(nullptr, dft);
+    for (int k = 0; k < len; k++)
+    {
+        double expected = (k == 5 || k == len - 5) ? len / 2.0 : 0.0;
+        ASSERT_NEAR(expected, dsp_fft_complex_to_magnitude(dft[k]), 1e-9) << "bin " << k;
+        ASSERT_NEAR(0.0, dft[k].imaginary, 1e-9) << "bin " << k;
+    }
+    free(dft);
+    dsp_stream_free_buffer(stream);
+    dsp_stream_free(stream);
+}
+
+TEST(DSP_FFT, Test_rdft_roundtrip_2d)
+{
+    int sizes[2] = { 12, 5 };
+    std::vector<double> in(60), out(60);
+    for (size_t i = 0; i < in.size(); i++)
+        in[i] = (i * 37) % 11 - 3.0;
+
+    // Run twice, the second transform goes through the cached plans
+    for (int pass = 0; pass < 2; pass++)
+    {
+        std::vector<dsp_complex> coefficients(dsp_fft_complex_len(2, sizes));
+        ASSERT_EQ(0, dsp_fft_rdft_buffer(in.data(), 2, sizes, coefficients.data()));
+        ASSERT_DOUBLE_EQ(std::accumulate(in.begin(), in.end(), 0.0), coefficients[0].real);
+        ASSERT_EQ(0, dsp_fft_irdft_buffer(coefficients.data(), 2, sizes, out.data()));
+        for (size_t i = 0; i < in.size(); i++)
+            ASSERT_NEAR(in[i], out[i], 1e-9);
+    }
+    dsp_fft_cleanup();
+}
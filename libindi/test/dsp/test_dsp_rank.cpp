@@ -0,0 +1,101 @@
+/*******************************************************************************
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "dsp.h"
+
+// Sort every clipped window, for 1-D (height 1) and stacks of 2-D planes
+template <typename T>
+static std::vector<T> reference_rank(const std::vector<T> &in, int width, int height, int size, double rank)
+{
+    std::vector<T> out(in.size());
+    int c = size / 2;
+    for (size_t row = 0; row < in.size() / width; row++)
+    {
+        int y = row % height;
+        size_t plane = (row - y) * width;
+        for (int x = 0; x < width; x++)
+        {
+            std::vector<T> window;
+            for (int r = std::max(0, y - c); r <= std::min(height - 1, y - c + size - 1); r++)
+                for (int i = std::max(0, x - c); i <= std::min(width - 1, x - c + size - 1); i++)
+                    window.push_back(in[plane + r * width + i]);
+            std::sort(window.begin(), window.end());
+            out[row * width + x] = window[static_cast<int>(rank * (window.size() - 1) + 0.5)];
+        }
+    }
+    return out;
+}
+
+TEST(DSP_RANK, Test_median_1d)
+{
+    std::vector<double> in(5000);
+    for (size_t i = 0; i < in.size(); i++)
+        in[i] = (i * 7919) % 1013 * 0.5;
+    std::vector<double> expected = reference_rank(in, in.size(), 1, 7, 0.5);
+
+    dsp_stream_p stream = dsp_stream_new();
+    dsp_stream_add_dim(stream, in.size());
+    dsp_stream_alloc_buffer(stream, stream->len);
+    std::copy(in.begin(), in.end(), stream->buf);
+    dsp_rank_median(stream, 7);
+    for (size_t i = 0; i < in.size(); i++)
+        ASSERT_DOUBLE_EQ(expected[i], stream->buf[i]) << "sample " << i;
+    dsp_stream_free_buffer(stream);
+    dsp_stream_free(stream);
+}
+
+TEST(DSP_RANK, Test_rank_2d_uint16)
+{
+    int sizes[2] = { 41, 29 };
+    std::vector<uint16_t> in(41 * 29), out(in.size());
+    for (size_t i = 0; i < in.size(); i++)
+        in[i] = (i * 7919) % 60000;
+    for (double rank : { 0.0, 0.25, 1.0 })
+    {
+        std::vector<uint16_t> expected = reference_rank(in, 41, 29, 5, rank);
+        dsp_rank_filter_buffer(in.data(), out.data(), 2, sizes, DSP_TYPE_UINT16, 5, rank);
+        ASSERT_EQ(expected, out) << "rank " << rank;
+    }
+}
+
+TEST(DSP_RANK, Test_median_2d_uint8_large_window)
+{
+    int sizes[2] = { 64, 48 };
+    std::vector<uint8_t> in(64 * 48), out(in.size());
+    for (size_t i = 0; i < in.size(); i++)
+        in[i] = (i * 7919) % 251;
+    std::vector<uint8_t> expected = reference_rank(in, 64, 48, 15, 0.5);
+    dsp_rank_filter_buffer(in.data(), out.data(), 2, sizes, DSP_TYPE_UINT8, 15, 0.5);
+    ASSERT_EQ(expected, out);
+}
+
+TEST(DSP_RANK, Test_median_3d_stack)
+{
+    int sizes[3] = { 17, 13, 3 };
+    std::vector<float> in(17 * 13 * 3), out(in.size());
+    for (size_t i = 0; i < in.size(); i++)
+        in[i] = (i * 7919) % 97 - 40.5f;
+    std::vector<float> expected = reference_rank(in, 17, 13, 3, 0.5);
+    dsp_rank_filter_buffer(in.data(), out.data(), 3, sizes, DSP_TYPE_FLOAT, 3, 0.5);
+    ASSERT_EQ(expected, out);
+}
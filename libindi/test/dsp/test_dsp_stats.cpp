@@ -0,0 +1,128 @@
+/*******************************************************************************
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#include "dsp.h"
+
+// Per-bin counting histogram the single pass kernels replaced, kept as reference
+static std::vector<double> reference_histogram(const std::vector<double> &in, int size)
+{
+    std::vector<double> clamped(in.size());
+    for (size_t i = 0; i < in.size(); i++)
+        clamped[i] = static_cast<long>(in[i] < 0 ? 0 : (in[i] > size ? size : in[i]));
+
+    std::vector<double> out(size);
+    for (int k = 0; k < size; k++)
+        for (double v : clamped)
+            out[k] += (v == k);
+
+    double mn = DBL_MAX, mx = -DBL_MAX;
+    for (double v : out)
+    {
+        mn = std::min(mn, v);
+        mx = std::max(mx, v);
+    }
+    double ratio = (mx - mn) == 0 ? 1.0 : (mx - mn);
+    for (double &v : out)
+        v = (v - mn) * size / ratio;
+    return out;
+}
+
+static dsp_stream_p make_stream(std::vector<double> &buf)
+{
+    int len = buf.size();
+    return dsp_stream_new_view(buf.data(), DSP_TYPE_DOUBLE, 1, &len);
+}
+
+TEST(DSP_STATS, Test_minmidmax_negative)
+{
+    std::vector<double> buf = { -8.0, -3.0, -5.0 };
+    dsp_stream_p stream = make_stream(buf);
+    double mn, mx;
+    double mid = dsp_stats_minmidmax(stream, &mn, &mx);
+    ASSERT_DOUBLE_EQ(-8.0, mn);
+    ASSERT_DOUBLE_EQ(-3.0, mx);
+    ASSERT_DOUBLE_EQ(-5.5, mid);
+    dsp_stream_free(stream);
+}
+
+TEST(DSP_STATS, Test_mean_variance)
+{
+    std::vector<uint16_t> buf = { 1000, 1002, 1004, 1006, 1008, 1010, 1012, 1014, 1016 };
+    double mean = 0;
+    double variance = dsp_stats_variance_buffer(buf.data(), buf.size(), DSP_TYPE_UINT16, &mean);
+    ASSERT_DOUBLE_EQ(1008.0, mean);
+    ASSERT_DOUBLE_EQ(80.0 / 3.0, variance);
+}
+
+TEST(DSP_STATS, Test_histogram_matches_reference)
+{
+    const int len = 1 << 16, size = 256;
+    std::vector<double> buf(len);
+    std::vector<uint16_t> native(len);
+    for (int i = 0; i < len; i++)
+    {
+        native[i] = (i * 7919) % 300;
+        buf[i]    = native[i] - 5.5;
+    }
+
+    std::vector<double> expected = reference_histogram(buf, size);
+    dsp_stream_p stream = make_stream(buf);
+    double *histo = dsp_stats_histogram(stream, size);
+    for (int k = 0; k < size; k++)
+        ASSERT_DOUBLE_EQ(expected[k], histo[k]) << "bin " << k;
+    free(histo);
+    dsp_stream_free(stream);
+
+    for (int i = 0; i < len; i++)
+        buf[i] = native[i];
+    expected = reference_histogram(buf, size);
+    histo = dsp_stats_histogram_buffer(native.data(), len, DSP_TYPE_UINT16, size);
+    for (int k = 0; k < size; k++)
+        ASSERT_DOUBLE_EQ(expected[k], histo[k]) << "bin " << k;
+    free(histo);
+}
+
+// Timing only, run with --gtest_also_run_disabled_tests
+TEST(DSP_STATS, DISABLED_Benchmark_histogram)
+{
+    const int len = 1 << 18, size = 1024;
+    std::vector<uint16_t> native(len);
+    std::vector<double> buf(len);
+    for (int i = 0; i < len; i++)
+        buf[i] = native[i] = rand() % size;
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<double> expected = reference_histogram(buf, size);
+    auto reference = std::chrono::steady_clock::now();
+    double *histo = dsp_stats_histogram_buffer(native.data(), len, DSP_TYPE_UINT16, size);
+    auto kernel = std::chrono::steady_clock::now();
+
+    for (int k = 0; k < size; k++)
+        ASSERT_DOUBLE_EQ(expected[k], histo[k]) << "bin " << k;
+    free(histo);
+
+    double t_reference = std::chrono::duration<double>(reference - start).count();
+    double t_kernel    = std::chrono::duration<double>(kernel - reference).count();
+    printf("histogram %d samples x %d bins: per-bin %.3f s, single pass %.5f s (%d threads)\n", len, size,
+           t_reference, t_kernel, dsp_get_max_threads());
+}
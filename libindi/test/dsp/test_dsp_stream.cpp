@@ -0,0 +1,144 @@
+/*******************************************************************************
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#include "dsp.h"
+
+TEST(DSP_STREAM, Test_view_native_stats)
+{
+    int sizes[2] = { 32, 16 };
+    std::vector<int16_t> native(32 * 16);
+    std::vector<double> converted(native.size());
+    for (size_t i = 0; i < native.size(); i++)
+        converted[i] = native[i] = static_cast<int16_t>((i * 7919) % 601) - 300;
+
+    dsp_stream_p view   = dsp_stream_new_view(native.data(), DSP_TYPE_INT16, 2, sizes);
+    dsp_stream_p stream = dsp_stream_new_view(converted.data(), DSP_TYPE_DOUBLE, 2, sizes);
+    ASSERT_EQ(nullptr, view->buf);
+    ASSERT_EQ(converted.data(), stream->buf);
+
+    double vmin, vmax, min, max;
+    ASSERT_DOUBLE_EQ(dsp_stats_minmidmax(stream, &min, &max), dsp_stats_minmidmax(view, &vmin, &vmax));
+    ASSERT_DOUBLE_EQ(min, vmin);
+    ASSERT_DOUBLE_EQ(max, vmax);
+    ASSERT_DOUBLE_EQ(dsp_stats_mean(stream), dsp_stats_mean(view));
+    ASSERT_NEAR(dsp_stats_variance(stream), dsp_stats_variance(view), 1e-9);
+    // Typed kernels must not have materialized the double buffer
+    ASSERT_EQ(nullptr, view->buf);
+
+    double *histo  = dsp_stats_histogram(stream, 64);
+    double *vhisto = dsp_stats_histogram(view, 64);
+    for (int k = 0; k < 64; k++)
+        ASSERT_DOUBLE_EQ(histo[k], vhisto[k]) << "bin " << k;
+    free(histo);
+    free(vhisto);
+
+    double *buf = dsp_stream_get_buffer(view);
+    for (size_t i = 0; i < native.size(); i++)
+        ASSERT_DOUBLE_EQ(converted[i], buf[i]);
+
+    dsp_stream_free(view);
+    dsp_stream_free(stream);
+}
+
+TEST(DSP_STREAM, Test_view_fft_and_rank)
+{
+    int sizes[2] = { 24, 10 };
+    std::vector<uint8_t> native(24 * 10);
+    for (size_t i = 0; i < native.size(); i++)
+        native[i] = (i * 37) % 251;
+    std::vector<double> converted(native.begin(), native.end());
+
+    dsp_stream_p view   = dsp_stream_new_view(native.data(), DSP_TYPE_UINT8, 2, sizes);
+    dsp_stream_p stream = dsp_stream_new_view(converted.data(), DSP_TYPE_DOUBLE, 2, sizes);
+    std::vector<double> vmag(native.size()), mag(native.size());
+    ASSERT_EQ(0, dsp_fft_magnitude(view, vmag.data()));
+    ASSERT_EQ(0, dsp_fft_magnitude(stream, mag.data()));
+    for (size_t i = 0; i < mag.size(); i++)
+        ASSERT_NEAR(mag[i], vmag[i], 1e-9) << "coefficient " << i;
+
+    // Views are filtered in place, in their own element type
+    dsp_rank_median(view, 3);
+    dsp_rank_median(stream, 3);
+    for (size_t i = 0; i < native.size(); i++)
+        ASSERT_DOUBLE_EQ(converted[i], native[i]) << "element " << i;
+
+    dsp_stream_free(view);
+    dsp_stream_free(stream);
+}
+
+TEST(DSP_STREAM, Test_pool_reuse)
+{
+    int sizes[2] = { 64, 48 };
+    int other[2] = { 48, 64 };
+    dsp_stream_pool_p pool = dsp_stream_pool_new(2);
+
+    dsp_stream_p stream = dsp_stream_pool_get(pool, DSP_TYPE_UINT16, 2, sizes);
+    ASSERT_EQ(64 * 48, stream->len);
+    ASSERT_EQ(DSP_TYPE_UINT16, stream->type);
+    void *data = stream->data;
+    dsp_stream_get_buffer(stream);
+    dsp_stream_free(stream);
+
+    // A different type or shape is not served by the idle stream
+    dsp_stream_p doubles = dsp_stream_pool_get(pool, DSP_TYPE_DOUBLE, 2, sizes);
+    dsp_stream_p transposed = dsp_stream_pool_get(pool, DSP_TYPE_UINT16, 2, other);
+    ASSERT_NE(data, doubles->data);
+    ASSERT_NE(data, transposed->data);
+    ASSERT_EQ(doubles->data, doubles->buf);
+
+    stream = dsp_stream_pool_get(pool, DSP_TYPE_UINT16, 2, sizes);
+    ASSERT_EQ(data, stream->data);
+    ASSERT_EQ(nullptr, stream->buf);
+
+    // A stream whose buffer was replaced is released instead of pooled
+    double *out = static_cast<double *>(malloc(sizeof(double) * doubles->len));
+    dsp_stream_free_buffer(doubles);
+    dsp_stream_set_buffer(doubles, out, doubles->len);
+
+    dsp_stream_free(doubles);
+    dsp_stream_free(transposed);
+    dsp_stream_free(stream);
+    dsp_stream_pool_free(pool);
+}
+
+TEST(DSP_STREAM, Test_dims_and_children)
+{
+    dsp_stream_p stream = dsp_stream_new();
+    dsp_stream_add_dim(stream, 4);
+    dsp_stream_add_dim(stream, 5);
+    dsp_stream_add_dim(stream, 6);
+    ASSERT_EQ(120, stream->len);
+    dsp_stream_del_dim(stream, 1);
+    ASSERT_EQ(2, stream->dims);
+    ASSERT_EQ(24, stream->len);
+    ASSERT_EQ(6, stream->sizes[1]);
+
+    dsp_stream_p children[3] = { dsp_stream_new(), dsp_stream_new(), dsp_stream_new() };
+    for (dsp_stream_p child : children)
+        dsp_stream_add_child(stream, child);
+    dsp_stream_del_child(stream, 0);
+    ASSERT_EQ(2, stream->child_count);
+    ASSERT_EQ(children[1], stream->children[0]);
+    for (dsp_stream_p child : children)
+        dsp_stream_free(child);
+    dsp_stream_free(stream);
+}
@@ -0,0 +1,687 @@
+/*******************************************************************************
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include "emulators.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+
+constexpr long SkyWatcherEmulator::MicrostepsPerRevolution;
+constexpr long SkyWatcherEmulator::StepperClockFrequency;
+constexpr long SkyWatcherEmulator::MicrostepsPerWormRevolution;
+constexpr long SkyWatcherEmulator::HighSpeedRatio;
+constexpr double SkyWatcherEmulator::GotoRate;
+constexpr double AuxEmulator::FastRate;
+constexpr double AuxEmulator::SlowRate;
+constexpr double MoonLiteEmulator::BaseRate;
+
+// Far enough for a constant rate move never to arrive
+#define ENDLESS 1e12
+
+static std::string format(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+static std::string format(const char *fmt, ...)
+{
+    char buf[128];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    return buf;
+}
+
+// Length of the ':' ... terminator command at the start of input, skipping anything before ':'
+static size_t frameColon(const std::string &input, char terminator)
+{
+    if (input[0] != ':')
+    {
+        size_t start = input.find(':');
+        return start == std::string::npos ? input.size() : start;
+    }
+
+    size_t end = input.find(terminator);
+    return end == std::string::npos ? 0 : end + 1;
+}
+
+/////////////////////////////////////////////
+/////////// EmulatedMotion
+/////////////////////////////////////////////
+
+double EmulatedMotion::at(clock::time_point now) const
+{
+    if (rate <= 0)
+        return to;
+
+    double travel = rate * std::chrono::duration<double>(now - start).count();
+    if (travel >= std::fabs(to - from))
+        return to;
+
+    return from + std::copysign(travel, to - from);
+}
+
+bool EmulatedMotion::busy(clock::time_point now) const
+{
+    return at(now) != to;
+}
+
+void EmulatedMotion::moveTo(double target, double unitsPerSecond)
+{
+    start = clock::now();
+    from  = at(start);
+    to    = target;
+    rate  = unitsPerSecond;
+}
+
+void EmulatedMotion::set(double value)
+{
+    from = to = value;
+    rate = 0;
+}
+
+void EmulatedMotion::halt()
+{
+    set(at());
+}
+
+/////////////////////////////////////////////
+/////////// LX200Emulator
+/////////////////////////////////////////////
+
+LX200Emulator::~LX200Emulator()
+{
+    stop();
+}
+
+void LX200Emulator::setPosition(double ra, double dec)
+{
+    std::lock_guard<std::recursive_mutex> lock(stateLock);
+    raMotion.set(ra);
+    decMotion.set(dec);
+}
+
+double LX200Emulator::ra()
+{
+    std::lock_guard<std::recursive_mutex> lock(stateLock);
+    return raMotion.at();
+}
+
+double LX200Emulator::dec()
+{
+    std::lock_guard<std::recursive_mutex> lock(stateLock);
+    return decMotion.at();
+}
+
+bool LX200Emulator::isSlewing()
+{
+    std::lock_guard<std::recursive_mutex> lock(stateLock);
+    return raMotion.busy() || decMotion.busy();
+}
+
+void LX200Emulator::setSlewTime(std::chrono::milliseconds value)
+{
+    std::lock_guard<std::recursive_mutex> lock(stateLock);
+    slewTime = value;
+}
+
+size_t LX200Emulator::frame(const std::string &input)
+{
+    // ACK and a bare '#', which some drivers send to clear the command buffer
+    if (input[0] == 0x06 || input[0] == '#')
+        return 1;
+
+    return frameColon(input, '#');
+}
+
+// Parse [+-]D[D][*:]MM[:SS] into a value, return false if malformed
+static bool parseSexa(const char *text, double *value)
+{
+    while (*text == ' ')
+        text++;
+
+    double sign = 1;
+    if (*text == '-' || *text == '+')
+        sign = (*text++ == '-') ? -1 : 1;
+
+    int d = 0, m = 0;
+    double s = 0;
+    int n = sscanf(text, "%d%*[*:\xdf]%d%*[:]%lf", &d, &m, &s);
+    if (n < 2)
+        return false;
+
+    *value = sign * (d + m / 60.0 + s / 3600.0);
+    return true;
+}
+
+std::string LX200Emulator::reply(const std::string &command)
+{
+    if (command == "\x06")
+        return "P";
+
+    if (command == ":GR#")
+    {
+        long total = std::lround(raMotion.at() * 3600) % 86400;
+        return format("%02ld:%02ld:%02ld#", total / 3600, total / 60 % 60, total % 60);
+    }
+
+    if (command == ":GD#")
+    {
+        double dec = decMotion.at();
+        long total = std::lround(std::fabs(dec) * 3600);
+        return format("%c%02ld*%02ld:%02ld#", dec < 0 ? '-' : '+', total / 3600, total / 60 % 60, total % 60);
+    }
+
+    if (command.compare(0, 3, ":Sr") == 0)
+        return parseSexa(command.c_str() + 3, &targetRA) && targetRA >= 0 && targetRA < 24 ? "1" : "0";
+
+    if (command.compare(0, 3, ":Sd") == 0)
+        return parseSexa(command.c_str() + 3, &targetDEC) && std::fabs(targetDEC) <= 90 ? "1" : "0";
+
+    if (command == ":MS#")
+    {
+        double seconds = std::chrono::duration<double>(slewTime).count();
+        if (seconds <= 0)
+        {
+            raMotion.set(targetRA);
+            decMotion.set(targetDEC);
+        }
+        else
+        {
+            raMotion.moveTo(targetRA, std::fabs(targetRA - raMotion.at()) / seconds);
+            decMotion.moveTo(targetDEC, std::fabs(targetDEC - decMotion.at()) / seconds);
+        }
+        return "0";
+    }
+
+    if (command == ":D#")
+        return raMotion.busy() || decMotion.busy() ? "\x7f#" : "#";
+
+    if (command.compare(0, 2, ":Q") == 0)
+    {
+        raMotion.halt();
+        decMotion.halt();
+        return "";
+    }
+
+    if (command == ":CM#")
+    {
+        raMotion.set(targetRA);
+        decMotion.set(targetDEC);
+        return " M31 EX GAL MAG 3.5 SZ178.0'#";
+    }
+
+    if (command == ":GVP#")
+        return "INDI Emulator#";
+
+    if (command == ":GVN#")
+        return "1.0#";
+
+    return "";
+}
+
+/////////////////////////////////////////////
+/////////// SkyWatcherEmulator
+/////////////////////////////////////////////
+
+// 24 bit values travel as six hex digits, least significant byte first
+static std::string toHex24(long value)
+{
+    return format("%02lX%02lX%02lX", value & 0xFF, (value >> 8) & 0xFF, (value >> 16) & 0xFF);
+}
+
+static long fromHex24(const std::string &data)
+{
+    long value = 0;
+    for (size_t i = 0; i + 1 < data.size() && i < 6; i += 2)
+        value |= strtol(data.substr(i, 2).c_str(), nullptr, 16) << (i * 4);
+    return value;
+}
+
+SkyWatcherEmulator::SkyWatcherEmulator()
+{
+    for (Axis &axis : axes)
+        axis.motion.set(0x800000);
+}
+
+SkyWatcherEmulator::~SkyWatcherEmulator()
+{
+    stop();
+}
+
+void SkyWatcherEmulator::setMountCode(uint8_t code)
+{
+    std::lock_guard<std::recursive_mutex> lock(stateLock);
+    mountCode = code;
+}
+
+long SkyWatcherEmulator::position(int axis)
+{
+    std::lock_guard<std::recursive_mutex> lock(stateLock);
+    return std::lround(axes[axis].motion.at());
+}
+
+void SkyWatcherEmulator::setPosition(int axis, long value)
+{
+    std::lock_guard<std::recursive_mutex> lock(stateLock);
+    axes[axis].motion.set(value);
+}
+
+bool SkyWatcherEmulator::isRunning(int axis)
+{
+    std::lock_guard<std::recursive_mutex> lock(stateLock);
+    update(axes[axis]);
+    return axes[axis].running;
+}
+
+void SkyWatcherEmulator::update(Axis &axis)
+{
+    // A goto stops by itself on arrival
+    if (axis.running && !axis.slewMode && !axis.motion.busy())
+        axis.running = false;
+}
+
+size_t SkyWatcherEmulator::frame(const std::string &input)
+{
+    size_t end = input.find('\r');
+    return end == std::string::npos ? 0 : end + 1;
+}
+
+std::string SkyWatcherEmulator::reply(const std::string &command)
+{
+    // A ':' restarts the command, e.g. after the lone ':' of the DC motor probe
+    size_t start = command.rfind(':');
+    if (start == std::string::npos || command.size() - start < 4)
+        return "!0\r";
+
+    char cmd  = command[start + 1];
+    char axis = command[start + 2];
+    std::string data = command.substr(start + 3, command.size() - start - 4);
+
+    if (axis < '1' || axis > '3')
+        return "!3\r";
+
+    bool ok = true;
+    std::string response;
+    if (axis != '2')
+        response = axisCommand(axes[0], cmd, data, ok);
+    if (ok && axis != '1')
+        response = axisCommand(axes[1], cmd, data, ok);
+
+    return (ok ? "=" : "!") + response + "\r";
+}
+
+std::string SkyWatcherEmulator::axisCommand(Axis &axis, char cmd, const std::string &data, bool &ok)
+{
+    update(axis);
+
+    switch (cmd)
+    {
+        case 'e':
+            return format("%02X%02X%02X", 3, 39, mountCode);
+
+        case 'a':
+            return toHex24(MicrostepsPerRevolution);
+
+        case 'b':
+            return toHex24(StepperClockFrequency);
+
+        case 'g':
+            return format("%02lX", HighSpeedRatio);
+
+        case 's':
+            return toHex24(MicrostepsPerWormRevolution);
+
+        case 'j':
+            return toHex24(std::lround(axis.motion.at()));
+
+        case 'f':
+            return format("%X%X%X", (axis.slewMode ? 1 : 0) | (axis.reverse ? 2 : 0) | (axis.highSpeed ? 4 : 0),
+                          axis.running ? 1 : 0, axis.initialized ? 1 : 0);
+
+        case 'F':
+            axis.initialized = true;
+            return "";
+
+        case 'E':
+            if (axis.running)
+            {
+                ok = false;
+                return "2";
+            }
+            axis.motion.set(fromHex24(data));
+            return "";
+
+        case 'G':
+            if (data.size() < 2)
+            {
+                ok = false;
+                return "1";
+            }
+            // 0 high speed goto, 1 low speed slew, 2 low speed goto, 3 high speed slew
+            axis.slewMode  = data[0] == '1' || data[0] == '3';
+            axis.highSpeed = data[0] == '0' || data[0] == '3';
+            axis.reverse   = (data[1] - '0') & 1;
+            return "";
+
+        case 'H':
+            axis.gotoIncrement = fromHex24(data);
+            axis.gotoTarget    = -1;
+            return "";
+
+        case 'S':
+            axis.gotoTarget = fromHex24(data);
+            return "";
+
+        case 'I':
+            axis.stepPeriod = std::max(1L, fromHex24(data));
+            if (axis.running && axis.slewMode)
+                axis.motion.moveTo(axis.motion.to, double(StepperClockFrequency) / axis.stepPeriod *
+                                   (axis.highSpeed ? HighSpeedRatio : 1));
+            return "";
+
+        case 'J':
+            axis.running = true;
+            if (axis.slewMode)
+                axis.motion.moveTo(axis.reverse ? -ENDLESS : ENDLESS, double(StepperClockFrequency) / axis.stepPeriod *
+                                   (axis.highSpeed ? HighSpeedRatio : 1));
+            else if (axis.gotoTarget >= 0)
+                axis.motion.moveTo(axis.gotoTarget, GotoRate);
+            else
+                axis.motion.moveTo(axis.motion.at() + (axis.reverse ? -axis.gotoIncrement : axis.gotoIncrement),
+                                   GotoRate);
+            return "";
+
+        case 'K':
+        case 'L':
+            axis.motion.halt();
+            axis.running = false;
+            return "";
+
+        case 'M':
+        case 'O':
+        case 'P':
+        case 'U':
+            return "";
+
+        case 'q':
+            return "000000";
+
+        default:
+            ok = false;
+            return "0";
+    }
+}
+
+/////////////////////////////////////////////
+/////////// AuxEmulator
+/////////////////////////////////////////////
+
+#define AUX_HDR         0x3b
+#define AUX_AZM         0x10
+#define AUX_ALT         0x11
+#define AUX_FOCUSER     0x12
+
+AuxEmulator::AuxEmulator()
+{
+    devices[AUX_AZM].set(0);
+    devices[AUX_ALT].set(0);
+    devices[AUX_FOCUSER].set(20000);
+}
+
+AuxEmulator::~AuxEmulator()
+{
+    stop();
+}
+
+long AuxEmulator::position(uint8_t target)
+{
+    std::lock_guard<std::recursive_mutex> lock(stateLock);
+    return std::lround(devices[target].at());
+}
+
+void AuxEmulator::setPosition(uint8_t target, long value)
+{
+    std::lock_guard<std::recursive_mutex> lock(stateLock);
+    devices[target].set(value);
+}
+
+bool AuxEmulator::isMoving(uint8_t target)
+{
+    std::lock_guard<std::recursive_mutex> lock(stateLock);
+    return devices[target].busy();
+}
+
+void AuxEmulator::setFocuserLimits(long low, long high)
+{
+    std::lock_guard<std::recursive_mutex> lock(stateLock);
+    focuserLow  = low;
+    focuserHigh = high;
+}
+
+size_t AuxEmulator::frame(const std::string &input)
+{
+    if (static_cast<uint8_t>(input[0]) != AUX_HDR)
+    {
+        size_t start = input.find(static_cast<char>(AUX_HDR));
+        return start == std::string::npos ? input.size() : start;
+    }
+
+    if (input.size() < 2)
+        return 0;
+
+    size_t total = static_cast<uint8_t>(input[1]) + 3;
+    return input.size() < total ? 0 : total;
+}
+
+static void appendBE(std::string &data, long value, int bytes)
+{
+    for (int i = bytes - 1; i >= 0; i--)
+        data.push_back(static_cast<char>((value >> (i * 8)) & 0xFF));
+}
+
+static long readBE(const std::string &data, size_t bytes)
+{
+    long value = 0;
+    for (size_t i = 0; i < bytes && i < data.size(); i++)
+        value = (value << 8) | static_cast<uint8_t>(data[i]);
+    return value;
+}
+
+std::string AuxEmulator::reply(const std::string &command)
+{
+    if (static_cast<uint8_t>(command[0]) != AUX_HDR || command.size() < 6)
+        return "";
+
+    int sum = 0;
+    for (size_t i = 1; i < command.size() - 1; i++)
+        sum += static_cast<uint8_t>(command[i]);
+    if (static_cast<uint8_t>(-sum & 0xff) != static_cast<uint8_t>(command.back()))
+        return "";
+
+    uint8_t source = command[2], destination = command[3], cmd = command[4];
+    std::string data = command.substr(5, command.size() - 6);
+
+    auto device = devices.find(destination);
+    if (device == devices.end())
+        return "";
+    EmulatedMotion &motion = device->second;
+
+    std::string response;
+    switch (cmd)
+    {
+        case 0x01: // MC_GET_POSITION
+            appendBE(response, std::lround(motion.at()), 3);
+            break;
+
+        case 0x02: // MC_GOTO_FAST
+        case 0x17: // MC_GOTO_SLOW
+        {
+            long target = readBE(data, 3);
+            if (destination == AUX_FOCUSER)
+                target = std::max(focuserLow, std::min(focuserHigh, target));
+            motion.moveTo(target, cmd == 0x02 ? FastRate : SlowRate);
+            break;
+        }
+
+        case 0x04: // MC_SET_POSITION
+            motion.set(readBE(data, 3));
+            break;
+
+        case 0x13: // MC_SLEW_DONE
+            response.push_back(motion.busy() ? 0x00 : static_cast<char>(0xFF));
+            break;
+
+        case 0x24: // MC_MOVE_POS
+        case 0x25: // MC_MOVE_NEG
+        {
+            long rate = readBE(data, 1);
+            if (rate == 0)
+                motion.halt();
+            else
+                motion.moveTo(cmd == 0x24 ? ENDLESS : -ENDLESS, FastRate * rate / 9);
+            break;
+        }
+
+        case 0x2c: // FOC_GET_HS_POSITIONS
+            appendBE(response, focuserLow, 4);
+            appendBE(response, focuserHigh, 4);
+            break;
+
+        case 0x2b: // FOC_CALIB_DONE
+            response.push_back(1);
+            response.push_back(0);
+            break;
+
+        case 0xfe: // GET_VER
+            response.push_back(7);
+            response.push_back(11);
+            appendBE(response, 5000, 2);
+            break;
+
+        default:
+            break;
+    }
+
+    std::string packet;
+    packet.push_back(static_cast<char>(AUX_HDR));
+    packet.push_back(static_cast<char>(response.size() + 3));
+    packet.push_back(static_cast<char>(destination));
+    packet.push_back(static_cast<char>(source));
+    packet.push_back(static_cast<char>(cmd));
+    packet += response;
+
+    sum = 0;
+    for (size_t i = 1; i < packet.size(); i++)
+        sum += static_cast<uint8_t>(packet[i]);
+    packet.push_back(static_cast<char>(-sum & 0xff));
+
+    return packet;
+}
+
+/////////////////////////////////////////////
+/////////// MoonLiteEmulator
+/////////////////////////////////////////////
+
+MoonLiteEmulator::MoonLiteEmulator()
+{
+    motion.set(10000);
+}
+
+MoonLiteEmulator::~MoonLiteEmulator()
+{
+    stop();
+}
+
+uint32_t MoonLiteEmulator::position()
+{
+    std::lock_guard<std::recursive_mutex> lock(stateLock);
+    return std::lround(motion.at());
+}
+
+void MoonLiteEmulator::setPosition(uint32_t value)
+{
+    std::lock_guard<std::recursive_mutex> lock(stateLock);
+    motion.set(value);
+}
+
+bool MoonLiteEmulator::isMoving()
+{
+    std::lock_guard<std::recursive_mutex> lock(stateLock);
+    return motion.busy();
+}
+
+void MoonLiteEmulator::setTemperature(double celsius)
+{
+    std::lock_guard<std::recursive_mutex> lock(stateLock);
+    temperature = celsius;
+}
+
+bool MoonLiteEmulator::isHalfStep()
+{
+    std::lock_guard<std::recursive_mutex> lock(stateLock);
+    return halfStep;
+}
+
+size_t MoonLiteEmulator::frame(const std::string &input)
+{
+    return frameColon(input, '#');
+}
+
+std::string MoonLiteEmulator::reply(const std::string &command)
+{
+    if (command.size() < 3 || command[0] != ':')
+        return "";
+
+    std::string body = command.substr(1, command.size() - 2);
+    long arg = body.size() > 2 ? strtol(body.c_str() + 2, nullptr, 16) : 0;
+
+    if (body == "GP")
+        return format("%04lX#", std::lround(motion.at()) & 0xFFFF);
+    if (body == "GN")
+        return format("%04X#", newPosition & 0xFFFF);
+    if (body == "GT")
+        return format("%04X#", static_cast<uint16_t>(std::lround(temperature * 2)));
+    if (body == "GV")
+        return "10#";
+    if (body == "GI")
+        return motion.busy() ? "01#" : "00#";
+    if (body == "GD")
+        return format("%02X#", speed);
+    if (body == "GH")
+        return halfStep ? "FF#" : "00#";
+    if (body == "GC")
+        return format("%02X#", coefficient);
+
+    if (body == "FG")
+        motion.moveTo(newPosition, BaseRate * 0x20 / std::max<uint8_t>(speed, 1));
+    else if (body == "FQ")
+        motion.halt();
+    else if (body.compare(0, 2, "SN") == 0)
+        newPosition = arg;
+    else if (body.compare(0, 2, "SP") == 0)
+        motion.set(arg);
+    else if (body.compare(0, 2, "SD") == 0)
+        speed = arg;
+    else if (body == "SF")
+        halfStep = false;
+    else if (body == "SH")
+        halfStep = true;
+    else if (body.compare(0, 2, "SC") == 0)
+        coefficient = arg;
+
+    return "";
+}
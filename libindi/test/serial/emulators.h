@@ -0,0 +1,187 @@
+/*******************************************************************************
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#pragma once
+
+#include "serialemulator.h"
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+
+/**
+ * @brief The EmulatedMotion struct moves one position towards a target at a constant rate.
+ */
+struct EmulatedMotion
+{
+    typedef std::chrono::steady_clock clock;
+
+    /** @return Position at time now. */
+    double at(clock::time_point now = clock::now()) const;
+    /** @return True while the target is not reached. */
+    bool busy(clock::time_point now = clock::now()) const;
+    /** @brief moveTo Start moving from the current position to target. */
+    void moveTo(double target, double unitsPerSecond);
+    /** @brief set Jump to value and stop. */
+    void set(double value);
+    /** @brief halt Stop at the current position. */
+    void halt();
+
+    double from { 0 }, to { 0 }, rate { 0 };
+    clock::time_point start;
+};
+
+/**
+ * @brief The LX200Emulator class answers the LX200 generic command set, as used by lx200driver and
+ * LX200Telescope: ACK, :GR#, :GD#, :Sr, :Sd, :MS#, :CM#, :D#, :Q#, :GVP# and :GVN#.
+ * Coordinates are reported in long format and a goto takes setSlewTime() to complete.
+ */
+class LX200Emulator : public SerialEmulator
+{
+    public:
+        LX200Emulator() = default;
+        ~LX200Emulator() override;
+
+        void setPosition(double ra, double dec);
+        /** @return Current RA in hours. */
+        double ra();
+        /** @return Current DEC in degrees. */
+        double dec();
+        bool isSlewing();
+        void setSlewTime(std::chrono::milliseconds value);
+
+    protected:
+        size_t frame(const std::string &input) override;
+        std::string reply(const std::string &command) override;
+
+    private:
+        EmulatedMotion raMotion, decMotion;
+        double targetRA { 0 }, targetDEC { 0 };
+        std::chrono::milliseconds slewTime { 500 };
+};
+
+/**
+ * @brief The SkyWatcherEmulator class answers the SkyWatcher motor controller protocol used by
+ * SkywatcherAPI: ":<cmd><axis><data>\r" answered by "=<data>\r", or "!<code>\r" on error.
+ * Encoder values are offset by 0x800000 as on the real controllers.
+ */
+class SkyWatcherEmulator : public SerialEmulator
+{
+    public:
+        SkyWatcherEmulator();
+        ~SkyWatcherEmulator() override;
+
+        /** @brief setMountCode Mount type reported in the motor board version, 0x90 (Dobsonian) by default. */
+        void setMountCode(uint8_t code);
+        /** @return Encoder value of axis 0 or 1. */
+        long position(int axis);
+        void setPosition(int axis, long value);
+        bool isRunning(int axis);
+
+        static constexpr long MicrostepsPerRevolution { 0x3E8000 };
+        static constexpr long StepperClockFrequency { 0x0F4240 };
+        static constexpr long MicrostepsPerWormRevolution { 0x00B400 };
+        static constexpr long HighSpeedRatio { 16 };
+        static constexpr double GotoRate { 200000 };
+
+    protected:
+        size_t frame(const std::string &input) override;
+        std::string reply(const std::string &command) override;
+
+    private:
+        struct Axis
+        {
+            EmulatedMotion motion;
+            bool slewMode { false };  // slew at a rate rather than goto a target
+            bool reverse { false };
+            bool highSpeed { false };
+            bool running { false };
+            bool initialized { false };
+            long gotoIncrement { 0 };
+            long gotoTarget { -1 };
+            long stepPeriod { 1 };
+        };
+
+        void update(Axis &axis);
+        std::string axisCommand(Axis &axis, char cmd, const std::string &data, bool &ok);
+
+        Axis axes[2];
+        uint8_t mountCode { 0x90 };
+};
+
+/**
+ * @brief The AuxEmulator class answers Celestron AUX packets for the motor controllers and the
+ * focuser: 0x3b, length, source, destination, command, data, checksum.
+ * Replies go back to the sender with the command echoed. Packets for other devices are not answered.
+ */
+class AuxEmulator : public SerialEmulator
+{
+    public:
+        AuxEmulator();
+        ~AuxEmulator() override;
+
+        /** @return Position of target, one of the Aux::Target values AZM, ALT or FOCUSER. */
+        long position(uint8_t target);
+        void setPosition(uint8_t target, long value);
+        bool isMoving(uint8_t target);
+        /** @brief setFocuserLimits Hard stops reported by the focuser. */
+        void setFocuserLimits(long low, long high);
+
+        static constexpr double FastRate { 50000 };
+        static constexpr double SlowRate { 5000 };
+
+    protected:
+        size_t frame(const std::string &input) override;
+        std::string reply(const std::string &command) override;
+
+    private:
+        std::map<uint8_t, EmulatedMotion> devices;
+        long focuserLow { 1000 }, focuserHigh { 40000 };
+};
+
+/**
+ * @brief The MoonLiteEmulator class answers the Moonlite focuser command set used by the MoonLite
+ * driver, ":XX#" with hexadecimal arguments and replies.
+ */
+class MoonLiteEmulator : public SerialEmulator
+{
+    public:
+        MoonLiteEmulator();
+        ~MoonLiteEmulator() override;
+
+        uint32_t position();
+        void setPosition(uint32_t value);
+        bool isMoving();
+        /** @brief setTemperature Temperature reported by :GT#, in degrees Celsius. */
+        void setTemperature(double celsius);
+        bool isHalfStep();
+
+        /** Steps per second at the longest step delay, 0x20, doubling each time the delay halves */
+        static constexpr double BaseRate { 250 };
+
+    protected:
+        size_t frame(const std::string &input) override;
+        std::string reply(const std::string &command) override;
+
+    private:
+        EmulatedMotion motion;
+        uint32_t newPosition { 0 };
+        uint8_t speed { 0x02 };
+        bool halfStep { false };
+        double temperature { 20 };
+        uint8_t coefficient { 0 };
+};
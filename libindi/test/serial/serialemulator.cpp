@@ -0,0 +1,247 @@
+/*******************************************************************************
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include "serialemulator.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+// Received data without a complete command is dropped past this size
+#define MAX_PENDING 4096
+
+SerialEmulator::~SerialEmulator()
+{
+    stop();
+}
+
+bool SerialEmulator::start()
+{
+    if (running)
+        return true;
+
+    masterFD = posix_openpt(O_RDWR | O_NOCTTY);
+    if (masterFD < 0)
+        return false;
+
+    char name[128];
+    if (grantpt(masterFD) != 0 || unlockpt(masterFD) != 0 || ptsname_r(masterFD, name, sizeof(name)) != 0)
+    {
+        close(masterFD);
+        masterFD = -1;
+        return false;
+    }
+    portName = name;
+
+    // Raw from the start, so nothing is echoed or translated before a driver configures the port
+    int slaveFD = open(name, O_RDWR | O_NOCTTY);
+    if (slaveFD >= 0)
+    {
+        struct termios tty_setting;
+        if (tcgetattr(slaveFD, &tty_setting) == 0)
+        {
+            cfmakeraw(&tty_setting);
+            tcsetattr(slaveFD, TCSANOW, &tty_setting);
+        }
+        close(slaveFD);
+    }
+
+    fcntl(masterFD, F_SETFL, fcntl(masterFD, F_GETFL) | O_NONBLOCK);
+
+    resetCounters();
+    running = true;
+    worker  = std::thread(&SerialEmulator::run, this);
+    return true;
+}
+
+void SerialEmulator::stop()
+{
+    running = false;
+    if (worker.joinable())
+        worker.join();
+
+    if (masterFD >= 0)
+    {
+        close(masterFD);
+        masterFD = -1;
+    }
+}
+
+void SerialEmulator::setLatency(std::chrono::microseconds value)
+{
+    latencyUS = value.count();
+}
+
+void SerialEmulator::setBaudRate(uint32_t value)
+{
+    baudRate = value;
+}
+
+void SerialEmulator::on(const std::string &prefix, Handler handler)
+{
+    std::lock_guard<std::mutex> lock(overrideLock);
+
+    for (auto &one : overrides)
+    {
+        if (one.first == prefix)
+        {
+            one.second = handler;
+            return;
+        }
+    }
+    overrides.push_back(std::make_pair(prefix, handler));
+}
+
+void SerialEmulator::on(const std::string &prefix, const std::string &reply)
+{
+    on(prefix, [reply](const std::string &) { return reply; });
+}
+
+void SerialEmulator::clearOverrides()
+{
+    std::lock_guard<std::mutex> lock(overrideLock);
+    overrides.clear();
+}
+
+void SerialEmulator::resetCounters()
+{
+    commandCount = 0;
+    bytesIn      = 0;
+    bytesOut     = 0;
+}
+
+std::chrono::steady_clock::duration SerialEmulator::transferTime(size_t bytes) const
+{
+    uint32_t baud = baudRate;
+    if (baud == 0)
+        return std::chrono::steady_clock::duration::zero();
+
+    // start bit, 8 data bits, stop bit
+    return std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+               std::chrono::nanoseconds(bytes * 10 * INT64_C(1000000000) / baud));
+}
+
+std::string SerialEmulator::dispatch(const std::string &command)
+{
+    Handler handler;
+    {
+        std::lock_guard<std::mutex> lock(overrideLock);
+        for (auto &one : overrides)
+        {
+            if (command.compare(0, one.first.size(), one.first) == 0)
+            {
+                handler = one.second;
+                break;
+            }
+        }
+    }
+
+    std::lock_guard<std::recursive_mutex> lock(stateLock);
+    return handler ? handler(command) : reply(command);
+}
+
+bool SerialEmulator::writeAll(const std::string &data)
+{
+    size_t done = 0;
+
+    while (done < data.size() && running)
+    {
+        ssize_t nw = write(masterFD, data.data() + done, data.size() - done);
+        if (nw > 0)
+        {
+            done += nw;
+            continue;
+        }
+
+        if (nw < 0 && errno != EAGAIN && errno != EINTR)
+            return false;
+
+        struct pollfd pfd = { masterFD, POLLOUT, 0 };
+        poll(&pfd, 1, 20);
+    }
+
+    bytesOut += done;
+    return done == data.size();
+}
+
+void SerialEmulator::run()
+{
+    using clock = std::chrono::steady_clock;
+
+    std::string input;
+    // When the line in each direction is next free
+    clock::time_point inFree, outFree;
+    char buf[512];
+
+    while (running)
+    {
+        struct pollfd pfd = { masterFD, POLLIN, 0 };
+        if (poll(&pfd, 1, 20) <= 0)
+            continue;
+
+        ssize_t nr = read(masterFD, buf, sizeof(buf));
+        if (nr <= 0)
+        {
+            // EIO while no driver has the port open
+            if (nr < 0 && errno != EAGAIN && errno != EINTR)
+            {
+                input.clear();
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            }
+            continue;
+        }
+
+        clock::time_point arrived = clock::now();
+        bytesIn += nr;
+        input.append(buf, nr);
+
+        size_t len;
+        while (running && !input.empty())
+        {
+            {
+                std::lock_guard<std::recursive_mutex> lock(stateLock);
+                len = frame(input);
+            }
+            if (len == 0)
+                break;
+
+            std::string command = input.substr(0, len);
+            input.erase(0, len);
+
+            inFree = std::max(inFree, arrived) + transferTime(command.size());
+
+            std::string response = dispatch(command);
+            commandCount++;
+            if (response.empty())
+                continue;
+
+            clock::time_point due = std::max(inFree + std::chrono::microseconds(latencyUS.load()), outFree);
+            outFree = due + transferTime(response.size());
+            std::this_thread::sleep_until(outFree);
+
+            if (!writeAll(response))
+                break;
+        }
+
+        if (input.size() > MAX_PENDING)
+            input.clear();
+    }
+}
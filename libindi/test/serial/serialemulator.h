@@ -0,0 +1,147 @@
+/*******************************************************************************
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief The SerialEmulator class runs a device protocol behind a pseudo-terminal.
+ *
+ * Drivers open port() like any serial port, through tty_connect() or Connection::Serial. Each
+ * command the driver writes is framed and answered by the protocol implemented in a subclass,
+ * after the configured latency and at the configured baud rate, so the whole driver I/O path can
+ * be exercised and timed without hardware.
+ *
+ * Replies can be scripted per command with on(), which takes precedence over the protocol:
+ * @code
+ * LX200Emulator mount;
+ * mount.on(":MS#", "1Below horizon#");
+ * mount.setLatency(std::chrono::milliseconds(20));
+ * mount.setBaudRate(9600);
+ * mount.start();
+ * @endcode
+ *
+ * Subclasses must call stop() in their destructor, the worker thread calls into them.
+ */
+class SerialEmulator
+{
+    public:
+        typedef std::function<std::string(const std::string &command)> Handler;
+
+        SerialEmulator() = default;
+        virtual ~SerialEmulator();
+
+        /**
+         * @brief start Create the pseudo-terminal and start answering commands.
+         * @return True if the port is ready, false otherwise.
+         */
+        bool start();
+
+        /** @brief stop Stop answering and close the pseudo-terminal. */
+        void stop();
+
+        /** @return Path of the serial port drivers should open, e.g. /dev/pts/3 */
+        const char *port() const
+        {
+            return portName.c_str();
+        }
+
+        /**
+         * @brief setLatency Delay between a command reaching the device and its reply leaving it.
+         * Commands written back to back are answered back to back, each after this delay.
+         */
+        void setLatency(std::chrono::microseconds value);
+
+        /**
+         * @brief setBaudRate Throttle both directions to the given rate, 10 bits per byte.
+         * @param value Bits per second, 0 to transfer as fast as the pseudo-terminal allows.
+         */
+        void setBaudRate(uint32_t value);
+
+        /**
+         * @brief on Answer commands starting with prefix with the handler instead of the protocol.
+         * An empty reply sends nothing back. A later call for the same prefix replaces the handler.
+         */
+        void on(const std::string &prefix, Handler handler);
+        /** @brief on Answer commands starting with prefix with a fixed reply. */
+        void on(const std::string &prefix, const std::string &reply);
+        /** @brief clearOverrides Remove all handlers set with on(). */
+        void clearOverrides();
+
+        /** @return Number of commands answered since start() or resetCounters(). */
+        uint64_t commands() const
+        {
+            return commandCount;
+        }
+        /** @return Number of bytes received from the driver. */
+        uint64_t bytesReceived() const
+        {
+            return bytesIn;
+        }
+        /** @return Number of bytes sent to the driver. */
+        uint64_t bytesSent() const
+        {
+            return bytesOut;
+        }
+        void resetCounters();
+
+    protected:
+        /**
+         * @brief frame Find the end of the first command in the received data.
+         * @param input Data received so far and not yet handled.
+         * @return Length of the first command, or 0 if more data is needed.
+         */
+        virtual size_t frame(const std::string &input) = 0;
+
+        /**
+         * @brief reply Handle one command framed by frame().
+         * @return Reply to send back, empty for none.
+         */
+        virtual std::string reply(const std::string &command) = 0;
+
+        /** Guards the device state, held while frame() and reply() run. */
+        std::recursive_mutex stateLock;
+
+    private:
+        void run();
+        std::string dispatch(const std::string &command);
+        bool writeAll(const std::string &data);
+        std::chrono::steady_clock::duration transferTime(size_t bytes) const;
+
+        int masterFD { -1 };
+        std::string portName;
+        std::thread worker;
+        std::atomic<bool> running { false };
+
+        std::atomic<int64_t> latencyUS { 0 };
+        std::atomic<uint32_t> baudRate { 0 };
+
+        std::mutex overrideLock;
+        std::vector<std::pair<std::string, Handler>> overrides;
+
+        std::atomic<uint64_t> commandCount { 0 };
+        std::atomic<uint64_t> bytesIn { 0 };
+        std::atomic<uint64_t> bytesOut { 0 };
+};
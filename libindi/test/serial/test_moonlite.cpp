@@ -0,0 +1,189 @@
+/*******************************************************************************
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "connectionplugins/connectionserial.h"
+#include "emulators.h"
+#include "moonlite.h"
+
+class MoonLiteTest : public MoonLite
+{
+    public:
+        using MoonLite::TimerHit;
+
+        Connection::Serial *serial() const
+        {
+            return serialConnection;
+        }
+
+        double position() const
+        {
+            return FocusAbsPosN[0].value;
+        }
+        IPState state() const
+        {
+            return FocusAbsPosNP.s;
+        }
+};
+
+class MoonLiteDriver : public ::testing::Test
+{
+    protected:
+        void SetUp() override
+        {
+            setenv("INDICONFIG", "/tmp/indi_test_moonlite.xml", 1);
+
+            ASSERT_TRUE(focuser.start());
+            driver.ISGetProperties(nullptr);
+
+            char *port[]      = { const_cast<char *>(focuser.port()) };
+            char *portNames[] = { const_cast<char *>("PORT") };
+            driver.ISNewText(driver.getDeviceName(), "DEVICE_PORT", port, portNames, 1);
+
+            // The handshake waits a second before talking to the focuser
+            ISState states[] = { ISS_ON, ISS_OFF };
+            char *names[]    = { const_cast<char *>("CONNECT"), const_cast<char *>("DISCONNECT") };
+            driver.ISNewSwitch(driver.getDeviceName(), "CONNECTION", states, names, 2);
+            ASSERT_TRUE(driver.isConnected());
+        }
+
+        void TearDown() override
+        {
+            ISState states[] = { ISS_OFF, ISS_ON };
+            char *names[]    = { const_cast<char *>("CONNECT"), const_cast<char *>("DISCONNECT") };
+            driver.ISNewSwitch(driver.getDeviceName(), "CONNECTION", states, names, 2);
+        }
+
+        void setNumber(const char *name, const char *element, double value)
+        {
+            double values[] = { value };
+            char *names[]   = { const_cast<char *>(element) };
+            driver.ISNewNumber(driver.getDeviceName(), name, values, names, 1);
+        }
+
+        // Poll like the driver timer until the move completes
+        void waitForMove()
+        {
+            auto start = std::chrono::steady_clock::now();
+            while (driver.state() == IPS_BUSY && std::chrono::steady_clock::now() - start < std::chrono::seconds(10))
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                driver.TimerHit();
+            }
+        }
+
+        // Commands without reply return once written, give the focuser time to read them
+        template <typename F> bool eventually(F condition)
+        {
+            auto start = std::chrono::steady_clock::now();
+            while (!condition() && std::chrono::steady_clock::now() - start < std::chrono::seconds(1))
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            return condition();
+        }
+
+        MoonLiteEmulator focuser;
+        MoonLiteTest driver;
+};
+
+TEST_F(MoonLiteDriver, Test_connect)
+{
+    ASSERT_EQ(10000, driver.position());
+    ASSERT_FALSE(focuser.isHalfStep());
+}
+
+TEST_F(MoonLiteDriver, Test_absolute_move)
+{
+    setNumber("ABS_FOCUS_POSITION", "FOCUS_ABSOLUTE_POSITION", 10400);
+    ASSERT_EQ(IPS_BUSY, driver.state());
+    ASSERT_TRUE(eventually([&] { return focuser.isMoving(); }));
+
+    waitForMove();
+    ASSERT_EQ(IPS_OK, driver.state());
+    ASSERT_EQ(10400u, focuser.position());
+    ASSERT_EQ(10400, driver.position());
+}
+
+TEST_F(MoonLiteDriver, Test_abort_and_sync)
+{
+    setNumber("ABS_FOCUS_POSITION", "FOCUS_ABSOLUTE_POSITION", 30000);
+    ASSERT_TRUE(eventually([&] { return focuser.isMoving(); }));
+
+    ISState states[] = { ISS_ON };
+    char *names[]    = { const_cast<char *>("ABORT") };
+    driver.ISNewSwitch(driver.getDeviceName(), "FOCUS_ABORT_MOTION", states, names, 1);
+    ASSERT_TRUE(eventually([&] { return !focuser.isMoving(); }));
+    ASSERT_LT(focuser.position(), 30000u);
+
+    setNumber("FOCUS_SYNC", "FOCUS_SYNC_VALUE", 5000);
+    ASSERT_TRUE(eventually([&] { return focuser.position() == 5000u; }));
+}
+
+TEST_F(MoonLiteDriver, Test_step_mode)
+{
+    ISState states[] = { ISS_ON, ISS_OFF };
+    char *names[]    = { const_cast<char *>("FOCUS_HALF_STEP"), const_cast<char *>("FOCUS_FULL_STEP") };
+    driver.ISNewSwitch(driver.getDeviceName(), "Step Mode", states, names, 2);
+    ASSERT_TRUE(eventually([&] { return focuser.isHalfStep(); }));
+}
+
+TEST_F(MoonLiteDriver, Test_probe_ports)
+{
+    // One more focuser and two devices that ignore its commands, all slow to answer
+    MoonLiteEmulator other;
+    LX200Emulator mount1, mount2;
+    for (SerialEmulator *device : std::initializer_list<SerialEmulator *> { &other, &mount1, &mount2 })
+    {
+        device->setLatency(std::chrono::milliseconds(300));
+        ASSERT_TRUE(device->start());
+    }
+
+    // The port of the connected focuser is locked by the driver
+    uint64_t commands = focuser.commands();
+    std::vector<std::string> found =
+        driver.serial()->probePorts({ mount1.port(), focuser.port(), other.port(), mount2.port() }, 9600);
+
+    ASSERT_EQ(1u, found.size());
+    ASSERT_EQ(other.port(), found[0]);
+    ASSERT_EQ(commands, focuser.commands());
+}
+
+// Timing only, run with --gtest_also_run_disabled_tests
+TEST_F(MoonLiteDriver, DISABLED_Benchmark_polling)
+{
+    const int n = 10;
+
+    for (int latency : { 0, 5, 20 })
+    {
+        focuser.setLatency(std::chrono::milliseconds(latency));
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < n; i++)
+            driver.TimerHit();
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        printf("MoonLite::TimerHit at %dms latency: %.1f/s, %.1fms per poll\n", latency, n / elapsed,
+               elapsed * 1000 / n);
+        // Position and temperature are two round trips
+        ASSERT_GE(elapsed * 1000 / n, 2 * latency);
+    }
+}
@@ -0,0 +1,465 @@
+/*******************************************************************************
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include "celestronauxpacket.h"
+#include "emulators.h"
+#include "indicom.h"
+#include "lx200driver.h"
+#include "lx200telescope.h"
+#include "skywatcherAPI.h"
+
+// Device callbacks the driver library expects, nothing is dispatched to them here
+void ISGetProperties(const char *dev)
+{
+    INDI_UNUSED(dev);
+}
+void ISNewSwitch(const char *dev, const char *name, ISState *states, char *names[], int n)
+{
+    INDI_UNUSED(dev);
+    INDI_UNUSED(name);
+    INDI_UNUSED(states);
+    INDI_UNUSED(names);
+    INDI_UNUSED(n);
+}
+void ISNewText(const char *dev, const char *name, char *texts[], char *names[], int n)
+{
+    INDI_UNUSED(dev);
+    INDI_UNUSED(name);
+    INDI_UNUSED(texts);
+    INDI_UNUSED(names);
+    INDI_UNUSED(n);
+}
+void ISNewNumber(const char *dev, const char *name, double values[], char *names[], int n)
+{
+    INDI_UNUSED(dev);
+    INDI_UNUSED(name);
+    INDI_UNUSED(values);
+    INDI_UNUSED(names);
+    INDI_UNUSED(n);
+}
+void ISNewBLOB(const char *dev, const char *name, int sizes[], int blobsizes[], char *blobs[], char *formats[],
+               char *names[], int n)
+{
+    INDI_UNUSED(dev);
+    INDI_UNUSED(name);
+    INDI_UNUSED(sizes);
+    INDI_UNUSED(blobsizes);
+    INDI_UNUSED(blobs);
+    INDI_UNUSED(formats);
+    INDI_UNUSED(names);
+    INDI_UNUSED(n);
+}
+void ISSnoopDevice(XMLEle *root)
+{
+    INDI_UNUSED(root);
+}
+
+static double seconds_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Send cmd and read the reply up to stop_char
+static std::string query(int fd, const char *cmd, char stop_char = '#')
+{
+    char buf[64] = { 0 };
+    int nbytes = 0;
+
+    if (tty_write_string(fd, cmd, &nbytes) != TTY_OK)
+        return "write failed";
+    if (tty_nread_section(fd, buf, sizeof(buf), stop_char, 2, &nbytes) != TTY_OK)
+        return "read failed";
+    return std::string(buf, nbytes);
+}
+
+TEST(SERIAL_EMULATOR, Test_scripted_replies)
+{
+    LX200Emulator mount;
+    ASSERT_TRUE(mount.start());
+
+    int fd = -1;
+    ASSERT_EQ(TTY_OK, tty_connect(mount.port(), 9600, 8, 0, 1, &fd));
+    ASSERT_EQ("INDI Emulator#", query(fd, ":GVP#"));
+
+    // Scripted replies take precedence over the protocol
+    int calls = 0;
+    mount.on(":GVP#", "Scripted#");
+    mount.on(":GVN", [&](const std::string &command) { calls++; return command.substr(1); });
+    ASSERT_EQ("Scripted#", query(fd, ":GVP#"));
+    ASSERT_EQ("GVN#", query(fd, ":GVN#"));
+    ASSERT_EQ(1, calls);
+
+    mount.clearOverrides();
+    ASSERT_EQ("INDI Emulator#", query(fd, ":GVP#"));
+    ASSERT_EQ(4u, mount.commands());
+    ASSERT_EQ(20u, mount.bytesReceived());
+
+    // The port can be opened again once the driver let go of it
+    tty_disconnect(fd);
+    ASSERT_EQ(TTY_OK, tty_connect(mount.port(), 9600, 8, 0, 1, &fd));
+    ASSERT_EQ("1.0#", query(fd, ":GVN#"));
+    tty_disconnect(fd);
+}
+
+TEST(SERIAL_EMULATOR, Test_latency_and_baud_rate)
+{
+    LX200Emulator mount;
+    ASSERT_TRUE(mount.start());
+
+    int fd = -1;
+    ASSERT_EQ(TTY_OK, tty_connect(mount.port(), 9600, 8, 0, 1, &fd));
+
+    mount.setLatency(std::chrono::milliseconds(30));
+    auto start = std::chrono::steady_clock::now();
+    ASSERT_EQ("00:00:00#", query(fd, ":GR#"));
+    double t_latency = seconds_since(start);
+    ASSERT_GE(t_latency, 0.03);
+
+    // 4 bytes out and 9 back at 1200 baud take about 108ms
+    mount.setLatency(std::chrono::microseconds(0));
+    mount.setBaudRate(1200);
+    start = std::chrono::steady_clock::now();
+    ASSERT_EQ("00:00:00#", query(fd, ":GR#"));
+    double t_baud = seconds_since(start);
+    ASSERT_GE(t_baud, 0.1);
+
+    tty_disconnect(fd);
+}
+
+TEST(SERIAL_EMULATOR, Test_lx200_goto)
+{
+    LX200Emulator mount;
+    mount.setPosition(2.5, 10);
+    mount.setSlewTime(std::chrono::milliseconds(200));
+    ASSERT_TRUE(mount.start());
+
+    int fd = -1;
+    ASSERT_EQ(TTY_OK, tty_connect(mount.port(), 9600, 8, 0, 1, &fd));
+    ASSERT_EQ(0, check_lx200_connection(fd));
+    ASSERT_EQ(0, checkLX200Format(fd));
+    ASSERT_EQ(LX200_LONG_FORMAT, getLX200Format());
+
+    double ra = 0, dec = 0;
+    ASSERT_EQ(0, getLX200RA(fd, &ra));
+    ASSERT_EQ(0, getLX200DEC(fd, &dec));
+    ASSERT_NEAR(2.5, ra, 1 / 3600.0);
+    ASSERT_NEAR(10, dec, 1 / 3600.0);
+
+    ASSERT_EQ(0, setObjectRA(fd, 5.5));
+    ASSERT_EQ(0, setObjectDEC(fd, -20.25));
+    ASSERT_EQ(0, Slew(fd));
+    ASSERT_EQ(0, isSlewComplete(fd));
+    ASSERT_TRUE(mount.isSlewing());
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    ASSERT_EQ(1, isSlewComplete(fd));
+    ASSERT_EQ(0, getLX200RA(fd, &ra));
+    ASSERT_EQ(0, getLX200DEC(fd, &dec));
+    ASSERT_NEAR(5.5, ra, 1 / 3600.0);
+    ASSERT_NEAR(-20.25, dec, 1 / 3600.0);
+
+    tty_disconnect(fd);
+}
+
+TEST(SERIAL_EMULATOR, Test_lx200_pipelined)
+{
+    LX200Emulator mount;
+    mount.setPosition(12.5, 45.25);
+    mount.setLatency(std::chrono::milliseconds(2));
+    ASSERT_TRUE(mount.start());
+
+    int fd = -1;
+    ASSERT_EQ(TTY_OK, tty_connect(mount.port(), 9600, 8, 0, 1, &fd));
+
+    // Replies are matched to their commands whether sent one by one or all at once
+    for (int pipelined = 0; pipelined < 2; pipelined++)
+    {
+        LX200Command radec[3] = { { ":GR#", '#', 5 }, { ":GD#", '#', 5 }, { ":GVP#", '#', 5 } };
+        ASSERT_EQ(0, sendLX200Commands(fd, radec, 3, pipelined));
+        ASSERT_STREQ("12:30:00", radec[0].reply);
+        ASSERT_STREQ("+45*15:00", radec[1].reply);
+        ASSERT_STREQ("INDI Emulator", radec[2].reply);
+    }
+    ASSERT_EQ(6u, mount.commands());
+
+    tty_disconnect(fd);
+}
+
+// Timing only, run with --gtest_also_run_disabled_tests
+TEST(SERIAL_EMULATOR, DISABLED_Benchmark_lx200_polling)
+{
+    const int n = 20;
+    LX200Emulator mount;
+    mount.setPosition(12.5, 45.25);
+    mount.setLatency(std::chrono::milliseconds(10));
+    mount.setBaudRate(9600);
+    ASSERT_TRUE(mount.start());
+
+    int fd = -1;
+    ASSERT_EQ(TTY_OK, tty_connect(mount.port(), 9600, 8, 0, 1, &fd));
+
+    double t[2];
+    for (int pipelined = 0; pipelined < 2; pipelined++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < n; i++)
+        {
+            LX200Command radec[2] = { { ":GR#", '#', 5 }, { ":GD#", '#', 5 } };
+            ASSERT_EQ(0, sendLX200Commands(fd, radec, 2, pipelined));
+            ASSERT_STREQ("12:30:00", radec[0].reply);
+            ASSERT_STREQ("+45*15:00", radec[1].reply);
+        }
+        t[pipelined] = seconds_since(start);
+    }
+    tty_disconnect(fd);
+
+    printf("LX200 RA/DEC polls at 10ms latency, 9600 baud: serial %.1f/s, pipelined %.1f/s\n", n / t[0], n / t[1]);
+}
+
+class LX200Mount : public LX200Telescope
+{
+    public:
+        LX200Mount()
+        {
+            setLX200Capability(0);
+            SetTelescopeCapability(TELESCOPE_CAN_GOTO | TELESCOPE_CAN_SYNC | TELESCOPE_CAN_ABORT, 4);
+        }
+
+        using LX200Telescope::Goto;
+
+        double ra() const
+        {
+            return EqN[AXIS_RA].value;
+        }
+        double dec() const
+        {
+            return EqN[AXIS_DE].value;
+        }
+        TelescopeStatus state() const
+        {
+            return TrackState;
+        }
+};
+
+// Connect a driver to port through its Connection::Serial, as a client would
+static void connectDriver(INDI::DefaultDevice &driver, const char *port)
+{
+    char *portName[]  = { const_cast<char *>(port) };
+    char *portNames[] = { const_cast<char *>("PORT") };
+    driver.ISNewText(driver.getDeviceName(), "DEVICE_PORT", portName, portNames, 1);
+
+    ISState states[] = { ISS_ON, ISS_OFF };
+    char *names[]    = { const_cast<char *>("CONNECT"), const_cast<char *>("DISCONNECT") };
+    driver.ISNewSwitch(driver.getDeviceName(), "CONNECTION", states, names, 2);
+}
+
+static void disconnectDriver(INDI::DefaultDevice &driver)
+{
+    ISState states[] = { ISS_OFF, ISS_ON };
+    char *names[]    = { const_cast<char *>("CONNECT"), const_cast<char *>("DISCONNECT") };
+    driver.ISNewSwitch(driver.getDeviceName(), "CONNECTION", states, names, 2);
+}
+
+TEST(SERIAL_EMULATOR, Test_telescope_driver)
+{
+    setenv("INDICONFIG", "/tmp/indi_test_serialemulator.xml", 1);
+
+    LX200Emulator mount;
+    mount.setPosition(3.25, -5.5);
+    mount.setSlewTime(std::chrono::milliseconds(200));
+    mount.setLatency(std::chrono::milliseconds(2));
+    ASSERT_TRUE(mount.start());
+
+    LX200Mount driver;
+    driver.ISGetProperties(nullptr);
+    connectDriver(driver, mount.port());
+    ASSERT_TRUE(driver.isConnected());
+
+    ASSERT_TRUE(driver.ReadScopeStatus());
+    ASSERT_NEAR(3.25, driver.ra(), 1 / 3600.0);
+    ASSERT_NEAR(-5.5, driver.dec(), 1 / 3600.0);
+
+    ASSERT_TRUE(driver.Goto(7.75, 30.5));
+    ASSERT_EQ(INDI::Telescope::SCOPE_SLEWING, driver.state());
+
+    auto start = std::chrono::steady_clock::now();
+    while (driver.state() == INDI::Telescope::SCOPE_SLEWING && seconds_since(start) < 5)
+        ASSERT_TRUE(driver.ReadScopeStatus());
+    ASSERT_EQ(INDI::Telescope::SCOPE_TRACKING, driver.state());
+    ASSERT_TRUE(driver.ReadScopeStatus());
+    ASSERT_NEAR(7.75, driver.ra(), 1 / 3600.0);
+    ASSERT_NEAR(30.5, driver.dec(), 1 / 3600.0);
+
+    disconnectDriver(driver);
+    ASSERT_FALSE(driver.isConnected());
+}
+
+// Timing only, run with --gtest_also_run_disabled_tests
+TEST(SERIAL_EMULATOR, DISABLED_Benchmark_telescope_driver)
+{
+    setenv("INDICONFIG", "/tmp/indi_test_serialemulator.xml", 1);
+
+    LX200Emulator mount;
+    mount.setLatency(std::chrono::milliseconds(2));
+    ASSERT_TRUE(mount.start());
+
+    LX200Mount driver;
+    driver.ISGetProperties(nullptr);
+    connectDriver(driver, mount.port());
+    ASSERT_TRUE(driver.isConnected());
+
+    const int n = 50;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < n; i++)
+        ASSERT_TRUE(driver.ReadScopeStatus());
+    printf("LX200Telescope::ReadScopeStatus at 2ms latency: %.1f/s\n", n / seconds_since(start));
+
+    disconnectDriver(driver);
+}
+
+// SkywatcherAPI over tty_* like the drivers using it
+class SkywatcherMount : public SkywatcherAPI, public INDI::Telescope
+{
+    public:
+        SkywatcherMount()
+        {
+            pChildTelescope = this;
+        }
+
+        const char *getDefaultName() override
+        {
+            return "SkyWatcher Test";
+        }
+        bool ReadScopeStatus() override
+        {
+            return true;
+        }
+
+    private:
+        int skywatcher_tty_read(int fd, char *buf, int nbytes, int timeout, int *nbytes_read) override
+        {
+            return tty_read(fd, buf, nbytes, timeout, nbytes_read);
+        }
+        int skywatcher_tty_write(int fd, const char *buffer, int nbytes, int *nbytes_written) override
+        {
+            return tty_write(fd, buffer, nbytes, nbytes_written);
+        }
+};
+
+TEST(SERIAL_EMULATOR, Test_skywatcher_motor_controller)
+{
+    SkyWatcherEmulator controller;
+    ASSERT_TRUE(controller.start());
+
+    int fd = -1;
+    ASSERT_EQ(TTY_OK, tty_connect(controller.port(), 9600, 8, 0, 1, &fd));
+
+    SkywatcherMount mount;
+    mount.SetSerialPort(fd);
+
+    ASSERT_TRUE(mount.GetMotorBoardVersion(SkywatcherAPI::AXIS1));
+    ASSERT_EQ(0x032790ul, mount.MCVersion);
+    mount.MountCode = mount.MCVersion & 0xFF;
+    ASSERT_TRUE(mount.IsVirtuosoMount());
+
+    ASSERT_TRUE(mount.GetMicrostepsPerRevolution(SkywatcherAPI::AXIS2));
+    ASSERT_EQ(SkyWatcherEmulator::MicrostepsPerRevolution, mount.MicrostepsPerRevolution[SkywatcherAPI::AXIS2]);
+    ASSERT_TRUE(mount.GetStepperClockFrequency(SkywatcherAPI::AXIS1));
+    ASSERT_EQ(SkyWatcherEmulator::StepperClockFrequency, mount.StepperClockFrequency[SkywatcherAPI::AXIS1]);
+    ASSERT_TRUE(mount.GetHighSpeedRatio(SkywatcherAPI::AXIS1));
+    ASSERT_EQ(SkyWatcherEmulator::HighSpeedRatio, mount.HighSpeedRatio[SkywatcherAPI::AXIS1]);
+
+    ASSERT_TRUE(mount.InitializeMC());
+    ASSERT_TRUE(mount.GetStatus(SkywatcherAPI::AXIS1));
+    ASSERT_FALSE(mount.AxesStatus[SkywatcherAPI::AXIS1].NotInitialized);
+    ASSERT_TRUE(mount.AxesStatus[SkywatcherAPI::AXIS1].FullStop);
+
+    controller.setPosition(1, 0x812345);
+    ASSERT_TRUE(mount.GetEncoder(SkywatcherAPI::AXIS2));
+    ASSERT_EQ(0x812345, mount.CurrentEncoders[SkywatcherAPI::AXIS2]);
+
+    // Relative goto, reverse direction
+    ASSERT_TRUE(mount.SetMotionMode(SkywatcherAPI::AXIS2, '0', '1'));
+    ASSERT_TRUE(mount.SetGotoTargetOffset(SkywatcherAPI::AXIS2, 20000));
+    ASSERT_TRUE(mount.StartMotion(SkywatcherAPI::AXIS2));
+    ASSERT_TRUE(mount.GetStatus(SkywatcherAPI::AXIS2));
+    ASSERT_TRUE(mount.AxesStatus[SkywatcherAPI::AXIS2].SlewingTo);
+    ASSERT_FALSE(mount.AxesStatus[SkywatcherAPI::AXIS2].SlewingForward);
+
+    auto start = std::chrono::steady_clock::now();
+    while (controller.isRunning(1) && seconds_since(start) < 5)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    ASSERT_TRUE(mount.GetStatus(SkywatcherAPI::AXIS2));
+    ASSERT_TRUE(mount.AxesStatus[SkywatcherAPI::AXIS2].FullStop);
+    ASSERT_TRUE(mount.GetEncoder(SkywatcherAPI::AXIS2));
+    ASSERT_EQ(0x812345 - 20000, mount.CurrentEncoders[SkywatcherAPI::AXIS2]);
+    ASSERT_EQ(0x812345 - 20000, controller.position(1));
+
+    tty_disconnect(fd);
+}
+
+TEST(SERIAL_EMULATOR, Test_celestron_aux_focuser)
+{
+    AuxEmulator bus;
+    bus.setPosition(Aux::Target::FOCUSER, 12000);
+    bus.setFocuserLimits(2000, 30000);
+    ASSERT_TRUE(bus.start());
+
+    int fd = -1;
+    ASSERT_EQ(TTY_OK, tty_connect(bus.port(), 19200, 8, 0, 1, &fd));
+
+    Aux::Communicator communicator(Aux::Target::APP);
+    Aux::buffer reply;
+    ASSERT_TRUE(communicator.sendCommand(fd, Aux::Target::FOCUSER, Aux::Command::GET_VER, reply));
+    ASSERT_EQ(4u, reply.size());
+    ASSERT_EQ(7, reply[0]);
+
+    ASSERT_TRUE(communicator.sendCommand(fd, Aux::Target::FOCUSER, Aux::Command::MC_GET_POSITION, reply));
+    ASSERT_EQ(3u, reply.size());
+    ASSERT_EQ(12000, (reply[0] << 16) + (reply[1] << 8) + reply[2]);
+
+    ASSERT_TRUE(communicator.sendCommand(fd, Aux::Target::FOCUSER, Aux::Command::FOC_GET_HS_POSITIONS, reply));
+    ASSERT_EQ(8u, reply.size());
+    ASSERT_EQ(30000, (reply[4] << 24) + (reply[5] << 16) + (reply[6] << 8) + reply[7]);
+
+    Aux::buffer target = { 0x00, 0x4e, 0x20 };
+    ASSERT_TRUE(communicator.commandBlind(fd, Aux::Target::FOCUSER, Aux::Command::MC_GOTO_FAST, target));
+    ASSERT_TRUE(communicator.sendCommand(fd, Aux::Target::FOCUSER, Aux::Command::MC_SLEW_DONE, reply));
+    ASSERT_EQ(0x00, reply[0]);
+
+    auto start = std::chrono::steady_clock::now();
+    do
+        ASSERT_TRUE(communicator.sendCommand(fd, Aux::Target::FOCUSER, Aux::Command::MC_SLEW_DONE, reply));
+    while (reply[0] != 0xFF && seconds_since(start) < 5);
+    ASSERT_EQ(0xFF, reply[0]);
+    ASSERT_EQ(20000, bus.position(Aux::Target::FOCUSER));
+
+    // The motors answer on the same bus
+    ASSERT_TRUE(communicator.sendCommand(fd, Aux::Target::AZM, Aux::Command::MC_GET_POSITION, reply));
+    ASSERT_EQ(0, (reply[0] << 16) + (reply[1] << 8) + reply[2]);
+
+    tty_disconnect(fd);
+}
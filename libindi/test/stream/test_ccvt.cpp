@@ -0,0 +1,245 @@
+/*******************************************************************************
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <vector>
+
+#include "ccvt.h"
+
+static const int levels[] = { CCVT_SIMD_NONE, CCVT_SIMD_BASE, CCVT_SIMD_AVX2 };
+
+template <typename T>
+static std::vector<T> random_frame(size_t size, int seed)
+{
+    std::vector<T> frame(size);
+    srand(seed);
+    for (T &v : frame)
+        v = static_cast<T>(rand());
+    return frame;
+}
+
+static double elapsed(const std::function<void()> &func, int count = 5)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; i++)
+        func();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / count;
+}
+
+// Byte offsets of Y0, U, Y1 and V in a packed 4:2:2 pair of pixels
+static void yuv422_offsets(int order, int offsets[4])
+{
+    static const int table[4][4] = { { 0, 1, 2, 3 }, { 1, 0, 3, 2 }, { 0, 3, 2, 1 }, { 1, 2, 3, 0 } };
+    for (int i = 0; i < 4; i++)
+        offsets[i] = table[order][i];
+}
+
+TEST(CCVT, Test_yuv422_matches_reference)
+{
+    // Widths with tails after 16 and 32 pixel chunks, rows padded with a larger stride
+    const int width = 1002, height = 6, stride = 2 * width + 10;
+    std::vector<uint8_t> frame = random_frame<uint8_t>(stride * height, 1);
+
+    for (int order = CCVT_YUYV; order <= CCVT_VYUY; order++)
+    {
+        int offsets[4];
+        yuv422_offsets(order, offsets);
+        std::vector<uint8_t> yuyv(2 * width * height);
+        for (int r = 0; r < height; r++)
+            for (int i = 0; i < width; i += 2)
+                for (int k = 0; k < 4; k++)
+                    yuyv[2 * (r * width + i) + k] = frame[r * stride + 2 * i + offsets[k]];
+
+        std::vector<uint8_t> expected(3 * width * height);
+        ccvt_yuyv_rgb24(width, height, yuyv.data(), expected.data());
+        std::vector<uint8_t> expectedY(width * height), expectedU(width * height / 4), expectedV(width * height / 4);
+        ccvt_yuyv_420p(width, height, yuyv.data(), expectedY.data(), expectedU.data(), expectedV.data());
+
+        for (int level : levels)
+        {
+            ccvt_set_simd(level);
+            std::vector<uint8_t> rgb(3 * width * height), y8(width * height);
+            ccvt_yuv422_rgb24(width, height, stride, order, frame.data(), rgb.data());
+            ccvt_yuv422_y8(width, height, stride, order, frame.data(), y8.data());
+            ASSERT_TRUE(expected == rgb) << "order " << order << " level " << level;
+            ASSERT_TRUE(expectedY == y8) << "order " << order << " level " << level;
+
+            std::vector<uint8_t> y(width * height), u(width * height / 4), v(width * height / 4);
+            ccvt_yuv422_420p(width, height, stride, order, frame.data(), y.data(), u.data(), v.data());
+            ASSERT_TRUE(expectedY == y && expectedU == u && expectedV == v) << "order " << order << " level " << level;
+        }
+    }
+    ccvt_set_simd(CCVT_SIMD_BEST);
+}
+
+TEST(CCVT, Test_420p_and_nv12_match_reference)
+{
+    const int width = 1010, height = 8;
+    std::vector<uint8_t> planar = random_frame<uint8_t>(width * height * 3 / 2, 2);
+    const uint8_t *y = planar.data(), *u = y + width * height, *v = u + width * height / 4;
+
+    std::vector<uint8_t> expected(3 * width * height);
+    ccvt_420p_rgb24(width, height, planar.data(), expected.data());
+
+    std::vector<uint8_t> nv12(planar.begin(), planar.begin() + width * height), nv21 = nv12;
+    for (int i = 0; i < width * height / 4; i++)
+    {
+        nv12.insert(nv12.end(), { u[i], v[i] });
+        nv21.insert(nv21.end(), { v[i], u[i] });
+    }
+
+    for (int level : levels)
+    {
+        ccvt_set_simd(level);
+        std::vector<uint8_t> rgb(3 * width * height), rgb12(rgb.size()), rgb21(rgb.size());
+        ccvt_yuv420p_rgb24(width, height, y, u, v, rgb.data());
+        ccvt_nv12_rgb24(width, height, width, 0, nv12.data(), rgb12.data());
+        ccvt_nv12_rgb24(width, height, width, 1, nv21.data(), rgb21.data());
+        ASSERT_TRUE(expected == rgb) << "level " << level;
+        ASSERT_TRUE(expected == rgb12) << "level " << level;
+        ASSERT_TRUE(expected == rgb21) << "level " << level;
+    }
+    ccvt_set_simd(CCVT_SIMD_BEST);
+}
+
+TEST(CCVT, Test_y16)
+{
+    const int width = 37, height = 3, stride = 2 * width + 4;
+    std::vector<uint8_t> frame = random_frame<uint8_t>(stride * height, 3);
+    for (int level : levels)
+    {
+        ccvt_set_simd(level);
+        std::vector<uint8_t> y8(width * height);
+        ccvt_y16_y8(width, height, stride, frame.data(), y8.data());
+        for (int r = 0; r < height; r++)
+            for (int i = 0; i < width; i++)
+                ASSERT_EQ(frame[r * stride + 2 * i + 1], y8[r * width + i]);
+    }
+    ccvt_set_simd(CCVT_SIMD_BEST);
+}
+
+// Compare the pixels which do not touch the frame borders, where the reference routines extrapolate differently
+template <typename T>
+static void expect_same_interior(const std::vector<T> &expected, const std::vector<T> &rgb, int width, int height,
+                                 const char *what)
+{
+    for (int r = 1; r < height - 1; r++)
+        for (int i = 3; i < 3 * (width - 1); i++)
+            ASSERT_EQ(expected[3 * r * width + i], rgb[3 * r * width + i]) << what << " row " << r << " byte " << i;
+}
+
+TEST(CCVT, Test_bayer_matches_reference)
+{
+    const int width = 202, height = 10;
+    std::vector<uint8_t> raw = random_frame<uint8_t>(width * height, 4);
+    std::vector<uint16_t> raw16 = random_frame<uint16_t>(width * height, 5);
+
+    std::vector<uint8_t> bggr(3 * width * height), rggb(bggr.size());
+    std::vector<uint16_t> bggr16(bggr.size());
+    bayer2rgb24(bggr.data(), raw.data(), width, height);
+    bayer_rggb_2rgb24(rggb.data(), raw.data(), width, height);
+    bayer16_2_rgb24(bggr16.data(), raw16.data(), width, height);
+
+    std::vector<uint8_t> reference[4];
+    std::vector<uint16_t> reference16[4];
+    for (int level : levels)
+    {
+        ccvt_set_simd(level);
+        for (int pattern = CCVT_BAYER_RGGB; pattern <= CCVT_BAYER_BGGR; pattern++)
+        {
+            std::vector<uint8_t> rgb(3 * width * height);
+            std::vector<uint16_t> rgb16(3 * width * height);
+            ccvt_bayer8_rgb24(width, height, width, pattern, raw.data(), rgb.data());
+            ccvt_bayer16_rgb48(width, height, 2 * width, pattern, raw16.data(), rgb16.data());
+            if (pattern == CCVT_BAYER_BGGR)
+            {
+                expect_same_interior(bggr, rgb, width, height, "BGGR");
+                expect_same_interior(bggr16, rgb16, width, height, "BGGR16");
+            }
+            if (pattern == CCVT_BAYER_RGGB)
+                expect_same_interior(rggb, rgb, width, height, "RGGB");
+
+            // All instruction sets give the same frame, borders included
+            if (level == CCVT_SIMD_NONE)
+            {
+                reference[pattern]   = rgb;
+                reference16[pattern] = rgb16;
+            }
+            ASSERT_TRUE(reference[pattern] == rgb) << "pattern " << pattern << " level " << level;
+            ASSERT_TRUE(reference16[pattern] == rgb16) << "pattern " << pattern << " level " << level;
+        }
+    }
+    ccvt_set_simd(CCVT_SIMD_BEST);
+
+    // Each site keeps its own color: the GRBG frame is the RGGB frame shifted by one column
+    std::vector<uint8_t> grbg(3 * width * height);
+    ccvt_bayer8_rgb24(width - 1, height, width, CCVT_BAYER_GRBG, raw.data() + 1, grbg.data());
+    for (int r = 1; r < height - 1; r++)
+        for (int i = 1; i < width - 2; i++)
+            for (int k = 0; k < 3; k++)
+                ASSERT_EQ(reference[CCVT_BAYER_RGGB][3 * (r * width + i + 1) + k], grbg[3 * (r * (width - 1) + i) + k]);
+}
+
+TEST(CCVT, Test_threads)
+{
+    const int width = 1280, height = 962;
+    std::vector<uint8_t> frame = random_frame<uint8_t>(2 * width * height, 6);
+    std::vector<uint8_t> single(3 * width * height), parallel(single.size());
+
+    ccvt_set_max_threads(1);
+    ccvt_yuv422_rgb24(width, height, 2 * width, CCVT_UYVY, frame.data(), single.data());
+    ccvt_set_max_threads(4);
+    ccvt_yuv422_rgb24(width, height, 2 * width, CCVT_UYVY, frame.data(), parallel.data());
+    ASSERT_TRUE(single == parallel);
+
+    ccvt_bayer8_rgb24(width, height, width, CCVT_BAYER_GBRG, frame.data(), parallel.data());
+    ccvt_set_max_threads(1);
+    ccvt_bayer8_rgb24(width, height, width, CCVT_BAYER_GBRG, frame.data(), single.data());
+    ASSERT_TRUE(single == parallel);
+    ccvt_set_max_threads(0);
+}
+
+// Timing only, run with --gtest_also_run_disabled_tests
+TEST(CCVT, DISABLED_Benchmark_conversions)
+{
+    const int width = 1920, height = 1080;
+    std::vector<uint8_t> frame = random_frame<uint8_t>(2 * width * height, 7);
+    std::vector<uint8_t> rgb(3 * width * height);
+    std::vector<uint16_t> rgb16(3 * width * height);
+    uint16_t *raw16 = reinterpret_cast<uint16_t *>(frame.data());
+
+    double yuyv_ref   = elapsed([&]() { ccvt_yuyv_rgb24(width, height, frame.data(), rgb.data()); });
+    double yuyv       = elapsed([&]() { ccvt_yuv422_rgb24(width, height, 2 * width, CCVT_YUYV, frame.data(), rgb.data()); });
+    double p420_ref   = elapsed([&]() { ccvt_420p_rgb24(width, height, frame.data(), rgb.data()); });
+    double p420       = elapsed([&]() {
+        ccvt_yuv420p_rgb24(width, height, frame.data(), frame.data() + width * height,
+                           frame.data() + width * height * 5 / 4, rgb.data());
+    });
+    double bayer_ref  = elapsed([&]() { bayer_rggb_2rgb24(rgb.data(), frame.data(), width, height); });
+    double bayer      = elapsed([&]() { ccvt_bayer8_rgb24(width, height, width, CCVT_BAYER_RGGB, frame.data(), rgb.data()); });
+    double bayer16_ref = elapsed([&]() { bayer16_2_rgb24(rgb16.data(), raw16, width, height); });
+    double bayer16    = elapsed([&]() { ccvt_bayer16_rgb48(width, height, 2 * width, CCVT_BAYER_BGGR, raw16, rgb16.data()); });
+
+    printf("%dx%d, reference / vectorized in ms: YUYV %.2f / %.2f, 420p %.2f / %.2f, Bayer8 %.2f / %.2f, Bayer16 %.2f / %.2f\n",
+           width, height, yuyv_ref * 1e3, yuyv * 1e3, p420_ref * 1e3, p420 * 1e3, bayer_ref * 1e3, bayer * 1e3,
+           bayer16_ref * 1e3, bayer16 * 1e3);
+}
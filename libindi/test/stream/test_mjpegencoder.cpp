@@ -0,0 +1,148 @@
+/*******************************************************************************
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "mjpegencoder.h"
+#include "jpegutils.h"
+
+using namespace INDI;
+
+static std::vector<uint8_t> make_frame(int width, int height, int components)
+{
+    std::vector<uint8_t> frame(static_cast<size_t>(width) * height * components);
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++)
+            for (int c = 0; c < components; c++)
+                frame[(static_cast<size_t>(y) * width + x) * components + c] =
+                    static_cast<uint8_t>(128 + 100 * sin((x + 7 * c) / 37.0) * cos((y - 5 * c) / 23.0));
+    return frame;
+}
+
+// Encode the frame through the encoder, and decode the resulting JPEG
+static std::vector<uint8_t> roundtrip(MJPEGEncoder &encoder, const std::vector<uint8_t> &frame, int width, int height,
+                                      bool color, size_t *jpegSize = nullptr)
+{
+    IBLOB blob {};
+    encoder.setPixelFormat(color ? INDI_RGB : INDI_MONO, 8);
+    encoder.setSize(width, height);
+    EXPECT_TRUE(encoder.upload(&blob, frame.data(), frame.size()));
+    EXPECT_STREQ(".stream_jpg", blob.format);
+    if (jpegSize)
+        *jpegSize = blob.size;
+
+    uint8_t *decoded = nullptr;
+    size_t size = 0;
+    int naxis = 0, w = 0, h = 0;
+    decode_jpeg_rgb(static_cast<unsigned char *>(blob.blob), blob.size, &decoded, &size, &naxis, &w, &h);
+    EXPECT_EQ(width, w);
+    EXPECT_EQ(height, h);
+    EXPECT_EQ(color ? 3 : 1, naxis);
+    std::vector<uint8_t> out(decoded, decoded + size);
+    free(decoded);
+    return out;
+}
+
+static double psnr(const std::vector<uint8_t> &a, const std::vector<uint8_t> &b)
+{
+    double mse = 0;
+    for (size_t i = 0; i < a.size(); i++)
+        mse += (a[i] - b[i]) * (a[i] - b[i]);
+    mse /= a.size();
+    return mse == 0 ? INFINITY : 10 * log10(255.0 * 255.0 / mse);
+}
+
+TEST(MJPEG_ENCODER, Test_striped_matches_single)
+{
+    const int width = 2000, height = 1500;
+    const bool modes[] = { true, false };
+    for (bool color : modes)
+    {
+        std::vector<uint8_t> frame = make_frame(width, height, color ? 3 : 1);
+
+        MJPEGEncoder single, striped;
+        single.setMaxThreads(1);
+        striped.setMaxThreads(4);
+        std::vector<uint8_t> reference = roundtrip(single, frame, width, height, color);
+        std::vector<uint8_t> decoded   = roundtrip(striped, frame, width, height, color);
+
+        ASSERT_EQ(reference.size(), decoded.size());
+        ASSERT_GT(psnr(frame, reference), 30);
+        // Stripes are aligned on MCU rows, so the coefficients and the decoded frame are the same
+        ASSERT_TRUE(reference == decoded) << (color ? "color" : "mono");
+
+        // The encoder state is reused by the next frames
+        ASSERT_TRUE(decoded == roundtrip(striped, frame, width, height, color));
+    }
+}
+
+TEST(MJPEG_ENCODER, Test_quality_and_subsampling)
+{
+    const int width = 1024, height = 1027;
+    std::vector<uint8_t> frame = make_frame(width, height, 3);
+
+    MJPEGEncoder encoder;
+    encoder.setMaxThreads(3);
+    size_t sizes[3];
+    const MJPEGEncoder::Subsampling modes[] = { MJPEGEncoder::SUBSAMPLING_444, MJPEGEncoder::SUBSAMPLING_422,
+                                                MJPEGEncoder::SUBSAMPLING_420 };
+    for (int i = 0; i < 3; i++)
+    {
+        encoder.setSubsampling(modes[i]);
+        ASSERT_GT(psnr(frame, roundtrip(encoder, frame, width, height, true, &sizes[i])), 30);
+    }
+    ASSERT_GT(sizes[0], sizes[1]);
+    ASSERT_GT(sizes[1], sizes[2]);
+
+    size_t low, high;
+    encoder.setQuality(20);
+    double psnrLow = psnr(frame, roundtrip(encoder, frame, width, height, true, &low));
+    encoder.setQuality(95);
+    double psnrHigh = psnr(frame, roundtrip(encoder, frame, width, height, true, &high));
+    ASSERT_LT(low, high);
+    ASSERT_LT(psnrLow, psnrHigh);
+}
+
+// Timing only, run with --gtest_also_run_disabled_tests
+TEST(MJPEG_ENCODER, DISABLED_Benchmark_stripes)
+{
+    const int width = 3000, height = 2000, frames = 5;
+    std::vector<uint8_t> frame = make_frame(width, height, 3);
+    IBLOB blob {};
+
+    double elapsed[2];
+    const int threads[2] = { 1, 0 };
+    for (int i = 0; i < 2; i++)
+    {
+        MJPEGEncoder encoder;
+        encoder.setMaxThreads(threads[i]);
+        encoder.setPixelFormat(INDI_RGB, 8);
+        encoder.setSize(width, height);
+        auto start = std::chrono::steady_clock::now();
+        for (int f = 0; f < frames; f++)
+            ASSERT_TRUE(encoder.upload(&blob, frame.data(), frame.size()));
+        elapsed[i] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / frames;
+    }
+    printf("MJPEG %dx%d RGB: single stripe %.4f s/frame, parallel stripes %.4f s/frame\n", width, height, elapsed[0],
+           elapsed[1]);
+}
@@ -0,0 +1,128 @@
+/*******************************************************************************
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "serrecorder.h"
+
+static std::vector<uint8_t> read_file(const std::string &filename)
+{
+    std::ifstream in(filename, std::ios::binary);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+static uint32_t read_le32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+static uint64_t read_le64(const uint8_t *p)
+{
+    return read_le32(p) | (static_cast<uint64_t>(read_le32(p + 4)) << 32);
+}
+
+static std::string temp_filename()
+{
+    char name[] = "/tmp/test_serrecorderXXXXXX";
+    int fd      = mkstemp(name);
+    close(fd);
+    return std::string(name) + ".ser";
+}
+
+// Records count frames, each filled with its index, and checks the file layout
+static void record_and_check(INDI::SER_Recorder &recorder, int width, int height, int count)
+{
+    std::string filename = temp_filename();
+    char errmsg[1024];
+    ASSERT_TRUE(recorder.setPixelFormat(INDI_MONO, 8));
+    ASSERT_TRUE(recorder.setSize(width, height));
+    ASSERT_TRUE(recorder.open(filename.c_str(), errmsg)) << errmsg;
+
+    std::vector<uint8_t> frame(width * height);
+    uint32_t submitted = 0;
+    for (int i = 0; i < count; i++)
+    {
+        std::fill(frame.begin(), frame.end(), static_cast<uint8_t>(i));
+        ASSERT_TRUE(recorder.writeFrame(frame.data(), frame.size()));
+        submitted++;
+    }
+    ASSERT_TRUE(recorder.close());
+
+    INDI::RecorderStatistics stats;
+    ASSERT_TRUE(recorder.getStatistics(stats));
+    ASSERT_EQ(0u, stats.framesQueued);
+
+    std::vector<uint8_t> data = read_file(filename);
+    unlink(filename.c_str());
+    ASSERT_GE(data.size(), static_cast<size_t>(SER_HEADER_SIZE));
+    ASSERT_EQ(0, memcmp(data.data(), "LUCAM-RECORDER", 14));
+    ASSERT_EQ(static_cast<uint32_t>(width), read_le32(&data[26]));
+    ASSERT_EQ(static_cast<uint32_t>(height), read_le32(&data[30]));
+    uint32_t frames = read_le32(&data[38]);
+    // Every frame is either written or counted as dropped
+    ASSERT_EQ(submitted, frames + stats.framesDropped);
+    ASSERT_EQ(SER_HEADER_SIZE + frames * frame.size() + frames * sizeof(uint64_t), data.size());
+
+    const uint8_t *trailer = &data[SER_HEADER_SIZE + frames * frame.size()];
+    for (uint32_t i = 0; i < frames; i++)
+    {
+        const uint8_t *pixels = &data[SER_HEADER_SIZE + i * frame.size()];
+        if (stats.framesDropped == 0)
+            ASSERT_EQ(static_cast<uint8_t>(i), pixels[0]) << "frame " << i;
+        ASSERT_EQ(pixels[0], pixels[frame.size() - 1]) << "frame " << i;
+        ASSERT_NE(0u, read_le64(trailer + i * 8)) << "timestamp " << i;
+        if (i > 0)
+            ASSERT_LE(read_le64(trailer + (i - 1) * 8), read_le64(trailer + i * 8)) << "timestamp " << i;
+    }
+}
+
+TEST(STREAM_SER_RECORDER, Test_frames_and_timestamps)
+{
+    INDI::SER_Recorder recorder;
+    // A queue large enough to hold the whole record, nothing may be dropped
+    recorder.setQueueSize(64 * 48 * 200);
+    record_and_check(recorder, 64, 48, 200);
+    INDI::RecorderStatistics stats;
+    recorder.getStatistics(stats);
+    ASSERT_EQ(0u, stats.framesDropped);
+}
+
+TEST(STREAM_SER_RECORDER, Test_spilled_timestamps)
+{
+    INDI::SER_Recorder recorder;
+    // More timestamps than kept in memory, and frames straddling the staging buffer
+    recorder.setQueueSize(1024 * 1024 * 1024);
+    record_and_check(recorder, 16, 16, 10000);
+    record_and_check(recorder, 1000, 999, 20);
+}
+
+TEST(STREAM_SER_RECORDER, Test_small_queue_direct_io)
+{
+    INDI::SER_Recorder recorder;
+    recorder.setQueueSize(1);
+    recorder.setDirectIO(true);
+    record_and_check(recorder, 640, 480, 300);
+}